@@ -3,6 +3,7 @@
 
 #include "ConditionBuilder.h"
 #include "IndexExprBuilder.h"
+#include "KernelAnalysisRunner.h"
 
 #include "IndexExpr/IndexExprs.h"
 #include "KernelAnalysis.h"
@@ -33,12 +34,26 @@ namespace {
   class AnalysisPass : public llvm::FunctionPass {
   public:
     static char ID;
-    AnalysisPass();
+    // If analyses is not NULL, the analysis of each kernel is appended to it
+    // instead of being written to analysis.txt. If reports is not NULL, the
+    // report of each kernel is appended to it.
+    AnalysisPass(std::vector<KernelAnalysis *> *analyses = NULL,
+		 std::vector<KernelAnalysisReport> *reports = NULL);
 
     virtual void getAnalysisUsage(llvm::AnalysisUsage &au) const;
     virtual bool runOnFunction(llvm::Function &F);
 
   private:
+    std::vector<KernelAnalysis *> *analyses;
+    std::vector<KernelAnalysisReport> *reports;
+
+    // Report of the current kernel, the loop counters of the IndexExprBuilder
+    // at the previous access telling whether an access depends on a loop
+    // bounded from its exit test or on an unknown loop.
+    KernelAnalysisReport report;
+    unsigned lastLoopsBounded;
+    unsigned lastLoopsUnknown;
+
     llvm::Module *MD;
 
     llvm::PostDominatorTree *PDT;
@@ -62,6 +77,9 @@ namespace {
 
     void analyze(llvm::Function *F);
 
+    // This function computes the static cost features of the kernel.
+    void computeFeatures(llvm::Function *F, KernelFeatures *features);
+
     ConditionBuilder *conditionBuilder;
     IndexExprBuilder *indexExprBuilder;
 
@@ -76,4 +94,9 @@ namespace {
   };
 }
 
+// The pass class is private to AnalysisPass.cpp.
+llvm::FunctionPass *
+createAnalysisPass(std::vector<KernelAnalysis *> *analyses,
+		   std::vector<KernelAnalysisReport> *reports);
+
 #endif /* ANALYSISPASS_H */
@@ -66,6 +66,12 @@ public:
   unsigned getNumIndirections() const;
   const LoadIndirectionExpr *getIndirection(unsigned n);
 
+  // Number of loop add-recurrences bounded from the exit test of their loop
+  // because ScalarEvolution could not compute its backedge count, and
+  // number of add-recurrences left with an unknown backedge count.
+  unsigned getNumLoopsBounded() const;
+  unsigned getNumLoopsUnknown() const;
+
 private:
   llvm::LoopInfo *loopInfo;
   llvm::ScalarEvolution *scalarEvolution;
@@ -78,9 +84,14 @@ private:
   IndexExpr *tryComputeLoopBackedCount(llvm::Loop *L);
   IndexExpr *tryComputeLoopStart(llvm::Loop *L);
   IndexExpr *tryComputeLoopStep(llvm::Loop *L);
+  IndexExpr *tryComputeLoopEnd(const llvm::SCEVAddRecExpr *addRec,
+			       const llvm::Argument **arg);
   bool computingBackedge;
   bool computingMemcpy;
 
+  unsigned numLoopsBounded;
+  unsigned numLoopsUnknown;
+
   /* Indirections */
   bool indirectionsDisabled;
   bool buildingIndirection;
@@ -0,0 +1,41 @@
+#ifndef KERNELANALYSISRUNNER_H
+#define KERNELANALYSISRUNNER_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+class KernelAnalysis;
+
+// Summary of the loop-aware summarization of the accesses of a kernel.
+struct KernelAnalysisReport {
+  std::string kernel;
+  unsigned numAccesses;
+  // Accesses in a loop whose backedge count is unknown to ScalarEvolution,
+  // bounded from the exit test of the loop instead of being unknown.
+  unsigned numBoundedAccesses;
+  // Accesses still depending on a loop with an unknown backedge count.
+  unsigned numUnknownAccesses;
+};
+
+// Run the analysis pass in process over all the kernels of OpenCL C source,
+// compiled in memory with the clang frontend, and append their analyses to
+// analyses in module order. If reports is not NULL, the report of each kernel
+// is appended to it. args are clang -cc1 arguments, without input file.
+// passes are the optimization passes run before the analysis, in the syntax
+// of opt: an optimization level ("-O2") or a list of passes ("-sroa -licm").
+// Return false if the source cannot be compiled or a pass is unknown.
+// Concurrent calls are serialized with getClangFrontendLock().
+bool runKernelAnalysisOnSource(const std::string &source,
+			       const std::vector<std::string> &args,
+			       const char *passes,
+			       std::vector<KernelAnalysis *> *analyses,
+			       std::vector<KernelAnalysisReport> *reports =
+			       NULL);
+
+// The clang frontend and the passes of LLVM 3.9 share global state, such as
+// the command line options and the statistics. Other in-process users of the
+// frontend, such as ClInline and ClTransform, have to hold this lock too.
+std::mutex &getClangFrontendLock();
+
+#endif /* KERNELANALYSISRUNNER_H */
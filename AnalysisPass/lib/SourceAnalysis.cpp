@@ -0,0 +1,132 @@
+#include "AnalysisPass.h"
+#include "KernelAnalysisRunner.h"
+
+#include "clang/CodeGen/CodeGenAction.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Module.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/PassInfo.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+
+#include <mutex>
+#include <sstream>
+
+using namespace llvm;
+
+// Name of the in-memory input file given to clang.
+#define INPUTNAME "libsplit-input.cl"
+
+// Programs built from several host threads are compiled and analyzed one at
+// a time, and not while ClInline or ClTransform run.
+static std::mutex frontendLock;
+
+std::mutex &
+getClangFrontendLock() {
+  return frontendLock;
+}
+
+static void
+initializePasses() {
+  static std::once_flag passesInitialized;
+  std::call_once(passesInitialized, []() {
+      PassRegistry &registry = *PassRegistry::getPassRegistry();
+      initializeCore(registry);
+      initializeScalarOpts(registry);
+      initializeIPO(registry);
+      initializeAnalysis(registry);
+      initializeTransformUtils(registry);
+      initializeInstCombine(registry);
+      initializeVectorization(registry);
+      initializeTarget(registry);
+    });
+}
+
+// Add the passes to PM, in the syntax of opt: either an optimization level
+// ("-O2") or a list of pass names ("-sroa -licm").
+static bool
+addPasses(const char *passes, legacy::PassManager &PM) {
+  std::istringstream s(passes);
+  std::string name;
+  while (s >> name) {
+    if (name.size() == 3 && name.compare(0, 2, "-O") == 0 &&
+	name[2] >= '0' && name[2] <= '3') {
+      PassManagerBuilder builder;
+      builder.OptLevel = name[2] - '0';
+      if (builder.OptLevel > 1)
+	builder.Inliner = createFunctionInliningPass(builder.OptLevel, 0);
+      else
+#if LLVM_VERSION_MAJOR >= 4
+	builder.Inliner = createAlwaysInlinerLegacyPass();
+#else
+	builder.Inliner = createAlwaysInlinerPass();
+#endif
+      builder.populateModulePassManager(PM);
+      continue;
+    }
+
+    const PassInfo *info = name[0] == '-' ?
+      PassRegistry::getPassRegistry()->getPassInfo(name.substr(1)) : NULL;
+    if (!info || !info->getNormalCtor()) {
+      errs() << "klanalysis: unknown pass " << name << "\n";
+      return false;
+    }
+    PM.add(info->createPass());
+  }
+
+  return true;
+}
+
+bool
+runKernelAnalysisOnSource(const std::string &source,
+			  const std::vector<std::string> &args,
+			  const char *passes,
+			  std::vector<KernelAnalysis *> *analyses,
+			  std::vector<KernelAnalysisReport> *reports) {
+  initializePasses();
+  std::lock_guard<std::mutex> guard(frontendLock);
+
+  // Compile the source to LLVM IR. The source is mapped to a virtual input
+  // file so that nothing is written to disk.
+  clang::CompilerInstance compiler;
+  compiler.createDiagnostics();
+
+  std::vector<const char *> argv;
+  for (const std::string &arg : args)
+    argv.push_back(arg.c_str());
+  argv.push_back(INPUTNAME);
+  if (!clang::CompilerInvocation::CreateFromArgs(compiler.getInvocation(),
+						 argv.data(),
+						 argv.data() + argv.size(),
+						 compiler.getDiagnostics()))
+    return false;
+
+  compiler.getPreprocessorOpts().addRemappedFile(INPUTNAME,
+    MemoryBuffer::getMemBufferCopy(source, INPUTNAME).release());
+
+  LLVMContext context;
+  clang::EmitLLVMOnlyAction action(&context);
+  if (!compiler.ExecuteAction(action))
+    return false;
+
+  std::unique_ptr<Module> module = action.takeModule();
+  if (!module)
+    return false;
+
+  // Optimize the module and analyze its kernels.
+  legacy::PassManager PM;
+  if (!addPasses(passes, PM))
+    return false;
+  PM.add(createAnalysisPass(analyses, reports));
+  PM.run(*module);
+
+  return true;
+}
@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <iostream>
 
 using namespace llvm;
@@ -40,8 +41,11 @@ static cl::opt<bool> optList("list",
 			     cl::desc("List kernel names"),
 			     cl::value_desc("list kernel names"));
 
-AnalysisPass::AnalysisPass() : FunctionPass(ID), conditionBuilder(NULL),
-			       indexExprBuilder(NULL) {}
+AnalysisPass::AnalysisPass(std::vector<KernelAnalysis *> *analyses,
+			   std::vector<KernelAnalysisReport> *reports)
+  : FunctionPass(ID), analyses(analyses), reports(reports),
+    lastLoopsBounded(0), lastLoopsUnknown(0), conditionBuilder(NULL),
+    indexExprBuilder(NULL) {}
 
 void
 AnalysisPass::getAnalysisUsage(AnalysisUsage &au) const {
@@ -82,6 +86,13 @@ AnalysisPass::runOnFunction(Function &F) {
 
   conditionBuilder = new ConditionBuilder(*PDT, indexExprBuilder);
 
+  report.kernel = F.getName().str();
+  report.numAccesses = 0;
+  report.numBoundedAccesses = 0;
+  report.numUnknownAccesses = 0;
+  lastLoopsBounded = 0;
+  lastLoopsUnknown = 0;
+
   analyze(&F);
 
   // Get global arguments (address space 1)
@@ -129,7 +140,7 @@ AnalysisPass::runOnFunction(Function &F) {
     argsAnalysis.push_back(argAnalysis);
   }
 
-  bool *argIsScalar = new bool(F.arg_size());
+  std::vector<bool> argIsScalar(F.arg_size());
   std::vector<size_t> scalarArgsSizes;
   std::vector<ArgumentAnalysis::TYPE> scalarArgsTypes;
   unsigned argIdx = 0;
@@ -220,10 +231,31 @@ AnalysisPass::runOnFunction(Function &F) {
 		       scalarArgsTypes,
 		       argsAnalysis,
 		       indirectionExprs);
-  delete argIsScalar;
 
-  if (optDump)
+  KernelFeatures features;
+  computeFeatures(&F, &features);
+  analysis->setFeatures(features);
+
+  if (optDump) {
     analysis->debug();
+    errs() << F.getName() << ": " << report.numAccesses << " accesses, "
+	   << report.numBoundedAccesses << " bounded from loop exit tests, "
+	   << report.numUnknownAccesses << " with unknown loop bounds\n";
+  }
+
+  if (reports)
+    reports->push_back(report);
+
+  delete conditionBuilder;
+  delete indexExprBuilder;
+  conditionBuilder = NULL;
+  indexExprBuilder = NULL;
+
+  // In process, the analysis is handed back to the caller.
+  if (analyses) {
+    analyses->push_back(analysis);
+    return false;
+  }
 
   // Pass number of global arguments, ArgumentAnalysis objects,
   // number of constant arguments and their positions
@@ -240,9 +272,22 @@ AnalysisPass::computeWorkItemExpr(llvm::Instruction *inst,
 				  IndexExpr *expr,
 				  const llvm::Argument *arg,
 				  WorkItemExpr::TYPE type) {
+  unsigned loopsBounded = indexExprBuilder->getNumLoopsBounded();
+  unsigned loopsUnknown = indexExprBuilder->getNumLoopsUnknown();
+  bool bounded = loopsBounded > lastLoopsBounded;
+  bool unknown = loopsUnknown > lastLoopsUnknown;
+  lastLoopsBounded = loopsBounded;
+  lastLoopsUnknown = loopsUnknown;
+
   if (!arg || !(isGlobalArgument(arg) || isConstantArgument(arg)))
     return;
 
+  report.numAccesses++;
+  if (unknown)
+    report.numUnknownAccesses++;
+  else if (bounded)
+    report.numBoundedAccesses++;
+
   std::vector<GuardExpr *> *guards =
     conditionBuilder->buildBasicBlockGuards(inst->getParent());
 
@@ -433,6 +478,94 @@ AnalysisPass::analyze(Function *F) {
   }
 }
 
+// Number of scalar operations of an instruction of type ty.
+static unsigned
+getNbLanes(Type *ty) {
+  if (VectorType *VT = dyn_cast<VectorType>(ty))
+    return VT->getNumElements();
+  return 1;
+}
+
+// Global (1) or constant (2) address space.
+static bool
+isGlobalPointer(Type *ty) {
+  unsigned AS = cast<PointerType>(ty)->getAddressSpace();
+  return AS == 1 || AS == 2;
+}
+
+// Local (3) address space.
+static bool
+isLocalPointer(Type *ty) {
+  PointerType *ptrTy = dyn_cast<PointerType>(ty);
+  return ptrTy && ptrTy->getAddressSpace() == 3;
+}
+
+void
+AnalysisPass::computeFeatures(Function *F, KernelFeatures *features) {
+  for (Argument &arg : F->args())
+    if (isLocalPointer(arg.getType()))
+      features->usesLocalMemory = true;
+
+  for (BasicBlock &BB : *F) {
+    // A loop whose trip count is unknown counts as a single iteration.
+    double weight = 1;
+    unsigned depth = 0;
+    for (Loop *L = loopInfo->getLoopFor(&BB); L; L = L->getParentLoop()) {
+      unsigned tripCount = scalarEvolution->getSmallConstantTripCount(L);
+      if (tripCount > 0)
+	weight *= tripCount;
+      depth++;
+    }
+    features->loopDepth = std::max(features->loopDepth, depth);
+
+    for (Instruction &I : BB) {
+      for (Value *op : I.operands())
+	if (isLocalPointer(op->getType()))
+	  features->usesLocalMemory = true;
+
+      if (isa<BinaryOperator>(&I)) {
+	double nbOps = weight * getNbLanes(I.getType());
+	features->nbArithOps += nbOps;
+	if (I.getType()->getScalarType()->isFloatingPointTy())
+	  features->nbFloatOps += nbOps;
+      }
+
+      else if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+	features->nbMemOps += weight;
+	if (isGlobalPointer(LI->getPointerOperand()->getType()))
+	  features->globalBytes +=
+	    weight * dataLayout->getTypeStoreSize(LI->getType());
+      }
+
+      else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+	Type *valTy = SI->getValueOperand()->getType();
+	features->nbMemOps += weight;
+	if (isGlobalPointer(SI->getPointerOperand()->getType()))
+	  features->globalBytes += weight * dataLayout->getTypeStoreSize(valTy);
+      }
+
+      // Builtin math functions, e.g. sqrt or exp, count as one operation.
+      else if (CallInst *CI = dyn_cast<CallInst>(&I)) {
+	Function *callee = CI->getCalledFunction();
+	if (callee) {
+	  StringRef name = callee->getName();
+	  if (name.find("barrier") != StringRef::npos)
+	    features->usesBarriers = true;
+	  if (name == "_Z12get_local_idj" || name == "_Z12get_group_idj" ||
+	      name == "_Z14get_local_sizej" || name == "_Z14get_num_groupsj")
+	    features->usesWorkGroupIds = true;
+	}
+	if (callee && !callee->isIntrinsic() &&
+	    CI->getType()->getScalarType()->isFloatingPointTy()) {
+	  double nbOps = weight * getNbLanes(CI->getType());
+	  features->nbArithOps += nbOps;
+	  features->nbFloatOps += nbOps;
+	}
+      }
+    }
+  }
+}
+
 void
 AnalysisPass::mmapAnalysis(const KernelAnalysis &analysis) {
   std::stringstream ss;
@@ -443,24 +576,15 @@ AnalysisPass::mmapAnalysis(const KernelAnalysis &analysis) {
   char *data;
   const char *c_str = str.c_str();
 
-  unsigned allocSize = 64 * getpagesize();
-
-  if (str.size() > allocSize) {
-    errs() << "Kernel Analysis ERROR: allocSize=" << allocSize
-	   << " stringSize=" << str.size() << "\n";
-    exit(EXIT_FAILURE);
-  }
+  // The file is sized to the analysis, the reader gets the size with fstat.
+  size_t allocSize = str.size();
 
   if ((fd = open("analysis.txt",
 		 O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR)) == -1) {
     perror("analysis open");
   } else {
-    if ((lseek(fd, allocSize + 1, SEEK_SET)) == -1)
-      perror("lseek");
-    if (write(fd, "", 1) != 1)
-      perror("write");
-    if (lseek(fd, 0, SEEK_SET) == -1)
-      perror("lseek");
+    if (ftruncate(fd, allocSize) == -1)
+      perror("ftruncate");
 
     data = static_cast<char *>(mmap((caddr_t) 0, allocSize,
 				    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
@@ -469,10 +593,17 @@ AnalysisPass::mmapAnalysis(const KernelAnalysis &analysis) {
       perror("analysis mmap");
     } else {
       memcpy(data, c_str, str.size());
+      munmap(data, allocSize);
     }
   }
 }
 
+FunctionPass *
+createAnalysisPass(std::vector<KernelAnalysis *> *analyses,
+		   std::vector<KernelAnalysisReport> *reports) {
+  return new AnalysisPass(analyses, reports);
+}
+
 char AnalysisPass::ID = 0;
 static RegisterPass<AnalysisPass>
 X("klanalysis", "Kernel Analysis Pass", false, false);
@@ -5,6 +5,8 @@
 
 #include "llvm/Analysis/ScalarEvolutionExpressions.h"
 
+#include <algorithm>
+
 using namespace llvm;
 using namespace std;
 
@@ -16,6 +18,8 @@ IndexExprBuilder::IndexExprBuilder(llvm::LoopInfo *loopInfo,
    dataLayout(dataLayout),
    computingBackedge(false),
    computingMemcpy(false),
+   numLoopsBounded(0),
+   numLoopsUnknown(0),
    indirectionsDisabled(false),
    buildingIndirection(false),
    doubleIndirectionReached(false),
@@ -765,6 +769,145 @@ IndexExprBuilder::tryComputeLoopStart(Loop *L) {
   return start;
 }
 
+// Strip the casts of an SCEV, e.g. the sign extension of a 32 bits induction
+// variable.
+static const SCEV *
+stripCasts(const SCEV *scev) {
+  while (const SCEVCastExpr *scCastExpr = dyn_cast<SCEVCastExpr>(scev))
+    scev = scCastExpr->getOperand();
+  return scev;
+}
+
+// Compute the higher bound of the affine add-recurrence addRec {a0,+,as}
+// from the exit test of its loop when its backedge count is unknown, e.g.
+// with a symbolic step:
+//
+// for (i = get_global_id(0); i < n; i += get_global_size(0))
+//   array[i] = ...
+//
+// The loop must stay while iv < bound, iv {x0,+,xs} being an add-recurrence
+// of the same loop with as = c * xs, c > 0, and bound loop invariant.
+// Iteration k > 0 is executed only if the test succeeded at iteration k-1,
+// iv(k-1) < bound, so addRec(k) = a0 + c * (iv(k) - x0) <= a0 + c * (bound -
+// 1 + xs - x0). With c < 0, e.g. out[n-1-i], addRec decreases and this is
+// its lower bound, which is not handled. The
+// bound of a nested loop is handled as the start of the recurrence of the
+// inner loop is itself a recurrence of the outer loop.
+IndexExpr *
+IndexExprBuilder::tryComputeLoopEnd(const SCEVAddRecExpr *addRec,
+				    const Argument **arg) {
+  const Loop *L = addRec->getLoop();
+  if (!addRec->isAffine())
+    return NULL;
+
+  const SCEV *step = addRec->getStepRecurrence(*scalarEvolution);
+  if (scalarEvolution->isKnownNonPositive(step))
+    return NULL;
+
+  // The exit test has to be done at each iteration.
+  BasicBlock *exitingBlock = L->getLoopLatch();
+  if (!exitingBlock || !L->isLoopExiting(exitingBlock))
+    exitingBlock = L->getExitingBlock();
+  if (!exitingBlock)
+    return NULL;
+
+  BranchInst *BI = dyn_cast<BranchInst>(exitingBlock->getTerminator());
+  if (!BI || BI->isUnconditional() ||
+      L->contains(BI->getSuccessor(0)) == L->contains(BI->getSuccessor(1)))
+    return NULL;
+
+  ICmpInst *icmp = dyn_cast<ICmpInst>(BI->getCondition());
+  if (!icmp)
+    return NULL;
+
+  // Predicate to stay in the loop, with the add-recurrence on the left.
+  CmpInst::Predicate pred = icmp->getPredicate();
+  if (!L->contains(BI->getSuccessor(0)))
+    pred = CmpInst::getInversePredicate(pred);
+
+  const SCEV *lhs = stripCasts(scalarEvolution->getSCEV(icmp->getOperand(0)));
+  const SCEV *rhs = stripCasts(scalarEvolution->getSCEV(icmp->getOperand(1)));
+  if (!isa<SCEVAddRecExpr>(lhs)) {
+    std::swap(lhs, rhs);
+    pred = CmpInst::getSwappedPredicate(pred);
+  }
+
+  const SCEVAddRecExpr *iv = dyn_cast<SCEVAddRecExpr>(lhs);
+  if (!iv || iv->getLoop() != L || !iv->isAffine() ||
+      !scalarEvolution->isLoopInvariant(rhs, L))
+    return NULL;
+
+  // Compute in the integer type of the add-recurrence.
+  Type *ty = scalarEvolution->getEffectiveSCEVType(step->getType());
+  const SCEV *one = scalarEvolution->getConstant(ty, 1);
+  const SCEV *ivStart =
+    scalarEvolution->getTruncateOrSignExtend(iv->getStart(), ty);
+  const SCEV *ivStep =
+    scalarEvolution->getTruncateOrSignExtend(iv->getStepRecurrence(*scalarEvolution),
+					     ty);
+  const SCEV *bound = scalarEvolution->getTruncateOrSignExtend(rhs, ty);
+  step = scalarEvolution->getTruncateOrSignExtend(step, ty);
+
+  if (scalarEvolution->isKnownNonPositive(ivStep))
+    return NULL;
+
+  // Exclusive bound
+  switch (pred) {
+  case CmpInst::ICMP_SLT:
+  case CmpInst::ICMP_ULT:
+    break;
+  case CmpInst::ICMP_SLE:
+  case CmpInst::ICMP_ULE:
+    bound = scalarEvolution->getAddExpr(bound, one);
+    break;
+  case CmpInst::ICMP_NE:
+    if (ivStep != one)
+      return NULL;
+    break;
+  default:
+    return NULL;
+  };
+
+  // Coefficient c > 0 such as step = c * ivStep.
+  const SCEV *coef = NULL;
+  if (step == ivStep) {
+    coef = one;
+  } else if (isa<SCEVConstant>(step) && isa<SCEVConstant>(ivStep)) {
+    const APInt &s = cast<SCEVConstant>(step)->getValue()->getValue();
+    const APInt &is = cast<SCEVConstant>(ivStep)->getValue()->getValue();
+    if (!is.isStrictlyPositive() || s.srem(is) != 0)
+      return NULL;
+    coef = scalarEvolution->getConstant(s.sdiv(is));
+  } else if (const SCEVMulExpr *mul = dyn_cast<SCEVMulExpr>(step)) {
+    if (mul->getNumOperands() == 2 && isa<SCEVConstant>(mul->getOperand(0)) &&
+	mul->getOperand(1) == ivStep)
+      coef = mul->getOperand(0);
+  }
+  if (!coef ||
+      !cast<SCEVConstant>(coef)->getValue()->getValue().isStrictlyPositive())
+    return NULL;
+
+  const SCEV *range =
+    scalarEvolution->getMinusSCEV(scalarEvolution->getAddExpr(bound, ivStep),
+				  scalarEvolution->getAddExpr(ivStart, one));
+  const SCEV *scevEnd =
+    scalarEvolution->getAddExpr(addRec->getStart(),
+				scalarEvolution->getMulExpr(coef, range));
+
+  IndexExpr *end = NULL;
+  parseSCEV(scevEnd, &end, arg);
+
+  IndexExpr *start = NULL;
+  const Argument *startArg = *arg;
+  parseSCEV(addRec->getStart(), &start, &startArg);
+
+  // The loop may be executed once whatever the test.
+  IndexExpr *ops[2];
+  ops[0] = new IndexExprHB(start);
+  ops[1] = new IndexExprHB(end);
+  return new IndexExprMax(2, ops);
+}
+
 void
 IndexExprBuilder::parseSCEV(const llvm::SCEV *scev, IndexExpr **indexExpr,
 			    const llvm::Argument **arg) {
@@ -883,23 +1026,42 @@ IndexExprBuilder::parseSCEV(const llvm::SCEV *scev, IndexExpr **indexExpr,
       parseSCEV(scAddRecExpr->getStepRecurrence(*scalarEvolution), &step, arg);
       const Loop *L = scAddRecExpr->getLoop();
       const SCEV *scevBackedgeCount = scalarEvolution->getBackedgeTakenCount(L);
+      IndexExpr *end = NULL;
+      backedgeCount = NULL;
 
       if (scevBackedgeCount->getSCEVType() != scCouldNotCompute) {
 	computingBackedge = true;
       	parseSCEV(scevBackedgeCount, &backedgeCount, arg);
 	computingBackedge = false;
+      } else if ((end = tryComputeLoopEnd(scAddRecExpr, arg))) {
+	// Bounded by the exit test, e.g. symbolic trip counts and grid-stride
+	// loops.
+	delete step;
+	numLoopsBounded++;
       } else {
       	// Fallback, not sure if it works in all cases.
 	backedgeCount = tryComputeLoopBackedCount(const_cast<Loop *>(L));
-	if (!backedgeCount)
-	  backedgeCount = new IndexExprUnknown("loop");
+	if (!backedgeCount) {
+	  const SCEV *scevMaxBackedgeCount =
+	    scalarEvolution->getMaxBackedgeTakenCount(L);
+	  if (scevMaxBackedgeCount->getSCEVType() != scCouldNotCompute) {
+	    computingBackedge = true;
+	    parseSCEV(scevMaxBackedgeCount, &backedgeCount, arg);
+	    computingBackedge = false;
+	    numLoopsBounded++;
+	  } else {
+	    backedgeCount = new IndexExprUnknown("loop");
+	    numLoopsUnknown++;
+	  }
+	}
       }
 
-      IndexExpr *end
-	= new IndexExprBinop(IndexExprBinop::Add,
-			     new IndexExprHB(start->clone()),
-			     new IndexExprBinop(IndexExprBinop::Mul,
-						new IndexExprHB(step), new IndexExprLB(backedgeCount)));
+      if (!end)
+	end = new IndexExprBinop(IndexExprBinop::Add,
+				 new IndexExprHB(start->clone()),
+				 new IndexExprBinop(IndexExprBinop::Mul,
+						    new IndexExprHB(step),
+						    new IndexExprLB(backedgeCount)));
       *indexExpr = new IndexExprInterval(start, end);
 #define DEBUG_TYPE "loop"
       DEBUG(
@@ -927,6 +1089,16 @@ IndexExprBuilder::getIndirection(unsigned n) {
   return indirections[n];
 }
 
+unsigned
+IndexExprBuilder::getNumLoopsBounded() const {
+  return numLoopsBounded;
+}
+
+unsigned
+IndexExprBuilder::getNumLoopsUnknown() const {
+  return numLoopsUnknown;
+}
+
 void
 IndexExprBuilder::disableIndirections() {
   indirectionsDisabled = true;
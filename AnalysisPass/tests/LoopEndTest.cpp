@@ -0,0 +1,124 @@
+// Regions of accesses in grid-stride loops, whose backedge count is unknown
+// to ScalarEvolution, have to cover every element the work-items of each
+// sub-kernel touch, including when the index decreases with the loop.
+
+#include "KernelAnalysisRunner.h"
+
+#include "IndexExpr/IndexExprValue.h"
+#include "KernelAnalysis.h"
+#include "ListInterval.h"
+#include "NDRange.h"
+
+#include <algorithm>
+#include <iostream>
+
+static unsigned nbFailures = 0;
+
+#define CHECK(cond)							\
+  do {									\
+    if (!(cond)) {							\
+      std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: "	\
+		<< #cond << "\n";					\
+      nbFailures++;							\
+    }									\
+  } while (0)
+
+#define CLANG_INCLUDE_DIR LLVM_LIB_DIR "/clang/" CLANGVERSION "/include"
+
+static const char *source =
+  "__kernel void forward(__global float *out, __global const float *in,\n"
+  "                      int n) {\n"
+  "  for (int i = get_global_id(0); i < n; i += get_global_size(0))\n"
+  "    out[i] = in[i];\n"
+  "}\n"
+  "__kernel void reverse(__global float *out, __global const float *in,\n"
+  "                      int n) {\n"
+  "  for (int i = get_global_id(0); i < n; i += get_global_size(0))\n"
+  "    out[n - 1 - i] = in[i];\n"
+  "}\n";
+
+static const long N = 5000;
+
+// Elements of out written by the work-items of subNDRange.
+static Interval
+writtenElements(const NDRange &subNDRange, bool reverse) {
+  long first = N, last = -1;
+  long stride = subNDRange.get_orig_global_size(0);
+  long begin = subNDRange.getOffset(0);
+  long end = begin + subNDRange.get_global_size(0);
+  for (long gid = begin; gid < end; gid++) {
+    for (long i = gid; i < N; i += stride) {
+      long idx = reverse ? N - 1 - i : i;
+      first = std::min(first, idx);
+      last = std::max(last, idx);
+    }
+  }
+  return Interval(first * sizeof(float), (last + 1) * sizeof(float) - 1);
+}
+
+static bool
+covers(const ListInterval &region, const Interval &elements) {
+  ListInterval expected;
+  expected.add(elements);
+  ListInterval *missing = ListInterval::difference(expected, region);
+  bool ret = missing->total() == 0;
+  delete missing;
+  return ret;
+}
+
+static void
+testKernel(KernelAnalysis *analysis, bool reverse) {
+  size_t gws[1] = {1024}, lws[1] = {64};
+  NDRange ndRange(1, gws, NULL, lws);
+  double granu[6] = {0, 1, 0.25, 1, 1, 0.75};
+  std::vector<NDRange> subNDRanges;
+  ndRange.splitDim(0, 6, granu, &subNDRanges);
+
+  std::vector<IndexExprValue *> argValues;
+  argValues.push_back(IndexExprValue::createLong(0)); // out
+  argValues.push_back(IndexExprValue::createLong(0)); // in
+  argValues.push_back(IndexExprValue::createLong(N));
+
+  analysis->setPartition(ndRange, subNDRanges, argValues);
+  analysis->performAnalysis();
+
+  // The forward loop is bounded from its exit test. The reverse one may not
+  // be bounded, but if it is the regions must not miss any element.
+  if (!reverse)
+    CHECK(analysis->argWrittenBoundsComputed(0));
+  if (analysis->argWrittenBoundsComputed(0)) {
+    for (unsigned i=0; i<subNDRanges.size(); i++) {
+      CHECK(covers(analysis->getArgWrittenSubkernelRegion(0, i),
+		   writtenElements(subNDRanges[i], reverse)));
+    }
+  }
+
+  for (IndexExprValue *value : argValues)
+    delete value;
+}
+
+int main() {
+  std::vector<std::string> args = {
+    "-cl-std=CL1.2", "-finclude-default-header", "-isystem", CLANG_INCLUDE_DIR
+  };
+  std::vector<KernelAnalysis *> analyses;
+  std::vector<KernelAnalysisReport> reports;
+  CHECK(runKernelAnalysisOnSource(source, args, "-O2", &analyses, &reports));
+  CHECK(analyses.size() == 2);
+  if (analyses.size() != 2)
+    return 1;
+
+  CHECK(reports[0].numBoundedAccesses > 0);
+  testKernel(analyses[0], false);
+  testKernel(analyses[1], true);
+
+  for (KernelAnalysis *analysis : analyses)
+    delete analysis;
+
+  if (nbFailures > 0) {
+    std::cerr << nbFailures << " check(s) failed\n";
+    return 1;
+  }
+
+  return 0;
+}
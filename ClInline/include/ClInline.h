@@ -0,0 +1,16 @@
+#ifndef CLINLINE_H
+#define CLINLINE_H
+
+#include <string>
+#include <vector>
+
+// Rewrite the OpenCL C source so that the whole kernel ends up in a single
+// LLVM function: non kernel functions are marked always_inline and kernels
+// called by other kernels are duplicated into inlined functions. args are
+// clang -cc1 arguments (include paths, macro definitions), without input
+// file. Parse errors are ignored, the source is rewritten as far as it was
+// parsed.
+std::string clInline(const std::string &source,
+		     const std::vector<std::string> &args);
+
+#endif /* CLINLINE_H */
@@ -1,5 +1,8 @@
+#include "ClInline.h"
+
 #include <cstdio>
 #include <memory>
+#include <set>
 #include <string>
 #include <sstream>
 
@@ -16,11 +19,12 @@
 #include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Rewrite/Frontend/Rewriters.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace clang;
 
-std::set<FunctionDecl *> kernelsCalledByKernel;
+namespace {
 
 // By implementing RecursiveASTVisitor, we can specify which AST nodes
 // we're interested in by overriding relevant methods.
@@ -119,6 +123,7 @@ private:
   Rewriter &TheRewriter;
   CompilerInstance &ci;
   SourceManager &sm;
+  std::set<FunctionDecl *> kernelsCalledByKernel;
 };
 
 // Implementation of the ASTConsumer interface for reading an AST produced
@@ -141,16 +146,15 @@ private:
   MyASTVisitor Visitor;
 };
 
-int main(int argc, char *argv[]) {
-  if (argc < 2) {
-    llvm::errs() << "Usage: clinline <filename>\n";
-    return 1;
-  }
+}
 
+std::string
+clInline(const std::string &source, const std::vector<std::string> &args) {
   // CompilerInstance will hold the instance of the Clang compiler for us,
   // managing the various objects needed to run the compiler.
   CompilerInstance TheCompInst;
-  TheCompInst.createDiagnostics();
+  // Errors are not fatal, the source is rewritten as far as it was parsed.
+  TheCompInst.createDiagnostics(new IgnoringDiagConsumer());
 
 #if LLVM_VERSION_MAJOR >= 5
   std::shared_ptr<CompilerInvocation> Invocation(new CompilerInvocation);
@@ -158,7 +162,11 @@ int main(int argc, char *argv[]) {
   CompilerInvocation *Invocation = new CompilerInvocation();
 #endif
 
-  CompilerInvocation::CreateFromArgs(*Invocation, argv + 1, argv + argc,
+  std::vector<const char *> argv;
+  for (const std::string &arg : args)
+    argv.push_back(arg.c_str());
+  CompilerInvocation::CreateFromArgs(*Invocation, argv.data(),
+				     argv.data() + argv.size(),
 				     TheCompInst.getDiagnostics());
   TheCompInst.setInvocation(Invocation);
 
@@ -185,10 +193,10 @@ int main(int argc, char *argv[]) {
   Rewriter TheRewriter;
   TheRewriter.setSourceMgr(SourceMgr, TheCompInst.getLangOpts());
 
-  // Set the main file handled by the source manager to the input file.
-  const FileEntry *FileIn = FileMgr.getFile(argv[argc-1]);
+  // Set the main file handled by the source manager to the input buffer.
   SourceMgr.setMainFileID(
-      SourceMgr.createFileID(FileIn, SourceLocation(), SrcMgr::C_User));
+      SourceMgr.createFileID(llvm::MemoryBuffer::getMemBufferCopy(source,
+								  "input.cl")));
   TheCompInst.getDiagnosticClient().BeginSourceFile(
       TheCompInst.getLangOpts(), &TheCompInst.getPreprocessor());
 
@@ -199,6 +207,7 @@ int main(int argc, char *argv[]) {
   // Parse the file to AST, registering our consumer as the AST consumer.
   ParseAST(TheCompInst.getPreprocessor(), &TheConsumer,
            TheCompInst.getASTContext());
+  TheCompInst.getDiagnosticClient().EndSourceFile();
 
   // At this point the rewriter's buffer should be full with the rewritten
   // file contents.
@@ -206,10 +215,9 @@ int main(int argc, char *argv[]) {
       TheRewriter.getRewriteBufferFor(SourceMgr.getMainFileID());
 
   if (RewriteBuf)
-    llvm::outs() << std::string(RewriteBuf->begin(), RewriteBuf->end());
-  else
-    llvm::outs() << std::string(TheRewriter.getEditBuffer(SourceMgr.getMainFileID()).begin(),
-				TheRewriter.getEditBuffer(SourceMgr.getMainFileID()).end());
+    return std::string(RewriteBuf->begin(), RewriteBuf->end());
 
-  return 0;
+  const RewriteBuffer &EditBuf =
+    TheRewriter.getEditBuffer(SourceMgr.getMainFileID());
+  return std::string(EditBuf.begin(), EditBuf.end());
 }
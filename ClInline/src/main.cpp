@@ -0,0 +1,27 @@
+#include "ClInline.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: clinline <options> <filename>\n";
+    return 1;
+  }
+
+  std::ifstream in(argv[argc-1]);
+  if (!in) {
+    std::cerr << "Error: cannot open " << argv[argc-1] << "\n";
+    return 1;
+  }
+  std::stringstream source;
+  source << in.rdbuf();
+
+  std::vector<std::string> args(argv + 1, argv + argc - 1);
+  std::cout << clInline(source.str(), args);
+
+  return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef CLTRANSFORM_H
+#define CLTRANSFORM_H
+
+#include <string>
+#include <vector>
+
+// Rewrite the OpenCL C source so that its kernels can be executed with a
+// fraction of the NDRange: calls to get_group_id, get_num_groups and
+// get_global_size are replaced with expressions of the two parameters
+// __libsplit_num_groups_ and __libsplit_split_dim_ added to the kernels and
+// to the functions using them. The expressions read the parameters through
+// the macros __LIBSPLIT_NUM_GROUPS and __LIBSPLIT_SPLIT_DIM, defined to the
+// parameters unless they are set with -D when building the program. args are
+// clang -cc1 arguments, without input file. Parse errors are ignored, the
+// source is rewritten as far as it was parsed.
+//
+// If inspectedKernels is not NULL, the kernels also get a third parameter
+// __libsplit_footprint_, a buffer where each work-group records the lowest
+// and highest bytes it reads and writes through each global and constant
+// pointer parameter (see Footprint.h in LibKernelExpr). The names of the
+// kernels whose accesses are all recorded, that is whose pointer parameters
+// are only used as subscript bases, are appended to inspectedKernels.
+std::string clTransform(const std::string &source,
+			const std::vector<std::string> &args,
+			std::vector<std::string> *inspectedKernels = NULL);
+
+#endif /* CLTRANSFORM_H */
@@ -1,5 +1,9 @@
+#include "ClTransform.h"
+
 #include <cstdio>
+#include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <sstream>
 
@@ -16,23 +20,39 @@
 #include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Rewrite/Frontend/Rewriters.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
 #define NUMGROUPSVAR "__libsplit_num_groups_"
 #define SPLITDIMVAR  "__libsplit_split_dim_"
+#define FOOTPRINTVAR "__libsplit_footprint_"
+#define RECORDFUNC   "__libsplit_record_"
+
+// The rewritten expressions read the parameters through these macros, which
+// can be defined with -D to build a program specialized for given values.
+#define NUMGROUPSVALUE "__LIBSPLIT_NUM_GROUPS"
+#define SPLITDIMVALUE  "__LIBSPLIT_SPLIT_DIM"
 
 using namespace clang;
 
-std::set<FunctionDecl *> functionsSet;
-std::set<FunctionDecl *> functionsSet2;
+namespace {
+
+// Functions using get_group_id, get_num_groups or get_global_size: non kernel
+// functions in functionsSet, kernels in functionsSet2.
+struct TransformedFunctions {
+  std::set<FunctionDecl *> functionsSet;
+  std::set<FunctionDecl *> functionsSet2;
+};
 
 // Second visitor :
 // add parameters numgroups and splitdim to stored non kernel functions
 
 class SecondVisitor : public RecursiveASTVisitor<SecondVisitor> {
 public:
-  SecondVisitor(Rewriter &R, CompilerInstance &ci, SourceManager &sm)
-    : TheRewriter(R), ci(ci), sm(sm) {}
+  SecondVisitor(Rewriter &R, CompilerInstance &ci, SourceManager &sm,
+		TransformedFunctions &F)
+    : TheRewriter(R), ci(ci), sm(sm), functionsSet(F.functionsSet),
+      functionsSet2(F.functionsSet2) {}
 
   bool VisitStmt(Stmt *s) {
     // Only care about CallExpr statements
@@ -100,6 +120,8 @@ private:
   Rewriter &TheRewriter;
   CompilerInstance &ci;
   SourceManager &sm;
+  std::set<FunctionDecl *> &functionsSet;
+  std::set<FunctionDecl *> &functionsSet2;
 };
 
 // First visitor :
@@ -109,8 +131,10 @@ private:
 
 class MyASTVisitor : public RecursiveASTVisitor<MyASTVisitor> {
 public:
-  MyASTVisitor(Rewriter &R, CompilerInstance &ci, SourceManager &sm)
-    : TheRewriter(R), ci(ci), sm(sm) {}
+  MyASTVisitor(Rewriter &R, CompilerInstance &ci, SourceManager &sm,
+	       TransformedFunctions &F, bool inspect)
+    : TheRewriter(R), ci(ci), sm(sm), functionsSet(F.functionsSet),
+      functionsSet2(F.functionsSet2), inspect(inspect) {}
 
   FunctionDecl *currentFunction;
 
@@ -129,7 +153,6 @@ public:
 
     // Get function name
     std::string funcname = func->getNameInfo().getAsString();
-    llvm::errs() << "funcname : " << funcname << "\n";
 
     // get_group_id(workDim) -> get_globalid(workDim) / get_local_id(workDim)
     if (funcname.compare("get_group_id") == 0) {
@@ -148,12 +171,12 @@ public:
 
       // Transformation
 
-      // get_group_id(arg) -> ((arg) == SPLITDIMVAR ?
-      // (get_global_id(SPLITDIMVAR) / get_local_size(SPLITDIMVAR))
+      // get_group_id(arg) -> ((arg) == SPLITDIMVALUE ?
+      // (get_global_id(SPLITDIMVALUE) / get_local_size(SPLITDIMVALUE))
       // : get_group_id(arg))
       std::string str = "((" + std::string(strArg) + std::string(") == ") +
-	SPLITDIMVAR + "? (get_global_id(" + SPLITDIMVAR +
-	") / get_local_size(" + SPLITDIMVAR + ")) : get_group_id(" +
+	SPLITDIMVALUE + "? (get_global_id(" + SPLITDIMVALUE +
+	") / get_local_size(" + SPLITDIMVALUE + ")) : get_group_id(" +
 	std::string(strArg) + "))";
 
       TheRewriter.ReplaceText(SourceRange(call->getLocStart(),
@@ -178,10 +201,10 @@ public:
 
       // Transformation
 
-      // get_num_groups(arg) -> ((arg) == SPLITDIMVAR ?
-      // NUMGROUPSVAR : get_num_groups(arg))
+      // get_num_groups(arg) -> ((arg) == SPLITDIMVALUE ?
+      // NUMGROUPSVALUE : get_num_groups(arg))
       std::string str = "((" + std::string(strArg) + std::string(") == ") +
-	SPLITDIMVAR + "? (" + NUMGROUPSVAR + ") : get_num_groups(" +
+	SPLITDIMVALUE + "? (" + NUMGROUPSVALUE + ") : get_num_groups(" +
 	std::string(strArg) + "))";
 
       TheRewriter.ReplaceText(SourceRange(call->getLocStart(),
@@ -206,10 +229,10 @@ public:
 
       // Transformation
 
-      // get_global_size(arg) -> ((arg) == SPLITDIMVAR ?
-      // NUMGROUPSVAR : get_local_size(arg))
+      // get_global_size(arg) -> ((arg) == SPLITDIMVALUE ?
+      // NUMGROUPSVALUE : get_local_size(arg))
       std::string str = "((" + std::string(strArg) + std::string(") == ") +
-	SPLITDIMVAR + "? (" + NUMGROUPSVAR + "* get_local_size(" +
+	SPLITDIMVALUE + "? (" + NUMGROUPSVALUE + "* get_local_size(" +
 	std::string(strArg) + ")) : get_global_size(" +
 	std::string(strArg) + "))";
 
@@ -230,19 +253,21 @@ public:
     if (!f->hasAttr<OpenCLKernelAttr>())
       return true;
 
-    llvm::errs() << f->getNameInfo().getAsString() << " is a kernel.\n";
-
     // Add parameter
     TypeLoc TL = f->getTypeSourceInfo()->getTypeLoc();
     FunctionTypeLoc FTL = TL.getAs<FunctionTypeLoc>();
 
+    // The inspector also gets the footprint buffer.
+    std::string footprintParam = inspect ?
+      std::string(", __global unsigned int *") + FOOTPRINTVAR : "";
+
     if (f->param_size() == 0) { // kernel with no parameter
       std::string str(std::string("(const int ") + NUMGROUPSVAR +
-		      ", const int " + SPLITDIMVAR + ")");
+		      ", const int " + SPLITDIMVAR + footprintParam + ")");
       TheRewriter.ReplaceText(FTL.getLocalSourceRange(), str);
     } else {
       std::string str(std::string(", const int ") + NUMGROUPSVAR + 
-		      ", const int " + SPLITDIMVAR);
+		      ", const int " + SPLITDIMVAR + footprintParam);
       TheRewriter.InsertText(FTL.getLocalRangeEnd(), str);
     }
 
@@ -255,15 +280,155 @@ private:
   Rewriter &TheRewriter;
   CompilerInstance &ci;
   SourceManager &sm;
+  std::set<FunctionDecl *> &functionsSet;
+  std::set<FunctionDecl *> &functionsSet2;
+  bool inspect;
+};
+
+// Inspector visitor, run on each kernel :
+// record the bytes accessed through the global and constant pointer
+// parameters of the kernel. The index of each subscript p[i] becomes
+// RECORDFUNC(FOOTPRINTVAR, ..., (i), sizeof(*p)), which stores the bounds of
+// the access in the footprint buffer and returns i. The kernel is
+// inspectable only if these parameters are used as subscript bases only.
+
+class InspectorVisitor : public RecursiveASTVisitor<InspectorVisitor> {
+public:
+  InspectorVisitor(Rewriter &R, FunctionDecl *kernel)
+    : TheRewriter(R), kernel(kernel), inspectable(true) {}
+
+  bool isInspectable() const { return inspectable; }
+
+  // Assignments write their left-hand side, compound assignments also read
+  // it.
+  bool VisitBinaryOperator(BinaryOperator *op) {
+    if (!op->isAssignmentOp())
+      return true;
+
+    ArraySubscriptExpr *sub = getAccessedSubscript(op->getLHS());
+    if (sub)
+      kinds[sub] = op->isCompoundAssignmentOp() ? ACCESS_RW : ACCESS_WRITE;
+
+    return true;
+  }
+
+  bool VisitUnaryOperator(UnaryOperator *op) {
+    ArraySubscriptExpr *sub = getAccessedSubscript(op->getSubExpr());
+    if (!sub)
+      return true;
+
+    if (op->isIncrementDecrementOp())
+      kinds[sub] = ACCESS_RW;
+    else if (op->getOpcode() == UO_AddrOf)
+      inspectable = false; // Pointer into the buffer escapes
+
+    return true;
+  }
+
+  bool VisitArraySubscriptExpr(ArraySubscriptExpr *e) {
+    DeclRefExpr *ref = dyn_cast<DeclRefExpr>(e->getBase()->IgnoreParenImpCasts());
+    if (!ref)
+      return true;
+    ParmVarDecl *param = getTrackedParam(ref);
+    if (!param)
+      return true;
+
+    Expr *idx = e->getIdx();
+    SourceLocation start = idx->getLocStart();
+    SourceLocation end = idx->getLocEnd();
+    if (start.isMacroID() || end.isMacroID())
+      return true; // Reported as an escape by VisitDeclRefExpr
+
+    instrumentedRefs.insert(ref);
+
+    unsigned kind = ACCESS_READ;
+    std::map<ArraySubscriptExpr *, unsigned>::iterator it = kinds.find(e);
+    if (it != kinds.end())
+      kind = it->second;
+
+    std::ostringstream args;
+    args << FOOTPRINTVAR << ", " << kernel->getNumParams() << ", "
+	 << param->getFunctionScopeIndex() << ", ";
+    std::string size = "sizeof(*" + param->getName().str() + ")";
+
+    std::string prefix, suffix;
+    if (kind & ACCESS_WRITE) {
+      prefix += std::string(RECORDFUNC) + "(" + args.str() + "1, ";
+      suffix = ", " + size + ")" + suffix;
+    }
+    if (kind & ACCESS_READ) {
+      prefix += std::string(RECORDFUNC) + "(" + args.str() + "0, ";
+      suffix = ", " + size + ")" + suffix;
+    }
+
+    TheRewriter.InsertTextBefore(start, prefix + "(");
+    TheRewriter.InsertTextAfterToken(end, ")" + suffix);
+
+    return true;
+  }
+
+  // Any other use of a tracked parameter, visited after the subscripts
+  // containing it, makes the kernel not inspectable.
+  bool VisitDeclRefExpr(DeclRefExpr *ref) {
+    if (getTrackedParam(ref) && !instrumentedRefs.count(ref))
+      inspectable = false;
+    return true;
+  }
+
+private:
+  enum {
+    ACCESS_READ = 1,
+    ACCESS_WRITE = 2,
+    ACCESS_RW = 3
+  };
+
+  // Global or constant pointer parameter of the kernel referenced by ref.
+  ParmVarDecl *getTrackedParam(DeclRefExpr *ref) {
+    ParmVarDecl *param = dyn_cast<ParmVarDecl>(ref->getDecl());
+    if (!param || param->getDeclContext() != kernel)
+      return NULL;
+
+    const PointerType *PT = param->getType()->getAs<PointerType>();
+    if (!PT)
+      return NULL;
+
+    unsigned AS = PT->getPointeeType().getAddressSpace();
+    if (AS != LangAS::opencl_global && AS != LangAS::opencl_constant)
+      return NULL;
+
+    return param;
+  }
+
+  // Subscript of e, through member and vector component accesses.
+  ArraySubscriptExpr *getAccessedSubscript(Expr *e) {
+    e = e->IgnoreParenImpCasts();
+    while (true) {
+      if (MemberExpr *member = dyn_cast<MemberExpr>(e))
+	e = member->getBase()->IgnoreParenImpCasts();
+      else if (ExtVectorElementExpr *elt = dyn_cast<ExtVectorElementExpr>(e))
+	e = elt->getBase()->IgnoreParenImpCasts();
+      else
+	break;
+    }
+    return dyn_cast<ArraySubscriptExpr>(e);
+  }
+
+  Rewriter &TheRewriter;
+  FunctionDecl *kernel;
+  bool inspectable;
+  std::map<ArraySubscriptExpr *, unsigned> kinds;
+  std::set<DeclRefExpr *> instrumentedRefs;
 };
 
 // Implementation of the ASTConsumer interface for reading an AST produced
 // by the Clang parser.
 class MyASTConsumer : public ASTConsumer {
 public:
-  MyASTConsumer(Rewriter &R, CompilerInstance &ci,
-		SourceManager &sm) : firstPass(R, ci, sm),
-				     secondPass(R, ci, sm) {}
+  MyASTConsumer(Rewriter &R, CompilerInstance &ci, SourceManager &sm,
+		std::vector<std::string> *inspectedKernels)
+    : TheRewriter(R), inspectedKernels(inspectedKernels),
+      firstPass(R, ci, sm, functions, inspectedKernels != NULL),
+      secondPass(R, ci, sm, functions) {}
 
   // Override the method that gets called for each parsed top-level
   // declaration.
@@ -280,25 +445,41 @@ public:
     // add parameters numgroups and splitdim to stored non kernel functions
     for (DeclGroupRef::iterator b = DR.begin(), e = DR.end(); b != e; ++b)
       secondPass.TraverseDecl(*b);
+
+    // Inspector visitor :
+    // record the accesses to the global and constant buffers of kernels
+    if (!inspectedKernels)
+      return true;
+    for (DeclGroupRef::iterator b = DR.begin(), e = DR.end(); b != e; ++b) {
+      FunctionDecl *f = dyn_cast<FunctionDecl>(*b);
+      if (!f || !f->hasAttr<OpenCLKernelAttr>() || !f->hasBody())
+	continue;
+      InspectorVisitor inspector(TheRewriter, f);
+      inspector.TraverseDecl(f);
+      if (inspector.isInspectable())
+	inspectedKernels->push_back(f->getNameInfo().getAsString());
+    }
     return true;
   }
 
 private:
+  Rewriter &TheRewriter;
+  std::vector<std::string> *inspectedKernels;
+  TransformedFunctions functions;
   MyASTVisitor firstPass;
   SecondVisitor secondPass;
 };
 
+}
 
-int main(int argc, char *argv[]) {
-  if (argc < 2) {
-    llvm::errs() << "Usage: cltranform <options> <filename>\n";
-    return 1;
-  }
-
+std::string
+clTransform(const std::string &source, const std::vector<std::string> &args,
+	    std::vector<std::string> *inspectedKernels) {
   // CompilerInstance will hold the instance of the Clang compiler for us,
   // managing the various objects needed to run the compiler.
   CompilerInstance TheCompInst;
-  TheCompInst.createDiagnostics();
+  // Errors are not fatal, the source is rewritten as far as it was parsed.
+  TheCompInst.createDiagnostics(new IgnoringDiagConsumer());
 
 #if LLVM_VERSION_MAJOR >= 5
   std::shared_ptr<CompilerInvocation> Invocation(new CompilerInvocation);
@@ -306,7 +487,11 @@ int main(int argc, char *argv[]) {
   CompilerInvocation *Invocation = new CompilerInvocation();
 #endif
 
-  CompilerInvocation::CreateFromArgs(*Invocation, argv + 1, argv + argc,
+  std::vector<const char *> argv;
+  for (const std::string &arg : args)
+    argv.push_back(arg.c_str());
+  CompilerInvocation::CreateFromArgs(*Invocation, argv.data(),
+				     argv.data() + argv.size(),
 				     TheCompInst.getDiagnostics());
   TheCompInst.setInvocation(Invocation);
 
@@ -333,20 +518,61 @@ int main(int argc, char *argv[]) {
   Rewriter TheRewriter;
   TheRewriter.setSourceMgr(SourceMgr, TheCompInst.getLangOpts());
 
-  // Set the main file handled by the source manager to the input file.
-  const FileEntry *FileIn = FileMgr.getFile(argv[argc-1]);
+  // Set the main file handled by the source manager to the input buffer.
   SourceMgr.setMainFileID(
-      SourceMgr.createFileID(FileIn, SourceLocation(), SrcMgr::C_User));
+      SourceMgr.createFileID(llvm::MemoryBuffer::getMemBufferCopy(source,
+								  "input.cl")));
   TheCompInst.getDiagnosticClient().BeginSourceFile(
       TheCompInst.getLangOpts(), &TheCompInst.getPreprocessor());
 
   // Create an AST consumer instance which is going to get called by
   // ParseAST.
-  MyASTConsumer TheConsumer(TheRewriter, TheCompInst, SourceMgr);
+  MyASTConsumer TheConsumer(TheRewriter, TheCompInst, SourceMgr,
+			    inspectedKernels);
 
   // Parse the file to AST, registering our consumer as the AST consumer.
   ParseAST(TheCompInst.getPreprocessor(), &TheConsumer,
            TheCompInst.getASTContext());
+  TheCompInst.getDiagnosticClient().EndSourceFile();
+
+  // Default the macros to the parameters. The #line directive keeps the
+  // line numbers of the build logs those of the original source.
+  std::string prelude =
+    std::string("#ifndef ") + NUMGROUPSVALUE + "\n" +
+    "#define " + NUMGROUPSVALUE + " " + NUMGROUPSVAR + "\n" +
+    "#endif\n" +
+    "#ifndef " + SPLITDIMVALUE + "\n" +
+    "#define " + SPLITDIMVALUE + " " + SPLITDIMVAR + "\n" +
+    "#endif\n";
+
+  // Record the lowest and highest bytes of an access in the bounds of the
+  // work-group, see Footprint.h for the layout. An access the 32-bit bounds
+  // cannot hold, at a negative index or past 4 GiB, is recorded as
+  // [0, UINT_MAX] instead of being truncated.
+  if (inspectedKernels) {
+    prelude +=
+      std::string("long " RECORDFUNC "(__global unsigned int *footprint, "
+		  "unsigned int numArgs, unsigned int arg, unsigned int kind, "
+		  "long idx, unsigned int size) {\n"
+		  "  size_t group = get_group_id(0) + get_num_groups(0) * "
+		  "(get_group_id(1) + get_num_groups(1) * get_group_id(2));\n"
+		  "  __global unsigned int *bounds = footprint + "
+		  "((group * numArgs + arg) * 2 + kind) * 2;\n"
+		  "  if (idx < 0 || idx >= (long) (UINT_MAX / size)) {\n"
+		  "    atomic_min(bounds, 0u);\n"
+		  "    atomic_max(bounds + 1, UINT_MAX);\n"
+		  "  } else {\n"
+		  "    atomic_min(bounds, (unsigned int) (idx * size));\n"
+		  "    atomic_max(bounds + 1, "
+		  "(unsigned int) (idx * size + size - 1));\n"
+		  "  }\n"
+		  "  return idx;\n"
+		  "}\n");
+  }
+
+  prelude += "#line 1\n";
+  TheRewriter.InsertText(SourceMgr.getLocForStartOfFile(
+			   SourceMgr.getMainFileID()), prelude);
 
   // At this point the rewriter's buffer should be full with the rewritten
   // file contents.
@@ -354,10 +580,9 @@ int main(int argc, char *argv[]) {
       TheRewriter.getRewriteBufferFor(SourceMgr.getMainFileID());
 
   if (RewriteBuf)
-    llvm::outs() << std::string(RewriteBuf->begin(), RewriteBuf->end());
-  else
-    llvm::outs() << std::string(TheRewriter.getEditBuffer(SourceMgr.getMainFileID()).begin(),
-				TheRewriter.getEditBuffer(SourceMgr.getMainFileID()).end());
+    return std::string(RewriteBuf->begin(), RewriteBuf->end());
 
-  return 0;
+  const RewriteBuffer &EditBuf =
+    TheRewriter.getEditBuffer(SourceMgr.getMainFileID());
+  return std::string(EditBuf.begin(), EditBuf.end());
 }
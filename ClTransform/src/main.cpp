@@ -0,0 +1,34 @@
+#include "ClTransform.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: cltransform [-inspect] <options> <filename>\n";
+    return 1;
+  }
+
+  // -inspect: inspector variant, the inspected kernels are listed on stderr.
+  bool inspect = argc > 2 && std::string(argv[1]) == "-inspect";
+
+  std::ifstream in(argv[argc-1]);
+  if (!in) {
+    std::cerr << "Error: cannot open " << argv[argc-1] << "\n";
+    return 1;
+  }
+  std::stringstream source;
+  source << in.rdbuf();
+
+  std::vector<std::string> args(argv + (inspect ? 2 : 1), argv + argc - 1);
+  std::vector<std::string> inspectedKernels;
+  std::cout << clTransform(source.str(), args,
+			   inspect ? &inspectedKernels : NULL);
+  for (const std::string &name : inspectedKernels)
+    std::cerr << "inspected: " << name << "\n";
+
+  return 0;
+}
@@ -1,11 +1,16 @@
 #ifndef ARGUMENTANALYSIS_H
 #define ARGUMENTANALYSIS_H
 
+#include "Footprint.h"
 #include "Indirection.h"
 #include "ListInterval.h"
 #include "NDRange.h"
 #include "WorkItemExpr.h"
 
+#include <map>
+#include <set>
+
+class IndexExprArena;
 class IndexExprValue;
 
 class ArgumentAnalysis {
@@ -98,14 +103,47 @@ public:
 		    const std::vector<NDRange> *subNDRanges);
   void injectArgValues(const std::vector<IndexExprValue *> &argValues);
 
+  // Inject the new argument values only if the expressions depend on one of
+  // the changed arguments. If the bounds of the subkernels are a closed-form
+  // affine function of the changed arguments, they are shifted by the
+  // changes of the arguments and substituted is set to true, otherwise the
+  // regions have to be recomputed and true is returned. If checkRegions is
+  // true, the shifted regions are checked against a full recomputation.
+  bool updateArgValues(const std::vector<IndexExprValue *> &argValues,
+		       const std::vector<unsigned> &changedArgs,
+		       bool checkRegions, bool *substituted);
+  bool dependsOnArgs(const std::vector<unsigned> &args) const;
+  bool analysisIsUpToDate() const;
+  void invalidateAnalysis();
+  enum status getLastStatus() const;
+
   enum status performAnalysis(const std::vector< std::vector<IndirectionValue> > &
 			      subKernelIndirectionValues);
 
+  // Move the split boundaries of the current partition in dimension
+  // splitDim. Read and written regions of affine accesses are shifted by the
+  // number of work-groups each boundary moved. Return false if the argument
+  // has to be fully re-analysed. If checkRegions is true, the shifted
+  // regions are checked against a full recomputation.
+  bool movePartition(const std::vector<NDRange> *subNDRanges,
+		     unsigned splitDim, bool checkRegions);
+
+  // Share the expressions of the argument through the kernel arena. The
+  // bounds of shared expressions are then computed once per instantiation.
+  void intern(IndexExprArena *arena);
+
+  // Use the bytes recorded in footprint for the read and written regions
+  // when they cannot be bounded statically and the footprint was recorded
+  // for the current kernel NDRange. footprint is not owned, NULL to stop
+  // using it.
+  void setFootprint(const Footprint *footprint);
+  bool footprintUsed() const;
+
   unsigned getPos() const;
   TYPE getType() const;
   unsigned getSizeInBytes() const;
 
-  static ArgumentAnalysis *open(std::stringstream &s);
+  static ArgumentAnalysis *open(std::istream &s);
   static ArgumentAnalysis *openFromFile(const std::string &name);
 
   bool readBoundsComputed() const;
@@ -118,6 +156,14 @@ public:
 private:
   void computeRegions();
   void performDisjointTest();
+  void computeArgsDependencies();
+  bool computeSplitDimCoefs(unsigned splitDim);
+  void clearSplitDimCoefs();
+  bool substituteArgValues(const std::vector<IndexExprValue *> &argValues,
+			   const std::vector<unsigned> &changedArgs,
+			   bool checkRegions);
+  bool checkMovedBounds() const;
+  enum status computeStatus();
 
   unsigned nbSplit;
   unsigned pos;
@@ -148,6 +194,10 @@ private:
   std::vector<std::vector<IndexExpr *> > atomicMinSubKernelsExprs;
   std::vector<std::vector<IndexExpr *> > atomicMaxSubKernelsExprs;
 
+  // Bounds of each load and store subkernel expression before clamping.
+  std::vector<std::vector<std::pair<long, long> > > loadSubKernelsBounds;
+  std::vector<std::vector<std::pair<long, long> > > storeSubKernelsBounds;
+
   /* Regions */
   std::vector<ListInterval> readSubkernelsRegions;
   std::vector<ListInterval> writtenSubkernelsRegions;
@@ -165,6 +215,24 @@ private:
   bool mAtomicMaxBoundsComputed;
   bool areDisjoint;
   bool analysisHasBeenRun;
+  enum status lastStatus;
+
+  // Position of the kernel arguments the expressions depend on.
+  std::set<unsigned> argsDependencies;
+  // Values of the integer ones at the last injection.
+  std::map<unsigned, long> argLongValues;
+
+  // Coefficient of the split dimension work-group index for each load and
+  // store expression, computed for dimension splitDimCoefsDim (-1 if not
+  // computed).
+  std::vector<long> loadSplitDimCoefs;
+  std::vector<long> storeSplitDimCoefs;
+  int splitDimCoefsDim;
+
+  IndexExprArena *arena;
+
+  const Footprint *footprint;
+  bool mFootprintUsed; // Regions of the last analysis from the footprint
 };
 
 #endif /* ARGUMENTANALYSIS_H */
@@ -0,0 +1,51 @@
+#ifndef FOOTPRINT_H
+#define FOOTPRINT_H
+
+#include "ListInterval.h"
+#include "NDRange.h"
+
+#include <cstdint>
+#include <vector>
+
+// Bytes of the kernel arguments accessed by each work-group of an NDRange,
+// recorded at runtime by the inspector variant of the kernel (see
+// clTransform()). The bounds are laid out as in the footprint buffer of the
+// inspector: for each work-group, with the work-group ids in row-major order
+// from dimension 0, and for each kernel argument, the lowest and highest
+// bytes read then the lowest and highest bytes written. A lower bound greater
+// than the upper bound means no access. The bounds are 32-bit: an access at a
+// negative index or past 4 GiB is recorded with an upper bound of UINT32_MAX,
+// which no access to a buffer smaller than 4 GiB reaches.
+class Footprint {
+public:
+  // bounds is swapped with the footprint content.
+  Footprint(const NDRange &ndRange, unsigned numArgs,
+	    std::vector<uint32_t> &bounds);
+  ~Footprint();
+
+  // Number of bounds of the footprint buffer.
+  static size_t getNbBounds(const NDRange &ndRange, unsigned numArgs);
+  // Initial value of bound n of the footprint buffer.
+  static uint32_t getInitialBound(size_t n);
+
+  const NDRange &getNDRange() const;
+
+  // Return true if the footprint was recorded for ndRange.
+  bool matches(const NDRange &ndRange) const;
+
+  // Return true if an access could not be recorded in the bounds.
+  bool overflowed() const;
+
+  // Union of the bytes of argument pos read and written by the work-groups
+  // of subNDRange.
+  void getRegions(const NDRange &subNDRange, unsigned pos,
+		  ListInterval *readRegion,
+		  ListInterval *writtenRegion) const;
+
+private:
+  NDRange ndRange;
+  unsigned numArgs;
+  std::vector<uint32_t> bounds;
+};
+
+#endif /* FOOTPRINT_H */
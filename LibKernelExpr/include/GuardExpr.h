@@ -4,10 +4,12 @@
 #include "IndexExpr/IndexExprOCL.h"
 
 
+#include <set>
 #include <vector>
 #include <sstream>
 
 class IndexExpr;
+class IndexExprArena;
 class IndexExprValue;
 class NDRange;
 
@@ -35,13 +37,15 @@ public:
   unsigned getOclFunc() const;
   void injectArgsValues(const std::vector<IndexExprValue *> &values,
 			const NDRange &kernelNDRange);
+  void getArgsDependencies(std::set<unsigned> &args) const;
+  void intern(IndexExprArena *arena);
 
   void write(std::stringstream &s) const;
   void writeToFile(const std::string &name) const;
 
   void dump() const;
 
-  static GuardExpr *open(std::stringstream &s);
+  static GuardExpr *open(std::istream &s);
   static GuardExpr *openFromFile(const std::string &name);
 
 
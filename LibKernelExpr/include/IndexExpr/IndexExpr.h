@@ -2,12 +2,14 @@
 #define INDEXEXPR_H
 
 #include <fstream>
+#include <set>
 #include <sstream>
 #include <vector>
 
 class GuardExpr;
 class IndirectionValue;
 class IndexExprValue;
+class IndexExprArena;
 class NDRange;
 
 class IndexExpr {
@@ -48,17 +50,42 @@ public:
 
   tagTy getTag() const;
   unsigned getID() const;
+  bool isInArena() const;
+
+  // Delete expr unless it is owned by an IndexExprArena.
+  static void release(IndexExpr *expr);
 
   static bool computeBounds(const IndexExpr *expr, long *lb, long *hb);
 
   static void injectArgsValues(IndexExpr *expr,
 			       const std::vector<IndexExprValue *> &values);
+  // Insert in args the position of each kernel argument the expression
+  // depends on.
+  static void getArgsDependencies(const IndexExpr *expr,
+				  std::set<unsigned> &args);
+  // Get the coefficient of the work-group index of dimension splitDim in
+  // expr, nbOcc being the number of get_global_id(splitDim) and
+  // get_group_id(splitDim) in expr. Return false if the bounds of expr are
+  // not an affine function of the first and last work-group of the dimension.
+  static bool getSplitDimCoef(const IndexExpr *expr, unsigned splitDim,
+			      const NDRange &ndRange, long *coef,
+			      unsigned *nbOcc);
+  // Get the coefficient of the kernel argument at position pos in expr,
+  // nbOcc being its number of occurrences. The other arguments of
+  // changedArgs are variables too. Return false if the bounds of expr are
+  // not an affine function of the changed arguments, whose products are
+  // not affine either.
+  static bool getArgCoef(const IndexExpr *expr, unsigned pos,
+			 const std::vector<unsigned> &changedArgs,
+			 const NDRange &ndRange, long *coef, unsigned *nbOcc);
   static void injectIndirValues(IndexExpr *expr,
 				const std::vector<std::pair<IndexExprValue *,
 							    IndexExprValue *>>
 
 				  &values);
-  static IndexExpr *open(std::stringstream &s);
+  // Return NULL for a NIL expression, and with the failbit of s set for a
+  // malformed one.
+  static IndexExpr *open(std::istream &s);
   static IndexExpr *openFromFile(const std::string &name);
 
 
@@ -80,6 +107,10 @@ protected:
   unsigned id;
   static unsigned idIndex;
 
+  // Set when the node is shared through an IndexExprArena.
+  bool inArena;
+  friend class IndexExprArena;
+
   void writeNIL(std::stringstream &s) const;
 
 private:
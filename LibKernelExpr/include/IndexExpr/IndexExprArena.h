@@ -0,0 +1,53 @@
+#ifndef INDEXEXPRARENA_H
+#define INDEXEXPRARENA_H
+
+#include "IndexExpr.h"
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Hash-consing table for the expressions of a kernel. Structurally equal
+// nodes are shared and owned by the arena, which frees them all at once when
+// destroyed.
+//
+// The arena also memoizes the bounds of shared expressions for each
+// subkernel. The memoized bounds are only valid during a single
+// instantiation of the kernel and have to be cleared with clearBounds()
+// before the next one.
+class IndexExprArena {
+public:
+  IndexExprArena();
+  ~IndexExprArena();
+
+  // Return the node structurally equal to expr, expr being inserted in the
+  // arena if there is none. The children of expr are interned first, nodes
+  // of expr that are replaced by an existing node are deleted.
+  IndexExpr *intern(IndexExpr *expr);
+
+  bool getBounds(const IndexExpr *expr, unsigned subkernel,
+		 long *lb, long *hb);
+  void setBounds(const IndexExpr *expr, unsigned subkernel,
+		 long lb, long hb);
+  void clearBounds();
+
+  unsigned getNbNodes() const;
+  unsigned getNbSharedNodes() const;
+  unsigned getNbBoundsHits() const;
+
+private:
+  static bool getKey(const IndexExpr *expr, std::string *key);
+
+  std::unordered_map<std::string, IndexExpr *> nodes;
+  // Children are inserted before their parents.
+  std::vector<IndexExpr *> insertionOrder;
+  std::map<std::pair<const IndexExpr *, unsigned>,
+	   std::pair<long, long> > bounds;
+
+  unsigned nbSharedNodes;
+  unsigned nbBoundsHits;
+};
+
+#endif /* INDEXEXPRARENA_H */
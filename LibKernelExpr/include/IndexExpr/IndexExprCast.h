@@ -19,6 +19,7 @@ public:
 
   const IndexExpr *getExpr() const;
   IndexExpr *getExpr();
+  void setExpr(IndexExpr *expr);
 
   virtual void dump() const;
   virtual IndexExpr *clone() const;
@@ -20,6 +20,7 @@ public:
 
   const IndexExpr *getExpr() const;
   IndexExpr *getExpr();
+  void setExpr(IndexExpr *expr);
 
 private:
   IndexExpr *expr;
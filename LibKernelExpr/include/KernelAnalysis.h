@@ -2,16 +2,40 @@
 #define KERNELANALYSIS_H
 
 #include "ArgumentAnalysis.h"
+#include "Footprint.h"
+#include "IndexExpr/IndexExprArena.h"
 #include "Indirection.h"
 
 #include <map>
 #include <vector>
 
+// Static cost features of a kernel, per work-item. Instructions in a loop are
+// weighted by the constant trip counts of the loop and of its parents when
+// they are known.
+struct KernelFeatures {
+  KernelFeatures()
+    : nbArithOps(0), nbFloatOps(0), nbMemOps(0), globalBytes(0),
+      loopDepth(0), usesBarriers(false), usesLocalMemory(false),
+      usesWorkGroupIds(false) {}
+
+  double nbArithOps; // integer and floating point operations
+  double nbFloatOps; // floating point operations only
+  double nbMemOps; // loads and stores
+  double globalBytes; // bytes loaded or stored in global and constant memory
+  unsigned loopDepth; // maximum loop nest depth
+
+  // A kernel using none of these computes the same results whatever its
+  // local work size.
+  bool usesBarriers;
+  bool usesLocalMemory;
+  bool usesWorkGroupIds; // get_local_id, get_group_id, get_local_size...
+};
+
 class KernelAnalysis {
  public:
   KernelAnalysis(const char *name,
 		 unsigned numArgs,
-		 bool *scalarArgs,
+		 const std::vector<bool> &scalarArgs,
 		 std::vector<size_t> &scalarArgsSizes,
 		 std::vector<ArgumentAnalysis::TYPE> &scalarArgsTypes,
 		 std::vector<ArgumentAnalysis *> argsAnalysis,
@@ -32,10 +56,44 @@ class KernelAnalysis {
   unsigned getGlobalArgPos(unsigned i);
   unsigned getGlobalArgId(unsigned pos);
 
+  // Static cost features.
+  const KernelFeatures &getFeatures() const;
+  void setFeatures(const KernelFeatures &features);
+
+  // Footprint recorded at runtime by the inspector variant of the kernel,
+  // used for the arguments whose regions cannot be bounded statically. The
+  // analysis takes ownership of footprint, NULL drops the current one.
+  void setFootprint(Footprint *footprint);
+  const Footprint *getFootprint() const;
+  // Return true if the last performAnalysis() used the footprint.
+  bool footprintUsed() const;
+
   // Set the requested partition.
   void setPartition(const NDRange &kernelNDRange,
 		    const std::vector<NDRange> &subNDRanges,
 		    const std::vector<IndexExprValue *> &argValues);
+
+  // Inject new argument values while keeping the current partition. Only the
+  // arguments whose expressions depend on one of the changed arguments are
+  // updated, the regions of the others are kept by performAnalysis(). The
+  // regions of the arguments whose bounds are an affine function of the
+  // changed arguments are shifted, their number being returned in
+  // nbSubstituted, the other ones are re-instantiated. Return the number of
+  // global arguments re-instantiated.
+  unsigned updateArgValues(const std::vector<IndexExprValue *> &argValues,
+			   const std::vector<unsigned> &changedArgs,
+			   bool checkRegions, unsigned *nbSubstituted);
+
+  // Set a partition which differs from the current one only by the split
+  // boundaries in dimension splitDim, the kernel NDRange and the argument
+  // values being unchanged. Regions of affine arguments are shifted instead
+  // of being recomputed, the other arguments are fully re-instantiated.
+  // Return the number of global arguments updated incrementally.
+  unsigned movePartition(const std::vector<NDRange> &subNDRanges,
+			 unsigned splitDim,
+			 const std::vector<IndexExprValue *> &argValues,
+			 bool checkRegions);
+
   const NDRange &getKernelNDRange() const;
   const std::vector<NDRange> &getSubNDRanges() const;
 
@@ -93,11 +151,24 @@ class KernelAnalysis {
   getArgWrittenMergeRegion(unsigned argNo) const;
 
   // I/O
+  // An analysis starts with FORMAT_MAGIC and FORMAT_VERSION followed by the
+  // kernel analysis record. open() returns NULL if the header does not match
+  // or the analysis is malformed, FORMAT_VERSION has to be increased each
+  // time the format changes.
+  static const unsigned FORMAT_MAGIC = 0x4b4c4131; // "KLA1"
+  static const unsigned FORMAT_VERSION = 4;
+
   void write(std::stringstream &s) const;
   void writeToFile(const std::string &name) const;
-  static KernelAnalysis *open(std::stringstream &s);
+  static KernelAnalysis *open(std::istream &s);
+  // Open an analysis directly from memory, e.g. a mapped file, without
+  // copying it.
+  static KernelAnalysis *open(const char *data, size_t size);
   static KernelAnalysis *openFromFile(const std::string &name);
 
+  // Deep copy of the analysis, made through an in-memory record.
+  KernelAnalysis *clone() const;
+
   // Dump kernel analysis.
   void debug();
 
@@ -117,6 +188,11 @@ class KernelAnalysis {
 
   std::vector<unsigned> mergeArguments;
 
+  KernelFeatures features;
+
+  // Not part of the record.
+  Footprint *footprint;
+
   // Indirections regions to be read.
   std::vector<ArgIndirectionRegionExpr *> kernelIndirectionExprs;
   std::vector< std::vector<ArgIndirectionRegion *> > subKernelIndirectionRegions;
@@ -126,6 +202,10 @@ class KernelAnalysis {
   // Current partition
   NDRange *kernelNDRange;
   std::vector<NDRange> *subNDRanges;
+
+  // Expressions shared by the arguments and indirections, freed with the
+  // kernel analysis.
+  IndexExprArena *arena;
 };
 
 #endif /* KERNELANALYSIS_H */
@@ -35,6 +35,9 @@ public:
   void shiftLeft(unsigned dim, int nbWgs);
   void shiftRight(unsigned dim, int nbWgs);
 
+  // Return true if ndRange is identical except for dimension dimindx.
+  bool sameExceptDim(const NDRange &ndRange, unsigned dimindx) const;
+
   void dump() const;
 
 private:
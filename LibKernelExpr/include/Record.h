@@ -0,0 +1,75 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <cstdint>
+#include <istream>
+#include <sstream>
+#include <streambuf>
+
+// KernelAnalysis, ArgumentAnalysis, WorkItemExpr and GuardExpr are written
+// as records prefixed with their size in bytes, so that a truncated or
+// outdated analysis is detected when it is opened instead of being silently
+// misread.
+
+// Write record to s prefixed with its size.
+void writeRecord(std::stringstream &s, const std::stringstream &record);
+
+// The open() functions return NULL on a malformed record: a read past its
+// end or past the end of the stream sets the failbit of the stream, which
+// they check after each read. Counts and lengths are bounded by the bytes
+// left in the record before anything is allocated.
+
+// Read the size of the record starting at the current position of s and
+// return the position of its end. Set the failbit of s if the record does
+// not fit in the rest of the stream.
+std::streampos readRecordSize(std::istream &s);
+
+// Return the position of the end of s.
+std::streampos getStreamEnd(std::istream &s);
+
+// Read a count of elements of at least minSize bytes each which have to fit
+// between the current position of s and end. Set the failbit of s and
+// return false otherwise.
+bool readCount(std::istream &s, std::streampos end, size_t minSize,
+	       unsigned *count);
+
+// Return true if the record has been read up to its end, otherwise set the
+// failbit of s.
+bool checkRecordEnd(std::istream &s, std::streampos end);
+
+// Enumerators are written as 32-bit integers and bools as bytes. Read them
+// as such and convert them only if they are in range, otherwise set the
+// failbit of s and return false.
+template<typename E>
+bool
+readEnum(std::istream &s, E first, E last, E *value) {
+  static_assert(sizeof(E) == sizeof(uint32_t),
+		"enumerators are written as 32-bit integers");
+  uint32_t n;
+  s.read(reinterpret_cast<char *>(&n), sizeof(n));
+  if (!s.good())
+    return false;
+  if (n < static_cast<uint32_t>(first) || n > static_cast<uint32_t>(last)) {
+    s.setstate(std::ios_base::failbit);
+    return false;
+  }
+  *value = static_cast<E>(n);
+  return true;
+}
+
+bool readBool(std::istream &s, bool *value);
+
+// Read-only stream buffer over a memory area, used to parse an analysis
+// directly from a mapped file without first copying the file into a string.
+// The expressions are still built on the heap.
+class MemoryStreamBuf : public std::streambuf {
+public:
+  MemoryStreamBuf(const char *data, size_t size);
+
+protected:
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+			   std::ios_base::openmode which);
+  virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+};
+
+#endif /* RECORD_H */
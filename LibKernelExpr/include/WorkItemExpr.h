@@ -4,6 +4,7 @@
 #include "GuardExpr.h"
 #include "IndexExpr/IndexExpr.h"
 
+class IndexExprArena;
 class IndexExprValue;
 class IndirectionValue;
 
@@ -25,6 +26,24 @@ public:
 
   void injectArgsValues(const std::vector<IndexExprValue *> &values,
 			const NDRange &kernelNDRange);
+  void getArgsDependencies(std::set<unsigned> &args) const;
+  void intern(IndexExprArena *arena);
+
+  // Return the expression if it is shared through an arena and the subkernel
+  // bounds only depend on it, NULL otherwise.
+  const IndexExpr *getSharedExpr() const;
+
+  // Get the coefficient of the work-group index of dimension splitDim.
+  // Return false if the subkernel bounds are not an affine function of the
+  // subkernel first and last work-group in this dimension.
+  bool getSplitDimCoef(unsigned splitDim, const NDRange &kernelNDRange,
+		       long *coef) const;
+  // Get the coefficient of the kernel argument at position pos, the bounds
+  // of the subkernels moving by coef times its change. Return false if they
+  // are not an affine function of the arguments of changedArgs, or if a
+  // guard depends on them.
+  bool getArgCoef(unsigned pos, const std::vector<unsigned> &changedArgs,
+		  const NDRange &kernelNDRange, long *coef) const;
   IndexExpr *getKernelExpr(const NDRange &kernelNDRange,
 			   const std::vector<IndirectionValue> &
 			   indirValues) const;
@@ -35,7 +54,7 @@ public:
   void write(std::stringstream &s) const;
   void writeToFile(const std::string &name) const;
 
-  static WorkItemExpr *open(std::stringstream &s);
+  static WorkItemExpr *open(std::istream &s);
   static WorkItemExpr *openFromFile(const std::string &name);
 
 private:
@@ -1,7 +1,9 @@
 
 #include "ArgumentAnalysis.h"
 
+#include "IndexExpr/IndexExprArena.h"
 #include "IndexExpr/IndexExprs.h"
+#include "Record.h"
 
 #include <cassert>
 #include <cstdlib>
@@ -25,7 +27,9 @@ ArgumentAnalysis::ArgumentAnalysis(unsigned pos, TYPE type,
     mReadBoundsComputed(false), mWriteBoundsComputed(false),
     mOrBoundsComputed(false), mAtomicSumBoundsComputed(false),
     mAtomicMinBoundsComputed(false), mAtomicMaxBoundsComputed(false),
-    areDisjoint(false), analysisHasBeenRun(false)
+    areDisjoint(false), analysisHasBeenRun(false), lastStatus(SUCCESS),
+    splitDimCoefsDim(-1), arena(NULL), footprint(NULL),
+    mFootprintUsed(false)
 {
   loadWorkItemExprs = new std::vector<WorkItemExpr *>();
   storeWorkItemExprs = new std::vector<WorkItemExpr *>();
@@ -46,6 +50,8 @@ ArgumentAnalysis::ArgumentAnalysis(unsigned pos, TYPE type,
     atomicMinWorkItemExprs->push_back(atomicMinExprs[i]->clone());
   for (unsigned i=0; i<atomicMaxExprs.size(); i++)
     atomicMaxWorkItemExprs->push_back(atomicMaxExprs[i]->clone());
+
+  computeArgsDependencies();
 }
 
 ArgumentAnalysis::ArgumentAnalysis(unsigned pos, TYPE type,
@@ -65,8 +71,11 @@ ArgumentAnalysis::ArgumentAnalysis(unsigned pos, TYPE type,
     mReadBoundsComputed(false), mWriteBoundsComputed(false),
     mOrBoundsComputed(false), mAtomicSumBoundsComputed(false),
     mAtomicMinBoundsComputed(false), mAtomicMaxBoundsComputed(false),
-    areDisjoint(false), analysisHasBeenRun(false)
+    areDisjoint(false), analysisHasBeenRun(false), lastStatus(SUCCESS),
+    splitDimCoefsDim(-1), arena(NULL), footprint(NULL),
+    mFootprintUsed(false)
 {
+  computeArgsDependencies();
 }
 
 ArgumentAnalysis::~ArgumentAnalysis() {
@@ -358,6 +367,7 @@ ArgumentAnalysis:: setPartition(const NDRange *kernelNDRange,
   writtenMergeRegion.clear();
 
   analysisHasBeenRun = false;
+  splitDimCoefsDim = -1;
 }
 
 void
@@ -376,6 +386,174 @@ ArgumentAnalysis::injectArgValues(const std::vector<IndexExprValue *> &argValues
     (*atomicMinWorkItemExprs)[idx]->injectArgsValues(argValues, *kernelNDRange);
   for (unsigned idx=0; idx<atomicMaxWorkItemExprs->size(); idx++)
     (*atomicMaxWorkItemExprs)[idx]->injectArgsValues(argValues, *kernelNDRange);
+
+  argLongValues.clear();
+  for (unsigned p : argsDependencies) {
+    if (p < argValues.size() && argValues[p] &&
+	argValues[p]->type == IndexExpr::LONG)
+      argLongValues[p] = argValues[p]->getLongValue();
+  }
+
+  analysisHasBeenRun = false;
+  splitDimCoefsDim = -1;
+}
+
+bool
+ArgumentAnalysis::updateArgValues(const std::vector<IndexExprValue *> &
+				  argValues,
+				  const std::vector<unsigned> &changedArgs,
+				  bool checkRegions, bool *substituted) {
+  *substituted = false;
+  if (!dependsOnArgs(changedArgs))
+    return !analysisHasBeenRun;
+
+  if (substituteArgValues(argValues, changedArgs, checkRegions)) {
+    *substituted = true;
+    return false;
+  }
+
+  injectArgValues(argValues);
+  return true;
+}
+
+bool
+ArgumentAnalysis::substituteArgValues(const std::vector<IndexExprValue *> &
+				      argValues,
+				      const std::vector<unsigned> &changedArgs,
+				      bool checkRegions) {
+  // Only read and written regions are shifted.
+  if (!analysisHasBeenRun || mFootprintUsed ||
+      !mReadBoundsComputed || !mWriteBoundsComputed ||
+      isWrittenOr() || isWrittenAtomicSum() || isWrittenAtomicMin() ||
+      isWrittenAtomicMax())
+    return false;
+
+  // Every expression has to be inside the guards for every subkernel.
+  for (unsigned i=0; i<nbSplit; i++) {
+    if (loadSubKernelsExprs[i].size() != loadWorkItemExprs->size() ||
+	storeSubKernelsExprs[i].size() != storeWorkItemExprs->size())
+      return false;
+  }
+
+  // Shift of the bounds of each expression, the sum over the changed
+  // arguments of their coefficient times their change.
+  std::vector<long> loadShifts(loadWorkItemExprs->size(), 0);
+  std::vector<long> storeShifts(storeWorkItemExprs->size(), 0);
+  for (unsigned p : changedArgs) {
+    if (argsDependencies.find(p) == argsDependencies.end())
+      continue;
+
+    auto it = argLongValues.find(p);
+    if (it == argLongValues.end() || p >= argValues.size() ||
+	!argValues[p] || argValues[p]->type != IndexExpr::LONG)
+      return false;
+    long delta = argValues[p]->getLongValue() - it->second;
+
+    for (unsigned j=0; j<loadWorkItemExprs->size(); j++) {
+      long coef;
+      if (!(*loadWorkItemExprs)[j]->getArgCoef(p, changedArgs,
+					       *kernelNDRange, &coef))
+	return false;
+      loadShifts[j] += coef * delta;
+    }
+    for (unsigned j=0; j<storeWorkItemExprs->size(); j++) {
+      long coef;
+      if (!(*storeWorkItemExprs)[j]->getArgCoef(p, changedArgs,
+						*kernelNDRange, &coef))
+	return false;
+      storeShifts[j] += coef * delta;
+    }
+  }
+
+  injectArgValues(argValues);
+
+  for (unsigned i=0; i<nbSplit; i++) {
+    for (unsigned j=0; j<loadSubKernelsExprs[i].size(); j++) {
+      std::pair<long, long> &bounds = loadSubKernelsBounds[i][j];
+      bounds.first += loadShifts[j];
+      bounds.second += loadShifts[j];
+      delete loadSubKernelsExprs[i][j];
+      loadSubKernelsExprs[i][j] =
+	new IndexExprInterval(IndexExprValue::createLong(bounds.first),
+			      IndexExprValue::createLong(bounds.second));
+    }
+    for (unsigned j=0; j<storeSubKernelsExprs[i].size(); j++) {
+      std::pair<long, long> &bounds = storeSubKernelsBounds[i][j];
+      bounds.first += storeShifts[j];
+      bounds.second += storeShifts[j];
+      delete storeSubKernelsExprs[i][j];
+      storeSubKernelsExprs[i][j] =
+	new IndexExprInterval(IndexExprValue::createLong(bounds.first),
+			      IndexExprValue::createLong(bounds.second));
+    }
+  }
+
+  if (checkRegions && !checkMovedBounds()) {
+    std::cerr << "Error: arg " << pos << ": substituted regions differ from "
+	      << "full recomputation !\n";
+    exit(EXIT_FAILURE);
+  }
+
+  computeRegions();
+  computeStatus();
+  analysisHasBeenRun = true;
+
+  return true;
+}
+
+bool
+ArgumentAnalysis::dependsOnArgs(const std::vector<unsigned> &args) const {
+  for (unsigned i=0; i<args.size(); i++) {
+    if (argsDependencies.find(args[i]) != argsDependencies.end())
+      return true;
+  }
+
+  return false;
+}
+
+bool
+ArgumentAnalysis::analysisIsUpToDate() const {
+  return analysisHasBeenRun;
+}
+
+void
+ArgumentAnalysis::invalidateAnalysis() {
+  analysisHasBeenRun = false;
+}
+
+void
+ArgumentAnalysis::setFootprint(const Footprint *footprint) {
+  this->footprint = footprint;
+  invalidateAnalysis();
+}
+
+bool
+ArgumentAnalysis::footprintUsed() const {
+  return mFootprintUsed;
+}
+
+enum ArgumentAnalysis::status
+ArgumentAnalysis::getLastStatus() const {
+  assert(analysisHasBeenRun);
+  return lastStatus;
+}
+
+void
+ArgumentAnalysis::computeArgsDependencies() {
+  argsDependencies.clear();
+
+  for (unsigned idx=0; idx<loadWorkItemExprs->size(); idx++)
+    (*loadWorkItemExprs)[idx]->getArgsDependencies(argsDependencies);
+  for (unsigned idx=0; idx<storeWorkItemExprs->size(); idx++)
+    (*storeWorkItemExprs)[idx]->getArgsDependencies(argsDependencies);
+  for (unsigned idx=0; idx<orWorkItemExprs->size(); idx++)
+    (*orWorkItemExprs)[idx]->getArgsDependencies(argsDependencies);
+  for (unsigned idx=0; idx<atomicSumWorkItemExprs->size(); idx++)
+    (*atomicSumWorkItemExprs)[idx]->getArgsDependencies(argsDependencies);
+  for (unsigned idx=0; idx<atomicMinWorkItemExprs->size(); idx++)
+    (*atomicMinWorkItemExprs)[idx]->getArgsDependencies(argsDependencies);
+  for (unsigned idx=0; idx<atomicMaxWorkItemExprs->size(); idx++)
+    (*atomicMaxWorkItemExprs)[idx]->getArgsDependencies(argsDependencies);
 }
 
 enum ArgumentAnalysis::status
@@ -471,29 +649,62 @@ ArgumentAnalysis::performAnalysis(const
   }
 #endif
 
+  // Shared expression of each load and store subkernel expression, the
+  // bounds computed for them are memoized in the arena.
+  std::vector<std::vector<const IndexExpr *> > loadSharedExprs(nbSplit);
+  std::vector<std::vector<const IndexExpr *> > storeSharedExprs(nbSplit);
+
   // Build load subkernel expressions
   for (unsigned idx=0; idx<loadWorkItemExprs->size(); idx++) {
+    const IndexExpr *shared =
+      arena ? (*loadWorkItemExprs)[idx]->getSharedExpr() : NULL;
+
     for (unsigned i=0; i<nbSplit; ++i) {
+      long lb, hb;
+      if (shared && arena->getBounds(shared, i, &lb, &hb)) {
+	loadSubKernelsExprs[i].push_back(
+	  new IndexExprInterval(IndexExprValue::createLong(lb),
+				IndexExprValue::createLong(hb)));
+	loadSharedExprs[i].push_back(NULL);
+	continue;
+      }
+
       IndexExpr *subExpr =
 	(*loadWorkItemExprs)[idx]->getKernelExpr((*subNDRanges)[i],
 						 subKernelIndirectionValues[i]);
 
       // NULL if kernelexpr is out of guards
-      if (subExpr)
+      if (subExpr) {
 	loadSubKernelsExprs[i].push_back(subExpr);
+	loadSharedExprs[i].push_back(shared);
+      }
     }
   }
 
   // Build store subkernel expressions
   for (unsigned idx=0; idx<storeWorkItemExprs->size(); idx++) {
+    const IndexExpr *shared =
+      arena ? (*storeWorkItemExprs)[idx]->getSharedExpr() : NULL;
+
     for (unsigned i=0; i<nbSplit; ++i) {
+      long lb, hb;
+      if (shared && arena->getBounds(shared, i, &lb, &hb)) {
+	storeSubKernelsExprs[i].push_back(
+	  new IndexExprInterval(IndexExprValue::createLong(lb),
+				IndexExprValue::createLong(hb)));
+	storeSharedExprs[i].push_back(NULL);
+	continue;
+      }
+
       IndexExpr *subExpr =
 	(*storeWorkItemExprs)[idx]
 	->getKernelExpr((*subNDRanges)[i], subKernelIndirectionValues[i]);
 
       // NULL if kernelexpr is out of guards
-      if (subExpr)
+      if (subExpr) {
 	storeSubKernelsExprs[i].push_back(subExpr);
+	storeSharedExprs[i].push_back(shared);
+      }
     }
   }
 
@@ -552,6 +763,190 @@ ArgumentAnalysis::performAnalysis(const
   // Compute subkernels bounds
   computeRegions();
 
+  // Bytes the static analysis cannot bound are taken from the footprint.
+  mFootprintUsed = false;
+  if (footprint && (!mReadBoundsComputed || !mWriteBoundsComputed) &&
+      footprint->matches(*kernelNDRange)) {
+    for (unsigned i=0; i<nbSplit; ++i)
+      footprint->getRegions((*subNDRanges)[i], pos,
+			    &readSubkernelsRegions[i],
+			    &writtenSubkernelsRegions[i]);
+    mReadBoundsComputed = true;
+    mWriteBoundsComputed = true;
+    mFootprintUsed = true;
+  }
+
+  // Memoize the bounds of shared expressions for the other arguments.
+  for (unsigned i=0; i<loadSubKernelsBounds.size(); ++i) {
+    for (unsigned j=0; j<loadSubKernelsBounds[i].size(); ++j) {
+      if (loadSharedExprs[i][j])
+	arena->setBounds(loadSharedExprs[i][j], i,
+			 loadSubKernelsBounds[i][j].first,
+			 loadSubKernelsBounds[i][j].second);
+    }
+  }
+  for (unsigned i=0; i<storeSubKernelsBounds.size(); ++i) {
+    for (unsigned j=0; j<storeSubKernelsBounds[i].size(); ++j) {
+      if (storeSharedExprs[i][j])
+	arena->setBounds(storeSharedExprs[i][j], i,
+			 storeSubKernelsBounds[i][j].first,
+			 storeSubKernelsBounds[i][j].second);
+    }
+  }
+
+  return computeStatus();
+}
+
+static void shiftBounds(std::pair<long, long> *bounds, long coef,
+			long lbShift, long hbShift) {
+  if (coef >= 0) {
+    bounds->first += coef * lbShift;
+    bounds->second += coef * hbShift;
+  } else {
+    bounds->first += coef * hbShift;
+    bounds->second += coef * lbShift;
+  }
+}
+
+bool
+ArgumentAnalysis::movePartition(const std::vector<NDRange> *subNDRanges,
+				unsigned splitDim, bool checkRegions) {
+  assert(subNDRanges->size() == nbSplit);
+
+  // Only read and written regions are shifted.
+  if (!analysisHasBeenRun || mFootprintUsed ||
+      !mReadBoundsComputed || !mWriteBoundsComputed ||
+      isWrittenOr() || isWrittenAtomicSum() || isWrittenAtomicMin() ||
+      isWrittenAtomicMax())
+    return false;
+
+  // Every expression has to be inside the guards for every subkernel.
+  for (unsigned i=0; i<nbSplit; i++) {
+    if (loadSubKernelsExprs[i].size() != loadWorkItemExprs->size() ||
+	storeSubKernelsExprs[i].size() != storeWorkItemExprs->size())
+      return false;
+  }
+
+  if (!computeSplitDimCoefs(splitDim))
+    return false;
+
+  for (unsigned i=0; i<nbSplit; i++) {
+    const NDRange &oldRange = (*this->subNDRanges)[i];
+    const NDRange &newRange = (*subNDRanges)[i];
+    long localSize = newRange.get_local_size(splitDim);
+    long oldLb = oldRange.getOffset(splitDim);
+    long oldHb = oldLb + oldRange.get_global_size(splitDim);
+    long newLb = newRange.getOffset(splitDim);
+    long newHb = newLb + newRange.get_global_size(splitDim);
+    long lbShift = (newLb - oldLb) / localSize;
+    long hbShift = (newHb - oldHb) / localSize;
+
+    for (unsigned j=0; j<loadSubKernelsExprs[i].size(); j++) {
+      std::pair<long, long> &bounds = loadSubKernelsBounds[i][j];
+      shiftBounds(&bounds, loadSplitDimCoefs[j], lbShift, hbShift);
+      delete loadSubKernelsExprs[i][j];
+      loadSubKernelsExprs[i][j] =
+	new IndexExprInterval(IndexExprValue::createLong(bounds.first),
+			      IndexExprValue::createLong(bounds.second));
+    }
+    for (unsigned j=0; j<storeSubKernelsExprs[i].size(); j++) {
+      std::pair<long, long> &bounds = storeSubKernelsBounds[i][j];
+      shiftBounds(&bounds, storeSplitDimCoefs[j], lbShift, hbShift);
+      delete storeSubKernelsExprs[i][j];
+      storeSubKernelsExprs[i][j] =
+	new IndexExprInterval(IndexExprValue::createLong(bounds.first),
+			      IndexExprValue::createLong(bounds.second));
+    }
+  }
+
+  this->subNDRanges = subNDRanges;
+
+  if (checkRegions && !checkMovedBounds()) {
+    std::cerr << "Error: arg " << pos << ": incremental regions differ from "
+	      << "full recomputation !\n";
+    exit(EXIT_FAILURE);
+  }
+
+  computeRegions();
+  computeStatus();
+  analysisHasBeenRun = true;
+
+  return true;
+}
+
+bool
+ArgumentAnalysis::computeSplitDimCoefs(unsigned splitDim) {
+  if (splitDimCoefsDim == (int) splitDim)
+    return true;
+
+  // Coefficients of another dimension are not valid anymore.
+  clearSplitDimCoefs();
+
+  loadSplitDimCoefs.resize(loadWorkItemExprs->size());
+  storeSplitDimCoefs.resize(storeWorkItemExprs->size());
+
+  for (unsigned idx=0; idx<loadWorkItemExprs->size(); idx++) {
+    if (!(*loadWorkItemExprs)[idx]->getSplitDimCoef(splitDim, *kernelNDRange,
+						    &loadSplitDimCoefs[idx])) {
+      clearSplitDimCoefs();
+      return false;
+    }
+  }
+  for (unsigned idx=0; idx<storeWorkItemExprs->size(); idx++) {
+    if (!(*storeWorkItemExprs)[idx]->getSplitDimCoef(splitDim, *kernelNDRange,
+						     &storeSplitDimCoefs[idx])) {
+      clearSplitDimCoefs();
+      return false;
+    }
+  }
+
+  splitDimCoefsDim = splitDim;
+  return true;
+}
+
+void
+ArgumentAnalysis::clearSplitDimCoefs() {
+  loadSplitDimCoefs.clear();
+  storeSplitDimCoefs.clear();
+  splitDimCoefsDim = -1;
+}
+
+bool
+ArgumentAnalysis::checkMovedBounds() const {
+  std::vector<IndirectionValue> indirValues;
+
+  for (unsigned i=0; i<nbSplit; i++) {
+    for (unsigned j=0; j<loadWorkItemExprs->size(); j++) {
+      IndexExpr *subExpr =
+	(*loadWorkItemExprs)[j]->getKernelExpr((*subNDRanges)[i],
+					       indirValues);
+      long lb, hb;
+      bool ok = subExpr && IndexExpr::computeBounds(subExpr, &lb, &hb) &&
+	lb == loadSubKernelsBounds[i][j].first &&
+	hb == loadSubKernelsBounds[i][j].second;
+      delete subExpr;
+      if (!ok)
+	return false;
+    }
+    for (unsigned j=0; j<storeWorkItemExprs->size(); j++) {
+      IndexExpr *subExpr =
+	(*storeWorkItemExprs)[j]->getKernelExpr((*subNDRanges)[i],
+						indirValues);
+      long lb, hb;
+      bool ok = subExpr && IndexExpr::computeBounds(subExpr, &lb, &hb) &&
+	lb == storeSubKernelsBounds[i][j].first &&
+	hb == storeSubKernelsBounds[i][j].second;
+      delete subExpr;
+      if (!ok)
+	return false;
+    }
+  }
+
+  return true;
+}
+
+enum ArgumentAnalysis::status
+ArgumentAnalysis::computeStatus() {
   // AtomicSum bounds can be undefined.
 
   // If written bounds are not computed return FAIL
@@ -559,17 +954,20 @@ ArgumentAnalysis::performAnalysis(const
       (isWrittenAtomicMin() && !mAtomicMinBoundsComputed) ||
       (isWrittenAtomicMax() && !mAtomicMaxBoundsComputed) ||
       (isWritten() && !mWriteBoundsComputed)) {
-    return ArgumentAnalysis::FAIL;
+    lastStatus = ArgumentAnalysis::FAIL;
+    return lastStatus;
   }
 
   // Find out if subkernels region are disjoint
   performDisjointTest();
 
   if (!areDisjoint) {
-    return ArgumentAnalysis::MERGE;
+    lastStatus = ArgumentAnalysis::MERGE;
+    return lastStatus;
   }
 
-  return ArgumentAnalysis::SUCCESS;
+  lastStatus = ArgumentAnalysis::SUCCESS;
+  return lastStatus;
 }
 
 bool
@@ -604,11 +1002,15 @@ ArgumentAnalysis::isWrittenAtomicMax() const {
 
 bool
 ArgumentAnalysis::isReadBySubkernel(unsigned i) const {
+  if (mFootprintUsed)
+    return !readSubkernelsRegions[i].mList.empty();
   return loadSubKernelsExprs[i].size() > 0;
 }
 
 bool
 ArgumentAnalysis::isWrittenBySubkernel(unsigned i) const {
+  if (mFootprintUsed)
+    return !writtenSubkernelsRegions[i].mList.empty();
   return storeSubKernelsExprs[i].size() > 0;
 }
 
@@ -664,33 +1066,41 @@ ArgumentAnalysis::getNumAtomicMax() const {
 
 void
 ArgumentAnalysis::write(std::stringstream &s) const {
-  s.write(reinterpret_cast<const char*>(&pos), sizeof(pos));
-  s.write(reinterpret_cast<const char*>(&type), sizeof(type));
-  s.write(reinterpret_cast<const char *>(&sizeInBytes), sizeof(sizeInBytes));
+  std::stringstream record;
+
+  record.write(reinterpret_cast<const char*>(&pos), sizeof(pos));
+  record.write(reinterpret_cast<const char*>(&type), sizeof(type));
+  record.write(reinterpret_cast<const char *>(&sizeInBytes),
+	       sizeof(sizeInBytes));
   unsigned nbLoad = loadWorkItemExprs->size();
-  s.write(reinterpret_cast<const char*>(&nbLoad), sizeof(nbLoad));
+  record.write(reinterpret_cast<const char*>(&nbLoad), sizeof(nbLoad));
   for (unsigned i=0; i<nbLoad; ++i)
-    (*loadWorkItemExprs)[i]->write(s);
+    (*loadWorkItemExprs)[i]->write(record);
   unsigned nbStore = storeWorkItemExprs->size();
-  s.write(reinterpret_cast<const char*>(&nbStore), sizeof(nbStore));
+  record.write(reinterpret_cast<const char*>(&nbStore), sizeof(nbStore));
   for (unsigned i=0; i<nbStore; ++i)
-    (*storeWorkItemExprs)[i]->write(s);
+    (*storeWorkItemExprs)[i]->write(record);
   unsigned nbOr = orWorkItemExprs->size();
-  s.write(reinterpret_cast<const char*>(&nbOr), sizeof(nbOr));
+  record.write(reinterpret_cast<const char*>(&nbOr), sizeof(nbOr));
   for (unsigned i=0; i<nbOr; ++i)
-    (*orWorkItemExprs)[i]->write(s);
+    (*orWorkItemExprs)[i]->write(record);
   unsigned nbAtomicSum = atomicSumWorkItemExprs->size();
-  s.write(reinterpret_cast<const char*>(&nbAtomicSum), sizeof(nbAtomicSum));
+  record.write(reinterpret_cast<const char*>(&nbAtomicSum),
+	       sizeof(nbAtomicSum));
   for (unsigned i=0; i<nbAtomicSum; ++i)
-    (*atomicSumWorkItemExprs)[i]->write(s);
+    (*atomicSumWorkItemExprs)[i]->write(record);
   unsigned nbAtomicMin = atomicMinWorkItemExprs->size();
-  s.write(reinterpret_cast<const char*>(&nbAtomicMin), sizeof(nbAtomicMin));
+  record.write(reinterpret_cast<const char*>(&nbAtomicMin),
+	       sizeof(nbAtomicMin));
   for (unsigned i=0; i<nbAtomicMin; ++i)
-    (*atomicMinWorkItemExprs)[i]->write(s);
+    (*atomicMinWorkItemExprs)[i]->write(record);
   unsigned nbAtomicMax = atomicMaxWorkItemExprs->size();
-  s.write(reinterpret_cast<const char*>(&nbAtomicMax), sizeof(nbAtomicMax));
+  record.write(reinterpret_cast<const char*>(&nbAtomicMax),
+	       sizeof(nbAtomicMax));
   for (unsigned i=0; i<nbAtomicMax; ++i)
-    (*atomicMaxWorkItemExprs)[i]->write(s);
+    (*atomicMaxWorkItemExprs)[i]->write(record);
+
+  writeRecord(s, record);
 }
 
 void
@@ -698,73 +1108,99 @@ ArgumentAnalysis::writeToFile(const std::string &name) const {
   std::ofstream out(name.c_str(), std::ofstream::trunc | std::ofstream::binary);
   std::stringstream ss;
   write(ss);
-  out << ss;
+  out << ss.rdbuf();
   out.close();
 }
 
+// Read a count of work-item expressions followed by them into a new vector,
+// NULL if the record is malformed.
+static std::vector<WorkItemExpr *> *
+openWorkItemExprs(std::istream &s, std::streampos end) {
+  // Each work-item expression is a record prefixed with its size.
+  unsigned nbExprs;
+  if (!readCount(s, end, sizeof(uint64_t), &nbExprs))
+    return NULL;
+
+  std::vector<WorkItemExpr *> *exprs = new std::vector<WorkItemExpr *>();
+  for (unsigned i=0; i<nbExprs; ++i) {
+    WorkItemExpr *expr = WorkItemExpr::open(s);
+    if (!expr) {
+      for (unsigned j=0; j<exprs->size(); ++j)
+	delete (*exprs)[j];
+      delete exprs;
+      return NULL;
+    }
+    exprs->push_back(expr);
+  }
+
+  return exprs;
+}
+
 ArgumentAnalysis *
-ArgumentAnalysis::open(std::stringstream &s) {
+ArgumentAnalysis::open(std::istream &s) {
+  std::streampos end = readRecordSize(s);
+  if (!s.good())
+    return NULL;
+
   unsigned pos;
   s.read(reinterpret_cast<char *>(&pos), sizeof(pos));
+  if (!s.good())
+    return NULL;
   TYPE type;
-  s.read(reinterpret_cast<char *>(&type), sizeof(type));
+  if (!readEnum(s, BOOL, UNKNOWN, &type))
+    return NULL;
   unsigned sizeInBytes;
   s.read(reinterpret_cast<char *>(&sizeInBytes), sizeof(sizeInBytes));
+  if (!s.good())
+    return NULL;
+
+  // Load, store, or, atomic sum, atomic min and atomic max expressions.
+  const unsigned nbKinds = 6;
+  std::vector<WorkItemExpr *> *exprs[nbKinds];
+  unsigned nbRead = 0;
+  while (nbRead < nbKinds) {
+    exprs[nbRead] = openWorkItemExprs(s, end);
+    if (!exprs[nbRead])
+      break;
+    nbRead++;
+  }
 
-  unsigned nbLoad;
-  s.read(reinterpret_cast<char *>(&nbLoad), sizeof(nbLoad));
-  std::vector<WorkItemExpr *> *loadExprs =
-    new std::vector<WorkItemExpr *>();
-  for (unsigned i=0; i<nbLoad; ++i)
-    loadExprs->push_back(WorkItemExpr::open(s));
-
-  unsigned nbStore;
-  s.read(reinterpret_cast<char *>(&nbStore), sizeof(nbStore));
-  std::vector<WorkItemExpr *> *storeExprs =
-    new std::vector<WorkItemExpr *>();
-  for (unsigned i=0; i<nbStore; ++i)
-    storeExprs->push_back(WorkItemExpr::open(s));
-
-  unsigned nbOr;
-  s.read(reinterpret_cast<char *>(&nbOr), sizeof(nbOr));
-  std::vector<WorkItemExpr *> *orExprs =
-    new std::vector<WorkItemExpr *>();
-  for (unsigned i=0; i<nbOr; ++i)
-    orExprs->push_back(WorkItemExpr::open(s));
-
-  unsigned nbAtomicSum;
-  s.read(reinterpret_cast<char *>(&nbAtomicSum), sizeof(nbAtomicSum));
-  std::vector<WorkItemExpr *> *atomicSumExprs =
-    new std::vector<WorkItemExpr *>();
-  for (unsigned i=0; i<nbAtomicSum; ++i)
-    atomicSumExprs->push_back(WorkItemExpr::open(s));
-
-  unsigned nbAtomicMin;
-  s.read(reinterpret_cast<char *>(&nbAtomicMin), sizeof(nbAtomicMin));
-  std::vector<WorkItemExpr *> *atomicMinExprs =
-    new std::vector<WorkItemExpr *>();
-  for (unsigned i=0; i<nbAtomicMin; ++i)
-    atomicMinExprs->push_back(WorkItemExpr::open(s));
-
-  unsigned nbAtomicMax;
-  s.read(reinterpret_cast<char *>(&nbAtomicMax), sizeof(nbAtomicMax));
-  std::vector<WorkItemExpr *> *atomicMaxExprs =
-    new std::vector<WorkItemExpr *>();
-  for (unsigned i=0; i<nbAtomicMax; ++i)
-    atomicMaxExprs->push_back(WorkItemExpr::open(s));
+  if (nbRead < nbKinds || !checkRecordEnd(s, end)) {
+    for (unsigned k=0; k<nbRead; k++) {
+      for (unsigned i=0; i<exprs[k]->size(); ++i)
+	delete (*exprs[k])[i];
+      delete exprs[k];
+    }
+    return NULL;
+  }
 
   return new ArgumentAnalysis(pos, type, sizeInBytes,
-			      loadExprs, storeExprs, orExprs,
-			      atomicSumExprs, atomicMinExprs, atomicMaxExprs);
+			      exprs[0], exprs[1], exprs[2],
+			      exprs[3], exprs[4], exprs[5]);
 }
 
 ArgumentAnalysis *
 ArgumentAnalysis::openFromFile(const std::string &name) {
   std::ifstream in(name.c_str(), std::ifstream::binary);
-  std::stringstream ss;
-  ss << in.rdbuf();
-  in.close();
-  return open(ss);
+  return open(in);
+}
+
+void
+ArgumentAnalysis::intern(IndexExprArena *arena) {
+  this->arena = arena;
+
+  for (unsigned idx=0; idx<loadWorkItemExprs->size(); idx++)
+    (*loadWorkItemExprs)[idx]->intern(arena);
+  for (unsigned idx=0; idx<storeWorkItemExprs->size(); idx++)
+    (*storeWorkItemExprs)[idx]->intern(arena);
+  for (unsigned idx=0; idx<orWorkItemExprs->size(); idx++)
+    (*orWorkItemExprs)[idx]->intern(arena);
+  for (unsigned idx=0; idx<atomicSumWorkItemExprs->size(); idx++)
+    (*atomicSumWorkItemExprs)[idx]->intern(arena);
+  for (unsigned idx=0; idx<atomicMinWorkItemExprs->size(); idx++)
+    (*atomicMinWorkItemExprs)[idx]->intern(arena);
+  for (unsigned idx=0; idx<atomicMaxWorkItemExprs->size(); idx++)
+    (*atomicMaxWorkItemExprs)[idx]->intern(arena);
 }
 
 unsigned
@@ -886,6 +1322,11 @@ ArgumentAnalysis::computeRegions() {
   mAtomicMinBoundsComputed = true;
   mAtomicMaxBoundsComputed = true;
 
+  loadSubKernelsBounds.clear();
+  loadSubKernelsBounds.resize(loadSubKernelsExprs.size());
+  storeSubKernelsBounds.clear();
+  storeSubKernelsBounds.resize(storeSubKernelsExprs.size());
+
   // Compute read subkernels regions
   for (unsigned i=0; i<loadSubKernelsExprs.size(); ++i) {
     readSubkernelsRegions[i].clear();
@@ -897,6 +1338,8 @@ ArgumentAnalysis::computeRegions() {
 	break;
       }
 
+      loadSubKernelsBounds[i].push_back(std::make_pair(lb, hb));
+
       lb = lb < 0 ? 0 : lb;
       hb = hb < 0 ? 0 : hb;
       assert(lb <= hb);
@@ -916,6 +1359,8 @@ ArgumentAnalysis::computeRegions() {
 	break;
       }
 
+      storeSubKernelsBounds[i].push_back(std::make_pair(lb, hb));
+
       lb = lb < 0 ? 0 : lb;
       hb = hb < 0 ? 0 : hb;
       assert(lb <= hb);
@@ -0,0 +1,112 @@
+#include "Footprint.h"
+
+#include <algorithm>
+#include <cassert>
+
+Footprint::Footprint(const NDRange &ndRange, unsigned numArgs,
+		     std::vector<uint32_t> &bounds)
+  : ndRange(ndRange), numArgs(numArgs) {
+  assert(bounds.size() == getNbBounds(ndRange, numArgs));
+  this->bounds.swap(bounds);
+}
+
+Footprint::~Footprint() {}
+
+size_t
+Footprint::getNbBounds(const NDRange &ndRange, unsigned numArgs) {
+  size_t nbGroups = 1;
+  for (unsigned i=0; i<ndRange.get_work_dim(); i++)
+    nbGroups *= ndRange.get_global_size(i) / ndRange.get_local_size(i);
+  return nbGroups * numArgs * 4;
+}
+
+uint32_t
+Footprint::getInitialBound(size_t n) {
+  return n % 2 == 0 ? UINT32_MAX : 0;
+}
+
+const NDRange &
+Footprint::getNDRange() const {
+  return ndRange;
+}
+
+bool
+Footprint::matches(const NDRange &ndRange) const {
+  if (ndRange.get_work_dim() != this->ndRange.get_work_dim())
+    return false;
+
+  for (unsigned i=0; i<ndRange.get_work_dim(); i++) {
+    if (ndRange.get_global_size(i) != this->ndRange.get_global_size(i) ||
+	ndRange.get_local_size(i) != this->ndRange.get_local_size(i) ||
+	ndRange.getOffset(i) != this->ndRange.getOffset(i))
+      return false;
+  }
+
+  return true;
+}
+
+bool
+Footprint::overflowed() const {
+  for (size_t n=1; n<bounds.size(); n+=2) {
+    if (bounds[n] == UINT32_MAX)
+      return true;
+  }
+  return false;
+}
+
+// Sort and merge intervals into region.
+static void
+mergeIntervals(std::vector<Interval> &intervals, ListInterval *region) {
+  region->clear();
+  if (intervals.empty())
+    return;
+
+  std::sort(intervals.begin(), intervals.end(),
+	    [](const Interval &a, const Interval &b) { return a.lb < b.lb; });
+
+  region->mList.push_back(intervals[0]);
+  for (unsigned i=1; i<intervals.size(); i++) {
+    Interval &top = region->mList.back();
+    if (top.hb + 1 < intervals[i].lb)
+      region->mList.push_back(intervals[i]);
+    else if (top.hb < intervals[i].hb)
+      top.hb = intervals[i].hb;
+  }
+}
+
+void
+Footprint::getRegions(const NDRange &subNDRange, unsigned pos,
+		      ListInterval *readRegion,
+		      ListInterval *writtenRegion) const {
+  assert(pos < numArgs);
+
+  // Work-groups of subNDRange in each dimension.
+  size_t numGroups[3] = {1, 1, 1};
+  size_t firstGroup[3] = {0, 0, 0};
+  size_t lastGroup[3] = {1, 1, 1};
+  for (unsigned i=0; i<ndRange.get_work_dim(); i++) {
+    size_t localSize = ndRange.get_local_size(i);
+    numGroups[i] = ndRange.get_global_size(i) / localSize;
+    firstGroup[i] = (subNDRange.getOffset(i) - ndRange.getOffset(i)) /
+      localSize;
+    lastGroup[i] = firstGroup[i] + subNDRange.get_global_size(i) / localSize;
+    assert(lastGroup[i] <= numGroups[i]);
+  }
+
+  std::vector<Interval> reads, writes;
+  for (size_t z=firstGroup[2]; z<lastGroup[2]; z++) {
+    for (size_t y=firstGroup[1]; y<lastGroup[1]; y++) {
+      for (size_t x=firstGroup[0]; x<lastGroup[0]; x++) {
+	size_t group = x + numGroups[0] * (y + numGroups[1] * z);
+	const uint32_t *b = &bounds[(group * numArgs + pos) * 4];
+	if (b[0] <= b[1])
+	  reads.push_back(Interval(b[0], b[1]));
+	if (b[2] <= b[3])
+	  writes.push_back(Interval(b[2], b[3]));
+      }
+    }
+  }
+
+  mergeIntervals(reads, readRegion);
+  mergeIntervals(writes, writtenRegion);
+}
@@ -1,9 +1,11 @@
 #include "GuardExpr.h"
 
+#include "IndexExpr/IndexExprArena.h"
 #include "IndexExpr/IndexExprOCL.h"
 #include "IndexExpr/IndexExprValue.h"
 #include "Indirection.h"
 #include "NDRange.h"
+#include "Record.h"
 
 #include <iostream>
 
@@ -43,7 +45,7 @@ GuardExpr::GuardExpr(IndexExprOCL::OpenclFunction oclFunc,
 }
 
 GuardExpr::~GuardExpr() {
-  delete mExpr;
+  IndexExpr::release(mExpr);
 }
 
 long
@@ -147,12 +149,26 @@ GuardExpr::injectArgsValues(const std::vector<IndexExprValue *> &values,
   delete kernelExpr;
 }
 
+void
+GuardExpr::getArgsDependencies(std::set<unsigned> &args) const {
+  IndexExpr::getArgsDependencies(mExpr, args);
+}
+
+void
+GuardExpr::intern(IndexExprArena *arena) {
+  mExpr = arena->intern(mExpr);
+}
+
 void
 GuardExpr::write(std::stringstream &s) const {
-  s.write(reinterpret_cast<const char *>(&mOclFunc), sizeof(mOclFunc));
-  s.write(reinterpret_cast<const char *>(&mDim), sizeof(mDim));
-  s.write(reinterpret_cast<const char *>(&mPred),sizeof(mPred));
-  mExpr->write(s);
+  std::stringstream record;
+
+  record.write(reinterpret_cast<const char *>(&mOclFunc), sizeof(mOclFunc));
+  record.write(reinterpret_cast<const char *>(&mDim), sizeof(mDim));
+  record.write(reinterpret_cast<const char *>(&mPred),sizeof(mPred));
+  mExpr->write(record);
+
+  writeRecord(s, record);
 }
 
 void
@@ -160,29 +176,39 @@ GuardExpr::writeToFile(const std::string &name) const {
   std::ofstream out(name.c_str(), std::ofstream::trunc | std::ofstream::binary);
   std::stringstream ss;
   write(ss);
-  out << ss;
+  out << ss.rdbuf();
   out.close();
 }
 
 GuardExpr *
-GuardExpr::open(std::stringstream &s) {
+GuardExpr::open(std::istream &s) {
+  std::streampos end = readRecordSize(s);
+  if (!s.good())
+    return NULL;
+
   IndexExprOCL::OpenclFunction oclFunc;
-  s.read(reinterpret_cast<char *>(&oclFunc), sizeof(oclFunc));
+  if (!readEnum(s, IndexExprOCL::GET_GLOBAL_ID, IndexExprOCL::GET_NUM_GROUPS,
+		&oclFunc))
+    return NULL;
   unsigned dim;
   s.read(reinterpret_cast<char *>(&dim), sizeof(dim));
+  if (!s.good())
+    return NULL;
   predicate pred;
-  s.read(reinterpret_cast<char *>(&pred), sizeof(pred));
+  if (!readEnum(s, LT, NEQ, &pred))
+    return NULL;
   IndexExpr *expr = IndexExpr::open(s);
 
+  if (!checkRecordEnd(s, end)) {
+    IndexExpr::release(expr);
+    return NULL;
+  }
+
   return new GuardExpr(oclFunc, dim, pred, true, expr);
 }
 
 GuardExpr *
 GuardExpr::openFromFile(const std::string &name) {
   std::ifstream in(name.c_str(), std::ifstream::binary);
-  std::stringstream ss;
-  ss << in.rdbuf();
-  in.close();
-  GuardExpr *ret = open(ss);
-  return ret;
+  return open(in);
 }
@@ -11,6 +11,9 @@
 #include "IndexExpr/IndexExprMax.h"
 #include "IndexExpr/IndexExprOCL.h"
 #include "IndexExpr/IndexExprUnknown.h"
+#include "Indirection.h"
+#include "NDRange.h"
+#include "Record.h"
 
 #include <cassert>
 #include <cmath>
@@ -23,7 +26,7 @@ unsigned IndexExpr::idIndex = 0;
 #define MIN(A,B) ((A) < (B) ? (A) : (B))
 
 IndexExpr::IndexExpr(tagTy tag)
-  : tag(tag), id(idIndex++) {}
+  : tag(tag), id(idIndex++), inArena(false) {}
 
 IndexExpr::~IndexExpr() {}
 
@@ -44,6 +47,17 @@ IndexExpr::getID() const {
   return id;
 }
 
+bool
+IndexExpr::isInArena() const {
+  return inArena;
+}
+
+void
+IndexExpr::release(IndexExpr *expr) {
+  if (expr && !expr->inArena)
+    delete expr;
+}
+
 void
 IndexExpr::toDot(std::string filename) const {
   std::ofstream out;
@@ -121,14 +135,35 @@ IndexExpr::writeToFile(const std::string &name) const {
   std::ofstream out(name.c_str(), std::ofstream::trunc | std::ofstream::binary);
   std::stringstream ss;
   write(ss);
-  out << ss;
+  out << ss.rdbuf();
   out.close();
 }
 
+// Read the operands of a MIN or MAX expression.
+static bool
+openOperands(std::istream &s, std::vector<IndexExpr *> *exprs) {
+  unsigned numOperands;
+  if (!readCount(s, getStreamEnd(s), sizeof(IndexExpr::tagTy), &numOperands))
+    return false;
+  for (unsigned i=0; i<numOperands; i++) {
+    exprs->push_back(IndexExpr::open(s));
+    if (!s.good())
+      break;
+  }
+  if (!s.good()) {
+    for (IndexExpr *expr : *exprs)
+      IndexExpr::release(expr);
+    return false;
+  }
+  return true;
+}
+
 IndexExpr *
-IndexExpr::open(std::stringstream &s) {
+IndexExpr::open(std::istream &s) {
   tagTy file_tag;
-  s.read(reinterpret_cast<char *>(&file_tag), sizeof(file_tag));
+  if (!readEnum(s, NIL, INDIR, &file_tag))
+    return NULL;
+
   switch(file_tag) {
   case NIL:
     return NULL;
@@ -136,12 +171,15 @@ IndexExpr::open(std::stringstream &s) {
   case VALUE:
     {
       value_type valTy;
-      s.read(reinterpret_cast<char *>(&valTy), sizeof(valTy));
+      if (!readEnum(s, LONG, DOUBLE, &valTy))
+	return NULL;
       switch (valTy) {
       case LONG:
 	{
 	  long val;
 	  s.read(reinterpret_cast<char *>(&val), sizeof(val));
+	  if (!s.good())
+	    return NULL;
 	  return IndexExprValue::createLong(val);
 
 	}
@@ -149,101 +187,139 @@ IndexExpr::open(std::stringstream &s) {
 	{
 	  float val;
 	  s.read(reinterpret_cast<char *>(&val), sizeof(val));
+	  if (!s.good())
+	    return NULL;
 	  return IndexExprValue::createFloat(val);
 	}
       case DOUBLE:
 	{
 	  double val;
 	  s.read(reinterpret_cast<char *>(&val), sizeof(val));
+	  if (!s.good())
+	    return NULL;
 	  return IndexExprValue::createDouble(val);
 	}
       };
+      break;
     }
   case CAST:
     {
       IndexExprCast::castTy c;
-      s.read(reinterpret_cast<char *>(&c), sizeof(c));
+      if (!readEnum(s, IndexExprCast::F2D, IndexExprCast::FLOOR, &c))
+	return NULL;
       IndexExpr *expr = open(s);
+      if (!s.good()) {
+	release(expr);
+	return NULL;
+      }
       return new IndexExprCast(expr, c);
     }
   case ARG:
     {
       unsigned pos;
       s.read(reinterpret_cast<char *>(&pos), sizeof(pos));
+      if (!s.good())
+	return NULL;
       return new IndexExprArg("arg", pos);
     }
   case OCL:
     {
       IndexExprOCL::OpenclFunction oclFunc;
-      s.read(reinterpret_cast<char *>(&oclFunc), sizeof(oclFunc));
+      if (!readEnum(s, IndexExprOCL::GET_GLOBAL_ID,
+		    IndexExprOCL::GET_NUM_GROUPS, &oclFunc))
+	return NULL;
       IndexExpr *arg = open(s);
+      if (!s.good()) {
+	release(arg);
+	return NULL;
+      }
       return new IndexExprOCL(oclFunc, arg);
     }
   case BINOP:
     {
       IndexExprBinop::BinOp op;
-      s.read(reinterpret_cast<char *>(&op), sizeof(op));
+      if (!readEnum(s, IndexExprBinop::Add, IndexExprBinop::Shr, &op))
+	return NULL;
       IndexExpr *expr1 = open(s);
-      IndexExpr *expr2 = open(s);
+      IndexExpr *expr2 = s.good() ? open(s) : NULL;
+      if (!s.good()) {
+	release(expr1);
+	release(expr2);
+	return NULL;
+      }
       return new IndexExprBinop(op, expr1, expr2);
     }
   case INTERVAL:
     {
       IndexExpr *lb = open(s);
-      IndexExpr *hb = open(s);
+      IndexExpr *hb = s.good() ? open(s) : NULL;
+      if (!s.good()) {
+	release(lb);
+	release(hb);
+	return NULL;
+      }
       return new IndexExprInterval(lb, hb);
     }
   case UNKNOWN:
     return new IndexExprUnknown("unknown");
   case MIN:
     {
-      unsigned numOperands;
-      s.read(reinterpret_cast<char *>(&numOperands), sizeof(numOperands));
-      IndexExpr *exprs[numOperands];
-      for (unsigned i=0; i<numOperands; i++)
-	exprs[i] = open(s);
-      return new IndexExprMin(numOperands, exprs);
+      std::vector<IndexExpr *> exprs;
+      if (!openOperands(s, &exprs))
+	return NULL;
+      return new IndexExprMin(exprs.size(), exprs.data());
     }
   case MAX:
     {
-      unsigned numOperands;
-      s.read(reinterpret_cast<char *>(&numOperands), sizeof(numOperands));
-      IndexExpr *exprs[numOperands];
-      for (unsigned i=0; i<numOperands; i++)
-	exprs[i] = open(s);
-      return new IndexExprMax(numOperands, exprs);
+      std::vector<IndexExpr *> exprs;
+      if (!openOperands(s, &exprs))
+	return NULL;
+      return new IndexExprMax(exprs.size(), exprs.data());
     }
   case LB:
     {
       IndexExpr *expr = open(s);
+      if (!s.good()) {
+	release(expr);
+	return NULL;
+      }
       return new IndexExprLB(expr);
     }
   case HB:
     {
       IndexExpr *expr = open(s);
+      if (!s.good()) {
+	release(expr);
+	return NULL;
+      }
       return new IndexExprHB(expr);
     }
   case INDIR:
     {
       unsigned no;
       s.read(reinterpret_cast<char *>(&no), sizeof(no));
+      if (!s.good())
+	return NULL;
       IndexExpr *lb = open(s);
-      IndexExpr *hb = open(s);
+      IndexExpr *hb = s.good() ? open(s) : NULL;
+      if (!s.good()) {
+	release(lb);
+	release(hb);
+	return NULL;
+      }
       return new IndexExprIndirection(no, lb, hb);
     }
   };
 
+  // Unknown tag or value type.
+  s.setstate(std::ios_base::failbit);
   return NULL;
 }
 
 IndexExpr *
 IndexExpr::openFromFile(const std::string &name) {
   std::ifstream in(name.c_str(), std::ifstream::binary);
-  std::stringstream ss;
-  ss << in.rdbuf();
-  in.close();
-  IndexExpr *ret = open(ss);
-  return ret;
+  return open(in);
 }
 
 void
@@ -346,6 +422,329 @@ IndexExpr::injectArgsValues(IndexExpr *expr, const std::vector<IndexExprValue *>
   };
 }
 
+void
+IndexExpr::getArgsDependencies(const IndexExpr *expr,
+			       std::set<unsigned> &args) {
+  if (!expr)
+    return;
+
+  switch (expr->getTag()) {
+  case NIL:
+  case VALUE:
+  case UNKNOWN:
+    /* Do nothing */
+    return;
+  case CAST:
+    {
+      const IndexExprCast *castExpr = static_cast<const IndexExprCast *>(expr);
+      getArgsDependencies(castExpr->getExpr(), args);
+      return;
+    }
+  case ARG:
+    {
+      const IndexExprArg *argExpr = static_cast<const IndexExprArg *>(expr);
+      args.insert(argExpr->getPos());
+      return;
+    }
+  case OCL:
+    {
+      const IndexExprOCL *oclExpr = static_cast<const IndexExprOCL *>(expr);
+      getArgsDependencies(oclExpr->getArg(), args);
+      return;
+    }
+  case BINOP:
+    {
+      const IndexExprBinop *binExpr =
+	static_cast<const IndexExprBinop *>(expr);
+      getArgsDependencies(binExpr->getExpr1(), args);
+      getArgsDependencies(binExpr->getExpr2(), args);
+      return;
+    }
+  case INTERVAL:
+  case INDIR:
+    {
+      const IndexExprInterval *intervalExpr =
+	static_cast<const IndexExprInterval *>(expr);
+      getArgsDependencies(intervalExpr->getLb(), args);
+      getArgsDependencies(intervalExpr->getHb(), args);
+      return;
+    }
+  case MIN:
+    {
+      const IndexExprMin *minExpr = static_cast<const IndexExprMin *>(expr);
+      for (unsigned i=0; i<minExpr->getNumOperands(); i++)
+	getArgsDependencies(minExpr->getExprN(i), args);
+      return;
+    }
+  case MAX:
+    {
+      const IndexExprMax *maxExpr = static_cast<const IndexExprMax *>(expr);
+      for (unsigned i=0; i<maxExpr->getNumOperands(); i++)
+	getArgsDependencies(maxExpr->getExprN(i), args);
+      return;
+    }
+  case LB:
+    {
+      const IndexExprLB *lbExpr = static_cast<const IndexExprLB *>(expr);
+      getArgsDependencies(lbExpr->getExpr(), args);
+      return;
+    }
+  case HB:
+    {
+      const IndexExprHB *hbExpr = static_cast<const IndexExprHB *>(expr);
+      getArgsDependencies(hbExpr->getExpr(), args);
+      return;
+    }
+  };
+}
+
+static bool getConstantValue(const IndexExpr *expr, const NDRange &ndRange,
+			     long *value) {
+  std::vector<GuardExpr *> guards;
+  std::vector<IndirectionValue> indirValues;
+  IndexExpr *kernelExpr = expr->getKernelExpr(ndRange, guards, indirValues);
+  long lb, hb;
+  bool ret = IndexExpr::computeBounds(kernelExpr, &lb, &hb) && lb == hb;
+  delete kernelExpr;
+  *value = lb;
+  return ret;
+}
+
+bool
+IndexExpr::getSplitDimCoef(const IndexExpr *expr, unsigned splitDim,
+			   const NDRange &ndRange, long *coef,
+			   unsigned *nbOcc) {
+  *coef = 0;
+  *nbOcc = 0;
+
+  if (!expr)
+    return false;
+
+  switch (expr->getTag()) {
+  case NIL:
+  case UNKNOWN:
+  case CAST:
+  case INDIR:
+    return false;
+  case VALUE:
+    return static_cast<const IndexExprValue *>(expr)->type == LONG;
+  case ARG:
+    {
+      const IndexExprArg *argExpr = static_cast<const IndexExprArg *>(expr);
+      return argExpr->getValue() && argExpr->getValue()->type == LONG;
+    }
+  case OCL:
+    {
+      const IndexExprOCL *oclExpr = static_cast<const IndexExprOCL *>(expr);
+      const IndexExpr *arg = oclExpr->getArg();
+      if (!arg || arg->getTag() != VALUE ||
+	  static_cast<const IndexExprValue *>(arg)->type != LONG)
+	return false;
+
+      long dim = static_cast<const IndexExprValue *>(arg)->getLongValue();
+      if (dim != (long) splitDim)
+	return true;
+
+      // The local id and the sizes have the same bounds for every
+      // subkernel.
+      switch (oclExpr->getOCLFunc()) {
+      case IndexExprOCL::GET_GLOBAL_ID:
+	*coef = ndRange.get_local_size(splitDim);
+	*nbOcc = 1;
+	return true;
+      case IndexExprOCL::GET_GROUP_ID:
+	*coef = 1;
+	*nbOcc = 1;
+	return true;
+      default:
+	return true;
+      };
+    }
+  case BINOP:
+    {
+      const IndexExprBinop *binExpr =
+	static_cast<const IndexExprBinop *>(expr);
+      long coef1, coef2;
+      unsigned nbOcc1, nbOcc2;
+      if (!getSplitDimCoef(binExpr->getExpr1(), splitDim, ndRange, &coef1,
+			   &nbOcc1) ||
+	  !getSplitDimCoef(binExpr->getExpr2(), splitDim, ndRange, &coef2,
+			   &nbOcc2))
+	return false;
+
+      // Interval arithmetic is not exact if the split dimension appears
+      // more than once (e.g. x - x).
+      *nbOcc = nbOcc1 + nbOcc2;
+      if (*nbOcc == 0)
+	return true;
+      if (*nbOcc > 1)
+	return false;
+
+      switch (binExpr->getOp()) {
+      case IndexExprBinop::Add:
+	*coef = coef1 + coef2;
+	return true;
+      case IndexExprBinop::Sub:
+	*coef = coef1 - coef2;
+	return true;
+      case IndexExprBinop::Mul:
+	{
+	  long value;
+	  if (!getConstantValue(nbOcc1 == 0 ? binExpr->getExpr1() :
+				binExpr->getExpr2(), ndRange, &value))
+	    return false;
+	  *coef = value * (nbOcc1 == 0 ? coef2 : coef1);
+	  return true;
+	}
+      default:
+	return false;
+      };
+    }
+  case INTERVAL:
+    {
+      const IndexExprInterval *intervalExpr =
+	static_cast<const IndexExprInterval *>(expr);
+      long c;
+      unsigned lbOcc, hbOcc;
+      return getSplitDimCoef(intervalExpr->getLb(), splitDim, ndRange, &c,
+			     &lbOcc) && lbOcc == 0 &&
+	getSplitDimCoef(intervalExpr->getHb(), splitDim, ndRange, &c,
+			&hbOcc) && hbOcc == 0;
+    }
+  case MIN:
+    {
+      const IndexExprMin *minExpr = static_cast<const IndexExprMin *>(expr);
+      for (unsigned i=0; i<minExpr->getNumOperands(); i++) {
+	long c;
+	unsigned occ;
+	if (!getSplitDimCoef(minExpr->getExprN(i), splitDim, ndRange, &c,
+			     &occ) || occ > 0)
+	  return false;
+      }
+      return true;
+    }
+  case MAX:
+    {
+      const IndexExprMax *maxExpr = static_cast<const IndexExprMax *>(expr);
+      for (unsigned i=0; i<maxExpr->getNumOperands(); i++) {
+	long c;
+	unsigned occ;
+	if (!getSplitDimCoef(maxExpr->getExprN(i), splitDim, ndRange, &c,
+			     &occ) || occ > 0)
+	  return false;
+      }
+      return true;
+    }
+  case LB:
+    {
+      const IndexExprLB *lbExpr = static_cast<const IndexExprLB *>(expr);
+      long c;
+      unsigned occ;
+      return getSplitDimCoef(lbExpr->getExpr(), splitDim, ndRange, &c,
+			     &occ) && occ == 0;
+    }
+  case HB:
+    {
+      const IndexExprHB *hbExpr = static_cast<const IndexExprHB *>(expr);
+      long c;
+      unsigned occ;
+      return getSplitDimCoef(hbExpr->getExpr(), splitDim, ndRange, &c,
+			     &occ) && occ == 0;
+    }
+  };
+
+  return false;
+}
+
+static bool dependsOnArgs(const IndexExpr *expr,
+			  const std::vector<unsigned> &args) {
+  std::set<unsigned> deps;
+  IndexExpr::getArgsDependencies(expr, deps);
+  for (unsigned i=0; i<args.size(); i++) {
+    if (deps.find(args[i]) != deps.end())
+      return true;
+  }
+  return false;
+}
+
+bool
+IndexExpr::getArgCoef(const IndexExpr *expr, unsigned pos,
+		      const std::vector<unsigned> &changedArgs,
+		      const NDRange &ndRange, long *coef, unsigned *nbOcc) {
+  *coef = 0;
+  *nbOcc = 0;
+
+  if (!expr)
+    return false;
+
+  // Constant with respect to the changed arguments.
+  if (!dependsOnArgs(expr, changedArgs))
+    return true;
+
+  switch (expr->getTag()) {
+  case ARG:
+    {
+      const IndexExprArg *argExpr = static_cast<const IndexExprArg *>(expr);
+      if (!argExpr->getValue() || argExpr->getValue()->type != LONG)
+	return false;
+      if (argExpr->getPos() == pos) {
+	*coef = 1;
+	*nbOcc = 1;
+      }
+      return true;
+    }
+  case BINOP:
+    {
+      const IndexExprBinop *binExpr =
+	static_cast<const IndexExprBinop *>(expr);
+      long coef1, coef2;
+      unsigned nbOcc1, nbOcc2;
+      if (!getArgCoef(binExpr->getExpr1(), pos, changedArgs, ndRange, &coef1,
+		      &nbOcc1) ||
+	  !getArgCoef(binExpr->getExpr2(), pos, changedArgs, ndRange, &coef2,
+		      &nbOcc2))
+	return false;
+
+      // Interval arithmetic is not exact if the argument appears more than
+      // once (e.g. n - n). The other changed arguments are checked with
+      // their own coefficient.
+      *nbOcc = nbOcc1 + nbOcc2;
+      if (*nbOcc == 0)
+	return true;
+      if (*nbOcc > 1)
+	return false;
+
+      switch (binExpr->getOp()) {
+      case IndexExprBinop::Add:
+	*coef = coef1 + coef2;
+	return true;
+      case IndexExprBinop::Sub:
+	*coef = coef1 - coef2;
+	return true;
+      case IndexExprBinop::Mul:
+	{
+	  // The factor must be a constant which does not depend on the
+	  // changed arguments.
+	  const IndexExpr *factor =
+	    nbOcc1 == 0 ? binExpr->getExpr1() : binExpr->getExpr2();
+	  long value;
+	  if (dependsOnArgs(factor, changedArgs) ||
+	      !getConstantValue(factor, ndRange, &value))
+	    return false;
+	  *coef = value * (nbOcc1 == 0 ? coef2 : coef1);
+	  return true;
+	}
+      default:
+	return false;
+      };
+    }
+  default:
+    return false;
+  };
+
+  return false;
+}
+
 void
 IndexExpr::injectIndirValues(IndexExpr *expr,
 			     const std::vector<std::pair<IndexExprValue *,
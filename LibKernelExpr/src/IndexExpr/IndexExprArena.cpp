@@ -0,0 +1,240 @@
+#include "IndexExpr/IndexExprArena.h"
+#include "IndexExpr/IndexExprs.h"
+
+#include <sstream>
+
+IndexExprArena::IndexExprArena()
+  : nbSharedNodes(0), nbBoundsHits(0) {}
+
+IndexExprArena::~IndexExprArena() {
+  // Children of a node in the arena are either in the arena or owned by the
+  // node, deleting each node once is enough. A node is deleted before its
+  // children in the arena, which it checks when released.
+  for (auto it = insertionOrder.rbegin(); it != insertionOrder.rend(); ++it)
+    delete *it;
+}
+
+IndexExpr *
+IndexExprArena::intern(IndexExpr *expr) {
+  if (!expr || expr->inArena)
+    return expr;
+
+  switch (expr->getTag()) {
+  case IndexExpr::NIL:
+  case IndexExpr::VALUE:
+  case IndexExpr::ARG:
+    break;
+
+  case IndexExpr::CAST:
+    {
+      IndexExprCast *castExpr = static_cast<IndexExprCast *>(expr);
+      castExpr->setExpr(intern(castExpr->getExpr()));
+      break;
+    }
+  case IndexExpr::OCL:
+    {
+      IndexExprOCL *oclExpr = static_cast<IndexExprOCL *>(expr);
+      oclExpr->setArg(intern(oclExpr->getArg()));
+      break;
+    }
+  case IndexExpr::BINOP:
+    {
+      IndexExprBinop *binExpr = static_cast<IndexExprBinop *>(expr);
+      binExpr->setExpr1(intern(binExpr->getExpr1()));
+      binExpr->setExpr2(intern(binExpr->getExpr2()));
+      break;
+    }
+  case IndexExpr::INTERVAL:
+    {
+      IndexExprInterval *intervalExpr = static_cast<IndexExprInterval *>(expr);
+      intervalExpr->setLb(intern(intervalExpr->getLb()));
+      intervalExpr->setHb(intern(intervalExpr->getHb()));
+      break;
+    }
+  case IndexExpr::MIN:
+    {
+      IndexExprMin *minExpr = static_cast<IndexExprMin *>(expr);
+      for (unsigned i=0; i<minExpr->getNumOperands(); i++)
+	minExpr->setExprN(i, intern(minExpr->getExprN(i)));
+      break;
+    }
+  case IndexExpr::MAX:
+    {
+      IndexExprMax *maxExpr = static_cast<IndexExprMax *>(expr);
+      for (unsigned i=0; i<maxExpr->getNumOperands(); i++)
+	maxExpr->setExprN(i, intern(maxExpr->getExprN(i)));
+      break;
+    }
+  case IndexExpr::LB:
+    {
+      IndexExprLB *lbExpr = static_cast<IndexExprLB *>(expr);
+      lbExpr->setExpr(intern(lbExpr->getExpr()));
+      break;
+    }
+  case IndexExpr::HB:
+    {
+      IndexExprHB *hbExpr = static_cast<IndexExprHB *>(expr);
+      hbExpr->setExpr(intern(hbExpr->getExpr()));
+      break;
+    }
+
+  case IndexExpr::UNKNOWN:
+  case IndexExpr::INDIR:
+    // Indirection bounds are replaced in place, never share them.
+    return expr;
+  };
+
+  std::string key;
+  if (!getKey(expr, &key))
+    return expr;
+
+  auto it = nodes.find(key);
+  if (it != nodes.end()) {
+    // The children of expr are now in the arena, only the node is deleted.
+    nbSharedNodes++;
+    delete expr;
+    return it->second;
+  }
+
+  expr->inArena = true;
+  nodes[key] = expr;
+  insertionOrder.push_back(expr);
+  return expr;
+}
+
+bool
+IndexExprArena::getKey(const IndexExpr *expr, std::string *key) {
+  std::stringstream s;
+  s << expr->getTag() << ":";
+
+  switch (expr->getTag()) {
+  case IndexExpr::VALUE:
+    {
+      const IndexExprValue *valueExpr =
+	static_cast<const IndexExprValue *>(expr);
+      s << valueExpr->type << ":";
+      switch (valueExpr->type) {
+      case IndexExpr::LONG:
+	s << valueExpr->getLongValue();
+	break;
+      case IndexExpr::FLOAT:
+	s.precision(9);
+	s << valueExpr->getFloatValue();
+	break;
+      case IndexExpr::DOUBLE:
+	s.precision(17);
+	s << valueExpr->getDoubleValue();
+	break;
+      };
+      break;
+    }
+  case IndexExpr::CAST:
+    {
+      const IndexExprCast *castExpr = static_cast<const IndexExprCast *>(expr);
+      s << castExpr->cast << ":" << castExpr->getExpr();
+      break;
+    }
+  case IndexExpr::ARG:
+    {
+      const IndexExprArg *argExpr = static_cast<const IndexExprArg *>(expr);
+      s << argExpr->getPos() << ":" << argExpr->getName();
+      break;
+    }
+  case IndexExpr::OCL:
+    {
+      const IndexExprOCL *oclExpr = static_cast<const IndexExprOCL *>(expr);
+      s << oclExpr->getOCLFunc() << ":" << oclExpr->getArg();
+      break;
+    }
+  case IndexExpr::BINOP:
+    {
+      const IndexExprBinop *binExpr =
+	static_cast<const IndexExprBinop *>(expr);
+      s << binExpr->getOp() << ":" << binExpr->getExpr1() << ":"
+	<< binExpr->getExpr2();
+      break;
+    }
+  case IndexExpr::INTERVAL:
+    {
+      const IndexExprInterval *intervalExpr =
+	static_cast<const IndexExprInterval *>(expr);
+      s << intervalExpr->getLb() << ":" << intervalExpr->getHb();
+      break;
+    }
+  case IndexExpr::MIN:
+    {
+      const IndexExprMin *minExpr = static_cast<const IndexExprMin *>(expr);
+      s << minExpr->getNumOperands();
+      for (unsigned i=0; i<minExpr->getNumOperands(); i++)
+	s << ":" << minExpr->getExprN(i);
+      break;
+    }
+  case IndexExpr::MAX:
+    {
+      const IndexExprMax *maxExpr = static_cast<const IndexExprMax *>(expr);
+      s << maxExpr->getNumOperands();
+      for (unsigned i=0; i<maxExpr->getNumOperands(); i++)
+	s << ":" << maxExpr->getExprN(i);
+      break;
+    }
+  case IndexExpr::LB:
+    {
+      const IndexExprLB *lbExpr = static_cast<const IndexExprLB *>(expr);
+      s << lbExpr->getExpr();
+      break;
+    }
+  case IndexExpr::HB:
+    {
+      const IndexExprHB *hbExpr = static_cast<const IndexExprHB *>(expr);
+      s << hbExpr->getExpr();
+      break;
+    }
+
+  case IndexExpr::NIL:
+  case IndexExpr::UNKNOWN:
+  case IndexExpr::INDIR:
+    return false;
+  };
+
+  *key = s.str();
+  return true;
+}
+
+bool
+IndexExprArena::getBounds(const IndexExpr *expr, unsigned subkernel,
+			  long *lb, long *hb) {
+  auto it = bounds.find(std::make_pair(expr, subkernel));
+  if (it == bounds.end())
+    return false;
+
+  nbBoundsHits++;
+  *lb = it->second.first;
+  *hb = it->second.second;
+  return true;
+}
+
+void
+IndexExprArena::setBounds(const IndexExpr *expr, unsigned subkernel,
+			  long lb, long hb) {
+  bounds[std::make_pair(expr, subkernel)] = std::make_pair(lb, hb);
+}
+
+void
+IndexExprArena::clearBounds() {
+  bounds.clear();
+}
+
+unsigned
+IndexExprArena::getNbNodes() const {
+  return nodes.size();
+}
+
+unsigned
+IndexExprArena::getNbSharedNodes() const {
+  return nbSharedNodes;
+}
+
+unsigned
+IndexExprArena::getNbBoundsHits() const {
+  return nbBoundsHits;
+}
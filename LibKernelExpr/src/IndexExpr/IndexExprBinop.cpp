@@ -10,9 +10,9 @@ IndexExprBinop::IndexExprBinop(IndexExprBinop::BinOp op, IndexExpr *expr1, Index
 
 IndexExprBinop::~IndexExprBinop() {
   if (expr1)
-    delete expr1;
+    release(expr1);
   if (expr2)
-    delete expr2;
+    release(expr2);
 }
 
 void
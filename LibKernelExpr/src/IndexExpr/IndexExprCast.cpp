@@ -8,7 +8,7 @@ IndexExprCast::IndexExprCast(IndexExpr *expr, castTy c)
 }
 
 IndexExprCast::~IndexExprCast() {
-  delete expr;
+  release(expr);
 }
 
 const IndexExpr *
@@ -21,6 +21,11 @@ IndexExprCast::getExpr() {
   return expr;
 }
 
+void
+IndexExprCast::setExpr(IndexExpr *expr) {
+  this->expr = expr;
+}
+
 void
 IndexExprCast::dump() const {
   switch (cast) {
@@ -10,7 +10,7 @@ IndexExprHB::IndexExprHB(IndexExpr *expr)
 
 IndexExprHB::~IndexExprHB() {
   if (expr)
-    delete expr;
+    release(expr);
 }
 
 void
@@ -85,6 +85,11 @@ IndexExprHB::getExpr() {
   return expr;
 }
 
+void
+IndexExprHB::setExpr(IndexExpr *expr) {
+  this->expr = expr;
+}
+
 void
 IndexExprHB::write(std::stringstream &s) const {
   IndexExpr::write(s);
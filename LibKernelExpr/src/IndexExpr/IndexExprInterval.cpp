@@ -9,9 +9,9 @@ IndexExprInterval::IndexExprInterval(IndexExpr *lb, IndexExpr *hb)
 
 IndexExprInterval::~IndexExprInterval() {
   if (lb)
-    delete lb;
+    release(lb);
   if (hb)
-    delete hb;
+    release(hb);
 }
 
 void
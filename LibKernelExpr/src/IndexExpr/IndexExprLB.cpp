@@ -10,7 +10,7 @@ IndexExprLB::IndexExprLB(IndexExpr *expr)
 
 IndexExprLB::~IndexExprLB() {
   if (expr)
-    delete expr;
+    release(expr);
 }
 
 void
@@ -85,6 +85,11 @@ IndexExprLB::getExpr() {
   return expr;
 }
 
+void
+IndexExprLB::setExpr(IndexExpr *expr) {
+  this->expr = expr;
+}
+
 void
 IndexExprLB::write(std::stringstream &s) const {
   IndexExpr::write(s);
@@ -13,7 +13,7 @@ IndexExprMax::IndexExprMax(unsigned numOperands, IndexExpr **exprs)
 
 IndexExprMax::~IndexExprMax() {
   for (unsigned i=0; i<mNumOperands; i++)
-      delete mExprs[i];
+      release(mExprs[i]);
 
   delete[] mExprs;
 }
@@ -13,7 +13,7 @@ IndexExprMin::IndexExprMin(unsigned numOperands, IndexExpr **exprs)
 
 IndexExprMin::~IndexExprMin() {
   for (unsigned i=0; i<mNumOperands; i++)
-      delete mExprs[i];
+      release(mExprs[i]);
 
   delete[] mExprs;
 }
@@ -12,7 +12,7 @@ IndexExprOCL::IndexExprOCL(IndexExprOCL::OpenclFunction oclFunc, IndexExpr *arg)
 
 IndexExprOCL::~IndexExprOCL() {
   if (arg)
-    delete arg;
+    release(arg);
 }
 
 void
@@ -7,17 +7,19 @@
 #include <string.h>
 
 #include <IndexExpr/IndexExprValue.h>
+#include <Record.h>
 
 KernelAnalysis::KernelAnalysis(const char *name,
 			       unsigned numArgs,
-			       bool *scalarArgs,
+			       const std::vector<bool> &scalarArgs,
 			       std::vector<size_t> &scalarArgsSizes,
 			       std::vector<ArgumentAnalysis::TYPE> &scalarArgsTypes,
 			       std::vector<ArgumentAnalysis *> argsAnalysis,
 			       std::vector<ArgIndirectionRegionExpr *>
 			       kernelIndirectionExprs)
   : numArgs(numArgs), numGlobalArgs(0), scalarArgsSizes(scalarArgsSizes),
-    scalarArgsTypes(scalarArgsTypes), kernelNDRange(NULL), subNDRanges(NULL) {
+    scalarArgsTypes(scalarArgsTypes), footprint(NULL), kernelNDRange(NULL),
+    subNDRanges(NULL), arena(new IndexExprArena()) {
   mName = strdup(name);
 
   for (unsigned i=0; i<numArgs; i++)
@@ -38,6 +40,11 @@ KernelAnalysis::KernelAnalysis(const char *name,
   for (unsigned i=0; i<kernelIndirectionExprs.size(); i++)
     this->kernelIndirectionExprs.push_back(kernelIndirectionExprs[i]);
 
+  for (unsigned i=0; i<mArgsAnalysis.size(); i++)
+    mArgsAnalysis[i]->intern(arena);
+  for (unsigned i=0; i<this->kernelIndirectionExprs.size(); i++)
+    this->kernelIndirectionExprs[i]->expr->intern(arena);
+
   if (kernelIndirectionExprs.size() > 0) {
     indirectionsComputed = new bool[kernelIndirectionExprs.size()];
   } else {
@@ -62,6 +69,10 @@ KernelAnalysis::~KernelAnalysis() {
 
   delete kernelNDRange;
   delete subNDRanges;
+  delete footprint;
+
+  // Delete the shared expressions once every owner has been deleted.
+  delete arena;
 }
 
 const char *
@@ -129,6 +140,40 @@ KernelAnalysis::getGlobalArgId(unsigned pos) {
   return argPos2GlobalId[pos];
 }
 
+const KernelFeatures &
+KernelAnalysis::getFeatures() const {
+  return features;
+}
+
+void
+KernelAnalysis::setFeatures(const KernelFeatures &features) {
+  this->features = features;
+}
+
+void
+KernelAnalysis::setFootprint(Footprint *footprint) {
+  for (unsigned i=0; i<numGlobalArgs; i++)
+    mArgsAnalysis[i]->setFootprint(footprint);
+
+  delete this->footprint;
+  this->footprint = footprint;
+}
+
+const Footprint *
+KernelAnalysis::getFootprint() const {
+  return footprint;
+}
+
+bool
+KernelAnalysis::footprintUsed() const {
+  for (unsigned i=0; i<numGlobalArgs; i++) {
+    if (mArgsAnalysis[i]->analysisIsUpToDate() &&
+	mArgsAnalysis[i]->footprintUsed())
+      return true;
+  }
+  return false;
+}
+
 void
 KernelAnalysis::setPartition(const NDRange &kernelNDRange,
 			     const std::vector<NDRange> &subNDRanges,
@@ -167,6 +212,73 @@ KernelAnalysis::setPartition(const NDRange &kernelNDRange,
   subKernelIndirectionValues.resize(nbSplit);
 }
 
+unsigned
+KernelAnalysis::updateArgValues(const std::vector<IndexExprValue *> &argValues,
+				const std::vector<unsigned> &changedArgs,
+				bool checkRegions, unsigned *nbSubstituted) {
+  assert(kernelNDRange && subNDRanges);
+  unsigned nbUpdated = 0;
+  *nbSubstituted = 0;
+
+  for (unsigned i=0; i<numGlobalArgs; i++) {
+    bool substituted;
+    if (mArgsAnalysis[i]->updateArgValues(argValues, changedArgs,
+					  checkRegions, &substituted))
+      nbUpdated++;
+    if (substituted)
+      (*nbSubstituted)++;
+  }
+
+  // Indirections regions depend on the argument values too.
+  for (unsigned i=0; i<kernelIndirectionExprs.size(); i++) {
+    kernelIndirectionExprs[i]->expr->injectArgsValues(argValues,
+						      *kernelNDRange);
+  }
+
+  return nbUpdated;
+}
+
+unsigned
+KernelAnalysis::movePartition(const std::vector<NDRange> &subNDRanges,
+			      unsigned splitDim,
+			      const std::vector<IndexExprValue *> &argValues,
+			      bool checkRegions) {
+  assert(kernelNDRange && this->subNDRanges);
+
+  // Indirection values depend on the subkernel ranges.
+  bool movable = !hasIndirection() &&
+    subNDRanges.size() == this->subNDRanges->size();
+  for (unsigned i=0; movable && i<subNDRanges.size(); i++) {
+    movable = (*this->subNDRanges)[i].sameExceptDim(subNDRanges[i], splitDim)
+      && (*this->subNDRanges)[i].get_global_size(splitDim) > 0
+      && subNDRanges[i].get_global_size(splitDim) > 0;
+  }
+
+  if (!movable) {
+    NDRange ndRange(*kernelNDRange);
+    setPartition(ndRange, subNDRanges, argValues);
+    return 0;
+  }
+
+  std::vector<NDRange> *oldSubNDRanges = this->subNDRanges;
+  this->subNDRanges = new std::vector<NDRange>(subNDRanges);
+  unsigned nbMoved = 0;
+
+  for (unsigned i=0; i<numGlobalArgs; i++) {
+    if (mArgsAnalysis[i]->movePartition(this->subNDRanges, splitDim,
+					checkRegions)) {
+      nbMoved++;
+    } else {
+      mArgsAnalysis[i]->setPartition(this->kernelNDRange, this->subNDRanges);
+      mArgsAnalysis[i]->injectArgValues(argValues);
+    }
+  }
+
+  delete oldSubNDRanges;
+
+  return nbMoved;
+}
+
 void
 KernelAnalysis::computeIndirections() {
   std::vector<unsigned> indirComputed;
@@ -276,6 +388,10 @@ KernelAnalysis::setSubkernelIndirectionsValues(unsigned n,
 
   subKernelIndirectionValues[n].insert(subKernelIndirectionValues[n].end(),
 				       values.begin(), values.end());
+
+  // Subkernel expressions have to be rebuilt with the new values.
+  for (unsigned i=0; i<numGlobalArgs; i++)
+    mArgsAnalysis[i]->invalidateAnalysis();
 }
 
 ArgumentAnalysis::status
@@ -283,8 +399,18 @@ KernelAnalysis::performAnalysis() {
   enum ArgumentAnalysis::status ret = ArgumentAnalysis::SUCCESS;
   mergeArguments.clear();
 
+  // Bounds memoized during the previous instantiation are outdated.
+  arena->clearBounds();
+
   for (unsigned i = 0; i<mArgsAnalysis.size(); i++) {
-    switch (mArgsAnalysis[i]->performAnalysis(subKernelIndirectionValues)) {
+    // Regions of arguments not affected by the last argument values update
+    // are still valid.
+    enum ArgumentAnalysis::status st =
+      mArgsAnalysis[i]->analysisIsUpToDate() ?
+      mArgsAnalysis[i]->getLastStatus() :
+      mArgsAnalysis[i]->performAnalysis(subKernelIndirectionValues);
+
+    switch (st) {
     case ArgumentAnalysis::SUCCESS:
       continue;
 
@@ -429,54 +555,83 @@ KernelAnalysis::getArgWrittenMergeRegion(unsigned argNo) const {
 
 void
 KernelAnalysis::write(std::stringstream &s) const {
+  unsigned magic = FORMAT_MAGIC;
+  unsigned version = FORMAT_VERSION;
+  s.write(reinterpret_cast<const char *>(&magic), sizeof(magic));
+  s.write(reinterpret_cast<const char *>(&version), sizeof(version));
+
+  std::stringstream record;
+
   // Write name
   unsigned len = strlen(mName);
-  s.write((char *) &len, sizeof(len));
-  s.write(mName, len);
+  record.write((char *) &len, sizeof(len));
+  record.write(mName, len);
 
   // Write num args
-  s.write(reinterpret_cast<const char *>(&numArgs), sizeof(numArgs));
+  record.write(reinterpret_cast<const char *>(&numArgs), sizeof(numArgs));
 
   // Write scalar arg map
   for (unsigned i=0; i<numArgs; i++) {
     bool isScalar = argIsScalar(i);
-    s.write(reinterpret_cast<const char *>(&isScalar), sizeof(isScalar));
+    record.write(reinterpret_cast<const char *>(&isScalar),
+		 sizeof(isScalar));
   }
 
   // Write scalar arg sizes
   for (unsigned i=0; i<numArgs; i++)
-    s.write(reinterpret_cast<const char *>(&scalarArgsSizes[i]),
-	    sizeof(scalarArgsSizes[i]));
+    record.write(reinterpret_cast<const char *>(&scalarArgsSizes[i]),
+	         sizeof(scalarArgsSizes[i]));
 
   // Write scalar arg types.
   for (unsigned i=0; i<numArgs; i++)
-    s.write(reinterpret_cast<const char *>(&scalarArgsTypes[i]),
-	    sizeof(scalarArgsTypes[i]));
+    record.write(reinterpret_cast<const char *>(&scalarArgsTypes[i]),
+	         sizeof(scalarArgsTypes[i]));
 
   // Write num global args
-  s.write(reinterpret_cast<const char *>(&numGlobalArgs),
-	  sizeof(numGlobalArgs));
+  record.write(reinterpret_cast<const char *>(&numGlobalArgs),
+	       sizeof(numGlobalArgs));
 
   // Write Global Arguments Analyses
   for (unsigned i=0; i<numGlobalArgs; i++) {
-    mArgsAnalysis[i]->write(s);
+    mArgsAnalysis[i]->write(record);
   }
 
   // Write Indirection Expressions
   unsigned nbIndirection = kernelIndirectionExprs.size();
-  s.write(reinterpret_cast<const char *>(&nbIndirection),
-	  sizeof(nbIndirection));
+  record.write(reinterpret_cast<const char *>(&nbIndirection),
+	       sizeof(nbIndirection));
   for (unsigned i=0; i<nbIndirection; i++) {
     unsigned id = kernelIndirectionExprs[i]->id;
-    s.write(reinterpret_cast<const char *>(&id), sizeof(id));
+    record.write(reinterpret_cast<const char *>(&id), sizeof(id));
     unsigned pos = kernelIndirectionExprs[i]->pos;
-    s.write(reinterpret_cast<const char *>(&pos), sizeof(pos));
+    record.write(reinterpret_cast<const char *>(&pos), sizeof(pos));
     unsigned numBytes = kernelIndirectionExprs[i]->numBytes;
-    s.write(reinterpret_cast<const char *>(&numBytes), sizeof(numBytes));
+    record.write(reinterpret_cast<const char *>(&numBytes),
+		 sizeof(numBytes));
     IndirectionType ty = kernelIndirectionExprs[i]->ty;
-    s.write(reinterpret_cast<const char *>(&ty), sizeof(ty));
-    kernelIndirectionExprs[i]->expr->write(s);
+    record.write(reinterpret_cast<const char *>(&ty), sizeof(ty));
+    kernelIndirectionExprs[i]->expr->write(record);
   }
+
+  // Write features
+  record.write(reinterpret_cast<const char *>(&features.nbArithOps),
+	       sizeof(features.nbArithOps));
+  record.write(reinterpret_cast<const char *>(&features.nbFloatOps),
+	       sizeof(features.nbFloatOps));
+  record.write(reinterpret_cast<const char *>(&features.nbMemOps),
+	       sizeof(features.nbMemOps));
+  record.write(reinterpret_cast<const char *>(&features.globalBytes),
+	       sizeof(features.globalBytes));
+  record.write(reinterpret_cast<const char *>(&features.loopDepth),
+	       sizeof(features.loopDepth));
+  record.write(reinterpret_cast<const char *>(&features.usesBarriers),
+	       sizeof(features.usesBarriers));
+  record.write(reinterpret_cast<const char *>(&features.usesLocalMemory),
+	       sizeof(features.usesLocalMemory));
+  record.write(reinterpret_cast<const char *>(&features.usesWorkGroupIds),
+	       sizeof(features.usesWorkGroupIds));
+
+  writeRecord(s, record);
 }
 
 void
@@ -490,58 +645,104 @@ KernelAnalysis::writeToFile(const std::string &name) const {
   out.close();
 }
 
+// Delete the parts of a malformed analysis read so far.
+static KernelAnalysis *
+openFailed(std::vector<ArgumentAnalysis *> &argsAnalysis,
+	   std::vector<ArgIndirectionRegionExpr *> &kernelIndirectionExprs) {
+  for (unsigned i=0; i<argsAnalysis.size(); i++)
+    delete argsAnalysis[i];
+  for (unsigned i=0; i<kernelIndirectionExprs.size(); i++)
+    delete kernelIndirectionExprs[i];
+  return NULL;
+}
+
 KernelAnalysis *
-KernelAnalysis::open(std::stringstream &s) {
+KernelAnalysis::open(std::istream &s) {
+  unsigned magic = 0, version = 0;
+  s.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  s.read(reinterpret_cast<char *>(&version), sizeof(version));
+  if (!s.good() || magic != FORMAT_MAGIC)
+    return NULL;
+  if (version != FORMAT_VERSION) {
+    std::cerr << "Error: kernel analysis format version " << version
+	      << " does not match expected version " << FORMAT_VERSION << "\n";
+    return NULL;
+  }
+
+  std::streampos end = readRecordSize(s);
+  if (!s.good())
+    return NULL;
+
   unsigned len;
-  char *name;
+  std::string name;
   unsigned numArgs;
+  std::vector<bool> isScalarArray;
   std::vector<size_t> argsSizes;
   std::vector<ArgumentAnalysis::TYPE> argsTypes;
   unsigned numGlobalArgs;
   std::vector<ArgumentAnalysis *> argsAnalysis;
   unsigned nbIndirections;
   std::vector<ArgIndirectionRegionExpr *> kernelIndirectionExprs;
+  KernelFeatures features;
 
   // Read name
-  s.read((char *) &len, sizeof(len));
-  name = (char *) malloc(len+1);
-  s.read(name, len);
-  name[len] = '\0';
-
-  // Read num args
-  s.read(reinterpret_cast<char *>(&numArgs), sizeof(numArgs));
+  if (!readCount(s, end, 1, &len))
+    return NULL;
+  name.resize(len);
+  s.read(&name[0], len);
+  if (!s.good())
+    return NULL;
+
+  // Read num args, each has a scalar flag, a size and a type.
+  if (!readCount(s, end, sizeof(bool) + sizeof(size_t) +
+		 sizeof(ArgumentAnalysis::TYPE), &numArgs))
+    return NULL;
 
   // Read scalar arg map
-  bool isScalarArray[numArgs];
   for (unsigned i=0; i<numArgs; i++) {
-    s.read(reinterpret_cast<char *>(&isScalarArray[i]),
-	   sizeof(isScalarArray[i]));
+    bool isScalar;
+    if (!readBool(s, &isScalar))
+      return NULL;
+    isScalarArray.push_back(isScalar);
   }
 
   // Read scalar arg sizes
   for (unsigned i=0; i<numArgs; i++) {
     size_t size;
     s.read(reinterpret_cast<char *>(&size), sizeof(size));
+    if (!s.good())
+      return NULL;
     argsSizes.push_back(size);
   }
 
   // Read scalar arg types.
   for (unsigned i=0; i<numArgs; i++) {
     ArgumentAnalysis::TYPE ty;
-    s.read(reinterpret_cast<char *>(&ty), sizeof(ty));
+    if (!readEnum(s, ArgumentAnalysis::BOOL, ArgumentAnalysis::UNKNOWN, &ty))
+      return NULL;
     argsTypes.push_back(ty);
   }
 
-  // Read num global args
-  s.read(reinterpret_cast<char *>(&numGlobalArgs), sizeof(numGlobalArgs));
+  // Read num global args, each analysis is a record prefixed with its size.
+  if (!readCount(s, end, sizeof(uint64_t), &numGlobalArgs))
+    return NULL;
 
   // Read global arg analyses
   for (unsigned i=0; i<numGlobalArgs; i++) {
-    argsAnalysis.push_back(ArgumentAnalysis::open(s));
+    ArgumentAnalysis *analysis = ArgumentAnalysis::open(s);
+    if (!analysis)
+      return openFailed(argsAnalysis, kernelIndirectionExprs);
+    if (analysis->getPos() >= numArgs) {
+      delete analysis;
+      return openFailed(argsAnalysis, kernelIndirectionExprs);
+    }
+    argsAnalysis.push_back(analysis);
   }
 
   // Read indirection expressions.
-  s.read(reinterpret_cast<char *>(&nbIndirections), sizeof(nbIndirections));
+  if (!readCount(s, end, 3 * sizeof(unsigned) + sizeof(IndirectionType) +
+		 sizeof(uint64_t), &nbIndirections))
+    return openFailed(argsAnalysis, kernelIndirectionExprs);
   for (unsigned i=0; i<nbIndirections; i++) {
     unsigned id;
     s.read(reinterpret_cast<char *>(&id), sizeof(id));
@@ -550,8 +751,11 @@ KernelAnalysis::open(std::stringstream &s) {
     unsigned numBytes;
     s.read(reinterpret_cast<char *>(&numBytes), sizeof(numBytes));
     IndirectionType ty;
-    s.read(reinterpret_cast<char *>(&ty), sizeof(ty));
+    if (!readEnum(s, INT, UNDEF, &ty))
+      return openFailed(argsAnalysis, kernelIndirectionExprs);
     WorkItemExpr *expr = WorkItemExpr::open(s);
+    if (!expr)
+      return openFailed(argsAnalysis, kernelIndirectionExprs);
     kernelIndirectionExprs.push_back(new ArgIndirectionRegionExpr(id,
 								  pos,
 								  numBytes,
@@ -559,24 +763,54 @@ KernelAnalysis::open(std::stringstream &s) {
 								  expr));
   }
 
-  KernelAnalysis *ret =
-    new KernelAnalysis(name, numArgs, isScalarArray, argsSizes, argsTypes,
-		       argsAnalysis,
-		       kernelIndirectionExprs);
+  // Read features
+  s.read(reinterpret_cast<char *>(&features.nbArithOps),
+	 sizeof(features.nbArithOps));
+  s.read(reinterpret_cast<char *>(&features.nbFloatOps),
+	 sizeof(features.nbFloatOps));
+  s.read(reinterpret_cast<char *>(&features.nbMemOps),
+	 sizeof(features.nbMemOps));
+  s.read(reinterpret_cast<char *>(&features.globalBytes),
+	 sizeof(features.globalBytes));
+  s.read(reinterpret_cast<char *>(&features.loopDepth),
+	 sizeof(features.loopDepth));
+  if (s.good())
+    readBool(s, &features.usesBarriers);
+  if (s.good())
+    readBool(s, &features.usesLocalMemory);
+  if (s.good())
+    readBool(s, &features.usesWorkGroupIds);
+
+  if (!checkRecordEnd(s, end))
+    return openFailed(argsAnalysis, kernelIndirectionExprs);
 
-  free(name);
+  KernelAnalysis *ret =
+    new KernelAnalysis(name.c_str(), numArgs, isScalarArray, argsSizes,
+		       argsTypes, argsAnalysis, kernelIndirectionExprs);
+  ret->setFeatures(features);
 
   return ret;
 }
 
+KernelAnalysis *
+KernelAnalysis::open(const char *data, size_t size) {
+  MemoryStreamBuf buf(data, size);
+  std::istream s(&buf);
+  return open(s);
+}
+
 KernelAnalysis *
 KernelAnalysis::openFromFile(const std::string &name) {
   std::ifstream in(name.c_str(), std::ios::in | std::ios::binary);
-  std::stringstream ss;
-  ss << in.rdbuf();
-  in.close();
 
-  return open(ss);
+  return open(in);
+}
+
+KernelAnalysis *
+KernelAnalysis::clone() const {
+  std::stringstream s;
+  write(s);
+  return open(s);
 }
 
 void
@@ -648,4 +882,17 @@ KernelAnalysis::debug() {
 	      << " cb " << kernelIndirectionExprs[i]->numBytes << "\n";
     kernelIndirectionExprs[i]->expr->dump();
   }
+
+  std::cerr << "Features: " << features.nbArithOps << " arithmetic ops ("
+	    << features.nbFloatOps << " floating point), "
+	    << features.nbMemOps << " memory ops, "
+	    << features.globalBytes << " global bytes, loop depth "
+	    << features.loopDepth
+	    << (features.usesBarriers ? ", barriers" : "")
+	    << (features.usesLocalMemory ? ", local memory" : "")
+	    << (features.usesWorkGroupIds ? ", work-group ids" : "") << "\n";
+
+  std::cerr << "Expression arena: " << arena->getNbNodes() << " nodes, "
+	    << arena->getNbSharedNodes() << " shared, "
+	    << arena->getNbBoundsHits() << " memoized bounds reused\n";
 }
@@ -202,6 +202,27 @@ NDRange::shiftRight(unsigned dim, int nbWgs) {
   m_global_work_size[dim] = new_global_size;
 }
 
+bool
+NDRange::sameExceptDim(const NDRange &ndRange, unsigned dimindx) const {
+  if (work_dim != ndRange.work_dim)
+    return false;
+
+  for (unsigned i=0; i<work_dim; i++) {
+    if (m_orig_global_work_size[i] != ndRange.m_orig_global_work_size[i] ||
+	m_local_work_size[i] != ndRange.m_local_work_size[i])
+      return false;
+
+    if (i == dimindx)
+      continue;
+
+    if (m_global_work_size[i] != ndRange.m_global_work_size[i] ||
+	m_offset[i] != ndRange.m_offset[i])
+      return false;
+  }
+
+  return true;
+}
+
 void
 NDRange::dump() const {
   std::cerr << "orig global work size : [";
@@ -0,0 +1,119 @@
+#include "Record.h"
+
+void
+writeRecord(std::stringstream &s, const std::stringstream &record) {
+  std::string str = record.str();
+  uint64_t size = str.size();
+  s.write(reinterpret_cast<const char *>(&size), sizeof(size));
+  s.write(str.data(), size);
+}
+
+std::streampos
+readRecordSize(std::istream &s) {
+  uint64_t size = 0;
+  s.read(reinterpret_cast<char *>(&size), sizeof(size));
+  if (!s.good())
+    return std::streampos(-1);
+
+  std::streampos pos = s.tellg();
+  std::streampos streamEnd = getStreamEnd(s);
+  if (!s.good() || size > static_cast<uint64_t>(streamEnd - pos)) {
+    s.setstate(std::ios_base::failbit);
+    return std::streampos(-1);
+  }
+
+  return pos + static_cast<std::streamoff>(size);
+}
+
+std::streampos
+getStreamEnd(std::istream &s) {
+  std::streampos pos = s.tellg();
+  if (pos == std::streampos(-1)) {
+    s.setstate(std::ios_base::failbit);
+    return pos;
+  }
+  s.seekg(0, std::ios_base::end);
+  std::streampos end = s.tellg();
+  s.seekg(pos);
+  return end;
+}
+
+bool
+readCount(std::istream &s, std::streampos end, size_t minSize,
+	  unsigned *count) {
+  *count = 0;
+  s.read(reinterpret_cast<char *>(count), sizeof(*count));
+  if (!s.good())
+    return false;
+
+  std::streampos pos = s.tellg();
+  if (pos == std::streampos(-1) || pos > end ||
+      static_cast<uint64_t>(*count) * minSize >
+      static_cast<uint64_t>(end - pos)) {
+    s.setstate(std::ios_base::failbit);
+    return false;
+  }
+
+  return true;
+}
+
+bool
+checkRecordEnd(std::istream &s, std::streampos end) {
+  if (s.good() && s.tellg() == end)
+    return true;
+  s.setstate(std::ios_base::failbit);
+  return false;
+}
+
+bool
+readBool(std::istream &s, bool *value) {
+  static_assert(sizeof(bool) == sizeof(uint8_t), "bools are written as bytes");
+  uint8_t n;
+  s.read(reinterpret_cast<char *>(&n), sizeof(n));
+  if (!s.good())
+    return false;
+  if (n > 1) {
+    s.setstate(std::ios_base::failbit);
+    return false;
+  }
+  *value = n;
+  return true;
+}
+
+MemoryStreamBuf::MemoryStreamBuf(const char *data, size_t size) {
+  char *p = const_cast<char *>(data);
+  setg(p, p, p + size);
+}
+
+MemoryStreamBuf::pos_type
+MemoryStreamBuf::seekoff(off_type off, std::ios_base::seekdir dir,
+			 std::ios_base::openmode which) {
+  if (!(which & std::ios_base::in))
+    return pos_type(off_type(-1));
+
+  char *pos;
+  switch (dir) {
+  case std::ios_base::beg:
+    pos = eback() + off;
+    break;
+  case std::ios_base::cur:
+    pos = gptr() + off;
+    break;
+  case std::ios_base::end:
+    pos = egptr() + off;
+    break;
+  default:
+    return pos_type(off_type(-1));
+  };
+
+  if (pos < eback() || pos > egptr())
+    return pos_type(off_type(-1));
+
+  setg(eback(), pos, egptr());
+  return pos_type(pos - eback());
+}
+
+MemoryStreamBuf::pos_type
+MemoryStreamBuf::seekpos(pos_type pos, std::ios_base::openmode which) {
+  return seekoff(off_type(pos), std::ios_base::beg, which);
+}
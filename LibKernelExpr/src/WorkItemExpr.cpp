@@ -1,6 +1,8 @@
+#include "IndexExpr/IndexExprArena.h"
 #include "IndexExpr/IndexExprOCL.h"
 #include "IndexExpr/IndexExprValue.h"
 #include "NDRange.h"
+#include "Record.h"
 #include "WorkItemExpr.h"
 
 #include <cassert>
@@ -20,7 +22,7 @@ WorkItemExpr::WorkItemExpr(IndexExpr *wiExpr, std::vector<GuardExpr *> *guards)
 }
 
 WorkItemExpr::~WorkItemExpr() {
-  delete mWiExpr;
+  IndexExpr::release(mWiExpr);
   for (unsigned i=0; i<mGuards->size(); ++i)
     delete (*mGuards)[i];
   delete mGuards;
@@ -39,6 +41,62 @@ WorkItemExpr::injectArgsValues(const std::vector<IndexExprValue *> &values,
     (*mGuards)[i]->injectArgsValues(values, kernelNDRange);
 }
 
+void
+WorkItemExpr::getArgsDependencies(std::set<unsigned> &args) const {
+  IndexExpr::getArgsDependencies(mWiExpr, args);
+
+  for (unsigned i=0; i<mGuards->size(); ++i)
+    (*mGuards)[i]->getArgsDependencies(args);
+}
+
+void
+WorkItemExpr::intern(IndexExprArena *arena) {
+  mWiExpr = arena->intern(mWiExpr);
+
+  for (unsigned i=0; i<mGuards->size(); ++i)
+    (*mGuards)[i]->intern(arena);
+}
+
+const IndexExpr *
+WorkItemExpr::getSharedExpr() const {
+  if (!mGuards->empty() || !mWiExpr->isInArena())
+    return NULL;
+
+  return mWiExpr;
+}
+
+bool
+WorkItemExpr::getSplitDimCoef(unsigned splitDim, const NDRange &kernelNDRange,
+			      long *coef) const {
+  // Guards on the split dimension clamp the subkernel bounds.
+  for (unsigned i=0; i<mGuards->size(); ++i) {
+    if ((*mGuards)[i]->getDim() == splitDim)
+      return false;
+  }
+
+  unsigned nbOcc;
+  return IndexExpr::getSplitDimCoef(mWiExpr, splitDim, kernelNDRange, coef,
+				    &nbOcc);
+}
+
+bool
+WorkItemExpr::getArgCoef(unsigned pos,
+			 const std::vector<unsigned> &changedArgs,
+			 const NDRange &kernelNDRange, long *coef) const {
+  // Guards on the changed arguments clamp the subkernel bounds.
+  std::set<unsigned> guardsArgs;
+  for (unsigned i=0; i<mGuards->size(); ++i)
+    (*mGuards)[i]->getArgsDependencies(guardsArgs);
+  for (unsigned i=0; i<changedArgs.size(); ++i) {
+    if (guardsArgs.find(changedArgs[i]) != guardsArgs.end())
+      return false;
+  }
+
+  unsigned nbOcc;
+  return IndexExpr::getArgCoef(mWiExpr, pos, changedArgs, kernelNDRange, coef,
+			       &nbOcc);
+}
+
 IndexExpr *
 WorkItemExpr::getKernelExpr(const NDRange &kernelNDRange,
 			    const std::vector<IndirectionValue> &indirValues)
@@ -71,11 +129,15 @@ WorkItemExpr::dump() const {
 
 void
 WorkItemExpr::write(std::stringstream &s) const {
-  mWiExpr->write(s);
+  std::stringstream record;
+
+  mWiExpr->write(record);
   unsigned size = mGuards->size();
-  s.write(reinterpret_cast<const char *>(&size), sizeof(size));
+  record.write(reinterpret_cast<const char *>(&size), sizeof(size));
   for (unsigned i=0; i<mGuards->size(); ++i)
-    (*mGuards)[i]->write(s);
+    (*mGuards)[i]->write(record);
+
+  writeRecord(s, record);
 }
 
 void
@@ -83,20 +145,37 @@ WorkItemExpr::writeToFile(const std::string &name) const {
   std::ofstream out(name.c_str(), std::ofstream::trunc | std::ofstream::binary);
   std::stringstream ss;
   write(ss);
-  out << ss;
+  out << ss.rdbuf();
   out.close();
 }
 
 WorkItemExpr *
-WorkItemExpr::open(std::stringstream &s) {
+WorkItemExpr::open(std::istream &s) {
+  std::streampos end = readRecordSize(s);
+  if (!s.good())
+    return NULL;
+
   IndexExpr *expr = IndexExpr::open(s);
 
-  unsigned nbGuards;
-  s.read(reinterpret_cast<char *>(&nbGuards), sizeof(nbGuards));
+  // Each guard is a record prefixed with its size.
+  unsigned nbGuards = 0;
+  if (s.good())
+    readCount(s, end, sizeof(uint64_t), &nbGuards);
 
   std::vector<GuardExpr *> *guards = new std::vector<GuardExpr *>();
-  for (unsigned i=0; i<nbGuards; ++i)
-    guards->push_back(GuardExpr::open(s));
+  for (unsigned i=0; i<nbGuards && s.good(); ++i) {
+    GuardExpr *guard = GuardExpr::open(s);
+    if (guard)
+      guards->push_back(guard);
+  }
+
+  if (!checkRecordEnd(s, end)) {
+    IndexExpr::release(expr);
+    for (unsigned i=0; i<guards->size(); ++i)
+      delete (*guards)[i];
+    delete guards;
+    return NULL;
+  }
 
   return  new WorkItemExpr(expr, guards);
 }
@@ -104,10 +183,7 @@ WorkItemExpr::open(std::stringstream &s) {
 WorkItemExpr *
 WorkItemExpr::openFromFile(const std::string &name) {
   std::ifstream in(name.c_str(), std::ifstream::binary);
-  std::stringstream ss;
-  ss << in.rdbuf();
-  in.close();
-  return open(ss);
+  return open(in);
 }
 
 bool
@@ -0,0 +1,138 @@
+// Opening a truncated or corrupted analysis returns NULL instead of reading
+// past its records.
+
+#include "KernelAnalysis.h"
+#include "IndexExpr/IndexExprs.h"
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+static unsigned nbFailures = 0;
+
+#define CHECK(cond)							\
+  do {									\
+    if (!(cond)) {							\
+      std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: "	\
+		<< #cond << "\n";					\
+      nbFailures++;							\
+    }									\
+  } while (0)
+
+static IndexExpr *gid0() {
+  return new IndexExprOCL(IndexExprOCL::GET_GLOBAL_ID,
+			  IndexExprValue::createLong(0));
+}
+
+static KernelAnalysis *createAnalysis() {
+  // a[gid + n] = b[max(gid, 1) * 2] with a guard gid < 512.
+  std::vector<GuardExpr *> guards;
+  guards.push_back(new GuardExpr(IndexExprOCL::GET_GLOBAL_ID, 0,
+				 GuardExpr::LT, true,
+				 IndexExprValue::createLong(512)));
+  IndexExpr *maxOps[2] = { gid0(), IndexExprValue::createLong(1) };
+  IndexExpr *load =
+    new IndexExprBinop(IndexExprBinop::Mul, new IndexExprMax(2, maxOps),
+		       IndexExprValue::createLong(2));
+  IndexExpr *store = new IndexExprBinop(IndexExprBinop::Add, gid0(),
+					new IndexExprArg("arg", 2));
+
+  std::vector<WorkItemExpr *> loads, stores, none;
+  loads.push_back(new WorkItemExpr(*load, guards));
+  stores.push_back(new WorkItemExpr(*store, guards));
+  delete load;
+  delete store;
+  delete guards[0];
+
+  std::vector<ArgumentAnalysis *> argsAnalysis;
+  argsAnalysis.push_back(new ArgumentAnalysis(0, ArgumentAnalysis::INT, 4,
+					      none, stores, none, none, none,
+					      none));
+  argsAnalysis.push_back(new ArgumentAnalysis(1, ArgumentAnalysis::INT, 4,
+					      loads, none, none, none, none,
+					      none));
+  delete loads[0];
+  delete stores[0];
+
+  std::vector<bool> scalarArgs = {false, false, true};
+  std::vector<size_t> sizes = {0, 0, 4};
+  std::vector<ArgumentAnalysis::TYPE> types =
+    {ArgumentAnalysis::UNKNOWN, ArgumentAnalysis::UNKNOWN,
+     ArgumentAnalysis::INT};
+  std::vector<ArgIndirectionRegionExpr *> indirections;
+
+  return new KernelAnalysis("kernel", 3, scalarArgs, sizes, types,
+			    argsAnalysis, indirections);
+}
+
+static std::string write(const KernelAnalysis *analysis) {
+  std::stringstream ss;
+  analysis->write(ss);
+  return ss.str();
+}
+
+int main() {
+  KernelAnalysis *analysis = createAnalysis();
+  std::string data = write(analysis);
+  delete analysis;
+
+  // Round-trip.
+  analysis = KernelAnalysis::open(data.data(), data.size());
+  CHECK(analysis != NULL);
+  if (analysis) {
+    CHECK(!strcmp(analysis->getName(), "kernel"));
+    CHECK(analysis->getNbGlobalArguments() == 2);
+    CHECK(write(analysis) == data);
+    delete analysis;
+  }
+
+  // Every truncation is rejected.
+  for (size_t size=0; size<data.size(); size++)
+    CHECK(KernelAnalysis::open(data.data(), size) == NULL);
+
+  // Another format version is rejected with an error.
+  std::string other = data;
+  other[sizeof(unsigned)]++;
+  std::stringstream err;
+  std::streambuf *cerrBuf = std::cerr.rdbuf(err.rdbuf());
+  CHECK(KernelAnalysis::open(other.data(), other.size()) == NULL);
+  std::cerr.rdbuf(cerrBuf);
+  CHECK(!err.str().empty());
+
+  // Out of range bools and enumerators are rejected: the scalar flag of the
+  // first argument, after the header, the record size and the name.
+  std::string flag = data;
+  flag[2 * sizeof(unsigned) + sizeof(uint64_t) + sizeof(unsigned) + 6 +
+       sizeof(unsigned)] = 2;
+  CHECK(KernelAnalysis::open(flag.data(), flag.size()) == NULL);
+
+  // Corrupted bytes either give another analysis or NULL, never a read past
+  // the data or an invalid enumerator, which would be reported by the
+  // address and undefined behavior sanitizers. The version bytes are skipped
+  // as they are checked above.
+  for (size_t i=0; i<data.size(); i++) {
+    if (i >= sizeof(unsigned) && i < 2 * sizeof(unsigned))
+      continue;
+    for (unsigned char c : {0x00, 0x7f, 0xff}) {
+      std::string corrupted = data;
+      corrupted[i] = c;
+      delete KernelAnalysis::open(corrupted.data(), corrupted.size());
+    }
+  }
+
+  // Huge counts and record sizes are rejected before allocating.
+  std::string huge = data;
+  memset(&huge[2 * sizeof(unsigned)], 0xff, sizeof(uint64_t));
+  CHECK(KernelAnalysis::open(huge.data(), huge.size()) == NULL);
+  huge = data;
+  memset(&huge[2 * sizeof(unsigned) + sizeof(uint64_t)], 0xff,
+	 sizeof(unsigned));
+  CHECK(KernelAnalysis::open(huge.data(), huge.size()) == NULL);
+
+  if (nbFailures > 0) {
+    std::cerr << nbFailures << " check(s) failed\n";
+    return 1;
+  }
+
+  return 0;
+}
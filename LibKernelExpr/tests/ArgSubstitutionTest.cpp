@@ -0,0 +1,200 @@
+// Regions updated in closed form when only scalar arguments change, checked
+// against a full instantiation with the new values.
+
+#include "ArgumentAnalysis.h"
+#include "IndexExpr/IndexExprs.h"
+
+#include <iostream>
+
+static unsigned nbFailures = 0;
+
+#define CHECK(cond)							\
+  do {									\
+    if (!(cond)) {							\
+      std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: "	\
+		<< #cond << "\n";					\
+      nbFailures++;							\
+    }									\
+  } while (0)
+
+static const unsigned N = 1;
+static const unsigned M = 2;
+
+static IndexExpr *gid0() {
+  return new IndexExprOCL(IndexExprOCL::GET_GLOBAL_ID,
+			  IndexExprValue::createLong(0));
+}
+
+static IndexExpr *arg(unsigned pos) {
+  return new IndexExprArg("arg", pos);
+}
+
+static IndexExpr *mul(IndexExpr *e1, IndexExpr *e2) {
+  return new IndexExprBinop(IndexExprBinop::Mul, e1, e2);
+}
+
+static IndexExpr *add(IndexExpr *e1, IndexExpr *e2) {
+  return new IndexExprBinop(IndexExprBinop::Add, e1, e2);
+}
+
+static IndexExpr *sub(IndexExpr *e1, IndexExpr *e2) {
+  return new IndexExprBinop(IndexExprBinop::Sub, e1, e2);
+}
+
+static std::vector<IndexExprValue *> values(long n, long m) {
+  std::vector<IndexExprValue *> ret;
+  ret.push_back(IndexExprValue::createLong(0)); // buffer
+  ret.push_back(IndexExprValue::createLong(n));
+  ret.push_back(IndexExprValue::createLong(m));
+  return ret;
+}
+
+static void deleteValues(std::vector<IndexExprValue *> &v) {
+  for (IndexExprValue *value : v)
+    delete value;
+  v.clear();
+}
+
+static ArgumentAnalysis *createAnalysis(IndexExpr *load, IndexExpr *store) {
+  std::vector<GuardExpr *> guards;
+  std::vector<WorkItemExpr *> loads, stores, none;
+  loads.push_back(new WorkItemExpr(*load, guards));
+  stores.push_back(new WorkItemExpr(*store, guards));
+  delete load;
+  delete store;
+
+  ArgumentAnalysis *ret =
+    new ArgumentAnalysis(0, ArgumentAnalysis::INT, 4, loads, stores, none,
+			 none, none, none);
+  delete loads[0];
+  delete stores[0];
+  return ret;
+}
+
+static void analyse(ArgumentAnalysis *a, const NDRange &ndRange,
+		    const std::vector<NDRange> &subNDRanges,
+		    const std::vector<IndexExprValue *> &argValues) {
+  std::vector<std::vector<IndirectionValue> >
+    indirValues(subNDRanges.size());
+  a->setPartition(&ndRange, &subNDRanges);
+  a->injectArgValues(argValues);
+  a->performAnalysis(indirValues);
+}
+
+static bool sameRegions(const ArgumentAnalysis *a, const ArgumentAnalysis *b,
+			unsigned nbSplit) {
+  for (unsigned i=0; i<nbSplit; i++) {
+    if (a->getReadSubkernelRegion(i).toString() !=
+	b->getReadSubkernelRegion(i).toString() ||
+	a->getWrittenSubkernelRegion(i).toString() !=
+	b->getWrittenSubkernelRegion(i).toString())
+      return false;
+  }
+  return true;
+}
+
+// Update the arguments from (n0, m0) to (n1, m1) and compare the regions to
+// the ones of a full instantiation.
+static void testUpdate(IndexExpr *load, IndexExpr *store, long n0, long m0,
+		       long n1, long m1, bool expectSubstituted) {
+  size_t gws[1] = {1024}, lws[1] = {64};
+  NDRange ndRange(1, gws, NULL, lws);
+  double granu[6] = {0, 1, 0.25, 1, 1, 0.75};
+  std::vector<NDRange> subNDRanges;
+  ndRange.splitDim(0, 6, granu, &subNDRanges);
+
+  ArgumentAnalysis *updated = createAnalysis(load->clone(), store->clone());
+  ArgumentAnalysis *full = createAnalysis(load, store);
+
+  std::vector<IndexExprValue *> oldValues = values(n0, m0);
+  std::vector<IndexExprValue *> newValues = values(n1, m1);
+  std::vector<unsigned> changedArgs;
+  if (n0 != n1)
+    changedArgs.push_back(N);
+  if (m0 != m1)
+    changedArgs.push_back(M);
+
+  analyse(updated, ndRange, subNDRanges, oldValues);
+  bool substituted;
+  bool recompute = updated->updateArgValues(newValues, changedArgs, true,
+					    &substituted);
+  CHECK(substituted == expectSubstituted);
+  CHECK(recompute == !expectSubstituted);
+  CHECK(updated->analysisIsUpToDate() == expectSubstituted);
+  if (recompute) {
+    std::vector<std::vector<IndirectionValue> > indirValues(2);
+    updated->performAnalysis(indirValues);
+  }
+
+  analyse(full, ndRange, subNDRanges, newValues);
+  CHECK(sameRegions(updated, full, 2));
+
+  deleteValues(oldValues);
+  deleteValues(newValues);
+  delete updated;
+  delete full;
+}
+
+static void testArgCoef() {
+  size_t gws[1] = {1024}, lws[1] = {64};
+  NDRange ndRange(1, gws, NULL, lws);
+  std::vector<IndexExprValue *> argValues = values(5, 7);
+  std::vector<unsigned> both = {N, M};
+  long coef;
+  unsigned nbOcc;
+
+  // 3*n - m + gid
+  IndexExpr *e = add(sub(mul(IndexExprValue::createLong(3), arg(N)), arg(M)),
+		     gid0());
+  IndexExpr::injectArgsValues(e, argValues);
+  CHECK(IndexExpr::getArgCoef(e, N, both, ndRange, &coef, &nbOcc) &&
+	coef == 3 && nbOcc == 1);
+  CHECK(IndexExpr::getArgCoef(e, M, both, ndRange, &coef, &nbOcc) &&
+	coef == -1 && nbOcc == 1);
+  delete e;
+
+  // n*m is not affine if both change, n is if only n does.
+  e = add(mul(arg(N), arg(M)), gid0());
+  IndexExpr::injectArgsValues(e, argValues);
+  CHECK(!IndexExpr::getArgCoef(e, N, both, ndRange, &coef, &nbOcc));
+  std::vector<unsigned> onlyN = {N};
+  CHECK(IndexExpr::getArgCoef(e, N, onlyN, ndRange, &coef, &nbOcc) &&
+	coef == 7);
+  delete e;
+
+  // n - n and gid*n are not affine.
+  e = sub(arg(N), arg(N));
+  IndexExpr::injectArgsValues(e, argValues);
+  CHECK(!IndexExpr::getArgCoef(e, N, onlyN, ndRange, &coef, &nbOcc));
+  delete e;
+  e = mul(gid0(), arg(N));
+  IndexExpr::injectArgsValues(e, argValues);
+  CHECK(!IndexExpr::getArgCoef(e, N, onlyN, ndRange, &coef, &nbOcc));
+  delete e;
+
+  deleteValues(argValues);
+}
+
+int main() {
+  testArgCoef();
+
+  // Affine in n, e.g. an iteration counter.
+  testUpdate(add(gid0(), arg(N)), add(gid0(), mul(IndexExprValue::createLong(2),
+						  arg(N))),
+	     0, 1, 10, 1, true);
+  // Affine in n and m, both changing.
+  testUpdate(add(gid0(), sub(arg(N), arg(M))),
+	     add(mul(arg(M), IndexExprValue::createLong(4)), gid0()),
+	     3, 8, 40, 2, true);
+  // Only m changes, the store does not depend on it.
+  testUpdate(add(gid0(), arg(M)), add(gid0(), arg(N)), 3, 8, 3, 100, true);
+  // Not affine in n: fully re-instantiated.
+  testUpdate(mul(gid0(), arg(N)), gid0(), 1, 0, 2, 0, false);
+
+  if (nbFailures > 0) {
+    std::cerr << nbFailures << " check(s) failed\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -1,5 +1,6 @@
 #include <BufferManager.h>
 #include <Globals.h>
+#include <IndexExpr/IndexExprValue.h>
 #include <Options.h>
 #include <Queue/DeviceQueue.h>
 #include <Utils/Debug.h>
@@ -9,11 +10,35 @@
 
 namespace libsplit {
   BufferManager::BufferManager(bool delayedWrite)
-    : delayedWrite(delayedWrite) {
+    : nbIndirectionHits(0), nbIndirectionMisses(0),
+      delayedWrite(delayedWrite) {
     noMemcpy = optNoMemcpy;
+    pthread_mutex_init(&mapLock, NULL);
+    pthread_mutex_init(&cacheLock, NULL);
   }
 
-  BufferManager::~BufferManager() {}
+  BufferManager::~BufferManager() {
+    for (auto &it : indirectionCache)
+      delete it.second.value;
+    pthread_mutex_destroy(&mapLock);
+    pthread_mutex_destroy(&cacheLock);
+  }
+
+  void
+  BufferManager::invalidate(MemoryHandle *m) {
+    m->version++;
+  }
+
+  void
+  BufferManager::releaseBuffer(MemoryHandle *m) {
+    pthread_mutex_lock(&cacheLock);
+    auto it = indirectionCache.lower_bound(indirection_key(m->id, 0, 0, INT));
+    while (it != indirectionCache.end() && std::get<0>(it->first) == m->id) {
+      delete it->second.value;
+      it = indirectionCache.erase(it);
+    }
+    pthread_mutex_unlock(&cacheLock);
+  }
 
   void
   BufferManager::read(MemoryHandle *m, cl_bool blocking, size_t offset,
@@ -86,13 +111,17 @@ namespace libsplit {
 			   (char *) ptr + myoffset - offset,
 			   event);
 	timeline->pushD2HEvent(event, queue->dev_id);
+	event->release();
       }
     }
 
     // FIXME: It is always blocking because a call to clEnqueueReadBuffer
     // returns a fake event. Thus there is no way for the user to know
     // when the command has been executed.
+    // Only wait for the devices read from.
     for (unsigned d=0; d<m->mNbBuffers; d++) {
+      if (toReadDevice[d]->mList.empty())
+	continue;
       DeviceQueue *queue = m->mContext->getQueueNo(d);
       queue->finish();
     }
@@ -118,6 +147,8 @@ namespace libsplit {
     size_t total_cb = offset + size;
     m->mMaxUsedSize = total_cb > m->mMaxUsedSize ? total_cb : m->mMaxUsedSize;
 
+    invalidate(m);
+
     if (!delayedWrite) {
       for (unsigned d=0; d<m->mNbBuffers; d++) {
 	DeviceQueue *queue = m->mContext->getQueueNo(d);
@@ -125,6 +156,7 @@ namespace libsplit {
 	queue->enqueueWrite(m->mBuffers[d], offset, size, ptr,
 			    event);
 	timeline->pushH2DEvent(event, queue->dev_id);
+	event->release();
       }
 
       // Update valid data.
@@ -164,6 +196,7 @@ namespace libsplit {
     size_t dst_max = dst->mMaxUsedSize;
     dst->mMaxUsedSize = total_cb > dst_max ? total_cb : dst_max;
 
+    invalidate(dst);
 
     // First ensure that local buffer contains valid data for the required
     // interval.
@@ -195,6 +228,7 @@ namespace libsplit {
 		std::cerr << "enqueueCopy: reading [" << myoffset << "," << myoffset+mycb-1
 		<< "] from dev " << d << "\n");
 
+	  src->recordTransfer(d, myoffset, mycb);
 	  Event *event = eventFactory->getNewEvent();
 	  queue->enqueueRead(src->mBuffers[d],
 			     myoffset,
@@ -202,6 +236,7 @@ namespace libsplit {
 			     (char *) src->mLocalBuffer + myoffset,
 			     event);
 	  timeline->pushD2HEvent(event, queue->dev_id);
+	  event->release();
 	}
 
 	missing.difference(*intersection);
@@ -238,7 +273,10 @@ namespace libsplit {
     (void) blocking_map;
 
     void *address = (void *) (((char *) m->mLocalBuffer) + offset);
-    if (map_entries.find(address) != map_entries.end()) {
+    pthread_mutex_lock(&mapLock);
+    bool mapped = map_entries.find(address) != map_entries.end();
+    pthread_mutex_unlock(&mapLock);
+    if (mapped) {
       std::cerr << "Error: address already mapped !\n";
       exit(EXIT_FAILURE);
     }
@@ -263,11 +301,13 @@ namespace libsplit {
 	for (unsigned i=0; i<toRead->mList.size(); i++) {
 	  size_t myoffset = toRead->mList[i].lb;
 	  size_t mycb = toRead->mList[i].hb - myoffset + 1;
+	  m->recordTransfer(d, myoffset, mycb);
 	  Event *event = eventFactory->getNewEvent();
 	  queue->enqueueRead(m->mBuffers[d], myoffset, mycb,
 			     (char *) m->mLocalBuffer + myoffset,
 			     event);
 	  timeline->pushD2HEvent(event, queue->dev_id);
+	  event->release();
 	}
 	missing->difference(*toRead);
 	delete toRead;
@@ -284,13 +324,16 @@ namespace libsplit {
       }
     }
 
+    pthread_mutex_lock(&mapLock);
     map_entries.emplace(address, map_entry(offset, cb, flags & CL_MAP_WRITE));
+    pthread_mutex_unlock(&mapLock);
 
     return address;
   }
 
   void
   BufferManager::unmap(MemoryHandle *m, void *mapped_ptr) {
+    pthread_mutex_lock(&mapLock);
     auto I = map_entries.find(mapped_ptr);
     if (I == map_entries.end()) {
       std::cerr << "Error: unmap\n";
@@ -298,12 +341,14 @@ namespace libsplit {
     }
 
     Interval inter(I->second.offset, I->second.offset+I->second.cb-1);
+    bool isWrite = I->second.isWrite;
     map_entries.erase(I);
+    pthread_mutex_unlock(&mapLock);
 
-    if (!I->second.isWrite)
+    if (!isWrite)
       return;
 
-
+    invalidate(m);
 
     for (unsigned d=0; d<m->mNbBuffers; d++)
       m->devicesValidData[d].remove(inter);
@@ -312,6 +357,8 @@ namespace libsplit {
   void
   BufferManager::fill(MemoryHandle *m, const void *pattern, size_t pattern_size,
 		      size_t offset, size_t size) {
+    invalidate(m);
+
     // EnqueueFillBuffer for all devices.
     for (unsigned d=0; d<m->mNbBuffers; d++) {
       DeviceQueue *queue = m->mContext->getQueueNo(d);
@@ -320,6 +367,7 @@ namespace libsplit {
 			 event);
       std::string method("Fill");
       timeline->pushEvent(event, method, queue->dev_id);
+      event->release();
 
     }
 
@@ -339,6 +387,11 @@ namespace libsplit {
   void
   BufferManager::computeIndirectionTransfers(std::vector<BufferIndirectionRegion> &regions,
 					     std::vector<DeviceBufferRegion> &D2HTransferList) {
+    // Data required for each buffer, all the subkernels and indirections
+    // together so that there is a single transfer per buffer and device.
+    std::map<MemoryHandle *, ListInterval> requiredMap;
+    std::vector<MemoryHandle *> buffers;
+
     for (unsigned i=0; i<regions.size(); i++) {
       MemoryHandle *m = regions[i].m;
 
@@ -367,13 +420,27 @@ namespace libsplit {
       size_t hb = regions[i].hb;
       size_t cb = regions[i].cb;
 
+      // Values already read from the current version of the buffer.
+      regions[i].lbValue = getCachedIndirectionValue(m, lb, cb, regions[i].type);
+      regions[i].hbValue = getCachedIndirectionValue(m, hb, cb, regions[i].type);
+      if (regions[i].lbValue && regions[i].hbValue)
+	continue;
+
+      if (requiredMap.find(m) == requiredMap.end())
+	buffers.push_back(m);
+
       // Compute data required.
-      ListInterval required;
-      required.add(Interval(lb, lb+cb-1));
-      required.add(Interval(hb, hb+cb-1));
+      ListInterval &required = requiredMap[m];
+      if (!regions[i].lbValue)
+	required.add(Interval(lb, lb+cb-1));
+      if (!regions[i].hbValue)
+	required.add(Interval(hb, hb+cb-1));
+    }
 
+    for (MemoryHandle *m : buffers) {
       // Compute data missing on the host.
-      ListInterval *missing = ListInterval::difference(required, m->hostValidData);
+      ListInterval *missing =
+	ListInterval::difference(requiredMap[m], m->hostValidData);
       if (missing->total() == 0) {
 	delete missing;
 	continue;
@@ -400,13 +467,107 @@ namespace libsplit {
 	missing->debug();
 	std::cerr << "\n";
 	std::cerr << "buffer size : " << m->mSize << "\n";
-	std::cerr << "indirectionId : " << regions[i].indirectionId << "\n";
+	std::cerr << "buffer id : " << m->id << "\n";
       }
       assert(missing->total() == 0);
       delete missing;
     }
   }
 
+  void
+  BufferManager::readIndirectionValues(std::vector<BufferIndirectionRegion> &regions) {
+    for (unsigned i=0; i<regions.size(); i++) {
+      MemoryHandle *m = regions[i].m;
+      size_t cb = regions[i].cb;
+
+      if (!regions[i].lbValue)
+	regions[i].lbValue =
+	  readIndirectionValue(m, regions[i].lb, cb, regions[i].type);
+      if (!regions[i].hbValue)
+	regions[i].hbValue =
+	  readIndirectionValue(m, regions[i].hb, cb, regions[i].type);
+    }
+  }
+
+  IndexExprValue *
+  BufferManager::getCachedIndirectionValue(MemoryHandle *m, size_t offset,
+					   size_t cb, IndirectionType type) {
+    IndexExprValue *value = NULL;
+
+    pthread_mutex_lock(&cacheLock);
+    auto it = indirectionCache.find(indirection_key(m->id, offset, cb, type));
+    if (it != indirectionCache.end() && it->second.version == m->version) {
+      nbIndirectionHits++;
+      value = static_cast<IndexExprValue *>(it->second.value->clone());
+    }
+    pthread_mutex_unlock(&cacheLock);
+
+    return value;
+  }
+
+  IndexExprValue *
+  BufferManager::readIndirectionValue(MemoryHandle *m, size_t offset,
+				      size_t cb, IndirectionType type) {
+    void *address = ((char *)m->mLocalBuffer) + offset;
+    IndexExprValue *value = NULL;
+
+    switch (type) {
+    case INT:
+      switch(cb) {
+      case 8:
+	value = IndexExprValue::createLong(*((long *) address));
+	break;
+      case 4:
+	value = IndexExprValue::createLong((long) *((int *) address));
+	break;
+      case 2:
+	value = IndexExprValue::createLong((long) *((short *) address));
+	break;
+      case 1:
+	value = IndexExprValue::createLong((long) *((char *) address));
+	break;
+      default:
+	std::cerr << "Error: Unhandled integer size : " << cb << "\n";
+	exit(EXIT_FAILURE);
+      };
+      break;
+    case FLOAT:
+      assert(cb == 4);
+      value = IndexExprValue::createFloat(*((float *) address));
+      break;
+    case DOUBLE:
+      assert(cb == 8);
+      value = IndexExprValue::createDouble(*((double *) address));
+      break;
+    case UNDEF:
+      std::cerr << "Error: unknown indirection type.\n";
+      exit(EXIT_FAILURE);
+    };
+
+    pthread_mutex_lock(&cacheLock);
+    nbIndirectionMisses++;
+
+    indirection_key key(m->id, offset, cb, type);
+    auto it = indirectionCache.find(key);
+    if (it != indirectionCache.end()) {
+      delete it->second.value;
+      indirectionCache.erase(it);
+    }
+    indirectionCache.emplace(key,
+			     indirection_entry(m->version,
+					       static_cast<IndexExprValue *>
+					       (value->clone())));
+    pthread_mutex_unlock(&cacheLock);
+
+    return value;
+  }
+
+  void
+  BufferManager::printIndirectionStats() const {
+    std::cerr << "indirection values: " << nbIndirectionHits << " cached, "
+	      << nbIndirectionMisses << " read\n";
+  }
+
   void
   BufferManager::computeTransfers(std::vector<DeviceBufferRegion> &
 				  dataRequired,
@@ -470,6 +631,13 @@ namespace libsplit {
       }
     }
 
+    // The content of the buffers written by the kernel changes, indirection
+    // values read from them are no longer valid.
+    for (auto *written : { &dataWritten, &dataWrittenMerge, &dataWrittenOr,
+	  &dataWrittenAtomicSum, &dataWrittenAtomicMin, &dataWrittenAtomicMax })
+      for (unsigned i=0; i<written->size(); i++)
+	invalidate((*written)[i].m);
+
     // Compute a map of the written atomic sum region for each memory handle.
     std::map<MemoryHandle *, ListInterval> atomicSumHostRequiredData;
     for (unsigned i=0; i<dataWrittenAtomicSum.size(); i++) {
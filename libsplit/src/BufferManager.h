@@ -4,9 +4,13 @@
 #include <Indirection.h>
 #include <Handle/MemoryHandle.h>
 #include <ListInterval.h>
+#include <map>
+#include <tuple>
 #include <utility>
 #include <vector>
 
+#include <pthread.h>
+
 namespace libsplit {
   struct DeviceBufferRegion {
     DeviceBufferRegion(MemoryHandle *m, unsigned devId, ListInterval &region,
@@ -57,7 +61,34 @@ namespace libsplit {
       size_t isWrite;
     };
 
+    // Mapped regions of all the buffers. The commands on a buffer are
+    // serialized by the lock of its handle, mapLock only protects the map.
     std::map<void *, map_entry> map_entries;
+    pthread_mutex_t mapLock;
+
+    // Indirection values read on the host, indexed by buffer id, offset, size
+    // and type. A value is valid as long as the version of the buffer is the
+    // one it has been read from.
+    struct indirection_entry {
+      indirection_entry(unsigned long version, IndexExprValue *value)
+	: version(version), value(value) {}
+      ~indirection_entry() {}
+
+      unsigned long version;
+      IndexExprValue *value;
+    };
+
+    typedef std::tuple<unsigned, size_t, size_t, IndirectionType>
+    indirection_key;
+    std::map<indirection_key, indirection_entry> indirectionCache;
+    unsigned nbIndirectionHits;
+    unsigned nbIndirectionMisses;
+    pthread_mutex_t cacheLock; // Protects the cache and its counters
+
+    IndexExprValue *getCachedIndirectionValue(MemoryHandle *m, size_t offset,
+					      size_t cb, IndirectionType type);
+    IndexExprValue *readIndirectionValue(MemoryHandle *m, size_t offset,
+					 size_t cb, IndirectionType type);
 
   public:
 
@@ -81,9 +112,23 @@ namespace libsplit {
     void fill(MemoryHandle *m, const void *pattern, size_t pattern_size,
 	      size_t offset, size_t size);
 
+    // Fill the indirection values that are cached and compute the D2H
+    // transfers required to read the others, batched per buffer and device.
     void computeIndirectionTransfers(std::vector<BufferIndirectionRegion> &regions,
 				     std::vector<DeviceBufferRegion> &D2HTransferList);
 
+    // Read the indirection values not filled from the host buffers once the
+    // transfers are done.
+    void readIndirectionValues(std::vector<BufferIndirectionRegion> &regions);
+
+    // Record that the content of m may have changed.
+    void invalidate(MemoryHandle *m);
+
+    // Drop the indirection values cached for m, which is being released.
+    void releaseBuffer(MemoryHandle *m);
+
+    void printIndirectionStats() const;
+
     void computeTransfers(std::vector<DeviceBufferRegion> &dataRequired,
 			  std::vector<DeviceBufferRegion> &dataWritten,
 			  std::vector<DeviceBufferRegion> &dataWrittenMerge,
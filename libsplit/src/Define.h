@@ -3,14 +3,18 @@
 
 namespace libsplit {
 
+// Headers of the clang used by ClInline, ClTransform and the in-memory
+// compilation of programs to LLVM IR.
+#define CLANG_INCLUDE_DIR LLVM_LIB_DIR "/clang/" CLANGVERSION "/include"
+
+// clang -cc1 arguments to compile programs to LLVM IR, followed by the
+// optimization passes run before the analysis.
 #if CLANGMAJOR >= 5
-#define OPENCLFLAGS "-Xclang -finclude-default-header -c -emit-llvm "	\
-  "-cl-std=CL1.2"
+#define OPENCLFLAGS "-cl-std=CL1.2 -finclude-default-header"
 
 #define OPTPASSES "-O2"
 #else
-#define OPENCLFLAGS "-cc1 -cl-std=CL1.2 "              \
-  "-emit-llvm-bc "				       \
+#define OPENCLFLAGS "-cl-std=CL1.2 "		       \
   "-finclude-default-header"			       \
   " -O0"
 
@@ -26,7 +30,9 @@ namespace libsplit {
   "-dse -adce -simplifycfg -strip-dead-prototypes -domtree -loop-reduce -verify"
 #endif
 
-#define PASSARG "-klanalysis"
+// Has to be increased when a change in libsplit invalidates the programs in
+// the persistent cache.
+#define LIBSPLIT_VERSION "1"
 
 #define QUOTE(name) #name
 #define STR(macro) QUOTE(macro)
@@ -27,6 +27,8 @@ clCreateCommandQueue(cl_context                     context,
   cl_command_queue ret = real_clCreateCommandQueue(ctxt, dev, properties, &err);
   clCheck(err, __FILE__, __LINE__);
 
+  driver->createStream(ret);
+
   if (errcode_ret)
     *errcode_ret = err;
 
@@ -42,7 +44,16 @@ clRetainCommandQueue(cl_command_queue command_queue)
 cl_int
 clReleaseCommandQueue(cl_command_queue command_queue)
 {
-  return real_clRetainCommandQueue(command_queue);
+  // The stream of the queue is dropped with its last reference, the handle
+  // may then be reused by another queue.
+  cl_uint refCount = 0;
+  cl_int err = real_clGetCommandQueueInfo(command_queue,
+					  CL_QUEUE_REFERENCE_COUNT,
+					  sizeof(refCount), &refCount, NULL);
+  if (err == CL_SUCCESS && refCount == 1)
+    driver->releaseStream(command_queue);
+
+  return real_clReleaseCommandQueue(command_queue);
 }
 
 cl_int
@@ -74,7 +85,9 @@ clFlush(cl_command_queue /* command_queue */)
 }
 
 cl_int
-clFinish(cl_command_queue /* command_queue */)
+clFinish(cl_command_queue command_queue)
 {
+  driver->finish(command_queue);
+
   return CL_SUCCESS;
 }
@@ -1,4 +1,5 @@
 #include <Dispatch/OpenCLFunctions.h>
+#include <Globals.h>
 
 #include <iostream>
 
@@ -6,12 +7,16 @@
 
 #include <CL/cl.h>
 
+using namespace libsplit;
+
 /* Event Object APIs */
 cl_int
 clWaitForEvents(cl_uint             num_events,
 		const cl_event *    event_list)
 {
-  return real_clWaitForEvents(num_events, event_list);
+  driver->waitForEvents(num_events, event_list);
+
+  return CL_SUCCESS;
 }
 
 cl_int
@@ -42,6 +47,13 @@ clRetainEvent(cl_event event)
 cl_int
 clReleaseEvent(cl_event event)
 {
+  // Forget the sub-kernels of the event with its last reference.
+  cl_uint refCount;
+  cl_int err = real_clGetEventInfo(event, CL_EVENT_REFERENCE_COUNT,
+				   sizeof(refCount), &refCount, NULL);
+  if (err == CL_SUCCESS && refCount == 1)
+    driver->releaseEvent(event);
+
   return real_clReleaseEvent(event);
 }
 
@@ -58,7 +58,9 @@ clSetKernelArg(cl_kernel    kernel,
 {
   KernelHandle *k = reinterpret_cast<KernelHandle *>(kernel);
 
+  k->lock();
   k->setKernelArg(arg_index, arg_size, arg_value);
+  k->unlock();
 
   return CL_SUCCESS;
 }
@@ -16,23 +16,13 @@
 #include <Options.h>
 #include <Globals.h>
 
+#include <algorithm>
 #include <set>
 
 #include <cstring>
 
 namespace libsplit {
 
-  static void waitForEvents(cl_uint num_events_in_wait_list,
-			    const cl_event *event_wait_list)
-  {
-    cl_int err;
-
-    if (event_wait_list) {
-      err = real_clWaitForEvents(num_events_in_wait_list, event_wait_list);
-      clCheck(err, __FILE__, __LINE__);
-    }
-  }
-
   static void createFakeEvent(cl_event *event, cl_command_queue queue) {
     if (event) {
       cl_int err;
@@ -83,9 +73,18 @@ namespace libsplit {
     }
   }
 
-  Driver::Driver() {
+  Driver::Driver()
+    : startTime(get_time()), firstKernelEnqueued(false), kernelNo(0),
+      dummyEventsEnqueued(false) {
+    pthread_mutex_init(&schedulerLock, NULL);
+    pthread_mutex_init(&dummyEventsLock, NULL);
+
     bufferMgr = new BufferManager(optDelayedWrite);
+    localSizeTuner = new LocalSizeTuner();
+    inspector = new Inspector();
+    streams = new StreamManager();
     unsigned nbDevices = optDeviceSelection.size() / 2;
+    taskPlacer = optDag ? new TaskPlacer(nbDevices) : NULL;
 
     if (optSkipKernels > 0) {
       scheduler = new SchedulerEnv(bufferMgr, nbDevices);
@@ -121,19 +120,96 @@ namespace libsplit {
   Driver::~Driver() {
     delete scheduler;
     delete bufferMgr;
+    delete localSizeTuner;
+    delete inspector;
+    delete streams;
+    delete taskPlacer;
+    pthread_mutex_destroy(&schedulerLock);
+    pthread_mutex_destroy(&dummyEventsLock);
   }
 
   void
-  Driver::enqueueDummyEvents() {
-    static bool done = false;
+  Driver::lockBuffers(std::vector<MemoryHandle *> &buffers) {
+    // Always taken in the order of the ids, so that threads locking
+    // several buffers cannot deadlock.
+    std::sort(buffers.begin(), buffers.end(),
+	      [](const MemoryHandle *a, const MemoryHandle *b) {
+		return a->id < b->id;
+	      });
+    buffers.erase(std::unique(buffers.begin(), buffers.end()),
+		  buffers.end());
+
+    for (MemoryHandle *m : buffers)
+      m->lock();
+  }
+
+  void
+  Driver::unlockBuffers(const std::vector<MemoryHandle *> &buffers) {
+    for (MemoryHandle *m : buffers)
+      m->unlock();
+  }
+
+  void
+  Driver::createStream(cl_command_queue queue) {
+    streams->createStream(queue);
+  }
+
+  void
+  Driver::releaseStream(cl_command_queue queue) {
+    streams->releaseStream(queue);
+  }
+
+  void
+  Driver::finish(cl_command_queue queue) {
+    streams->finish(queue);
+  }
 
-    if (done)
+  void
+  Driver::waitForEvents(cl_uint num_events_in_wait_list,
+			const cl_event *event_wait_list) {
+    if (!event_wait_list)
       return;
 
-    done = true;
+    streams->waitForEvents(num_events_in_wait_list, event_wait_list);
+
+    cl_int err = real_clWaitForEvents(num_events_in_wait_list,
+				      event_wait_list);
+    clCheck(err, __FILE__, __LINE__);
+  }
+
+  void
+  Driver::releaseEvent(cl_event event) {
+    streams->releaseEvent(event);
+  }
 
-    for (unsigned d=0; d<contextHandle->getNbDevices(); d++)
-      contextHandle->getQueueNo(d)->enqueueDummyEvents();
+  void
+  Driver::releaseBuffer(MemoryHandle *m) {
+    bufferMgr->releaseBuffer(m);
+  }
+
+  void
+  Driver::releaseKernel(KernelHandle *k) {
+    pthread_mutex_lock(&schedulerLock);
+    inspector->releaseKernel(k);
+    if (taskPlacer)
+      taskPlacer->releaseKernel(k);
+    localSizeTuner->releaseKernel(k);
+    pthread_mutex_unlock(&schedulerLock);
+  }
+
+  void
+  Driver::enqueueDummyEvents() {
+    if (dummyEventsEnqueued.load(std::memory_order_acquire))
+      return;
+
+    // Other threads wait until the dummy events are enqueued.
+    pthread_mutex_lock(&dummyEventsLock);
+    if (!dummyEventsEnqueued.load(std::memory_order_relaxed)) {
+      for (unsigned d=0; d<contextHandle->getNbDevices(); d++)
+	contextHandle->getQueueNo(d)->enqueueDummyEvents();
+      dummyEventsEnqueued.store(true, std::memory_order_release);
+    }
+    pthread_mutex_unlock(&dummyEventsLock);
   }
 
   void
@@ -150,7 +226,9 @@ namespace libsplit {
 
     waitForEvents(num_events_in_wait_list, event_wait_list);
 
+    m->lock();
     bufferMgr->read(m, blocking, offset, size, ptr);
+    m->unlock();
 
     createFakeEvent(event, queue);
   }
@@ -169,7 +247,9 @@ namespace libsplit {
 
     waitForEvents(num_events_in_wait_list, event_wait_list);
 
+    m->lock();
     bufferMgr->write(m, blocking, offset, size, ptr);
+    m->unlock();
 
     createFakeEvent(event, queue);
   }
@@ -188,7 +268,10 @@ namespace libsplit {
 
     waitForEvents(num_events_in_wait_list, event_wait_list);
 
+    std::vector<MemoryHandle *> buffers = {src, dst};
+    lockBuffers(buffers);
     bufferMgr->copy(src, dst, src_offset, dst_offset, size);
+    unlockBuffers(buffers);
 
     createFakeEvent(event, queue);
   }
@@ -209,7 +292,11 @@ namespace libsplit {
 
     createFakeEvent(event, queue);
 
-    return bufferMgr->map(m, blocking_map, map_flags, offset, size);
+    m->lock();
+    void *address = bufferMgr->map(m, blocking_map, map_flags, offset, size);
+    m->unlock();
+
+    return address;
   }
 
   void
@@ -223,7 +310,9 @@ namespace libsplit {
 
     waitForEvents(num_events_in_wait_list, event_wait_list);
 
+    m->lock();
     bufferMgr->unmap(m, mapped_ptr);
+    m->unlock();
 
     createFakeEvent(event, queue);
   }
@@ -242,7 +331,9 @@ namespace libsplit {
 
     waitForEvents(num_events_in_wait_list, event_wait_list);
 
+    m->lock();
     bufferMgr->fill(m, pattern, pattern_size, offset, size);
+    m->unlock();
 
     createFakeEvent(event, queue);
 }
@@ -294,9 +385,52 @@ namespace libsplit {
 			       cl_event *event) {
     enqueueDummyEvents();
 
+    // Sub-kernels of the events of the application to wait for. The other
+    // events are waited for on the host, before taking any lock.
+    StreamManager::device_waits waits;
+    std::vector<cl_event> otherEvents;
+    streams->getWaits(num_events_in_wait_list, event_wait_list,
+		      k->getContext()->getNbDevices(), waits, otherEvents);
+    if (!otherEvents.empty()) {
+      cl_int err = real_clWaitForEvents(otherEvents.size(),
+					otherEvents.data());
+      clCheck(err, __FILE__, __LINE__);
+    }
+
+    // The launches of a kernel are serialized, and the buffers it accesses
+    // are locked while its launch is planned and enqueued.
+    k->lock();
+
+    std::vector<MemoryHandle *> buffers;
+    unsigned nbGlobals = k->getAnalysis()->getNbGlobalArguments();
+    for (unsigned a=0; a<nbGlobals; a++) {
+      MemoryHandle *m = k->getGlobalArgHandle(a);
+      if (m)
+	buffers.push_back(m);
+    }
+    lockBuffers(buffers);
+
+    launchKernel(queue, k, work_dim, global_work_offset, global_work_size,
+		 local_work_size, waits, event);
+
+    streams->releaseWaits(waits);
+    unlockBuffers(buffers);
+    k->unlock();
+  }
+
+  void
+  Driver::launchKernel(cl_command_queue queue,
+		       KernelHandle *k,
+		       cl_uint work_dim,
+		       const size_t *global_work_offset,
+		       const size_t *global_work_size,
+		       const size_t *local_work_size,
+		       const StreamManager::device_waits &waits,
+		       cl_event *event) {
+    pthread_mutex_lock(&schedulerLock);
+
     // Option skipKernels
     {
-      static unsigned kernelNo = 0;
       if (optSkipKernels > 0 && optSkipKernels == kernelNo) {
 	delete scheduler;
 	unsigned nbDevices = optDeviceSelection.size() / 2;
@@ -330,10 +464,24 @@ namespace libsplit {
     }
 
     double t1 = get_time();
-    if (local_work_size == NULL) {
-      std::cerr << "Error, local_work_size NULL not handled !\n";
-      exit(EXIT_FAILURE);
+
+    if (optInspector)
+      inspector->beginLaunch(k, scheduler);
+
+    // Local work size chosen by libsplit when the application gives none.
+    size_t split_local_work_size[3];
+    LocalSizeTuner::ndrange_info *localSizes =
+      localSizeTuner->getNDRangeInfo(k, work_dim, global_work_size,
+				     local_work_size, split_local_work_size);
+
+    // Small kernels are placed whole on a device in DAG mode.
+    if (optDag) {
+      scheduler->setPlacement(k, taskPlacer->getDevice(k, work_dim,
+						       global_work_size));
     }
+    pthread_mutex_unlock(&schedulerLock);
+    if (localSizes)
+      local_work_size = split_local_work_size;
 
     std::cerr << "kernel " << k->getName() << "\n";
 
@@ -342,8 +490,6 @@ namespace libsplit {
 	    std::cerr << "#wg" << i << ": " << global_work_size[i] / local_work_size[i] << " ";
 	  std::cerr << "\n";);
 
-    waitForEvents(num_events_in_wait_list, event_wait_list);
-
     std::vector<SubKernelExecInfo *> subkernels;
     std::vector<DeviceBufferRegion> dataRequired;
     std::vector<DeviceBufferRegion> dataWritten;
@@ -368,92 +514,43 @@ namespace libsplit {
       std::vector<BufferIndirectionRegion> indirectionRegions;
       std::vector<DeviceBufferRegion> D2HTransfers;
 
+      pthread_mutex_lock(&schedulerLock);
       scheduler->getIndirectionRegions(k,
 				       work_dim,
 				       global_work_offset,
 				       global_work_size,
 				       local_work_size,
 				       indirectionRegions);
+      pthread_mutex_unlock(&schedulerLock);
 
       bufferMgr->computeIndirectionTransfers(indirectionRegions, D2HTransfers);
 
       if (indirectionRegions.size() > 0) {
-	std::set<unsigned> devToWait;
-	startD2HTransfers(D2HTransfers, devToWait);
-
-	// Barrier
-	ContextHandle *context = k->getContext();
-	for (unsigned i : devToWait) {
-	  context->getQueueNo(i)->finish();
+	// Values not in the cache are read with a single transfer per buffer
+	// and device for all subkernels.
+	if (!D2HTransfers.empty()) {
+	  std::set<unsigned> devToWait;
+	  startD2HTransfers(D2HTransfers, devToWait);
+
+	  // Barrier
+	  ContextHandle *context = k->getContext();
+	  for (unsigned i : devToWait) {
+	    context->getQueueNo(i)->finish();
+	  }
 	}
 
 	// Fill indirection values.
-	for (unsigned i=0; i<indirectionRegions.size(); i++) {
-	  size_t cb = indirectionRegions[i].cb;
-	  size_t lb = indirectionRegions[i].lb;
-	  size_t hb = indirectionRegions[i].hb;
-	  MemoryHandle *m = indirectionRegions[i].m;
-	  void *lbAddress = ((char *)m->mLocalBuffer) + lb;
-	  void *hbAddress = ((char *)m->mLocalBuffer) + hb;
-
-	  switch (indirectionRegions[i].type) {
-	  case INT:
-	  switch(cb) {
-	  case 8:
-	    indirectionRegions[i].lbValue =
-	      IndexExprValue::createLong(*((long *) lbAddress));
-	    indirectionRegions[i].hbValue =
-	      IndexExprValue::createLong(*((long *) hbAddress));
-	    break;
-	  case 4:
-	    indirectionRegions[i].lbValue =
-	      IndexExprValue::createLong((long) *((int *) lbAddress));
-	    indirectionRegions[i].hbValue =
-	      IndexExprValue::createLong((long) *((int *) hbAddress));
-	    break;
-	  case 2:
-	    indirectionRegions[i].lbValue =
-	      IndexExprValue::createLong((long) *((short *) lbAddress));
-	    indirectionRegions[i].hbValue =
-	      IndexExprValue::createLong((long) *((short *) hbAddress));
-	    break;
-	  case 1:
-	    indirectionRegions[i].lbValue =
-	      IndexExprValue::createLong((long) *((char *) lbAddress));
-	    indirectionRegions[i].hbValue =
-	      IndexExprValue::createLong((long) *((char *) hbAddress));
-	    break;
-	  default:
-	    std::cerr << "Error: Unhandled integer size : " << cb << "\n";
-	    exit(EXIT_FAILURE);
-	  };
-	  break;
-	  case FLOAT:
-	    assert(cb == 4);
-	    indirectionRegions[i].lbValue =
-	      IndexExprValue::createFloat(*((float *) lbAddress));
-	    indirectionRegions[i].hbValue =
-	      IndexExprValue::createFloat(*((float *) hbAddress));
-	    break;
-	  case DOUBLE:
-	    assert(cb == 8);
-	    indirectionRegions[i].lbValue =
-	      IndexExprValue::createDouble(*((double *) lbAddress));
-	    indirectionRegions[i].hbValue =
-	      IndexExprValue::createDouble(*((double *) hbAddress));
-	    break;
-	  case UNDEF:
-	    std::cerr << "Error: unknown indirection type.\n";
-	    exit(EXIT_FAILURE);
-	  };
-
-	  DEBUG("indirection",
+	bufferMgr->readIndirectionValues(indirectionRegions);
+
+	DEBUG("indirection",
+	      for (unsigned i=0; i<indirectionRegions.size(); i++)
 		debugIndirectionRegion(indirectionRegions[i]);
-		);
-	}
+	      );
       }
 
+      pthread_mutex_lock(&schedulerLock);
       done = scheduler->setIndirectionValues(k, indirectionRegions);
+      pthread_mutex_unlock(&schedulerLock);
 
       if (indirectionRegions.size() > 0) {
 	for (unsigned i=0; i<indirectionRegions.size(); i++) {
@@ -465,6 +562,7 @@ namespace libsplit {
     } while(!done);
 
     // Get partition from scheduler along with data required and data written.
+    pthread_mutex_lock(&schedulerLock);
     scheduler->getPartition(k,
 			    &needOtherExecutionToComplete,
 			    subkernels,
@@ -473,6 +571,7 @@ namespace libsplit {
 			    dataWrittenAtomicSum, dataWrittenAtomicMin,
 			    dataWrittenAtomicMax,
 			    &kerId);
+    pthread_mutex_unlock(&schedulerLock);
 
     double t2 = get_time();
 
@@ -509,7 +608,9 @@ namespace libsplit {
 
     if (D2HTransfers.size() > 0) {
       std::set<unsigned> devToWait;
+      pthread_mutex_lock(&schedulerLock);
       startD2HTransfers(kerId, D2HTransfers, devToWait);
+      pthread_mutex_unlock(&schedulerLock);
 
       // Barrier
       for (unsigned i : devToWait) {
@@ -520,7 +621,9 @@ namespace libsplit {
 
     if (H2DTransfers.size() > 0) {
       std::set<unsigned> devToWait;
+      pthread_mutex_lock(&schedulerLock);
       startH2DTransfers(kerId, H2DTransfers, devToWait);
+      pthread_mutex_unlock(&schedulerLock);
     }
 
 
@@ -529,7 +632,60 @@ namespace libsplit {
     // No nead for a barrier given the fact that we use in order queues.
     // Barrier
 
-    enqueueSubKernels(k, kerId, subkernels, dataWritten);
+    pthread_mutex_lock(&schedulerLock);
+    if (localSizes)
+      localSizeTuner->setLocalSizes(localSizes, subkernels);
+
+    // Inspect the kernel if the analysis cannot split it.
+    const Inspector::inspection *inspection = NULL;
+    if (optInspector)
+      inspection = inspector->getInspection(k, kerId, scheduler, work_dim,
+					    global_work_offset,
+					    global_work_size, local_work_size,
+					    subkernels);
+    pthread_mutex_unlock(&schedulerLock);
+
+    // Buffers accessed by the sub-kernels, to order them with the other
+    // command queues.
+    std::vector<std::vector<DeviceQueue::buffer_access> >
+      accesses(context->getNbDevices());
+    if (optCopyQueues || optStreams > 1) {
+      addBufferAccesses(dataRequired, false, accesses);
+      addBufferAccesses(dataWritten, true, accesses);
+      addBufferAccesses(dataWrittenMerge, true, accesses);
+      addBufferAccesses(dataWrittenOr, true, accesses);
+      addBufferAccesses(dataWrittenAtomicSum, true, accesses);
+      addBufferAccesses(dataWrittenAtomicMin, true, accesses);
+      addBufferAccesses(dataWrittenAtomicMax, true, accesses);
+    }
+
+    StreamManager::device_commands launched(context->getNbDevices(),
+					    DeviceQueue::command_ref());
+    enqueueSubKernels(k, kerId, subkernels, dataWritten, accesses,
+		      inspection, streams->getComputeQueue(queue), waits,
+		      launched);
+
+    pthread_mutex_lock(&schedulerLock);
+    if (optInspector)
+      inspector->endLaunch(k, inspection);
+
+    if (localSizes)
+      localSizeTuner->pushLaunch(localSizes, subkernels);
+
+    if (optDag) {
+      taskPlacer->pushLaunch(k, launched, dataRequired, dataWritten,
+			     dataWrittenMerge, dataWrittenOr,
+			     dataWrittenAtomicSum, dataWrittenAtomicMin,
+			     dataWrittenAtomicMax);
+    }
+
+    if (!firstKernelEnqueued) {
+      firstKernelEnqueued = true;
+      DEBUG("programhandle",
+	    std::cerr << "time to first kernel: "
+	    << (get_time() - startTime) * 1e3 << " ms\n";);
+    }
+    pthread_mutex_unlock(&schedulerLock);
 
     if (OrD2HTransfers.size() > 0)
       startOrD2HTransfers(kerId, OrD2HTransfers);
@@ -572,14 +728,15 @@ namespace libsplit {
     // NDRange.
     if (needOtherExecutionToComplete) {
       assert(false);
-      return enqueueNDRangeKernel(queue, k, work_dim,
-				  global_work_offset,
-				  global_work_size,
-				  local_work_size,
-				  0, NULL, event);
+      return launchKernel(queue, k, work_dim,
+			  global_work_offset,
+			  global_work_size,
+			  local_work_size,
+			  StreamManager::device_waits(), event);
     }
 
     createFakeEvent(event, queue);
+    streams->recordLaunch(queue, event ? *event : NULL, launched);
 
     DEBUG("drivertimers", printDriverTimers(t1, t2, t3, t4, t5, t6));
 
@@ -600,10 +757,12 @@ namespace libsplit {
       }
 
       std::set<MemoryHandle *>buffersRead;
+      pthread_mutex_lock(&schedulerLock);
       for (unsigned i=0; i<dataRequired.size(); i++) {
 	buffersRead.insert(dataRequired[i].m);
 	scheduler->setBufferRequired(kerId, dataRequired[i].m);
       }
+      pthread_mutex_unlock(&schedulerLock);
       for (MemoryHandle *m : buffersRead) {
 	for (unsigned d=0; d<m->mNbBuffers; d++) {
 	  m->ker2Dev2ReadRegion[kerId][d].clear();
@@ -641,6 +800,7 @@ namespace libsplit {
 	DEBUG("transfers",
 	      std::cerr << "D2H: reading [" << offset << "," << offset+cb-1
 	      << "] from dev " << d << "\n");
+	m->recordTransfer(d, offset, cb);
 	Event *event = eventFactory->getNewEvent();
 	queue->enqueueRead(m->mBuffers[d],
 			   offset, cb,
@@ -648,6 +808,7 @@ namespace libsplit {
 			   event);
 	timeline->pushD2HEvent(event, queue->dev_id);
 	scheduler->setD2HEvent(m->lastWriter, kerId, d, cb, event);
+	event->release();
       }
 
       // 2) update valid data
@@ -680,12 +841,14 @@ namespace libsplit {
 	      std::cerr << "D2H: reading [" << offset << "," << offset+cb-1
 	      << "] from dev " << d << "\n");
 
+	m->recordTransfer(d, offset, cb);
 	Event *event = eventFactory->getNewEvent();
 	queue->enqueueRead(m->mBuffers[d],
 			   offset, cb,
 			   (char *) m->mLocalBuffer + offset,
 			   event);
 	timeline->pushD2HEvent(event, queue->dev_id);
+	event->release();
       }
 
       // 2) update valid data
@@ -717,6 +880,7 @@ namespace libsplit {
 	DEBUG("transfers",
 	      std::cerr << "writing [" << offset << "," << offset+cb-1
 	      << "] to dev " << d << " on buffer " << m->id << "\n");
+	m->recordTransfer(d, offset, cb);
 	Event *event = eventFactory->getNewEvent();
 	queue->enqueueWrite(m->mBuffers[d],
 			    offset, cb,
@@ -724,6 +888,7 @@ namespace libsplit {
 			    event);
 	scheduler->setH2DEvent(m->lastWriter, kerId, d, cb, event);
 	timeline->pushH2DEvent(event, queue->dev_id);
+	event->release();
       }
 
       // 2) update valid data
@@ -764,6 +929,7 @@ namespace libsplit {
 			   (char *) transferList[i].tmp + tmpOffset,
 			   event);
 	timeline->pushD2HEvent(event, queue->dev_id);
+	event->release();
 	tmpOffset += cb;
       }
     }
@@ -802,6 +968,7 @@ namespace libsplit {
 			   (char *) transferList[i].tmp + tmpOffset,
 			   event);
 	timeline->pushD2HEvent(event, queue->dev_id);
+	event->release();
 	tmpOffset += cb;
       }
     }
@@ -840,6 +1007,7 @@ namespace libsplit {
 			   (char *) transferList[i].tmp + tmpOffset,
 			   event);
 	timeline->pushD2HEvent(event, queue->dev_id);
+	event->release();
 	tmpOffset += cb;
       }
     }
@@ -878,6 +1046,7 @@ namespace libsplit {
 			   (char *) transferList[i].tmp + tmpOffset,
 			   event);
 	timeline->pushD2HEvent(event, queue->dev_id);
+	event->release();
 	tmpOffset += cb;
       }
     }
@@ -920,6 +1089,7 @@ namespace libsplit {
 			   (char *) transferList[i].tmp + tmpOffset,
 			   event);
 	timeline->pushD2HEvent(event, queue->dev_id);
+	event->release();
 	tmpOffset += cb;
       }
     }
@@ -931,7 +1101,13 @@ namespace libsplit {
   Driver::enqueueSubKernels(KernelHandle *k,
 			    unsigned kerId,
 			    std::vector<SubKernelExecInfo *> &subkernels,
-			    const std::vector<DeviceBufferRegion> &dataWritten)
+			    const std::vector<DeviceBufferRegion> &dataWritten,
+			    std::vector<std::vector<DeviceQueue::buffer_access> >
+			    &accesses,
+			    const Inspector::inspection *inspection,
+			    DeviceQueue::QUEUE_TYPE computeQueue,
+			    const StreamManager::device_waits &waits,
+			    StreamManager::device_commands &launched)
   {
     // 1) enqueue subkernels with events
     for (unsigned i=0; i<subkernels.size(); ++i) {
@@ -941,17 +1117,38 @@ namespace libsplit {
       k->setNumgroupsArg(d, subkernels[i]->numgroups);
       k->setSplitdimArg(d, subkernels[i]->splitdim);
 
+      cl_kernel kernel;
+      const KernelArgs *args = &k->getKernelArgsForDevice(d);
+      KernelArgs inspectorArgs;
+      if (inspection) {
+	kernel = inspection->kernel;
+	inspectorArgs = *args;
+	KernelArg a(sizeof(cl_mem), false, &inspection->buffer);
+	updateKernelArg(inspectorArgs, inspection->argIndex, a);
+	args = &inspectorArgs;
+	DeviceQueue::buffer_access footprint = {inspection->buffer, true};
+	accesses[d].push_back(footprint);
+      } else {
+	kernel = k->getLaunchKernel(d);
+      }
+
+      if (subkernels[i]->event)
+	subkernels[i]->event->release();
       subkernels[i]->event = eventFactory->getNewEvent();
-      queue->enqueueExec(k->getDeviceKernel(d),
-			 subkernels[i]->work_dim,
-			 subkernels[i]->global_work_offset,
-			 subkernels[i]->global_work_size,
-			 subkernels[i]->local_work_size,
-			 k->getKernelArgsForDevice(d),
-			 subkernels[i]->event);
+      launched[d] =
+	queue->enqueueExec(kernel,
+			   subkernels[i]->work_dim,
+			   subkernels[i]->global_work_offset,
+			   subkernels[i]->global_work_size,
+			   subkernels[i]->local_work_size,
+			   *args,
+			   optCopyQueues || optStreams > 1 ? &accesses[d] : NULL,
+			   computeQueue,
+			   waits.empty() ? NULL : &waits[d],
+			   subkernels[i]->event);
       std::string kernelName(k->getName());
       timeline->pushEvent(subkernels[i]->event, kernelName,
-			  queue->dev_id);
+			  queue->dev_id, computeQueue);
     }
 
     // 2) update valid data
@@ -974,6 +1171,17 @@ namespace libsplit {
     }
   }
 
+  void
+  Driver::addBufferAccesses(const std::vector<DeviceBufferRegion> &regions,
+			    bool write,
+			    std::vector<std::vector<DeviceQueue::buffer_access> >
+			    &accesses) {
+    for (const DeviceBufferRegion &r : regions) {
+      DeviceQueue::buffer_access a = {r.m->mBuffers[r.devId], write};
+      accesses[r.devId].push_back(a);
+    }
+  }
+
   void
   Driver::performHostOrVariableReduction(const std::vector<DeviceBufferRegion> &
 					 transferList) {
@@ -1450,6 +1658,16 @@ namespace libsplit {
 
   void
   Driver::shutdown() {
+    DEBUG("instantiation", scheduler->printInstantiationStats());
+    DEBUG("indirection", bufferMgr->printIndirectionStats());
+    DEBUG("cache", programCache->printStats());
+    DEBUG("localsize", localSizeTuner->printStats());
+    DEBUG("inspector", inspector->printStats());
+    DEBUG("streams", streams->printStats());
+    DEBUG("dag", if (taskPlacer) taskPlacer->printStats());
+    DEBUG("events", eventFactory->printStats());
+    DEBUG("numa", if (numaPlacement) numaPlacement->printStats());
+
     if (optScheduler == Scheduler::MKGR2) {
       SchedulerMKGR2 *schedMKGR2 = static_cast<SchedulerMKGR2 *>(scheduler);
       schedMKGR2->plotD2HPoints();
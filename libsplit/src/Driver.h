@@ -4,14 +4,29 @@
 #include <BufferManager.h>
 #include <Handle/KernelHandle.h>
 #include <Handle/MemoryHandle.h>
+#include <Inspector.h>
+#include <LocalSizeTuner.h>
+#include <Queue/DeviceQueue.h>
+#include <StreamManager.h>
+#include <TaskPlacer.h>
 
+#include <atomic>
 #include <set>
 
+#include <pthread.h>
+
 namespace libsplit {
 
   class Scheduler;
   class SubKernelExecInfo;
 
+  // Entry points of the OpenCL calls, which may be called by several host
+  // threads. Buffers are locked by the calls accessing them, and a kernel
+  // launch locks the kernel and all its buffers. The scheduler, the
+  // inspector, the local size tuner and the task placer share state between
+  // kernels and are called under the scheduler lock, released while waiting
+  // for transfers.
+  // Locks are taken in the order: kernel, buffers by id, scheduler.
   class Driver {
   public:
     Driver();
@@ -86,11 +101,54 @@ namespace libsplit {
 			      const cl_event *event_wait_list,
 			      cl_event *event);
 
+    // Command queues of the application and their events, see
+    // StreamManager.
+    void createStream(cl_command_queue queue);
+    void releaseStream(cl_command_queue queue);
+    void finish(cl_command_queue queue);
+    void waitForEvents(cl_uint num_events_in_wait_list,
+		       const cl_event *event_wait_list);
+    void releaseEvent(cl_event event);
+
+    // Drop the state kept on a buffer or a kernel being deleted.
+    void releaseBuffer(MemoryHandle *m);
+    void releaseKernel(KernelHandle *k);
+
     void shutdown();
 
   private:
     Scheduler *scheduler;
     BufferManager *bufferMgr;
+    LocalSizeTuner *localSizeTuner;
+    Inspector *inspector;
+    StreamManager *streams;
+    TaskPlacer *taskPlacer;
+
+    // Time between the initialization of the library and the first kernel
+    // enqueued, dominated by program builds.
+    double startTime;
+    bool firstKernelEnqueued;
+
+    pthread_mutex_t schedulerLock;
+    unsigned kernelNo; // Kernels launched, for SKIPKERNELS
+
+    std::atomic<bool> dummyEventsEnqueued;
+    pthread_mutex_t dummyEventsLock;
+
+    // Lock buffers in the order of their ids, removing duplicates.
+    void lockBuffers(std::vector<MemoryHandle *> &buffers);
+    void unlockBuffers(const std::vector<MemoryHandle *> &buffers);
+
+    // Launch of kernel k, with k and its buffers locked, after the
+    // sub-kernels of waits.
+    void launchKernel(cl_command_queue queue,
+		      KernelHandle *k,
+		      cl_uint work_dim,
+		      const size_t *global_work_offset,
+		      const size_t *global_work_size,
+		      const size_t *local_work_size,
+		      const StreamManager::device_waits &waits,
+		      cl_event *event);
 
     void startD2HTransfers(unsigned kerId,
 			   const std::vector<DeviceBufferRegion> &transferList,
@@ -116,10 +174,25 @@ namespace libsplit {
 				const std::vector<DeviceBufferRegion>
 				&transferList);
 
+    // With an inspection, the single sub-kernel is launched with the
+    // inspector kernel. accesses holds the buffers accessed on each device.
+    // Enqueue the sub-kernels in the compute queue computeQueue of their
+    // devices, and fill launched with them.
     void enqueueSubKernels(KernelHandle *k,
 			   unsigned kerId,
 			   std::vector<SubKernelExecInfo *> &subkernels,
-			   const std::vector<DeviceBufferRegion> &dataWritten);
+			   const std::vector<DeviceBufferRegion> &dataWritten,
+			   std::vector<std::vector<DeviceQueue::buffer_access> >
+			   &accesses,
+			   const Inspector::inspection *inspection,
+			   DeviceQueue::QUEUE_TYPE computeQueue,
+			   const StreamManager::device_waits &waits,
+			   StreamManager::device_commands &launched);
+
+    void addBufferAccesses(const std::vector<DeviceBufferRegion> &regions,
+			   bool write,
+			   std::vector<std::vector<DeviceQueue::buffer_access> >
+			   &accesses);
 
     void performHostOrVariableReduction(const std::vector<DeviceBufferRegion> &
 					transferList);
@@ -1,41 +1,120 @@
 #include <EventFactory.h>
-#include <Dispatch/OpenCLFunctions.h>
-#include <Handle/MemoryHandle.h>
 
-#include <cassert>
+#include <iostream>
 
-#define MAXEVENTS 1000000
+// Events allocated each time the pool grows.
+#define EVENTCHUNK 1024
 
 namespace libsplit {
-  EventFactory::EventFactory() {
-    events = new Event[MAXEVENTS];
-    nextEventId = 0;
+  EventFactory::EventFactory()
+    : nbEvents(0), nbLive(0), highWaterMark(0), nbAllocations(0),
+      completedEvents(NULL), nbWaits(0), waitTime(0), waitCpuTime(0) {
+    pthread_mutex_init(&lock, NULL);
+    grow();
   }
 
   EventFactory::~EventFactory() {
-    delete events;
+    for (Event *chunk : chunks)
+      delete[] chunk;
+    pthread_mutex_destroy(&lock);
+  }
+
+  void
+  EventFactory::grow() {
+    Event *chunk = new Event[EVENTCHUNK];
+    chunks.push_back(chunk);
+    nbEvents += EVENTCHUNK;
+
+    // Hand out the events of the chunk in order.
+    for (unsigned i=EVENTCHUNK; i>0; i--) {
+      chunk[i-1].factory = this;
+      freeEvents.push_back(&chunk[i-1]);
+    }
   }
 
   Event *
   EventFactory::getNewEvent() {
-    assert(nextEventId < MAXEVENTS);
-    return &events[nextEventId++];
+    releaseCompleted();
+
+    pthread_mutex_lock(&lock);
+    if (freeEvents.empty())
+      grow();
+    Event *event = freeEvents.back();
+    freeEvents.pop_back();
+
+    nbAllocations++;
+    nbLive++;
+    if (nbLive > highWaterMark)
+      highWaterMark = nbLive;
+    pthread_mutex_unlock(&lock);
+
+    event->refCount.store(1, std::memory_order_relaxed);
+    return event;
+  }
+
+  void
+  EventFactory::recycle(Event *event) {
+    event->reset();
+
+    pthread_mutex_lock(&lock);
+    freeEvents.push_back(event);
+    nbLive--;
+    pthread_mutex_unlock(&lock);
   }
 
   void
-  EventFactory::setMemoryHandleDep(MemoryHandle *m) {
-    memoryDeps.insert(m);
+  EventFactory::pushCompleted(Event *event) {
+    Event *head = completedEvents.load(std::memory_order_relaxed);
+    do {
+      event->nextCompleted = head;
+    } while (!completedEvents.compare_exchange_weak(head, event,
+						    std::memory_order_release,
+						    std::memory_order_relaxed));
+  }
+
+  void
+  EventFactory::releaseCompleted() {
+    Event *event = completedEvents.exchange(NULL, std::memory_order_acquire);
+    while (event) {
+      Event *next = event->nextCompleted;
+      event->release();
+      event = next;
+    }
+  }
+
+  void
+  EventFactory::addWait(double wallTime, double cpuTime) {
+    pthread_mutex_lock(&lock);
+    nbWaits++;
+    waitTime += wallTime;
+    waitCpuTime += cpuTime;
+    pthread_mutex_unlock(&lock);
+  }
+
+  unsigned
+  EventFactory::getNbLiveEvents() const {
+    pthread_mutex_lock(&lock);
+    unsigned n = nbLive;
+    pthread_mutex_unlock(&lock);
+    return n;
+  }
+
+  unsigned
+  EventFactory::getHighWaterMark() const {
+    pthread_mutex_lock(&lock);
+    unsigned n = highWaterMark;
+    pthread_mutex_unlock(&lock);
+    return n;
   }
 
   void
-  EventFactory::freeEvents() {
-    // for (MemoryHandle *m : memoryDeps) {
-    //   for (unsigned d=0; d<m->mNbBuffers; d++) {
-    // 	m->lastDeviceWritterEvent[d] = nullptr;
-    //   }
-    // }
-    // for (unsigned i=0; i<nextEventId; i++)
-    //   cl_int err = real_clReleaseEvent(events[i]);
-    // nextEventId = 0;
+  EventFactory::printStats() const {
+    pthread_mutex_lock(&lock);
+    std::cerr << "events: " << nbAllocations << " allocations, " << nbLive
+	      << " live, " << highWaterMark << " high-water mark, "
+	      << nbEvents << " events in the pool\n";
+    std::cerr << "events: " << nbWaits << " host waits, " << waitTime
+	      << " s waiting, " << waitCpuTime << " s of CPU time\n";
+    pthread_mutex_unlock(&lock);
   }
 };
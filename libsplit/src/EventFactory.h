@@ -3,29 +3,61 @@
 
 #include <Queue/Event.h>
 
-#include <set>
-
-#include <CL/cl.h>
+#include <atomic>
+#include <vector>
 
+#include <pthread.h>
 
 namespace libsplit {
 
-  class MemoryHandle;
-
+  // Pool of events, growing by chunks when all the events are in use. Events
+  // are returned to the pool by Event::release(), possibly from the queue
+  // threads.
+  //
+  // Events completed by OpenCL callbacks are pushed to a lock-free
+  // completion queue, and the reference of the callback is released by the
+  // host thread when it gets a new event, not in the callback threads of the
+  // OpenCL implementation.
   class EventFactory {
   public:
     EventFactory();
     ~EventFactory();
 
+    // Return an event holding one reference for the caller.
     Event *getNewEvent();
-    void freeEvents();
-    void setMemoryHandleDep(MemoryHandle *m);
+
+    // Called when the last reference to event is released.
+    void recycle(Event *event);
+
+    // Called by the completion callback of event.
+    void pushCompleted(Event *event);
+    // Release the references of the completion callbacks.
+    void releaseCompleted();
+
+    // Account a host wait for an event.
+    void addWait(double wallTime, double cpuTime);
+
+    unsigned getNbLiveEvents() const;
+    unsigned getHighWaterMark() const;
+    void printStats() const;
 
   private:
-    unsigned nextEventId;
-    Event *events;
+    void grow();
+
+    mutable pthread_mutex_t lock;
+    std::vector<Event *> chunks;
+    std::vector<Event *> freeEvents;
+
+    unsigned nbEvents;
+    unsigned nbLive;
+    unsigned highWaterMark;
+    unsigned long nbAllocations;
+
+    std::atomic<Event *> completedEvents;
 
-    std::set<MemoryHandle *> memoryDeps;
+    unsigned long nbWaits;
+    double waitTime;
+    double waitCpuTime;
   };
 
 };
@@ -6,4 +6,6 @@ namespace libsplit {
   ContextHandle *contextHandle = NULL;
   Timeline *timeline = NULL;
   EventFactory *eventFactory = NULL;
+  ProgramCache *programCache = NULL;
+  NumaPlacement *numaPlacement = NULL;
 };
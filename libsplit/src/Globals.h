@@ -5,12 +5,16 @@
 #include <Handle/ContextHandle.h>
 #include <Utils/Timeline.h>
 #include <EventFactory.h>
+#include <NumaPlacement.h>
+#include <ProgramCache.h>
 
 namespace libsplit {
   extern Driver *driver;
   extern ContextHandle *contextHandle;
   extern Timeline *timeline;
   extern EventFactory *eventFactory;
+  extern ProgramCache *programCache;
+  extern NumaPlacement *numaPlacement; // NULL unless NUMA=1
 };
 
 #endif /* GLOBALS_H */
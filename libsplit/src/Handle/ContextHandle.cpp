@@ -4,6 +4,7 @@
 #include <Options.h>
 #include <Queue/DeviceLFQueue.h>
 #include <Queue/DevicePthreadQueue.h>
+#include <Queue/QueueBench.h>
 #include <Utils/Debug.h>
 #include <Utils/Utils.h>
 
@@ -26,6 +27,9 @@ namespace libsplit {
     else
       createOneCtxtPerDevice(optDeviceSelection.data());
 
+    if (optBenchQueue)
+      benchSubmissionLatency(getContext(0), getDevice(0));
+
     // Create one command queue for each device
     queues = new DeviceQueue *[nbDevices];
 
@@ -59,6 +63,8 @@ namespace libsplit {
     timeline->writeTrace(fileout);
     fileout = "partitions.dat";
     timeline->writePartitions(fileout);
+    fileout = "placements.dat";
+    timeline->writePlacements(fileout);
     timeline->writeD2HTransfers();
     timeline->writeH2DTransfers();
     timeline->writeH2DTransfersSampling();
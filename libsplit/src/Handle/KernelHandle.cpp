@@ -1,21 +1,22 @@
 #include <Define.h>
+#include <Globals.h>
+#include <Handle/ContextHandle.h>
 #include <Handle/KernelHandle.h>
 #include <Options.h>
+#include <Queue/DeviceQueue.h>
 #include <Utils/Debug.h>
 #include <Utils/Utils.h>
 #include <IndexExpr/IndexExprValue.h>
 
 #include <cassert>
 #include <iostream>
-#include <fcntl.h>
 #include <malloc.h>
-#include <sys/mman.h>
+#include <sstream>
 #include <string.h>
-#include <unistd.h>
 
 namespace libsplit {
 
-  unsigned KernelHandle::numKernels = 0;
+  std::atomic<unsigned> KernelHandle::numKernels(0);
 
   KernelArg::KernelArg(size_t size, bool local, const void *value)
     : size(size), local(local) {
@@ -63,6 +64,8 @@ namespace libsplit {
 
     id = ++numKernels;
 
+    pthread_mutex_init(&mutex, NULL);
+
     DEBUG("kernelstats",
 	  std::cerr << "kernel " << mName << " id " << id << "\n";
 	  );
@@ -90,6 +93,12 @@ namespace libsplit {
     mNbGlobalArgs = 0;
     subkernelArgs = new KernelArgs[mNbSubKernels];
 
+    specialization_info spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.lastSplitdim = -1;
+    mSpecializations.resize(mNbSubKernels, spec);
+    mInspectorKernels.resize(mNbSubKernels, NULL);
+
     // Launch analysis
     launchAnalysis();
 
@@ -121,10 +130,34 @@ namespace libsplit {
 
 
 
+  void
+  KernelHandle::releaseDeviceKernel(cl_kernel kernel) {
+    for (unsigned d=0; d<mContext->getNbDevices(); d++)
+      mContext->getQueueNo(d)->releaseKernel(kernel);
+    cl_int err = real_clReleaseKernel(kernel);
+    clCheck(err, __FILE__, __LINE__);
+  }
+
   KernelHandle::~KernelHandle() {
-    for (unsigned i=0; i<mNbSubKernels; i++) {
-      cl_int err = real_clReleaseKernel(mSubKernels[i]);
-      clCheck(err, __FILE__, __LINE__);
+    driver->releaseKernel(this);
+
+    for (unsigned i=0; i<mNbSubKernels; i++)
+      releaseDeviceKernel(mSubKernels[i]);
+
+    for (specialization_info &spec : mSpecializations) {
+      if (spec.build) {
+	cl_program p = mProgram->joinSpecialized(spec.build);
+	if (p)
+	  real_clReleaseProgram(p);
+      }
+    }
+    for (cl_kernel kernel : mSpecKernels)
+      releaseDeviceKernel(kernel);
+    for (cl_program program : mSpecPrograms)
+      real_clReleaseProgram(program);
+    for (cl_kernel kernel : mInspectorKernels) {
+      if (kernel)
+	releaseDeviceKernel(kernel);
     }
 
     for (unsigned i=0; i<mNumArgs; i++)
@@ -138,6 +171,8 @@ namespace libsplit {
     delete mAnalysis;
 
     free(mName);
+
+    pthread_mutex_destroy(&mutex);
   }
 
   void
@@ -257,19 +292,31 @@ namespace libsplit {
     }
   }
 
+  void
+  KernelHandle::lock() {
+    pthread_mutex_lock(&mutex);
+  }
+
+  void
+  KernelHandle::unlock() {
+    pthread_mutex_unlock(&mutex);
+  }
+
   void
   KernelHandle::setNumgroupsArg(unsigned dev, int numgroups) {
     KernelArg a = KernelArg(sizeof(int), false, (void *) &numgroups);
     updateKernelArg(subkernelArgs[dev], mNumArgs, a);
+    mSpecializations[dev].numgroups = numgroups;
   }
 
   void
   KernelHandle::setSplitdimArg(unsigned dev, int splitdim) {
     KernelArg a = KernelArg(sizeof(int), false, (void *) &splitdim);
     updateKernelArg(subkernelArgs[dev], mNumArgs+1, a);
+    mSpecializations[dev].splitdim = splitdim;
   }
 
-  KernelArgs
+  const KernelArgs &
   KernelHandle::getKernelArgsForDevice(unsigned i) {
     return subkernelArgs[i];
   }
@@ -318,6 +365,83 @@ namespace libsplit {
     return mSubKernels[d];
   }
 
+  cl_kernel
+  KernelHandle::getLaunchKernel(unsigned d) {
+    if (optSpecialize == 0)
+      return mSubKernels[d];
+
+    specialization_info &spec = mSpecializations[d];
+
+    if (spec.numgroups == spec.lastNumgroups &&
+	spec.splitdim == spec.lastSplitdim) {
+      spec.nbStableLaunches++;
+    } else {
+      spec.lastNumgroups = spec.numgroups;
+      spec.lastSplitdim = spec.splitdim;
+      spec.nbStableLaunches = 1;
+    }
+
+    // Swap the specialized kernel in once its program is built.
+    if (spec.build && mProgram->specializedBuildDone(spec.build)) {
+      cl_program p = mProgram->joinSpecialized(spec.build);
+      spec.build = NULL;
+      if (p) {
+	cl_int err;
+	cl_kernel kernel = real_clCreateKernel(p, mName, &err);
+	clCheck(err, __FILE__, __LINE__);
+	mSpecPrograms.push_back(p);
+	mSpecKernels.push_back(kernel);
+	spec.kernel = kernel;
+	spec.kernelNumgroups = spec.buildNumgroups;
+	spec.kernelSplitdim = spec.buildSplitdim;
+
+	DEBUG("specialize",
+	      std::cerr << "kernel " << mName << " specialized on device " << d
+	      << " for numgroups=" << spec.kernelNumgroups << " splitdim="
+	      << spec.kernelSplitdim << "\n";);
+      } else {
+	// Do not retry a failed specialization.
+	spec.nbBuilds = MAXSPECIALIZATIONS;
+      }
+    }
+
+    if (spec.kernel && spec.kernelNumgroups == spec.numgroups &&
+	spec.kernelSplitdim == spec.splitdim)
+      return spec.kernel;
+
+    // Hot parameters without a specialized kernel.
+    if (!spec.build && spec.nbStableLaunches >= optSpecialize &&
+	spec.nbBuilds < MAXSPECIALIZATIONS) {
+      std::stringstream defines;
+      defines << " -D__LIBSPLIT_NUM_GROUPS=" << spec.numgroups
+	      << " -D__LIBSPLIT_SPLIT_DIM=" << spec.splitdim;
+      spec.build = mProgram->buildSpecialized(d, defines.str());
+      spec.buildNumgroups = spec.numgroups;
+      spec.buildSplitdim = spec.splitdim;
+      spec.nbBuilds = spec.build ? spec.nbBuilds + 1 : MAXSPECIALIZATIONS;
+    }
+
+    return mSubKernels[d];
+  }
+
+  cl_kernel
+  KernelHandle::getInspectorKernel(unsigned d) {
+    if (mInspectorKernels[d])
+      return mInspectorKernels[d];
+
+    if (!mProgram->isInspectable(mName))
+      return NULL;
+    cl_program program = mProgram->getInspectorProgram(d);
+    if (!program)
+      return NULL;
+
+    cl_int err;
+    mInspectorKernels[d] = real_clCreateKernel(program, mName, &err);
+    clCheck(err, __FILE__, __LINE__);
+
+    return mInspectorKernels[d];
+  }
+
   KernelAnalysis *
   KernelHandle::getAnalysis() {
     return mAnalysis;
@@ -352,41 +476,20 @@ namespace libsplit {
 
   void
   KernelHandle::launchAnalysis() {
-    // Launch KernelAnalysis Pass over the LLVM IR binary
-    char opt_command[1024];
-    sprintf(opt_command, "%s -load %s %s -kernelname=%s .spir%d.bc > /dev/null",
-	    OPTPATH, KERNELANALYSIS_SO_PATH, PASSARG, mName, mProgram->getId());
-
-    DEBUG("kernelhandle",
-	  std::cerr << "opt command: " << opt_command << "\n");
-    int err = system(opt_command);
-    assert(err == 0);
-
-    // Get results from analysis using mmap
-    int fd;
-    char *data;
-
-    if ((fd = open("analysis.txt", O_RDONLY)) == -1) {
-      perror("libhook open");
-      exit(EXIT_FAILURE);
-    }
-
-    size_t len = 64 * getpagesize();
-    data = (char *) mmap((caddr_t) 0, len, PROT_READ, MAP_SHARED, fd, 0);
-    if (data == (char *) (caddr_t) -1) {
-      perror("libhook mmap");
+    // The kernels of the program have been analyzed when it was built.
+    mAnalysis = mProgram->getKernelAnalysis(mName);
+    if (!mAnalysis) {
+      std::cerr << "Error: cannot load analysis of kernel " << mName << "\n";
       exit(EXIT_FAILURE);
     }
 
-    close(fd);
-
-    std::string str(data, len);
-    std::stringstream ss;
-    ss << str;
-
-    mAnalysis = KernelAnalysis::open(ss);
     DEBUG("analysis",
 	  mAnalysis->debug(););
+    DEBUG("analysisload",
+	  std::stringstream ss;
+	  mAnalysis->write(ss);
+	  std::string str = ss.str();
+	  benchAnalysisLoad(str.data(), str.size()););
 
     assert(!strcmp(mAnalysis->getName(), mName));
 
@@ -405,6 +508,29 @@ namespace libsplit {
       globalArg2PosMap[i] = mAnalysis->getGlobalArgPos(i);
   }
 
+  void
+  KernelHandle::benchAnalysisLoad(const char *data, size_t len) const {
+    // Round-trip: the loaded analysis has to be written back identically.
+    std::stringstream ss;
+    mAnalysis->write(ss);
+    std::string str = ss.str();
+    if (str.size() != len || memcmp(str.data(), data, len)) {
+      std::cerr << "Error: analysis round-trip mismatch for kernel " << mName
+		<< " (" << len << " bytes read, " << str.size()
+		<< " bytes written)\n";
+      exit(EXIT_FAILURE);
+    }
+
+    const unsigned nbLoads = 100;
+    double t1 = get_time();
+    for (unsigned i=0; i<nbLoads; i++)
+      delete KernelAnalysis::open(data, len);
+    double t2 = get_time();
+
+    std::cerr << "analysis of " << mName << ": " << len << " bytes, load time "
+	      << (t2 - t1) * 1e6 / nbLoads << " us\n";
+  }
+
   void
   KernelHandle::getEnvOptions() {
     // Get single device ID
@@ -9,8 +9,11 @@
 
 #include <CL/opencl.h>
 
+#include <atomic>
 #include <map>
 
+#include <pthread.h>
+
 namespace libsplit {
 
   struct KernelArg {
@@ -43,7 +46,7 @@ namespace libsplit {
     void setNumgroupsArg(unsigned dev, int numgroups);
     void setSplitdimArg(unsigned dev, int splitdim);
 
-    KernelArgs getKernelArgsForDevice(unsigned i);
+    const KernelArgs &getKernelArgsForDevice(unsigned i);
 
     void getKernelWorkgroupInfo(cl_device_id device,
 				cl_kernel_work_group_info param_name,
@@ -60,6 +63,17 @@ namespace libsplit {
 
     cl_kernel getDeviceKernel(unsigned d);
 
+    // Return the kernel to launch on device d with the split parameters set
+    // by setNumgroupsArg() and setSplitdimArg(). After SPECIALIZE launches
+    // with the same parameters, a program specialized for them is built in
+    // the background and its kernel is launched instead once it is ready.
+    cl_kernel getLaunchKernel(unsigned d);
+
+    // Return the kernel of the inspector program of device d, NULL if the
+    // kernel cannot be inspected. It takes the footprint buffer as an
+    // additional argument after the split parameters.
+    cl_kernel getInspectorKernel(unsigned d);
+
     KernelAnalysis *getAnalysis();
 
     const std::vector<IndexExprValue *> &getArgsValues() const;
@@ -69,13 +83,23 @@ namespace libsplit {
 
     const char *getName() const;
 
+    // Held by clSetKernelArg() and for the whole launch of the kernel, so
+    // that the arguments do not change during a launch.
+    void lock();
+    void unlock();
+
   private:
+    // Release a kernel of the devices and forget its arguments in the queues.
+    void releaseDeviceKernel(cl_kernel kernel);
+
     // Kernel name
     char *mName;
 
-    static unsigned numKernels;
+    static std::atomic<unsigned> numKernels;
     unsigned id;
 
+    pthread_mutex_t mutex;
+
     // Sub-Kernels
     unsigned mNbSubKernels;
     cl_kernel *mSubKernels;
@@ -110,9 +134,38 @@ namespace libsplit {
     bool mDontSplit;
     unsigned mSingleDeviceID;
 
-    // Launch KernelAnalysis pass over the spir binary.
+    // Specialization of the sub-kernels for constant split parameters.
+    static const unsigned MAXSPECIALIZATIONS = 4;
+    struct specialization_info {
+      int numgroups; // Parameters of the next launch
+      int splitdim;
+      int lastNumgroups;
+      int lastSplitdim;
+      unsigned nbStableLaunches;
+      unsigned nbBuilds;
+      ProgramHandle::specialized_build *build; // Build in progress
+      int buildNumgroups;
+      int buildSplitdim;
+      cl_kernel kernel; // Specialized kernel, NULL if none
+      int kernelNumgroups;
+      int kernelSplitdim;
+    };
+    std::vector<specialization_info> mSpecializations;
+    // Specialized programs and kernels, released with the handle as
+    // enqueued commands may still use a replaced kernel.
+    std::vector<cl_program> mSpecPrograms;
+    std::vector<cl_kernel> mSpecKernels;
+
+    // Inspector kernels, NULL until created.
+    std::vector<cl_kernel> mInspectorKernels;
+
+    // Get the analysis of the kernel from the program.
     void launchAnalysis();
 
+    // Check that the analysis written at data round-trips and print its load
+    // time (DEBUGTYPE=analysisload).
+    void benchAnalysisLoad(const char *data, size_t len) const;
+
     // Parse the environment variable SPLITPARAMS to get the split parameters.
     // This function initialize the attributes mNbSplits, mDenominator,
     // mNominators and mSplitDevices.
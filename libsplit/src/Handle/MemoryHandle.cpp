@@ -1,27 +1,32 @@
+#include <Globals.h>
 #include <Handle/MemoryHandle.h>
 #include <Utils/Debug.h>
 #include <Utils/Utils.h>
 #include <Options.h>
 #include <Queue/DeviceQueue.h>
 
+#include <atomic>
 #include <cassert>
 #include <cstring>
 #include <iostream>
 
 namespace libsplit {
 
-  static unsigned numMemoryHandle = 0;
+  static std::atomic<unsigned> numMemoryHandle(0);
 
   MemoryHandle::MemoryHandle(ContextHandle *context, cl_mem_flags flags,
 			     size_t size, void *host_ptr)
     : mFlags(flags), mSize(size), mMaxUsedSize(1), id(numMemoryHandle++),
-      mHostPtr(host_ptr), mContext(context) {
+      mHostPtr(host_ptr), numaShadow(NULL), mContext(context) {
     cl_int err;
 
+    pthread_mutex_init(&mutex, NULL);
+
     // Retain context
     mContext->retain();
 
     lastWriter = -1;
+    version = 0;
 
     isRO = flags & CL_MEM_READ_ONLY;
 
@@ -81,14 +86,21 @@ namespace libsplit {
 				&err);
 	clCheck(err, __FILE__, __LINE__);
 	mLocalBuffer = real_clEnqueueMapBuffer(context->getQueueNo(firstGpuID)
-					       ->cl_queue,
+					       ->getCLQueue(DeviceQueue::COMPUTE),
 					       dummyBuffer,
 					       CL_TRUE,
 					       CL_MAP_WRITE_INVALIDATE_REGION,
 					       0, size, 0, NULL, NULL, &err);
 	clCheck(err, __FILE__, __LINE__);
       } else {
-	mLocalBuffer = calloc(1, size);
+	// With NOMEMCPY the host buffer may be replaced by the application
+	// pointer, it is not placed.
+	if (numaPlacement && !NOMEMCPY)
+	  numaShadow = numaPlacement->allocShadow(id, size);
+	if (numaShadow)
+	  mLocalBuffer = numaShadow->base;
+	else
+	  mLocalBuffer = calloc(1, size);
       }
     }
 
@@ -111,7 +123,10 @@ namespace libsplit {
   MemoryHandle::~MemoryHandle() {
     cl_int err;
 
+    driver->releaseBuffer(this);
+
     for (unsigned i=0; i<mNbBuffers; i++) {
+      mContext->getQueueNo(i)->releaseBuffer(mBuffers[i]);
       err = real_clReleaseMemObject(mBuffers[i]);
       clCheck(err, __FILE__, __LINE__);
     }
@@ -119,15 +134,39 @@ namespace libsplit {
 
     if (!(mFlags & CL_MEM_ALLOC_HOST_PTR) &&
 	!(mFlags & CL_MEM_USE_HOST_PTR) && !NOMEMCPY) {
-      if (!optPinnedMem)
+      if (numaShadow)
+	numaPlacement->freeShadow(numaShadow);
+      else if (!optPinnedMem)
 	free(mLocalBuffer);
     }
 
     delete[] devicesValidData;
 
+    pthread_mutex_destroy(&mutex);
+
     mContext->release();
   }
 
+  void
+  MemoryHandle::lock() {
+    pthread_mutex_lock(&mutex);
+  }
+
+  void
+  MemoryHandle::unlock() {
+    pthread_mutex_unlock(&mutex);
+  }
+
+  void
+  MemoryHandle::recordTransfer(unsigned dev, size_t offset, size_t cb) {
+    if (!numaShadow)
+      return;
+
+    numaPlacement->recordTransfer(numaShadow,
+				  mContext->getQueueNo(dev)->getNumaNode(),
+				  offset, cb);
+  }
+
   void
   MemoryHandle::dumpMemoryState() {
     std::cerr << "Memory Handle size : " << mSize << "\n";
@@ -7,9 +7,12 @@
 
 #include <CL/opencl.h>
 
+#include <pthread.h>
+
 namespace libsplit {
 
   class ContextHandle;
+  struct NumaShadow;
 
   class MemoryHandle : public Retainable {
   public:
@@ -19,6 +22,15 @@ namespace libsplit {
 
     void dumpMemoryState();
 
+    // Account a transfer between the host buffer and the buffer of dev,
+    // for the NUMA placement of the host buffer.
+    void recordTransfer(unsigned dev, size_t offset, size_t cb);
+
+    // Held while the regions and the host buffer are read or updated, by a
+    // buffer command or by a kernel launch using the buffer.
+    void lock();
+    void unlock();
+
     cl_mem_flags mFlags;
     cl_mem_flags mTransFlags;
     size_t mSize; // original size
@@ -34,6 +46,7 @@ namespace libsplit {
 
     // Host buffer
     void *mLocalBuffer;
+    NumaShadow *numaShadow; // Placement of mLocalBuffer with NUMA=1
 
     // Context
     ContextHandle *mContext;
@@ -48,6 +61,12 @@ namespace libsplit {
     std::map<unsigned, std::map<unsigned, ListInterval> > ker2Dev2ReadRegion;
 
     int lastWriter;
+
+    // Incremented each time the content of the buffer may change.
+    unsigned long version;
+
+  private:
+    pthread_mutex_t mutex;
   };
 
 };
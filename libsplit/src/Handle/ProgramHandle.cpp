@@ -1,11 +1,17 @@
 #include <Define.h>
+#include <Globals.h>
 #include <Handle/ProgramHandle.h>
 #include <Handle/KernelHandle.h>
 #include <Options.h>
 #include <Utils/Debug.h>
 #include <Utils/Utils.h>
 
+#include <ClInline.h>
+#include <ClTransform.h>
+#include <KernelAnalysisRunner.h>
+
 #include <fstream>
+#include <sstream>
 
 #include <cassert>
 #include <cstdio>
@@ -13,16 +19,64 @@
 
 namespace libsplit {
 
-  int ProgramHandle::idxCount = -1;
+  std::atomic<int> ProgramHandle::idxCount(-1);
+
+  static std::vector<std::string>
+  splitOptions(const char *options) {
+    std::vector<std::string> args;
+    if (!options)
+      return args;
+
+    std::istringstream s(options);
+    std::string arg;
+    while (s >> arg)
+      args.push_back(arg);
+    return args;
+  }
+
+  // Arguments of ClInline and ClTransform.
+  static std::vector<std::string>
+  getClangArgs(const char *options) {
+    std::vector<std::string> args;
+    args.push_back("-finclude-default-header");
+    args.push_back("-isystem");
+    args.push_back(CLANG_INCLUDE_DIR);
+    std::vector<std::string> programArgs = splitOptions(options);
+    args.insert(args.end(), programArgs.begin(), programArgs.end());
+    // cl_khr_fp64 is defined to avoid Clang errors when using doubles
+    args.push_back("-Dcl_khr_fp64");
+    return args;
+  }
+
+  static std::string
+  getDeviceInfoString(cl_device_id d, cl_device_info param_name) {
+    size_t size = 0;
+    cl_int err = real_clGetDeviceInfo(d, param_name, 0, NULL, &size);
+    clCheck(err, __FILE__, __LINE__);
+    std::string str(size, '\0');
+    err = real_clGetDeviceInfo(d, param_name, size, &str[0], NULL);
+    clCheck(err, __FILE__, __LINE__);
+    return str.c_str();
+  }
 
   void
   ProgramHandle::init(ContextHandle *context) {
     this->context = context;
     hasBeenBuilt = false;
+    buildsPending = false;
+    pthread_mutex_init(&buildsLock, NULL);
+    pfn_notify = NULL;
+    user_data = NULL;
+    fromCache = false;
+    inspectorTransformed = false;
     idx = ++idxCount;
 
     nbPrograms = context->getNbDevices();
     programs = new cl_program[nbPrograms];
+    binaryKeys.resize(nbPrograms);
+    programFromBinary.resize(nbPrograms, false);
+    inspectorPrograms.resize(nbPrograms, NULL);
+    inspectorBuildTried.resize(nbPrograms, false);
   }
 
   ProgramHandle::ProgramHandle(ContextHandle *context, cl_uint count,
@@ -61,177 +115,237 @@ namespace libsplit {
     delete programBinary;
 
     if (hasBeenBuilt) {
+      waitForBuilds();
       cl_int err = CL_SUCCESS;
       for (unsigned i=0; i<nbPrograms; i++)
 	err |= real_clReleaseProgram(programs[i]);
       clCheck(err, __FILE__, __LINE__);
     }
 
+    for (cl_program p : inspectorPrograms) {
+      if (p)
+	real_clReleaseProgram(p);
+    }
+
     for (unsigned i=0; i<count; ++i)
       delete[] programSources[i];
     delete[] programSources;
     delete[] programs;
+
+    for (auto &it : kernelAnalyses)
+      delete it.second;
+
+    pthread_mutex_destroy(&buildsLock);
   }
 
   void
   ProgramHandle::build(const char *options, void (*pfn_notify)
 		       (cl_program, void *user_data), void *user_data) {
+    buildOptions = options ? options : "";
+
     // Make transformations and create program
     if (isBinary)
       createProgramsWithBinary();
     else
       createProgramsWithSource(options);
 
-    // Build programs
+    // Build programs, each on its own thread. The builds run concurrently
+    // with the generation of the analyses and are joined when a program is
+    // first needed.
+    builds.resize(nbPrograms);
     for (unsigned i=0; i<nbPrograms; i++) {
+      build_info &info = builds[i];
+      info.program = this;
+      info.dev = i;
+      info.options = getDeviceBuildOptions(options, i);
+      info.binary.clear();
 
-      char *alt_option = nullptr;
-      if (options && optBuildOptionDev[i]) {
-	size_t length = strlen(options) + strlen(optBuildOptionDev[i]) + 2;
-	alt_option = (char *) malloc(length);
-	sprintf(alt_option, "%s %s", options, optBuildOptionDev[i]);
-	DEBUG("programhandle",
+      DEBUG("programhandle",
+	    if (options && optBuildOptionDev[i])
 	      std::cerr << "alternative build options for device " << i << ": "
-	      << alt_option << "\n";);
-      }
-
-      cl_int err = real_clBuildProgram(programs[i], 0, NULL,
-				       alt_option ? alt_option : options,
-				       pfn_notify, user_data);
-
-      if (alt_option)
-	free(alt_option);
+			<< info.options << "\n";);
 
-      if (err != CL_SUCCESS) {
-	size_t len;
-	real_clGetProgramBuildInfo(programs[i],
-				   context->getDevice(i),
-				   CL_PROGRAM_BUILD_LOG,
-				   0,
-				   NULL,
-				   &len);
-
-	char *log = new char[len];
-
-	real_clGetProgramBuildInfo(programs[i],
-				   context->getDevice(i),
-				   CL_PROGRAM_BUILD_LOG,
-				   len,
-				   log,
-				   NULL);
-
-	std::cerr << "build error :\n" << log << "\n";
+      if (pthread_create(&info.thread, NULL, buildThread, &info) != 0) {
+	std::cerr << "Error: cannot create build thread\n";
+	exit(EXIT_FAILURE);
       }
-      clCheck(err, __FILE__, __LINE__);
     }
-
-    // If it is not a binary, generate LLVM IR.
-    if (!isBinary) {
-      char src_filename[64];
-      sprintf(src_filename, ".source%d.cl", idx);
-
-      // Generate inline sources
-      char inline_filename[64];
-      sprintf(inline_filename, ".source-inline%d.cl", idx);
+    pthread_mutex_lock(&buildsLock);
+    buildsPending = true;
+    this->pfn_notify = pfn_notify;
+    this->user_data = user_data;
+    pthread_mutex_unlock(&buildsLock);
+
+    // If it is not a binary and not in the cache, compile the source to LLVM
+    // IR and analyze it, in memory.
+    if (!isBinary && !fromCache) {
+      double t1 = get_time();
+
+      // Inline functions. Fake sources are used instead of the program
+      // sources if set.
+      std::string source;
+      if (optFakeSources) {
+	char *fake = file_load(optFakeSources);
+	source = fake;
+	free(fake);
+      } else {
+	source = getSource();
+      }
+      std::string inlineSource;
       {
-	char command[1024];
-	sprintf(command,
-		"%s -finclude-default-header -isystem %s/clang/%s/include %s " \
-		"%s %s > %s 2> /dev/null",
-		CLINLINEPATH, LLVM_LIB_DIR, CLANGVERSION,
-		options ? options : "",
-		"-Dcl_khr_fp64",
-		optFakeSources ? optFakeSources : src_filename,
-		inline_filename);
-	// cl_khr_fp64 is defined to avoid Clang errors when using doubles
-
-	DEBUG("programhandle",
-	      std::cerr << "inline command : " << command << "\n";
-	      );
-
-	int err = system(command);
-	assert(err == 0);
+	std::lock_guard<std::mutex> guard(getClangFrontendLock());
+	inlineSource = clInline(source, getClangArgs(options));
       }
 
-      // Generate spir
-      char bc_filename[64];
-      sprintf(bc_filename, ".spir%d.bc", idx);
+      double t2 = get_time();
 
-      // Generate spir with no optimization
+      // Compile to LLVM IR, optimize and analyze all the kernels of the
+      // module at once, and get the kernel list from the analyses.
       {
-	char command[1024];
-#if CLANGMAJOR < 5
-	sprintf(command, "%s %s -isystem %s/clang/%s/include %s %s -o %s",
-		CLANGPATH,
-		OPENCLFLAGS,
-		LLVM_LIB_DIR, CLANGVERSION,
-		options ? options : "",
-		inline_filename,
-		bc_filename);
-#else
-	sprintf(command, "%s %s %s %s -o %s",
-		CLANGPATH,
-		OPENCLFLAGS,
-		options ? options : "",
-		inline_filename,
-		bc_filename);
-
-#endif
+	std::vector<std::string> args = splitOptions(OPENCLFLAGS);
+	args.push_back("-isystem");
+	args.push_back(CLANG_INCLUDE_DIR);
+	std::vector<std::string> programArgs = splitOptions(options);
+	args.insert(args.end(), programArgs.begin(), programArgs.end());
+
+	std::vector<KernelAnalysis *> analyses;
+	std::vector<KernelAnalysisReport> reports;
+	if (!runKernelAnalysisOnSource(inlineSource, args, OPTPASSES,
+				       &analyses, &reports)) {
+	  std::cerr << "Error: cannot compile and analyze program " << idx
+		    << "\n";
+	  exit(EXIT_FAILURE);
+	}
 
+	setKernelAnalyses(analyses);
 
-	DEBUG("programhandle",
-	      std::cerr << "spir command : " << command << "\n";
-	      );
+	double t3 = get_time();
 
-	int err = system(command);
-	assert(err == 0);
+	DEBUG("programhandle",
+	      std::cerr << "inline: " << (t2 - t1) * 1e3 << " ms, "
+	      << "compilation and analysis of " << analyses.size()
+	      << " kernels: " << (t3 - t2) * 1e3 << " ms\n";
+	      for (const KernelAnalysisReport &r : reports)
+		std::cerr << "  " << r.kernel << ": " << r.numAccesses
+			  << " accesses, " << r.numBoundedAccesses
+			  << " bounded from loop exit tests, "
+			  << r.numUnknownAccesses << " with unknown loop bounds\n";);
+
+	programCache->store(cacheKey, transSource, analyses);
       }
+    }
 
-      // Opt passes
-      {
-	char command[2048];
-	sprintf(command, "%s %s -o %s < %s",
-		OPTPATH,
-		OPTPASSES,
-		bc_filename,
-		bc_filename);
+    hasBeenBuilt = true;
 
-	DEBUG("programhandle",
-	      std::cerr << "opt command : " << command << "\n";
-	      );
+    // An application given a callback may wait for it before using the
+    // program, which would join the builds.
+    if (pfn_notify)
+      waitForBuilds();
+  }
 
-	int err = system(command);
-	assert(err == 0);
-      }
+  void *
+  ProgramHandle::buildThread(void *arg) {
+    build_info *info = (build_info *) arg;
+    info->program->buildProgram(info);
+    return NULL;
+  }
 
-      // Get kernel list.
-      {
-	char command[2048];
-	sprintf(command, "%s -load %s %s -list .spir%d.bc > /dev/null " \
-		"2> .kernellist%d.txt",
-		OPTPATH, KERNELANALYSIS_SO_PATH, PASSARG, getId(), getId());
-	DEBUG("programhandle",
-	      std::cerr << "kernel list command: " << command << "\n";);
-	int err = system(command);
-	assert(err == 0);
+  void
+  ProgramHandle::buildProgram(build_info *info) {
+    unsigned i = info->dev;
 
+    double t1 = get_time();
+    cl_int err = real_clBuildProgram(programs[i], 0, NULL,
+				     info->options.c_str(), NULL, NULL);
 
-	char list_name[64];
-	sprintf(list_name, ".kernellist%d.txt", getId());
+    // The cached binary may have been rejected by the driver, build from
+    // source instead.
+    if (err != CL_SUCCESS && programFromBinary[i]) {
+      DEBUG("programhandle",
+	    std::cerr << "cached binary rejected for device " << i
+	    << ", building from source\n";);
+      real_clReleaseProgram(programs[i]);
+      programFromBinary[i] = false;
+      createProgramFromSource(i);
+      err = real_clBuildProgram(programs[i], 0, NULL, info->options.c_str(),
+				NULL, NULL);
+    }
+    double t2 = get_time();
+
+    DEBUG("programhandle",
+	  std::cerr << "build of program " << idx << " for device " << i
+	  << (programFromBinary[i] ? " from binary: " : " from source: ")
+	  << (t2 - t1) * 1e3 << " ms\n";);
+
+    if (err != CL_SUCCESS) {
+      size_t len;
+      real_clGetProgramBuildInfo(programs[i],
+				 context->getDevice(i),
+				 CL_PROGRAM_BUILD_LOG,
+				 0,
+				 NULL,
+				 &len);
+
+      char *log = new char[len];
+
+      real_clGetProgramBuildInfo(programs[i],
+				 context->getDevice(i),
+				 CL_PROGRAM_BUILD_LOG,
+				 len,
+				 log,
+				 NULL);
+
+      std::cerr << "build error :\n" << log << "\n";
+    }
+    clCheck(err, __FILE__, __LINE__);
 
-	char *str_list = file_load(list_name);
+    // The binary is stored in the cache by the thread joining the build.
+    if (!isBinary && !programFromBinary[i] && programCache->isEnabled() &&
+	!binaryKeys[i].empty())
+      getProgramBinary(programs[i], &info->binary);
+  }
 
-	char *kernel_name = strtok(str_list, ",");;
-	while (kernel_name) {
-	  kernel_list.push_back(std::string(kernel_name));
-	  kernel_name = strtok(NULL, ",");
-	}
+  void
+  ProgramHandle::waitForBuilds() {
+    pthread_mutex_lock(&buildsLock);
+    if (!buildsPending) {
+      pthread_mutex_unlock(&buildsLock);
+      return;
+    }
 
-	free(str_list);
+    double t1 = get_time();
+    for (unsigned i=0; i<nbPrograms; i++) {
+      pthread_join(builds[i].thread, NULL);
+      dev2ProgramMap[context->getDevice(i)] = programs[i];
+      if (!builds[i].binary.empty()) {
+	programCache->storeBinary(binaryKeys[i], builds[i].binary);
+	builds[i].binary.clear();
       }
     }
-
-    hasBeenBuilt = true;
+    double t2 = get_time();
+
+    DEBUG("programhandle",
+	  std::cerr << "waited " << (t2 - t1) * 1e3 << " ms for the builds of "
+	  << "program " << idx << "\n";);
+
+    // The transformed source is only needed to fill the cache, and to build
+    // specialized programs.
+    if (optSpecialize == 0)
+      transSource.clear();
+
+    buildsPending = false;
+
+    // The application is notified once, when the programs of all the
+    // devices are built, without the lock as the callback may use the
+    // program.
+    void (*notify)(cl_program, void *user_data) = pfn_notify;
+    void *data = user_data;
+    pfn_notify = NULL;
+    user_data = NULL;
+    pthread_mutex_unlock(&buildsLock);
+
+    if (notify)
+      notify(reinterpret_cast<cl_program>(this), data);
   }
 
   void
@@ -244,6 +358,8 @@ namespace libsplit {
       exit(EXIT_FAILURE);
     }
 
+    waitForBuilds();
+
     cl_int err;
 
     err =  real_clGetProgramInfo(programs[0], param_name, param_value_size,
@@ -264,6 +380,7 @@ namespace libsplit {
       exit(EXIT_FAILURE);
     }
 
+    waitForBuilds();
 
     bool deviceFound = false;
     for (auto I : dev2ProgramMap) {
@@ -318,53 +435,317 @@ namespace libsplit {
   }
 
 
+  void
+  ProgramHandle::setKernelAnalyses(const std::vector<KernelAnalysis *> &
+				   analyses) {
+    for (KernelAnalysis *analysis : analyses) {
+      kernel_list.push_back(std::string(analysis->getName()));
+      kernelAnalyses[analysis->getName()] = analysis;
+    }
+  }
+
+  std::string
+  ProgramHandle::getSource() {
+    std::string source;
+    for (unsigned i = 0; i < count; ++i)
+      source += programSources[i];
+    return source;
+  }
+
   void
   ProgramHandle::createProgramsWithSource(const char *options) {
     cl_int err;
 
-    // Write source
-    char src_filename[64];
-    sprintf(src_filename, ".source%d.cl", idx);
-    FILE *fd = fopen(src_filename, "w");
-    for (unsigned i = 0; i < count; ++i)
-      fprintf(fd, "%s", programSources[i]);
-    fclose(fd);
+    // Look the program up in the persistent cache. Fake sources are used
+    // instead of the program sources to generate the LLVM IR, they are part
+    // of the key.
+    if (programCache->isEnabled()) {
+      std::string source = getSource();
+      if (optFakeSources) {
+	char *fake = file_load(optFakeSources);
+	source += "\nfake sources:\n";
+	source += fake;
+	free(fake);
+      }
 
-    // Transform sources with ClTransform
-    char trans_filename[64];
-    sprintf(trans_filename, ".trans%d.cl", idx);
-    {
-      char command[1024];
+      cacheKey = ProgramCache::getKey(source, options);
 
-      sprintf(command,
-	      "%s -finclude-default-header -isystem %s/clang/%s/include %s " \
-	      "%s %s > %s 2> /dev/null",
-	      CLTRANSFORMPATH, LLVM_LIB_DIR, CLANGVERSION,
-	      options ? options : "",
-	      "-Dcl_khr_fp64", src_filename, trans_filename);
-      // cl_khr_fp64 is defined to avoid Clang errors when using doubles
+      double t1 = get_time();
+      std::vector<KernelAnalysis *> analyses;
+      fromCache = programCache->lookup(cacheKey, &transSource, &analyses);
+      double t2 = get_time();
 
-      DEBUG("programhandle",
-	    std::cerr << "cltranform command : " << command << "\n";
-	    );
-      int err = system(command);
-      assert(err == 0);
+      if (fromCache) {
+	setKernelAnalyses(analyses);
+
+	DEBUG("programhandle",
+	      std::cerr << "program " << idx << " loaded from cache in "
+	      << (t2 - t1) * 1e3 << " ms\n";);
+      }
     }
 
-    // Load transformed source
-    char *trans_source = file_load(trans_filename);
+    // Transform sources with ClTransform
+    if (!fromCache) {
+      double t1 = get_time();
+      {
+	std::lock_guard<std::mutex> guard(getClangFrontendLock());
+	transSource = clTransform(getSource(), getClangArgs(options));
+      }
+      double t2 = get_time();
+
+      DEBUG("programhandle",
+	    std::cerr << "transformation of program " << idx << ": "
+	    << (t2 - t1) * 1e3 << " ms\n";);
+    }
 
-    // Create split programs
+    // Create split programs, from the binaries of a previous run when they
+    // are in the cache.
     for (unsigned i=0; i<nbPrograms; i++) {
-      programs[i] = real_clCreateProgramWithSource(context->getContext(i),
+      if (programCache->isEnabled()) {
+	cl_device_id d = context->getDevice(i);
+	std::string devOptions = getDeviceBuildOptions(options, i);
+	binaryKeys[i] =
+	  ProgramCache::getBinaryKey(getDeviceInfoString(d, CL_DEVICE_NAME),
+				     getDeviceInfoString(d, CL_DRIVER_VERSION),
+				     transSource, devOptions.c_str());
+
+	std::string binary;
+	if (programCache->lookupBinary(binaryKeys[i], &binary)) {
+	  const unsigned char *bin = (const unsigned char *) binary.data();
+	  size_t length = binary.size();
+	  cl_int status;
+	  programs[i] = real_clCreateProgramWithBinary(context->getContext(i),
+						       1, &d, &length, &bin,
+						       &status, &err);
+	  if (err == CL_SUCCESS && status == CL_SUCCESS) {
+	    programFromBinary[i] = true;
+	    continue;
+	  }
+
+	  DEBUG("programhandle",
+		std::cerr << "cached binary rejected for device " << i
+		<< " (" << err << "), creating program from source\n";);
+	  if (err == CL_SUCCESS)
+	    real_clReleaseProgram(programs[i]);
+	}
+      }
+
+      createProgramFromSource(i);
+    }
+  }
+
+  void
+  ProgramHandle::createProgramFromSource(unsigned dev) {
+    cl_int err;
+    const char *trans_source = transSource.c_str();
+    programs[dev] = real_clCreateProgramWithSource(context->getContext(dev),
 						   1,
-						   (const char **) &trans_source,
+						   &trans_source,
 						   NULL, &err);
+    clCheck(err, __FILE__, __LINE__);
+  }
+
+  std::string
+  ProgramHandle::getDeviceBuildOptions(const char *options, unsigned dev) {
+    if (options && optBuildOptionDev[dev])
+      return std::string(options) + " " + optBuildOptionDev[dev];
+
+    return options ? options : "";
+  }
+
+  void
+  ProgramHandle::getProgramBinary(cl_program program, std::string *binary) {
+    // The program has a single device.
+    size_t size = 0;
+    cl_int err = real_clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES,
+				       sizeof(size), &size, NULL);
+    if (err != CL_SUCCESS || size == 0)
+      return;
+
+    binary->resize(size);
+    unsigned char *bin = (unsigned char *) &(*binary)[0];
+    err = real_clGetProgramInfo(program, CL_PROGRAM_BINARIES,
+				sizeof(bin), &bin, NULL);
+    if (err != CL_SUCCESS)
+      binary->clear();
+  }
+
+  ProgramHandle::specialized_build *
+  ProgramHandle::buildSpecialized(unsigned dev, const std::string &defines) {
+    waitForBuilds();
+
+    if (transSource.empty())
+      return NULL;
+
+    specialized_build *build = new specialized_build();
+    build->program = this;
+    build->dev = dev;
+    build->options = builds[dev].options + defines;
+    build->fromBinary = false;
+    build->specProgram = NULL;
+    build->err = CL_SUCCESS;
+    build->done = false;
+
+    cl_int err;
+    cl_device_id d = context->getDevice(dev);
+    if (programCache->isEnabled()) {
+      build->binaryKey =
+	ProgramCache::getBinaryKey(getDeviceInfoString(d, CL_DEVICE_NAME),
+				   getDeviceInfoString(d, CL_DRIVER_VERSION),
+				   transSource, build->options.c_str());
+
+      std::string binary;
+      if (programCache->lookupBinary(build->binaryKey, &binary)) {
+	const unsigned char *bin = (const unsigned char *) binary.data();
+	size_t length = binary.size();
+	cl_int status;
+	build->specProgram =
+	  real_clCreateProgramWithBinary(context->getContext(dev), 1, &d,
+					 &length, &bin, &status, &err);
+	if (err == CL_SUCCESS && status == CL_SUCCESS) {
+	  build->fromBinary = true;
+	} else {
+	  if (err == CL_SUCCESS)
+	    real_clReleaseProgram(build->specProgram);
+	  build->specProgram = NULL;
+	}
+      }
+    }
+
+    if (!build->specProgram) {
+      const char *trans_source = transSource.c_str();
+      build->specProgram =
+	real_clCreateProgramWithSource(context->getContext(dev), 1,
+				       &trans_source, NULL, &err);
       clCheck(err, __FILE__, __LINE__);
-      dev2ProgramMap[context->getDevice(i)] = programs[i];
     }
 
-    free(trans_source);
+    if (pthread_create(&build->thread, NULL, specializedBuildThread,
+		       build) != 0) {
+      std::cerr << "Error: cannot create build thread\n";
+      exit(EXIT_FAILURE);
+    }
+
+    DEBUG("specialize",
+	  std::cerr << "specializing program " << idx << " for device " << dev
+	  << ":" << defines << (build->fromBinary ? " (cached binary)" : "")
+	  << "\n";);
+
+    return build;
+  }
+
+  void *
+  ProgramHandle::specializedBuildThread(void *arg) {
+    specialized_build *build = (specialized_build *) arg;
+
+    double t1 = get_time();
+    build->err = real_clBuildProgram(build->specProgram, 0, NULL,
+				     build->options.c_str(), NULL, NULL);
+    double t2 = get_time();
+
+    DEBUG("specialize",
+	  std::cerr << "specialized build of program " << build->program->idx
+	  << " for device " << build->dev << ": " << (t2 - t1) * 1e3
+	  << " ms" << (build->err == CL_SUCCESS ? "" : " (failed)") << "\n";);
+
+    if (build->err == CL_SUCCESS && !build->fromBinary &&
+	!build->binaryKey.empty())
+      getProgramBinary(build->specProgram, &build->binary);
+
+    build->done = true;
+    return NULL;
+  }
+
+  bool
+  ProgramHandle::specializedBuildDone(const specialized_build *build) const {
+    return build->done;
+  }
+
+  cl_program
+  ProgramHandle::joinSpecialized(specialized_build *build) {
+    pthread_join(build->thread, NULL);
+
+    cl_program specProgram = build->specProgram;
+    if (build->err != CL_SUCCESS) {
+      real_clReleaseProgram(specProgram);
+      specProgram = NULL;
+    } else if (!build->binary.empty()) {
+      programCache->storeBinary(build->binaryKey, build->binary);
+    }
+
+    delete build;
+
+    return specProgram;
+  }
+
+  void
+  ProgramHandle::transformInspector() {
+    if (inspectorTransformed)
+      return;
+    inspectorTransformed = true;
+
+    if (isBinary)
+      return;
+
+    double t1 = get_time();
+    std::vector<std::string> kernels;
+    {
+      std::lock_guard<std::mutex> guard(getClangFrontendLock());
+      inspectorSource = clTransform(getSource(),
+				    getClangArgs(buildOptions.c_str()),
+				    &kernels);
+    }
+    inspectedKernels.insert(kernels.begin(), kernels.end());
+    double t2 = get_time();
+
+    DEBUG("inspector",
+	  std::cerr << "inspector transformation of program " << idx << ": "
+	  << (t2 - t1) * 1e3 << " ms, " << kernels.size() << "/"
+	  << kernel_list.size() << " kernels inspectable\n";);
+  }
+
+  bool
+  ProgramHandle::isInspectable(const char *kernel_name) {
+    transformInspector();
+    return inspectedKernels.count(kernel_name) > 0;
+  }
+
+  cl_program
+  ProgramHandle::getInspectorProgram(unsigned dev) {
+    transformInspector();
+    if (inspectorBuildTried[dev])
+      return inspectorPrograms[dev];
+    inspectorBuildTried[dev] = true;
+
+    if (inspectedKernels.empty())
+      return NULL;
+
+    waitForBuilds();
+
+    cl_int err;
+    const char *source = inspectorSource.c_str();
+    cl_program program =
+      real_clCreateProgramWithSource(context->getContext(dev), 1, &source,
+				     NULL, &err);
+    clCheck(err, __FILE__, __LINE__);
+
+    double t1 = get_time();
+    err = real_clBuildProgram(program, 0, NULL, builds[dev].options.c_str(),
+			      NULL, NULL);
+    double t2 = get_time();
+
+    DEBUG("inspector",
+	  std::cerr << "inspector build of program " << idx << " for device "
+	  << dev << ": " << (t2 - t1) * 1e3 << " ms"
+	  << (err == CL_SUCCESS ? "" : " (failed)") << "\n";);
+
+    if (err != CL_SUCCESS) {
+      real_clReleaseProgram(program);
+      return NULL;
+    }
+
+    inspectorPrograms[dev] = program;
+    return program;
   }
 
   void
@@ -418,8 +799,19 @@ namespace libsplit {
     // free(transBinary);
   }
 
+  KernelAnalysis *
+  ProgramHandle::getKernelAnalysis(const char *kernel_name) {
+    auto it = kernelAnalyses.find(kernel_name);
+    if (it == kernelAnalyses.end())
+      return NULL;
+
+    // Each kernel handle instantiates its own analysis.
+    return it->second->clone();
+  }
+
   cl_program
   ProgramHandle::getProgram(unsigned n) {
+    waitForBuilds();
     return programs[n];
   }
 
@@ -435,6 +827,7 @@ namespace libsplit {
 
   cl_program
   ProgramHandle::getProgramFromDevice(cl_device_id d) {
+    waitForBuilds();
     assert(dev2ProgramMap.find(d) != dev2ProgramMap.end());
     return dev2ProgramMap[d];
   }
@@ -6,9 +6,16 @@
 
 #include <CL/opencl.h>
 
+#include <KernelAnalysis.h>
+
+#include <atomic>
 #include <map>
+#include <set>
+#include <string>
 #include <vector>
 
+#include <pthread.h>
+
 namespace libsplit {
 
   class ProgramHandle : public Retainable {
@@ -37,11 +44,75 @@ namespace libsplit {
     cl_program getProgramFromDevice(cl_device_id d);
     ContextHandle *getContext();
 
+    // Return a copy of the analysis of kernel_name, NULL if there is no such
+    // kernel in the program.
+    KernelAnalysis *getKernelAnalysis(const char *kernel_name);
+
     int getId();
 
+    // Build of the program of a device with additional build options, e.g.
+    // -D constants, run in the background while the generic program is used.
+    struct specialized_build {
+      ProgramHandle *program;
+      unsigned dev;
+      std::string options;
+      std::string binaryKey;
+      bool fromBinary;
+      cl_program specProgram;
+      cl_int err;
+      pthread_t thread;
+      std::atomic<bool> done;
+      std::string binary;
+    };
+
+    // Start building the program of device dev with defines appended to its
+    // build options. Return NULL if the transformed source is not available.
+    specialized_build *buildSpecialized(unsigned dev,
+					const std::string &defines);
+    bool specializedBuildDone(const specialized_build *build) const;
+    // Join the build and free it. Return the specialized program, owned by
+    // the caller, or NULL if the build failed.
+    cl_program joinSpecialized(specialized_build *build);
+
+    // Return true if the accesses of kernel_name to its buffers can be
+    // recorded by the inspector program.
+    bool isInspectable(const char *kernel_name);
+    // Program of device dev whose kernels also record their footprint (see
+    // clTransform()), built on first use. Return NULL if it cannot be built.
+    cl_program getInspectorProgram(unsigned dev);
+
   private:
+    std::string getSource();
     void createProgramsWithSource(const char *options);
     void createProgramsWithBinary();
+    void createProgramFromSource(unsigned dev);
+    std::string getDeviceBuildOptions(const char *options, unsigned dev);
+    static void getProgramBinary(cl_program program, std::string *binary);
+
+    // The programs of the devices are built concurrently, each on its own
+    // thread, while the kernels are analyzed. The builds are joined when a
+    // program is first needed, e.g. by clCreateKernel, by the first host
+    // thread taking buildsLock.
+    struct build_info {
+      ProgramHandle *program;
+      unsigned dev;
+      std::string options;
+      pthread_t thread;
+      std::string binary; // Stored in the cache when the build is joined.
+    };
+
+    static void *buildThread(void *arg);
+    static void *specializedBuildThread(void *arg);
+    void buildProgram(build_info *info);
+    void waitForBuilds();
+
+    std::vector<build_info> builds;
+    bool buildsPending;
+    pthread_mutex_t buildsLock;
+
+    // Callback given to clBuildProgram, called by waitForBuilds().
+    void (*pfn_notify)(cl_program, void *user_data);
+    void *user_data;
 
     cl_uint count;
     char **programSources;
@@ -59,11 +130,41 @@ namespace libsplit {
 
     std::vector<std::string> kernel_list;
 
+    // Analyses of the kernels of the program, run once when it is built.
+    std::map<std::string, KernelAnalysis *> kernelAnalyses;
+
+    // Persistent cache entry of the program. When the program is found in the
+    // cache, its transformed source and analyses are loaded from it and no
+    // subprocess is spawned.
+    std::string cacheKey;
+    std::string transSource;
+    bool fromCache;
+
+    // Persistent cache entries of the binaries of the programs, one per
+    // device. A program created from a cached binary that fails to build is
+    // created again from the transformed source.
+    std::vector<std::string> binaryKeys;
+    std::vector<bool> programFromBinary;
+
+    void setKernelAnalyses(const std::vector<KernelAnalysis *> &analyses);
+
+    // Build options of the application.
+    std::string buildOptions;
+
+    // Source of the inspector programs, transformed on first use, and the
+    // programs of the devices, NULL until built or if the build failed.
+    void transformInspector();
+    bool inspectorTransformed;
+    std::string inspectorSource;
+    std::set<std::string> inspectedKernels;
+    std::vector<cl_program> inspectorPrograms;
+    std::vector<bool> inspectorBuildTried;
+
     std::map<cl_device_id, cl_program> dev2ProgramMap;
 
     int idx;
 
-    static int idxCount;
+    static std::atomic<int> idxCount;
   };
 
 };
@@ -20,6 +20,10 @@ namespace libsplit {
     driver = new Driver();
     eventFactory = new EventFactory();
     timeline = new Timeline(optDeviceSelection.size() / 2);
+    programCache = new ProgramCache(optCacheDir,
+				    (size_t) optCacheSize * 1024 * 1024);
+    if (optNuma)
+      numaPlacement = new NumaPlacement();
   }
 
 };
@@ -0,0 +1,327 @@
+#include <Inspector.h>
+#include <Dispatch/OpenCLFunctions.h>
+#include <Globals.h>
+#include <Handle/ContextHandle.h>
+#include <Options.h>
+#include <Queue/DeviceQueue.h>
+#include <Utils/Debug.h>
+#include <Utils/Utils.h>
+
+#include <iostream>
+
+namespace libsplit {
+
+  Inspector::Inspector()
+    : nbInspections(0), nbFootprintLaunches(0), nbArgsChanges(0),
+      nbBuffersChanges(0), nbRevalidations(0), nbGivenUp(0) {}
+
+  Inspector::~Inspector() {
+    for (auto &it : kernels) {
+      kernel_info &info = it.second;
+      if (info.pending) {
+	info.readEvent->wait();
+	info.readEvent->release();
+	real_clReleaseMemObject(info.insp.buffer);
+	delete info.ndRange;
+      }
+      clearArgsValues(info);
+    }
+  }
+
+  void
+  Inspector::releaseKernel(KernelHandle *k) {
+    auto it = kernels.find(k);
+    if (it == kernels.end())
+      return;
+
+    kernel_info &info = it->second;
+    if (info.pending) {
+      info.readEvent->wait();
+      info.readEvent->release();
+      k->getContext()->getQueueNo(info.dev)->releaseBuffer(info.insp.buffer);
+      cl_int err = real_clReleaseMemObject(info.insp.buffer);
+      clCheck(err, __FILE__, __LINE__);
+      delete info.ndRange;
+    }
+    clearArgsValues(info);
+    kernels.erase(it);
+  }
+
+  void
+  Inspector::clearArgsValues(kernel_info &info) {
+    for (IndexExprValue *v : info.argsValues)
+      delete v;
+    info.argsValues.clear();
+  }
+
+  void
+  Inspector::getBuffersVersions(KernelHandle *k,
+				std::vector<std::pair<unsigned,
+				unsigned long> > *versions) {
+    versions->clear();
+    for (unsigned i=0; i<k->getAnalysis()->getNbGlobalArguments(); i++) {
+      MemoryHandle *m = k->getGlobalArgHandle(i);
+      if (m)
+	versions->push_back(std::make_pair(m->id, m->version));
+      else
+	versions->push_back(std::make_pair(~0u, 0ul)); // No buffer set
+    }
+  }
+
+  bool
+  Inspector::argsChanged(const kernel_info &info, KernelHandle *k) {
+    const std::vector<IndexExprValue *> &values = k->getArgsValues();
+    if (values.size() != info.argsValues.size())
+      return true;
+
+    for (unsigned i=0; i<values.size(); i++) {
+      const IndexExprValue *a = info.argsValues[i];
+      const IndexExprValue *b = values[i];
+      if (!a || !b) {
+	if (a != b)
+	  return true;
+	continue;
+      }
+      if (a->type != b->type)
+	return true;
+      switch (a->type) {
+      case IndexExpr::LONG:
+	if (a->getLongValue() != b->getLongValue())
+	  return true;
+	break;
+      case IndexExpr::FLOAT:
+	if (a->getFloatValue() != b->getFloatValue())
+	  return true;
+	break;
+      case IndexExpr::DOUBLE:
+	if (a->getDoubleValue() != b->getDoubleValue())
+	  return true;
+	break;
+      };
+    }
+
+    return false;
+  }
+
+  void
+  Inspector::dropFootprint(KernelHandle *k, kernel_info &info,
+			   Scheduler *scheduler) {
+    k->getAnalysis()->setFootprint(NULL);
+    scheduler->invalidateAnalysis(k);
+    clearArgsValues(info);
+    info.buffersVersions.clear();
+  }
+
+  void
+  Inspector::finishInspection(KernelHandle *k, kernel_info &info,
+			      Scheduler *scheduler) {
+    info.readEvent->wait();
+    info.readEvent->release();
+    info.readEvent = NULL;
+    info.pending = false;
+    k->getContext()->getQueueNo(info.dev)->releaseBuffer(info.insp.buffer);
+    cl_int err = real_clReleaseMemObject(info.insp.buffer);
+    clCheck(err, __FILE__, __LINE__);
+
+    Footprint *footprint =
+      new Footprint(*info.ndRange, k->getAnalysis()->getNbArguments(),
+		    info.bounds);
+    delete info.ndRange;
+    info.ndRange = NULL;
+
+    if (footprint->overflowed()) {
+      delete footprint;
+      clearArgsValues(info);
+      info.givenUp = true;
+      nbGivenUp++;
+      DEBUG("inspector",
+	    std::cerr << k->getName() << ": footprint does not fit in 32-bit "
+	    "bounds, not inspected anymore\n";);
+      return;
+    }
+
+    k->getAnalysis()->setFootprint(footprint);
+    scheduler->invalidateAnalysis(k);
+    info.nbLaunches = 0;
+
+    DEBUG("inspector",
+	  std::cerr << k->getName() << ": footprint recorded on device "
+	  << info.dev << "\n";);
+  }
+
+  void
+  Inspector::beginLaunch(KernelHandle *k, Scheduler *scheduler) {
+    auto it = kernels.find(k);
+    if (it == kernels.end())
+      return;
+    kernel_info &info = it->second;
+
+    if (info.pending)
+      finishInspection(k, info, scheduler);
+
+    if (!k->getAnalysis()->getFootprint())
+      return;
+
+    std::vector<std::pair<unsigned, unsigned long> > buffersVersions;
+    getBuffersVersions(k, &buffersVersions);
+
+    if (argsChanged(info, k)) {
+      nbArgsChanges++;
+      DEBUG("inspector",
+	    std::cerr << k->getName() << ": arguments changed, footprint "
+	    "dropped\n";);
+      dropFootprint(k, info, scheduler);
+    } else if (buffersVersions != info.buffersVersions) {
+      nbBuffersChanges++;
+      DEBUG("inspector",
+	    std::cerr << k->getName() << ": buffers changed, footprint "
+	    "dropped\n";);
+      dropFootprint(k, info, scheduler);
+    } else if (optInspectPeriod > 0 &&
+	       ++info.nbLaunches >= optInspectPeriod) {
+      nbRevalidations++;
+      DEBUG("inspector",
+	    std::cerr << k->getName() << ": footprint dropped after "
+	    << info.nbLaunches << " launches\n";);
+      dropFootprint(k, info, scheduler);
+    }
+  }
+
+  const Inspector::inspection *
+  Inspector::getInspection(KernelHandle *k, unsigned kerId,
+			   Scheduler *scheduler, cl_uint work_dim,
+			   const size_t *global_work_offset,
+			   const size_t *global_work_size,
+			   const size_t *local_work_size,
+			   const std::vector<SubKernelExecInfo *> &subkernels) {
+    KernelAnalysis *analysis = k->getAnalysis();
+    if (!scheduler->cannotSplit(kerId)) {
+      if (analysis->footprintUsed())
+	nbFootprintLaunches++;
+      return NULL;
+    }
+
+    if (subkernels.size() != 1)
+      return NULL;
+
+    kernel_info &info = kernels[k];
+    if (info.givenUp || info.pending)
+      return NULL;
+
+    NDRange ndRange(work_dim, global_work_size, global_work_offset,
+		    local_work_size);
+
+    // The analysis cannot split the kernel with a footprint of the same
+    // NDRange either.
+    if (analysis->getFootprint() &&
+	analysis->getFootprint()->matches(ndRange)) {
+      info.givenUp = true;
+      nbGivenUp++;
+      dropFootprint(k, info, scheduler);
+      DEBUG("inspector",
+	    std::cerr << k->getName() << ": not split with its footprint, "
+	    "not inspected anymore\n";);
+      return NULL;
+    }
+
+    // The work-groups of the sub-kernel must be those of the NDRange.
+    SubKernelExecInfo *sk = subkernels[0];
+    for (cl_uint i=0; i<work_dim; i++) {
+      if (sk->global_work_size[i] != global_work_size[i] ||
+	  sk->local_work_size[i] != local_work_size[i])
+	return NULL;
+    }
+
+    // The bounds of the footprint are 32-bit.
+    for (unsigned i=0; i<analysis->getNbGlobalArguments(); i++) {
+      MemoryHandle *m = k->getGlobalArgHandle(i);
+      if (m && m->mSize >= UINT32_MAX) {
+	info.givenUp = true;
+	nbGivenUp++;
+	DEBUG("inspector",
+	      std::cerr << k->getName() << ": buffer of 4 GiB or more, not "
+	      "inspected\n";);
+	return NULL;
+      }
+    }
+
+    cl_kernel kernel = k->getInspectorKernel(sk->device);
+    if (!kernel) {
+      info.givenUp = true;
+      nbGivenUp++;
+      DEBUG("inspector",
+	    std::cerr << k->getName() << ": cannot be inspected\n";);
+      return NULL;
+    }
+
+    unsigned numArgs = analysis->getNbArguments();
+    size_t nbBounds = Footprint::getNbBounds(ndRange, numArgs);
+    info.bounds.resize(nbBounds);
+    for (size_t n=0; n<nbBounds; n++)
+      info.bounds[n] = Footprint::getInitialBound(n);
+
+    cl_int err;
+    size_t size = nbBounds * sizeof(uint32_t);
+    info.insp.kernel = kernel;
+    info.insp.argIndex = numArgs + 2;
+    info.insp.buffer =
+      real_clCreateBuffer(k->getContext()->getContext(sk->device),
+			  CL_MEM_READ_WRITE, size, NULL, &err);
+    clCheck(err, __FILE__, __LINE__);
+
+    DeviceQueue *queue = k->getContext()->getQueueNo(sk->device);
+    Event *event = eventFactory->getNewEvent();
+    queue->enqueueWrite(info.insp.buffer, 0, size, info.bounds.data(), event);
+    event->release();
+
+    info.pending = true;
+    info.dev = sk->device;
+    info.ndRange = new NDRange(ndRange);
+    info.readEvent = NULL;
+    nbInspections++;
+
+    // Arguments of the inspected launch.
+    clearArgsValues(info);
+    for (IndexExprValue *v : k->getArgsValues())
+      info.argsValues.push_back(v ? static_cast<IndexExprValue *>(v->clone()) :
+				nullptr);
+
+    DEBUG("inspector",
+	  std::cerr << k->getName() << ": inspected on device " << sk->device
+	  << ", " << size << " bytes of footprint\n";);
+
+    return &info.insp;
+  }
+
+  void
+  Inspector::endLaunch(KernelHandle *k, const inspection *insp) {
+    auto it = kernels.find(k);
+    if (it == kernels.end())
+      return;
+    kernel_info &info = it->second;
+
+    if (insp) {
+      DeviceQueue *queue = k->getContext()->getQueueNo(info.dev);
+      info.readEvent = eventFactory->getNewEvent();
+      queue->enqueueRead(info.insp.buffer, 0,
+			 info.bounds.size() * sizeof(uint32_t),
+			 info.bounds.data(), info.readEvent);
+    }
+
+    // The buffers written by the launch are already invalidated, only the
+    // changes made by the other commands are seen at the next launch.
+    if (info.pending || k->getAnalysis()->getFootprint())
+      getBuffersVersions(k, &info.buffersVersions);
+  }
+
+  void
+  Inspector::printStats() const {
+    std::cerr << "inspector: " << nbInspections << " inspections, "
+	      << nbFootprintLaunches << " launches split with a footprint, "
+	      << nbArgsChanges << " dropped on argument changes, "
+	      << nbBuffersChanges << " dropped on buffer changes, "
+	      << nbRevalidations << " revalidations, " << nbGivenUp
+	      << " kernels given up\n";
+  }
+
+};
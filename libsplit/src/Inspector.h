@@ -0,0 +1,116 @@
+#ifndef INSPECTOR_H
+#define INSPECTOR_H
+
+#include <Handle/KernelHandle.h>
+#include <Queue/Event.h>
+#include <Scheduler/Scheduler.h>
+
+#include <Footprint.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace libsplit {
+
+  // Inspector-executor fallback for the kernels the analysis cannot split
+  // (INSPECTOR=1). When the scheduler runs a kernel on a single device
+  // because its accesses cannot be bounded, the sub-kernel is launched with
+  // the inspector variant of the kernel (see clTransform()), which also
+  // records the lowest and highest bytes each work-group reads and writes in
+  // each buffer. At the next launch the footprint is given to the analysis,
+  // which uses it for the regions of the arguments it cannot bound, as long
+  // as the NDRange is the one inspected.
+  //
+  // Footprints are speculative: a footprint is dropped when an argument of
+  // the kernel changes, when the content of one of its buffers is changed by
+  // another command than the kernel, e.g. an index buffer written by the
+  // host, and after INSPECTPERIOD launches. The kernel is then inspected
+  // again at the next launch the scheduler cannot split. A kernel still not
+  // split with its footprint is not inspected anymore, nor a kernel whose
+  // buffers are not only accessed through subscripts, e.g. passed to
+  // functions or atomics, or whose footprint does not fit in 32-bit bounds.
+  class Inspector {
+  public:
+    Inspector();
+    ~Inspector();
+
+    // Inspector kernel and footprint buffer to launch instead of the kernel.
+    struct inspection {
+      cl_kernel kernel;
+      cl_uint argIndex;
+      cl_mem buffer;
+    };
+
+    // Called at each launch of k, before the scheduler. Give the footprint
+    // of the last inspection to the analysis, or drop the current one if it
+    // has to be validated again.
+    void beginLaunch(KernelHandle *k, Scheduler *scheduler);
+
+    // Return the inspection of the launch of k with the partition returned
+    // by the scheduler for kernel id kerId, NULL if the launch is not
+    // inspected. The initial footprint is written before the sub-kernel.
+    const inspection *getInspection(KernelHandle *k, unsigned kerId,
+				    Scheduler *scheduler, cl_uint work_dim,
+				    const size_t *global_work_offset,
+				    const size_t *global_work_size,
+				    const size_t *local_work_size,
+				    const std::vector<SubKernelExecInfo *>
+				    &subkernels);
+
+    // Called once the sub-kernels of each launch of k are enqueued. Read the
+    // footprint back if the launch is inspected, and record the versions of
+    // the buffers of k after the launch.
+    void endLaunch(KernelHandle *k, const inspection *insp);
+
+    // Called when k is deleted: wait for the read of its pending inspection
+    // and drop its state.
+    void releaseKernel(KernelHandle *k);
+
+    void printStats() const;
+
+  private:
+    struct kernel_info {
+      kernel_info()
+	: givenUp(false), nbLaunches(0), pending(false), dev(0),
+	  ndRange(NULL), readEvent(NULL) {}
+
+      bool givenUp;
+      unsigned nbLaunches; // Launches since the footprint was set
+      std::vector<IndexExprValue *> argsValues; // When it was recorded
+      // Id and version of the buffer of each global argument after the last
+      // launch.
+      std::vector<std::pair<unsigned, unsigned long> > buffersVersions;
+
+      // Pending inspection
+      bool pending;
+      inspection insp;
+      unsigned dev;
+      NDRange *ndRange;
+      std::vector<uint32_t> bounds;
+      Event *readEvent;
+    };
+
+    void finishInspection(KernelHandle *k, kernel_info &info,
+			  Scheduler *scheduler);
+    void dropFootprint(KernelHandle *k, kernel_info &info,
+		       Scheduler *scheduler);
+    static bool argsChanged(const kernel_info &info, KernelHandle *k);
+    static void clearArgsValues(kernel_info &info);
+    static void getBuffersVersions(KernelHandle *k,
+				   std::vector<std::pair<unsigned,
+				   unsigned long> > *versions);
+
+    std::map<KernelHandle *, kernel_info> kernels;
+
+    unsigned nbInspections;
+    unsigned nbFootprintLaunches; // Launches split with a footprint
+    unsigned nbArgsChanges;
+    unsigned nbBuffersChanges;
+    unsigned nbRevalidations;
+    unsigned nbGivenUp;
+  };
+
+};
+
+#endif /* INSPECTOR_H */
@@ -0,0 +1,305 @@
+#include <LocalSizeTuner.h>
+#include <Dispatch/OpenCLFunctions.h>
+#include <Handle/ContextHandle.h>
+#include <Options.h>
+#include <Utils/Debug.h>
+#include <Utils/Utils.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace libsplit {
+
+  // Work-group size above which larger candidates are tried last.
+  static const size_t PREFERRED_MAX_SIZE = 256;
+
+  static void
+  getWorkGroupLimits(KernelHandle *k, unsigned d, size_t *preferred,
+		     size_t *maxSize) {
+    cl_device_id dev = k->getContext()->getDevice(d);
+    cl_int err;
+
+    err = real_clGetKernelWorkGroupInfo(k->getDeviceKernel(d), dev,
+					CL_KERNEL_WORK_GROUP_SIZE,
+					sizeof(*maxSize), maxSize, NULL);
+    clCheck(err, __FILE__, __LINE__);
+    err = real_clGetKernelWorkGroupInfo(k->getDeviceKernel(d), dev,
+					CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+					sizeof(*preferred), preferred, NULL);
+    clCheck(err, __FILE__, __LINE__);
+
+    *maxSize = std::max(*maxSize, (size_t) 1);
+    *preferred = std::max(std::min(*preferred, *maxSize), (size_t) 1);
+  }
+
+  static void
+  debugLocalSize(cl_uint work_dim, const size_t *size) {
+    for (cl_uint i=0; i<work_dim; i++)
+      std::cerr << (i > 0 ? "x" : "") << size[i];
+  }
+
+  LocalSizeTuner::LocalSizeTuner()
+    : nbLaunches(0), nbOverrides(0), nbTuned(0) {}
+
+  LocalSizeTuner::~LocalSizeTuner() {
+    for (auto &it : ndranges)
+      freeNDRangeInfo(it.second);
+  }
+
+  void
+  LocalSizeTuner::freeNDRangeInfo(ndrange_info *info) {
+    for (device_tuning &dev : info->devices)
+      if (dev.pending)
+	dev.pending->release();
+    delete info;
+  }
+
+  void
+  LocalSizeTuner::releaseKernel(KernelHandle *k) {
+    for (auto it = ndranges.begin(); it != ndranges.end();) {
+      if (it->second->kernel == k) {
+	freeNDRangeInfo(it->second);
+	it = ndranges.erase(it);
+      } else {
+	++it;
+      }
+    }
+  }
+
+  bool
+  LocalSizeTuner::getShape(size_t p, cl_uint work_dim,
+			   const size_t *global_work_size, local_size *shape) {
+    for (unsigned i=0; i<3; i++)
+      shape->size[i] = 1;
+
+    for (size_t total = 1; total < p; total *= 2) {
+      int dim = -1;
+      for (cl_uint i=0; i<work_dim; i++) {
+	if (global_work_size[i] % (2 * shape->size[i]) != 0)
+	  continue;
+	if (dim < 0 || shape->size[i] < shape->size[dim])
+	  dim = i;
+      }
+      if (dim < 0)
+	return false;
+      shape->size[dim] *= 2;
+    }
+
+    return true;
+  }
+
+  void
+  LocalSizeTuner::getCandidates(KernelHandle *k, unsigned d, cl_uint work_dim,
+				const size_t *global_work_size, bool tune,
+				std::vector<local_size> &candidates) {
+    size_t preferred, maxSize;
+    getWorkGroupLimits(k, d, &preferred, &maxSize);
+
+    // Sizes from the preferred multiple up to PREFERRED_MAX_SIZE, largest
+    // first, then the larger ones and at last the ones below the preferred
+    // multiple.
+    std::vector<size_t> sizes;
+    for (size_t p = 1; p <= maxSize; p *= 2)
+      sizes.push_back(p);
+    std::stable_sort(sizes.begin(), sizes.end(),
+		     [preferred](size_t a, size_t b) {
+		       auto rank = [preferred](size_t p) {
+			 return p < preferred ? 2 :
+			 p > PREFERRED_MAX_SIZE ? 1 : 0;
+		       };
+		       if (rank(a) != rank(b))
+			 return rank(a) < rank(b);
+		       return rank(a) == 1 ? a < b : a > b;
+		     });
+
+    unsigned maxCandidates = tune ? std::max(optLocalSizeTune, 1u) : 1;
+    for (size_t p : sizes) {
+      local_size shape;
+      if (!getShape(p, work_dim, global_work_size, &shape))
+	continue;
+      candidates.push_back(shape);
+      if (candidates.size() == maxCandidates)
+	break;
+    }
+  }
+
+  LocalSizeTuner::ndrange_info *
+  LocalSizeTuner::getNDRangeInfo(KernelHandle *k, cl_uint work_dim,
+				 const size_t *global_work_size,
+				 const size_t *app_local_work_size,
+				 size_t *local_work_size) {
+    const KernelFeatures &features = k->getAnalysis()->getFeatures();
+    bool usesWorkGroup = features.usesBarriers || features.usesLocalMemory ||
+      features.usesWorkGroupIds;
+    if (app_local_work_size && (!optLocalSizeOverride || usesWorkGroup))
+      return NULL;
+
+    std::vector<size_t> key;
+    key.push_back(k->getId());
+    key.push_back(work_dim);
+    key.insert(key.end(), global_work_size, global_work_size + work_dim);
+
+    ndrange_info *info;
+    auto it = ndranges.find(key);
+    if (it != ndranges.end()) {
+      info = it->second;
+    } else {
+      info = new ndrange_info;
+      info->kernel = k;
+      info->work_dim = work_dim;
+      unsigned nbDevices = k->getContext()->getNbDevices();
+      info->devices.resize(nbDevices);
+
+      if (!features.usesWorkGroupIds) {
+	for (unsigned d=0; d<nbDevices; d++)
+	  getCandidates(k, d, work_dim, global_work_size, optLocalSizeTune > 0,
+			info->devices[d].candidates);
+      } else {
+	// Largest common candidate, the first one of the device with the
+	// smallest maximum work-group size.
+	unsigned dmin = 0;
+	size_t minSize = 0;
+	for (unsigned d=0; d<nbDevices; d++) {
+	  size_t preferred, maxSize;
+	  getWorkGroupLimits(k, d, &preferred, &maxSize);
+	  if (d == 0 || maxSize < minSize) {
+	    dmin = d;
+	    minSize = maxSize;
+	  }
+	}
+	std::vector<local_size> candidates;
+	getCandidates(k, dmin, work_dim, global_work_size, false, candidates);
+	for (unsigned d=0; d<nbDevices; d++)
+	  info->devices[d].candidates = candidates;
+      }
+
+      for (unsigned i=0; i<3; i++)
+	info->split_local_size[i] = 1;
+      for (device_tuning &dev : info->devices) {
+	dev.times.resize(dev.candidates.size(), 0);
+	dev.current = 0;
+	dev.tuned = dev.candidates.size() == 1;
+	dev.pending = NULL;
+	dev.pendingWorkItems = 0;
+
+	// Powers of two: the maximum is a multiple of all of them.
+	for (const local_size &l : dev.candidates)
+	  for (unsigned i=0; i<3; i++)
+	    info->split_local_size[i] = std::max(info->split_local_size[i],
+						 l.size[i]);
+      }
+
+      ndranges[key] = info;
+
+      DEBUG("localsize",
+	    std::cerr << k->getName() << ": split local size ";
+	    debugLocalSize(work_dim, info->split_local_size);
+	    for (unsigned d=0; d<nbDevices; d++) {
+	      std::cerr << ", dev " << d << " {";
+	      for (unsigned c=0; c<info->devices[d].candidates.size(); c++) {
+		std::cerr << (c > 0 ? " " : "");
+		debugLocalSize(work_dim, info->devices[d].candidates[c].size);
+	      }
+	      std::cerr << "}";
+	    }
+	    std::cerr << "\n";);
+    }
+
+    memcpy(local_work_size, info->split_local_size,
+	   work_dim * sizeof(size_t));
+
+    nbLaunches++;
+    if (app_local_work_size)
+      nbOverrides++;
+
+    return info;
+  }
+
+  void
+  LocalSizeTuner::measure(device_tuning &dev) {
+    // Called with the scheduler lock held: a launch still running is
+    // measured by a later one.
+    if (!dev.pending || !dev.pending->isComplete())
+      return;
+
+    cl_ulong start = dev.pending->getStart();
+    cl_ulong end = dev.pending->getEnd();
+
+    // A null time still marks the candidate as measured.
+    double t = (end - start) * 1e-9 / dev.pendingWorkItems;
+    dev.times[dev.current] = std::max(t, 1e-15);
+    dev.pending->release();
+    dev.pending = NULL;
+  }
+
+  void
+  LocalSizeTuner::setLocalSizes(ndrange_info *info,
+				std::vector<SubKernelExecInfo *> &subkernels) {
+    for (SubKernelExecInfo *sk : subkernels) {
+      device_tuning &dev = info->devices[sk->device];
+
+      if (!dev.tuned) {
+	measure(dev);
+
+	// Next candidate not measured yet, or the fastest one.
+	unsigned next = 0;
+	while (next < dev.times.size() && dev.times[next] > 0)
+	  next++;
+	if (next < dev.times.size()) {
+	  dev.current = next;
+	} else {
+	  dev.tuned = true;
+	  dev.current = std::min_element(dev.times.begin(), dev.times.end()) -
+	    dev.times.begin();
+	  nbTuned++;
+
+	  DEBUG("localsize",
+		std::cerr << info->kernel->getName() << ": dev "
+		<< sk->device << " local size ";
+		debugLocalSize(info->work_dim,
+			       dev.candidates[dev.current].size);
+		std::cerr << " (";
+		for (unsigned c=0; c<dev.times.size(); c++)
+		  std::cerr << (c > 0 ? " " : "") << dev.times[c] * 1e9;
+		std::cerr << " ns/work-item)\n";);
+	}
+      }
+
+      const local_size &l = dev.candidates[dev.current];
+      unsigned splitdim = sk->splitdim;
+      sk->numgroups = sk->numgroups * info->split_local_size[splitdim] /
+	l.size[splitdim];
+      memcpy(sk->local_work_size, l.size, sizeof(l.size));
+    }
+  }
+
+  void
+  LocalSizeTuner::pushLaunch(ndrange_info *info,
+			     const std::vector<SubKernelExecInfo *>
+			     &subkernels) {
+    for (SubKernelExecInfo *sk : subkernels) {
+      device_tuning &dev = info->devices[sk->device];
+      if (dev.tuned || dev.pending)
+	continue;
+
+      size_t workItems = 1;
+      for (cl_uint i=0; i<sk->work_dim; i++)
+	workItems *= sk->global_work_size[i];
+      if (workItems == 0)
+	continue;
+
+      dev.pending = sk->event;
+      dev.pending->retain();
+      dev.pendingWorkItems = workItems;
+    }
+  }
+
+  void
+  LocalSizeTuner::printStats() const {
+    std::cerr << "local size: " << nbLaunches << " launches, "
+	      << nbOverrides << " overrides, " << ndranges.size()
+	      << " ndranges, " << nbTuned << " devices tuned\n";
+  }
+
+};
@@ -0,0 +1,108 @@
+#ifndef LOCALSIZETUNER_H
+#define LOCALSIZETUNER_H
+
+#include <Handle/KernelHandle.h>
+#include <Queue/Event.h>
+#include <Scheduler/Scheduler.h>
+
+#include <map>
+#include <vector>
+
+namespace libsplit {
+
+  // Choice of the local work sizes of the sub-kernels when the application
+  // passes a NULL local_work_size, or when LOCALSIZEOVERRIDE is set and the
+  // kernel uses no barrier, no local memory and no work-group id.
+  //
+  // The candidates of a device are the power of two work-group sizes from
+  // CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE up to CL_KERNEL_WORK_GROUP_SIZE
+  // whose shape divides the global work size. The first launches of a
+  // kernel with a given NDRange try LOCALSIZETUNE of them on each device,
+  // timed with the profiling of the sub-kernel events, and the fastest one
+  // is kept.
+  //
+  // The scheduler splits the NDRange in units of a local work size multiple
+  // of every candidate, so that each sub-kernel can be launched with the
+  // local work size of its device. Kernels using work-group ids get the same
+  // local work size on all devices as the analysis of their accesses depends
+  // on it, and are not tuned.
+  class LocalSizeTuner {
+  public:
+    LocalSizeTuner();
+    ~LocalSizeTuner();
+
+    struct ndrange_info;
+
+    // Return NULL if the sub-kernels are launched with the local work size
+    // of the application. Otherwise local_work_size is set to the split
+    // granularity to give to the scheduler.
+    ndrange_info *getNDRangeInfo(KernelHandle *k, cl_uint work_dim,
+				 const size_t *global_work_size,
+				 const size_t *app_local_work_size,
+				 size_t *local_work_size);
+
+    // Set the local work size and the number of work-groups of the
+    // sub-kernels, before they are enqueued.
+    void setLocalSizes(ndrange_info *info,
+		       std::vector<SubKernelExecInfo *> &subkernels);
+
+    // Record the events of the sub-kernels enqueued with a candidate being
+    // tuned.
+    void pushLaunch(ndrange_info *info,
+		    const std::vector<SubKernelExecInfo *> &subkernels);
+
+    // Free the NDRanges of kernel k, released by the application.
+    void releaseKernel(KernelHandle *k);
+
+    void printStats() const;
+
+    struct local_size {
+      size_t size[3];
+    };
+
+    struct device_tuning {
+      std::vector<local_size> candidates;
+      std::vector<double> times; // Time per work-item, 0 if not measured
+      unsigned current;
+      bool tuned;
+      Event *pending; // Last launch of a candidate not measured yet
+      size_t pendingWorkItems;
+    };
+
+    struct ndrange_info {
+      KernelHandle *kernel;
+      cl_uint work_dim;
+      size_t split_local_size[3];
+      std::vector<device_tuning> devices;
+    };
+
+  private:
+    // Candidate local work sizes of kernel k on device d, most likely
+    // fastest first.
+    void getCandidates(KernelHandle *k, unsigned d, cl_uint work_dim,
+		       const size_t *global_work_size, bool tune,
+		       std::vector<local_size> &candidates);
+
+    // Shape of total size p, obtained by doubling the smallest dimension
+    // that still divides the global work size. Return false if there is
+    // none.
+    static bool getShape(size_t p, cl_uint work_dim,
+			 const size_t *global_work_size, local_size *shape);
+
+    // Record the time of the pending launch of dev if it is complete,
+    // without blocking.
+    void measure(device_tuning &dev);
+
+    static void freeNDRangeInfo(ndrange_info *info);
+
+    // Key: kernel id, work_dim and global work size.
+    std::map<std::vector<size_t>, ndrange_info *> ndranges;
+
+    unsigned nbLaunches;
+    unsigned nbOverrides;
+    unsigned nbTuned;
+  };
+
+};
+
+#endif /* LOCALSIZETUNER_H */
@@ -0,0 +1,222 @@
+#include <Globals.h>
+#include <NumaPlacement.h>
+#include <Utils/Debug.h>
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef USE_HWLOC
+
+#ifdef CUDA
+#include <hwloc/cudart.h>
+#endif /* CUDA */
+
+#include <hwloc/opencl.h>
+
+#endif /* USE_HWLOC */
+
+// Bytes of a shadow placed together, a multiple of the page size.
+#define NUMACHUNKSIZE (2 * 1024 * 1024)
+
+// A chunk is migrated when the devices of another node transfer it that
+// many times more than those of its node.
+#define NUMAMIGRATEFACTOR 2
+
+namespace libsplit {
+
+  NumaPlacement::NumaPlacement()
+    : nbNodes(0), nbPlacements(0), nbMigrations(0), nbFailures(0),
+      migratedBytes(0) {
+#ifdef USE_HWLOC
+    hwloc_topology_init(&topology);
+#if HWLOC_API_VERSION >= 0x00020000
+    hwloc_topology_set_io_types_filter(topology,
+				       HWLOC_TYPE_FILTER_KEEP_IMPORTANT);
+#else
+    hwloc_topology_set_flags(topology, HWLOC_TOPOLOGY_FLAG_IO_DEVICES);
+#endif
+    hwloc_topology_load(topology);
+
+    hwloc_obj_t node = NULL;
+    while ((node = hwloc_get_next_obj_by_type(topology, HWLOC_OBJ_NUMANODE,
+					      node)))
+      nbNodes = std::max(nbNodes, node->os_index + 1);
+#else
+    std::cerr << "Warning: NUMA placement requires libsplit to be built with "
+	      << "USE_HWLOC, it is disabled.\n";
+#endif /* USE_HWLOC */
+  }
+
+  NumaPlacement::~NumaPlacement() {
+#ifdef USE_HWLOC
+    hwloc_topology_destroy(topology);
+#endif /* USE_HWLOC */
+  }
+
+  int
+  NumaPlacement::getDeviceNode(cl_device_id dev, int cudaId) {
+    // Nothing to place on a single node.
+    if (nbNodes < 2)
+      return -1;
+
+    int node = -1;
+
+#ifdef USE_HWLOC
+    hwloc_bitmap_t cpuset = hwloc_bitmap_alloc();
+    int err;
+
+#ifdef CUDA
+    if (cudaId >= 0)
+      err = hwloc_cudart_get_device_cpuset(topology, cudaId, cpuset);
+    else
+#endif /* CUDA */
+      err = hwloc_opencl_get_device_cpuset(topology, dev, cpuset);
+
+    if (!err) {
+      hwloc_bitmap_t nodeset = hwloc_bitmap_alloc();
+      hwloc_cpuset_to_nodeset(topology, cpuset, nodeset);
+      // A device close to all the cores has no node.
+      if (hwloc_bitmap_weight(nodeset) == 1)
+	node = hwloc_bitmap_first(nodeset);
+      hwloc_bitmap_free(nodeset);
+    }
+    hwloc_bitmap_free(cpuset);
+#endif /* USE_HWLOC */
+
+    (void) dev;
+    (void) cudaId;
+
+    DEBUG("numa", std::cerr << "numa: device " << dev << " on node " << node
+	  << "\n";);
+
+    return node;
+  }
+
+  void
+  NumaPlacement::bindThread(int node) {
+#ifdef USE_HWLOC
+    hwloc_bitmap_t nodeset = hwloc_bitmap_alloc();
+    hwloc_bitmap_t cpuset = hwloc_bitmap_alloc();
+
+    hwloc_bitmap_only(nodeset, node);
+    hwloc_cpuset_from_nodeset(topology, cpuset, nodeset);
+    if (hwloc_set_cpubind(topology, cpuset, HWLOC_CPUBIND_THREAD) < 0)
+      std::cerr << "Warning: cannot bind thread to NUMA node " << node
+		<< "\n";
+
+    hwloc_bitmap_free(cpuset);
+    hwloc_bitmap_free(nodeset);
+#else
+    (void) node;
+#endif /* USE_HWLOC */
+  }
+
+  NumaShadow *
+  NumaPlacement::allocShadow(unsigned bufferId, size_t size) {
+    if (nbNodes < 2 || size == 0)
+      return NULL;
+
+#ifdef USE_HWLOC
+    // Pages of anonymous mappings are zeroed and allocated on first touch.
+    void *base = hwloc_alloc(topology, size);
+    if (!base)
+      return NULL;
+
+    size_t nbChunks = (size + NUMACHUNKSIZE - 1) / NUMACHUNKSIZE;
+
+    NumaShadow *shadow = new NumaShadow;
+    shadow->bufferId = bufferId;
+    shadow->base = base;
+    shadow->size = size;
+    shadow->chunkNodes.assign(nbChunks, -1);
+    shadow->chunkTraffic.assign(nbChunks, std::vector<size_t>(nbNodes, 0));
+
+    return shadow;
+#else
+    (void) bufferId;
+    return NULL;
+#endif /* USE_HWLOC */
+  }
+
+  void
+  NumaPlacement::freeShadow(NumaShadow *shadow) {
+#ifdef USE_HWLOC
+    hwloc_free(topology, shadow->base, shadow->size);
+#endif /* USE_HWLOC */
+    delete shadow;
+  }
+
+  void
+  NumaPlacement::recordTransfer(NumaShadow *shadow, int node, size_t offset,
+				size_t cb) {
+    if (node < 0 || cb == 0)
+      return;
+
+    size_t first = offset / NUMACHUNKSIZE;
+    size_t last = (offset + cb - 1) / NUMACHUNKSIZE;
+
+    for (size_t c=first; c<=last; c++) {
+      size_t lb = std::max(offset, c * NUMACHUNKSIZE);
+      size_t hb = std::min(offset + cb, (c + 1) * NUMACHUNKSIZE);
+      std::vector<size_t> &traffic = shadow->chunkTraffic[c];
+      traffic[node] += hb - lb;
+
+      int current = shadow->chunkNodes[c];
+      if (current == node)
+	continue;
+      if (current < 0 ||
+	  traffic[node] >= NUMAMIGRATEFACTOR * traffic[current])
+	placeChunk(shadow, c, node);
+    }
+  }
+
+  void
+  NumaPlacement::placeChunk(NumaShadow *shadow, size_t chunk, int node) {
+    size_t offset = chunk * NUMACHUNKSIZE;
+    size_t size = std::min((size_t) NUMACHUNKSIZE, shadow->size - offset);
+
+#ifdef USE_HWLOC
+    hwloc_bitmap_t nodeset = hwloc_bitmap_alloc();
+    hwloc_bitmap_only(nodeset, node);
+    // Pages already touched are moved, the others are allocated on node.
+#if HWLOC_API_VERSION >= 0x00020000
+    int err = hwloc_set_area_membind(topology, (char *) shadow->base + offset,
+				     size, nodeset, HWLOC_MEMBIND_BIND,
+				     HWLOC_MEMBIND_MIGRATE |
+				     HWLOC_MEMBIND_BYNODESET);
+#else
+    int err = hwloc_set_area_membind_nodeset(topology,
+					     (char *) shadow->base + offset,
+					     size, nodeset, HWLOC_MEMBIND_BIND,
+					     HWLOC_MEMBIND_MIGRATE);
+#endif
+    if (err < 0)
+      nbFailures++;
+    hwloc_bitmap_free(nodeset);
+#endif /* USE_HWLOC */
+
+    if (shadow->chunkNodes[chunk] < 0) {
+      nbPlacements++;
+    } else {
+      nbMigrations++;
+      migratedBytes += size;
+    }
+    // Not retried on failure.
+    shadow->chunkNodes[chunk] = node;
+
+    DEBUG("numa",
+	  std::cerr << "numa: buffer " << shadow->bufferId << " [" << offset
+	  << "," << offset + size - 1 << "] on node " << node << "\n";);
+
+    timeline->pushBufferPlacement(shadow->bufferId, offset, size, node);
+  }
+
+  void
+  NumaPlacement::printStats() const {
+    std::cerr << "numa: " << nbNodes << " nodes, " << nbPlacements
+	      << " chunks placed, " << nbMigrations << " migrations ("
+	      << migratedBytes << " bytes), " << nbFailures
+	      << " failed bindings\n";
+  }
+
+};
@@ -0,0 +1,75 @@
+#ifndef NUMAPLACEMENT_H
+#define NUMAPLACEMENT_H
+
+#include <CL/cl.h>
+
+#include <atomic>
+#include <vector>
+
+#include <cstddef>
+
+#ifdef USE_HWLOC
+#include <hwloc.h>
+#endif /* USE_HWLOC */
+
+namespace libsplit {
+
+  // Host shadow of a buffer, placed on the NUMA nodes by chunks.
+  struct NumaShadow {
+    unsigned bufferId;
+    void *base;
+    size_t size;
+
+    // Node of each chunk, -1 until it is first transferred, and bytes of the
+    // chunk transferred with the devices of each node.
+    std::vector<int> chunkNodes;
+    std::vector<std::vector<size_t> > chunkTraffic;
+  };
+
+  // NUMA placement (NUMA=1, needs USE_HWLOC). The thread of each device is
+  // bound to the cores of the NUMA node closest to the device. The host
+  // shadows of the buffers are allocated without touching their pages, and
+  // each chunk of a shadow is bound to the node of the devices it is
+  // transferred with, then migrated when the devices of another node
+  // transfer it twice as much.
+  class NumaPlacement {
+  public:
+    NumaPlacement();
+    ~NumaPlacement();
+
+    // NUMA node (OS index) closest to dev, -1 if unknown. cudaId is the
+    // CUDA runtime index of a CUDA device, -1 otherwise.
+    int getDeviceNode(cl_device_id dev, int cudaId);
+
+    // Bind the calling thread to the cores of node.
+    void bindThread(int node);
+
+    // Allocate a zeroed shadow of size bytes, NULL if it cannot be placed.
+    NumaShadow *allocShadow(unsigned bufferId, size_t size);
+    void freeShadow(NumaShadow *shadow);
+
+    // Account cb bytes at offset of shadow transferred with a device of
+    // node, placing or migrating the chunks accordingly.
+    void recordTransfer(NumaShadow *shadow, int node, size_t offset,
+			size_t cb);
+
+    void printStats() const;
+
+  private:
+    void placeChunk(NumaShadow *shadow, size_t chunk, int node);
+
+    unsigned nbNodes; // Greatest OS index of the nodes + 1
+    // Updated by the host threads transferring to different buffers.
+    std::atomic<unsigned long> nbPlacements;
+    std::atomic<unsigned long> nbMigrations;
+    std::atomic<unsigned long> nbFailures;
+    std::atomic<size_t> migratedBytes;
+
+#ifdef USE_HWLOC
+    hwloc_topology_t topology;
+#endif /* USE_HWLOC */
+  };
+
+};
+
+#endif /* NUMAPLACEMENT_H */
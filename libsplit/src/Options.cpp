@@ -1,4 +1,5 @@
 #include <Options.h>
+#include <Queue/DeviceQueue.h>
 #include <Scheduler/Scheduler.h>
 
 #include <iomanip>
@@ -44,6 +45,27 @@ namespace libsplit {
 					 nullptr, nullptr};
   bool optPinnedMem = true;
   bool optMKGRNoComm = false;
+  bool optCheckIncrementalRegions = false;
+  char *optCacheDir = nullptr;
+  unsigned optCacheSize = 256;
+  bool optRooflineStart = true;
+  std::vector<double> optDeviceGflops;
+  std::vector<double> optDeviceBandwidth;
+  unsigned optSpecialize = 0;
+  bool optLocalSizeOverride = false;
+  unsigned optLocalSizeTune = 4;
+  bool optInspector = false;
+  unsigned optInspectPeriod = 16;
+  bool optEventCallbacks = true;
+  bool optCopyQueues = true;
+  unsigned optBatchSize = 64;
+  unsigned optFlushThreshold = 16;
+  bool optNuma = false;
+  unsigned optStreams = DeviceQueue::MAXSTREAMS;
+  bool optDag = false;
+  unsigned optDagWindow = 8;
+  unsigned optDagSplitSize = 1 << 20;
+  bool optBenchQueue = false;
 
   struct option {
     const char *name;
@@ -83,13 +105,37 @@ namespace libsplit {
   static void buildOptionDevOption(char *env);
   static void pinnedMemOption(char *env);
   static void mkgrNoCommOption(char *env);
+  static void checkIncrementalRegionsOption(char *env);
+  static void cacheDirOption(char *env);
+  static void cacheSizeOption(char *env);
+  static void rooflineStartOption(char *env);
+  static void deviceGflopsOption(char *env);
+  static void deviceBandwidthOption(char *env);
+  static void specializeOption(char *env);
+  static void localSizeOverrideOption(char *env);
+  static void localSizeTuneOption(char *env);
+  static void inspectorOption(char *env);
+  static void inspectPeriodOption(char *env);
+  static void eventCallbacksOption(char *env);
+  static void copyQueuesOption(char *env);
+  static void batchSizeOption(char *env);
+  static void flushThresholdOption(char *env);
+  static void numaOption(char *env);
+  static void streamsOption(char *env);
+  static void dagOption(char *env);
+  static void dagWindowOption(char *env);
+  static void dagSplitSizeOption(char *env);
+  static void benchQueueOption(char *env);
 
   static option opts[] = {
     {"HELP", "Display available options.", false, helpOption},
     {"DEBUG", "Execute all debug macros.", false, debugOption},
     {"DEBUGTYPE", "Execute only selected debug macros (e.g. DEBUGTYPE=foo,bar)." \
-     "\n                      Available DEBUGTYPE are: broyden, kernelstats, " \
-     "log, memcpy, programhandle, schedtimer, timer.", false, debugtypeOption},
+     "\n                      Available DEBUGTYPE are: analysis, " \
+     "analysisload, batches, broyden, cache, commands, dag, events, " \
+     "indirection, inspector, instantiation, kernelstats, localsize, " \
+     "memcpy, numa, programhandle, roofline, specialize, streams, " \
+     "timers, transfers.", false, debugtypeOption},
     {"DEVICES", "Devices selection. Must be of the following form : " \
      "<pf id1, dev_id1, ..., pf_idN, dev_idN>.", true, devicesOption},
     {"PERPLATFORM", "One context per platform when set to 1," \
@@ -148,6 +194,75 @@ namespace libsplit {
      pinnedMemOption},
     {"MKGRNOCOMM", "Ignore comm constraints with MKGR scheduler.", false,
      mkgrNoCommOption},
+    {"CHECKINCREMENTALREGIONS", "Check incrementally updated regions, " \
+     "shifted with the split boundaries or the scalar arguments, against a " \
+     "full recomputation.", false, checkIncrementalRegionsOption},
+    {"CACHEDIR", "Directory of the persistent program cache " \
+     "(default: $XDG_CACHE_HOME/libsplit or $HOME/.cache/libsplit).", false,
+     cacheDirOption},
+    {"CACHESIZE", "Maximum size of the program cache in MB, 0 disables the " \
+     "cache (default: 256).", false, cacheSizeOption},
+    {"ROOFLINESTART", "Start adaptive schedulers from a partition computed " \
+     "from the static kernel features and the device peaks (enabled by " \
+     "default).", false, rooflineStartOption},
+    {"DEVICEGFLOPS", "<gflops0> ... <gflopsN> peak performance of the devices " \
+     "(default: estimated from the device info).", false, deviceGflopsOption},
+    {"DEVICEBANDWIDTH", "<GB/s0> ... <GB/sN> memory bandwidth of the devices " \
+     "(default: estimated from the device type).", false,
+     deviceBandwidthOption},
+    {"SPECIALIZE", "Number of launches of a kernel on a device with the same " \
+     "split parameters after which a program specialized for them is built " \
+     "in the background, 0 disables specialization (default: 0).", false,
+     specializeOption},
+    {"LOCALSIZEOVERRIDE", "Replace the local work size given by the " \
+     "application with one chosen per device when the kernel uses no " \
+     "barrier, no local memory and no work-group id (default: 0).", false,
+     localSizeOverrideOption},
+    {"LOCALSIZETUNE", "Number of local work sizes tried on each device " \
+     "for a kernel and an NDRange when libsplit chooses the local work " \
+     "size, the fastest one is kept, 0 keeps the first one (default: 4).",
+     false, localSizeTuneOption},
+    {"INSPECTOR", "Launch the kernels the analysis cannot split with an " \
+     "instrumented variant recording the bytes accessed by each " \
+     "work-group, and split the next launches with this footprint, which " \
+     "is speculative if the accesses depend on buffer contents " \
+     "(default: 0).", false, inspectorOption},
+    {"INSPECTPERIOD", "Number of launches after which the footprint of " \
+     "an inspected kernel is recorded again, 0 keeps it until the kernel " \
+     "arguments change (default: 16).", false, inspectPeriodOption},
+    {"EVENTCALLBACKS", "Complete the events with OpenCL event callbacks, " \
+     "0 polls the events in the host threads waiting for them " \
+     "(default: 1).", false, eventCallbacksOption},
+    {"COPYQUEUES", "Enqueue the host to device and device to host " \
+     "transfers in their own command queues, ordered with the kernels " \
+     "accessing the same buffers, so that they overlap with the other " \
+     "kernels (default: 1).", false, copyQueuesOption},
+    {"BATCHSIZE", "Maximum number of commands dequeued and submitted in " \
+     "a batch by the thread of a device (default: 64).", false,
+     batchSizeOption},
+    {"FLUSHTHRESHOLD", "Number of commands submitted to a command queue " \
+     "in a batch before it is flushed, 0 flushes only at the end of the " \
+     "batch (default: 16).", false, flushThresholdOption},
+    {"NUMA", "Bind the thread of each device to the NUMA node closest " \
+     "to the device, and place the chunks of the host buffers on the node " \
+     "of the devices they are transferred with, needs hwloc (default: 0).",
+     false, numaOption},
+    {"STREAMS", "Number of compute command queues of each device, over " \
+     "which the kernels of the command queues of the application are " \
+     "distributed, so that kernels not accessing the same buffers run " \
+     "concurrently (default: 4, at most 4).", false, streamsOption},
+    {"DAG", "Run the kernels of less than DAGSPLITSIZE work-items whole on " \
+     "a single device instead of splitting them, on different devices for " \
+     "the kernels not accessing the regions written by the pending " \
+     "launches, single kernel schedulers only (default: 0).", false,
+     dagOption},
+    {"DAGWINDOW", "Number of pending launches the kernels are checked " \
+     "against in DAG mode (default: 8).", false, dagWindowOption},
+    {"DAGSPLITSIZE", "Number of work-items from which a kernel is split " \
+     "in DAG mode (default: 1048576).", false, dagSplitSizeOption},
+    {"BENCHQUEUE", "Print the submission latency of the device queue " \
+     "implementations when the context is created (default: 0).", false,
+     benchQueueOption},
 
   };
 
@@ -435,6 +550,155 @@ namespace libsplit {
     optMKGRNoComm = atoi(env);
   }
 
+  static void checkIncrementalRegionsOption(char *env) {
+    if (!env)
+      return;
+    optCheckIncrementalRegions = atoi(env);
+  }
+
+  static void cacheDirOption(char *env) {
+    if (!env)
+      return;
+    optCacheDir = strdup(env);
+  }
+
+  static void cacheSizeOption(char *env) {
+    if (!env)
+      return;
+    optCacheSize = atoi(env);
+  }
+
+  static void rooflineStartOption(char *env) {
+    if (!env)
+      return;
+    optRooflineStart = atoi(env);
+  }
+
+  static void deviceGflopsOption(char *env) {
+    if (!env)
+      return;
+
+    std::string s(env);
+    std::istringstream is(s);
+    double n;
+    while (is >> n)
+      optDeviceGflops.push_back(n);
+  }
+
+  static void deviceBandwidthOption(char *env) {
+    if (!env)
+      return;
+
+    std::string s(env);
+    std::istringstream is(s);
+    double n;
+    while (is >> n)
+      optDeviceBandwidth.push_back(n);
+  }
+
+  static void specializeOption(char *env) {
+    if (!env)
+      return;
+    optSpecialize = atoi(env);
+  }
+
+  static void localSizeOverrideOption(char *env) {
+    if (!env)
+      return;
+    optLocalSizeOverride = atoi(env);
+  }
+
+  static void localSizeTuneOption(char *env) {
+    if (!env)
+      return;
+    optLocalSizeTune = atoi(env);
+  }
+
+  static void inspectorOption(char *env) {
+    if (!env)
+      return;
+    optInspector = atoi(env);
+  }
+
+  static void inspectPeriodOption(char *env) {
+    if (!env)
+      return;
+    optInspectPeriod = atoi(env);
+  }
+
+  static void eventCallbacksOption(char *env) {
+    if (!env)
+      return;
+    optEventCallbacks = atoi(env);
+  }
+
+  static void copyQueuesOption(char *env) {
+    if (!env)
+      return;
+    optCopyQueues = atoi(env);
+  }
+
+  static void batchSizeOption(char *env) {
+    if (!env)
+      return;
+    optBatchSize = atoi(env);
+    if (optBatchSize == 0) {
+      std::cerr << "Error: BATCHSIZE must be at least 1 !\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  static void flushThresholdOption(char *env) {
+    if (!env)
+      return;
+    optFlushThreshold = atoi(env);
+  }
+
+  static void numaOption(char *env) {
+    if (!env)
+      return;
+    optNuma = atoi(env);
+  }
+
+  static void streamsOption(char *env) {
+    if (!env)
+      return;
+    optStreams = atoi(env);
+    if (optStreams == 0 || optStreams > DeviceQueue::MAXSTREAMS) {
+      std::cerr << "Error: STREAMS must be between 1 and "
+		<< DeviceQueue::MAXSTREAMS << " !\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  static void dagOption(char *env) {
+    if (!env)
+      return;
+    optDag = atoi(env);
+  }
+
+  static void dagWindowOption(char *env) {
+    if (!env)
+      return;
+    optDagWindow = atoi(env);
+    if (optDagWindow == 0) {
+      std::cerr << "Error: DAGWINDOW must be at least 1 !\n";
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  static void dagSplitSizeOption(char *env) {
+    if (!env)
+      return;
+    optDagSplitSize = atoi(env);
+  }
+
+  static void benchQueueOption(char *env) {
+    if (!env)
+      return;
+    optBenchQueue = atoi(env);
+  }
+
   void parseEnvOptions()
   {
     for (option o : opts) {
@@ -456,6 +720,14 @@ namespace libsplit {
       exit(EXIT_FAILURE);
     }
 
+    if (optDag && (optScheduler == Scheduler::MKGR ||
+		   optScheduler == Scheduler::MKGR2 ||
+		   optScheduler == Scheduler::MKSTATIC)) {
+      std::cerr << "Error: option DAG cannot be used with the MKGR, MKGR2 " \
+	"and MKSTATIC schedulers.\n";
+      exit(EXIT_FAILURE);
+    }
+
     if (optScheduler == Scheduler::SAMPLE && optSampleSteps <= 0) {
       std::cerr << "Error: option SAMPLESTEPS must be set when using SAMPLE " \
 	"scheduler.\n";
@@ -35,6 +35,27 @@ namespace libsplit {
   extern char *optBuildOptionDev[MAXDEVICES];
   extern bool optPinnedMem;
   extern bool optMKGRNoComm;
+  extern bool optCheckIncrementalRegions;
+  extern char *optCacheDir;
+  extern unsigned optCacheSize;
+  extern bool optRooflineStart;
+  extern std::vector<double> optDeviceGflops;
+  extern std::vector<double> optDeviceBandwidth;
+  extern unsigned optSpecialize;
+  extern bool optLocalSizeOverride;
+  extern unsigned optLocalSizeTune;
+  extern bool optInspector;
+  extern unsigned optInspectPeriod;
+  extern bool optEventCallbacks;
+  extern bool optCopyQueues;
+  extern unsigned optBatchSize;
+  extern unsigned optFlushThreshold;
+  extern bool optNuma;
+  extern unsigned optStreams;
+  extern bool optDag;
+  extern unsigned optDagWindow;
+  extern unsigned optDagSplitSize;
+  extern bool optBenchQueue;
 
   void parseEnvOptions();
 
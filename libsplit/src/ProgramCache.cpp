@@ -0,0 +1,440 @@
+#include <Define.h>
+#include <ProgramCache.h>
+#include <Utils/Debug.h>
+
+#include <Record.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+namespace libsplit {
+
+  static uint64_t
+  hashBytes(const char *data, size_t size) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i=0; i<size; i++) {
+      hash ^= static_cast<unsigned char>(data[i]);
+      hash *= 0x100000001b3ULL;
+    }
+    return hash;
+  }
+
+  static bool
+  makeDirectories(const std::string &path) {
+    for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+      std::string sub = path.substr(0, pos);
+      if (mkdir(sub.c_str(), S_IRWXU) == -1 && errno != EEXIST)
+	return false;
+      if (pos == std::string::npos)
+	return true;
+    }
+  }
+
+  static void
+  writeString(std::ostream &s, const std::string &str) {
+    uint64_t size = str.size();
+    s.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    s.write(str.data(), size);
+  }
+
+  static bool
+  readString(std::istream &s, size_t total, std::string *str) {
+    uint64_t size = 0;
+    s.read(reinterpret_cast<char *>(&size), sizeof(size));
+    if (!s || size > total - static_cast<size_t>(s.tellg()))
+      return false;
+
+    str->resize(size);
+    s.read(&(*str)[0], size);
+    return static_cast<bool>(s);
+  }
+
+  ProgramCache::ProgramCache(const char *dir, size_t maxSize)
+    : maxSize(maxSize), enabled(maxSize > 0), nbHits(0), nbMisses(0),
+      nbStores(0), nbEvictions(0), nbBinaryHits(0), nbBinaryMisses(0),
+      nbTmpFiles(0) {
+    pthread_mutex_init(&cacheLock, NULL);
+
+    if (!enabled)
+      return;
+
+    if (dir) {
+      this->dir = dir;
+    } else if (getenv("XDG_CACHE_HOME")) {
+      this->dir = std::string(getenv("XDG_CACHE_HOME")) + "/libsplit";
+    } else if (getenv("HOME")) {
+      this->dir = std::string(getenv("HOME")) + "/.cache/libsplit";
+    } else {
+      enabled = false;
+      return;
+    }
+
+    if (!makeDirectories(this->dir)) {
+      std::cerr << "Warning: cannot create cache directory " << this->dir
+		<< ", program cache disabled.\n";
+      enabled = false;
+    }
+  }
+
+  ProgramCache::~ProgramCache() {
+    pthread_mutex_destroy(&cacheLock);
+  }
+
+  bool
+  ProgramCache::isEnabled() const {
+    return enabled;
+  }
+
+  std::string
+  ProgramCache::getKey(const std::string &source, const char *options) {
+    std::stringstream s;
+    s << "libsplit " << LIBSPLIT_VERSION << "\n"
+      << "llvm " << CLANGVERSION << "\n"
+      << "analysis " << KernelAnalysis::FORMAT_VERSION << "\n"
+      << "options " << (options ? options : "") << "\n"
+      << "source " << source.size() << "\n"
+      << source;
+    return s.str();
+  }
+
+  std::string
+  ProgramCache::getBinaryKey(const std::string &deviceName,
+			     const std::string &driverVersion,
+			     const std::string &source, const char *options) {
+    std::stringstream s;
+    s << "libsplit " << LIBSPLIT_VERSION << "\n"
+      << "device " << deviceName << "\n"
+      << "driver " << driverVersion << "\n"
+      << "options " << (options ? options : "") << "\n"
+      << "source " << source.size() << "\n"
+      << source;
+    return s.str();
+  }
+
+  std::string
+  ProgramCache::getEntryPath(const std::string &key, const char *suffix) const {
+    char name[32];
+    sprintf(name, "%016llx",
+	    (unsigned long long) hashBytes(key.data(), key.size()));
+    return dir + "/" + name + suffix;
+  }
+
+  bool
+  ProgramCache::writeEntryFile(const std::string &path, unsigned magic,
+			       unsigned version, const std::stringstream &s) {
+    std::string payload = s.str();
+    entry_header header;
+    header.magic = magic;
+    header.version = version;
+    header.size = payload.size();
+    header.checksum = hashBytes(payload.data(), payload.size());
+
+    std::stringstream tmpPath;
+    tmpPath << path << ".tmp" << getpid() << "." << nbTmpFiles++;
+    {
+      std::ofstream out(tmpPath.str().c_str(),
+			std::ios::out | std::ios::trunc | std::ios::binary);
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      out.write(payload.data(), payload.size());
+      if (!out) {
+	unlink(tmpPath.str().c_str());
+	return false;
+      }
+    }
+
+    if (rename(tmpPath.str().c_str(), path.c_str()) == -1) {
+      perror("cache rename");
+      unlink(tmpPath.str().c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+  const char *
+  ProgramCache::checkEntry(const char *data, size_t size, unsigned magic,
+			   unsigned version, size_t *payloadSize) {
+    entry_header header;
+    if (size < sizeof(header))
+      return NULL;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != magic || header.version != version ||
+	header.size != size - sizeof(header))
+      return NULL;
+
+    const char *payload = data + sizeof(header);
+    if (hashBytes(payload, header.size) != header.checksum)
+      return NULL;
+
+    *payloadSize = header.size;
+    return payload;
+  }
+
+  bool
+  ProgramCache::lookup(const std::string &key, std::string *transSource,
+		       std::vector<KernelAnalysis *> *analyses) {
+    if (!enabled)
+      return false;
+
+    std::string path = getEntryPath(key);
+
+    pthread_mutex_lock(&cacheLock);
+
+    int fd;
+    struct stat st;
+    if ((fd = open(path.c_str(), O_RDONLY)) == -1) {
+      nbMisses++;
+      DEBUG("cache", std::cerr << "cache miss: " << path << "\n";);
+      pthread_mutex_unlock(&cacheLock);
+      return false;
+    }
+
+    bool valid = false;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      size_t len = st.st_size;
+      char *data = (char *) mmap((caddr_t) 0, len, PROT_READ, MAP_SHARED,
+				 fd, 0);
+      if (data != (char *) (caddr_t) -1) {
+	size_t payloadSize;
+	const char *payload = checkEntry(data, len, ENTRY_MAGIC,
+					 ENTRY_VERSION, &payloadSize);
+	valid = payload && readEntry(payload, payloadSize, key, transSource,
+				     analyses);
+	munmap(data, len);
+      } else {
+	perror("cache mmap");
+      }
+    }
+    close(fd);
+
+    if (!valid) {
+      DEBUG("cache", std::cerr << "cache entry " << path
+	    << " is invalid, removing it\n";);
+      unlink(path.c_str());
+      nbMisses++;
+      pthread_mutex_unlock(&cacheLock);
+      return false;
+    }
+
+    // Most recently used.
+    utime(path.c_str(), NULL);
+
+    nbHits++;
+    DEBUG("cache", std::cerr << "cache hit: " << path << " ("
+	  << analyses->size() << " kernels)\n";);
+    pthread_mutex_unlock(&cacheLock);
+    return true;
+  }
+
+  bool
+  ProgramCache::readEntry(const char *data, size_t size,
+			  const std::string &key, std::string *transSource,
+			  std::vector<KernelAnalysis *> *analyses) {
+    MemoryStreamBuf buf(data, size);
+    std::istream s(&buf);
+
+    // Different keys can have the same hash.
+    std::string entryKey;
+    if (!readString(s, size, &entryKey) || entryKey != key)
+      return false;
+
+    if (!readString(s, size, transSource))
+      return false;
+
+    // Each analysis is a record prefixed with its size.
+    unsigned nbKernels = 0;
+    if (!readCount(s, size, sizeof(uint64_t), &nbKernels))
+      return false;
+
+    std::vector<KernelAnalysis *> entryAnalyses;
+    for (unsigned i=0; i<nbKernels; i++) {
+      std::streampos end = readRecordSize(s);
+      KernelAnalysis *analysis = s.good() ? KernelAnalysis::open(s) : NULL;
+      if (!analysis || !checkRecordEnd(s, end)) {
+	delete analysis;
+	for (KernelAnalysis *a : entryAnalyses)
+	  delete a;
+	return false;
+      }
+      entryAnalyses.push_back(analysis);
+    }
+
+    analyses->insert(analyses->end(), entryAnalyses.begin(),
+		     entryAnalyses.end());
+    return true;
+  }
+
+  void
+  ProgramCache::store(const std::string &key, const std::string &transSource,
+		      const std::vector<KernelAnalysis *> &analyses) {
+    if (!enabled)
+      return;
+
+    std::stringstream s;
+    writeString(s, key);
+    writeString(s, transSource);
+    unsigned nbKernels = analyses.size();
+    s.write(reinterpret_cast<const char *>(&nbKernels), sizeof(nbKernels));
+    for (const KernelAnalysis *analysis : analyses) {
+      std::stringstream record;
+      analysis->write(record);
+      writeRecord(s, record);
+    }
+
+    std::string path = getEntryPath(key);
+    pthread_mutex_lock(&cacheLock);
+    if (writeEntryFile(path, ENTRY_MAGIC, ENTRY_VERSION, s)) {
+      nbStores++;
+      DEBUG("cache", std::cerr << "cache store: " << path << " ("
+	    << analyses.size() << " kernels)\n";);
+
+      cleanup();
+    }
+    pthread_mutex_unlock(&cacheLock);
+  }
+
+  bool
+  ProgramCache::lookupBinary(const std::string &key, std::string *binary) {
+    if (!enabled)
+      return false;
+
+    std::string path = getEntryPath(key, ".bin");
+
+    pthread_mutex_lock(&cacheLock);
+
+    std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+    if (!in) {
+      nbBinaryMisses++;
+      DEBUG("cache", std::cerr << "binary cache miss: " << path << "\n";);
+      pthread_mutex_unlock(&cacheLock);
+      return false;
+    }
+
+    std::stringstream content;
+    content << in.rdbuf();
+    std::string data = content.str();
+
+    size_t payloadSize = 0;
+    const char *payload = checkEntry(data.data(), data.size(), BINARY_MAGIC,
+				     BINARY_VERSION, &payloadSize);
+    MemoryStreamBuf buf(payload, payloadSize);
+    std::istream s(&buf);
+    std::string entryKey;
+    if (!payload || !readString(s, payloadSize, &entryKey) ||
+	entryKey != key || !readString(s, payloadSize, binary)) {
+      DEBUG("cache", std::cerr << "binary cache entry " << path
+	    << " is invalid, removing it\n";);
+      unlink(path.c_str());
+      nbBinaryMisses++;
+      pthread_mutex_unlock(&cacheLock);
+      return false;
+    }
+
+    // Most recently used.
+    utime(path.c_str(), NULL);
+
+    nbBinaryHits++;
+    DEBUG("cache", std::cerr << "binary cache hit: " << path << " ("
+	  << binary->size() << " bytes)\n";);
+    pthread_mutex_unlock(&cacheLock);
+    return true;
+  }
+
+  void
+  ProgramCache::storeBinary(const std::string &key, const std::string &binary) {
+    if (!enabled)
+      return;
+
+    std::stringstream s;
+    writeString(s, key);
+    writeString(s, binary);
+
+    std::string path = getEntryPath(key, ".bin");
+    pthread_mutex_lock(&cacheLock);
+    if (writeEntryFile(path, BINARY_MAGIC, BINARY_VERSION, s)) {
+      nbStores++;
+      DEBUG("cache", std::cerr << "binary cache store: " << path << " ("
+	    << binary.size() << " bytes)\n";);
+
+      cleanup();
+    }
+    pthread_mutex_unlock(&cacheLock);
+  }
+
+  void
+  ProgramCache::cleanup() {
+    struct entry_info {
+      std::string path;
+      size_t size;
+      time_t mtime;
+    };
+
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+      return;
+
+    std::vector<entry_info> entries;
+    size_t total = 0;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+      size_t len = strlen(de->d_name);
+      if ((len < 6 || strcmp(de->d_name + len - 6, ".entry")) &&
+	  (len < 4 || strcmp(de->d_name + len - 4, ".bin")))
+	continue;
+
+      std::string path = dir + "/" + de->d_name;
+      struct stat st;
+      if (stat(path.c_str(), &st) == -1)
+	continue;
+
+      entries.push_back({path, (size_t) st.st_size, st.st_mtime});
+      total += st.st_size;
+    }
+    closedir(d);
+
+    if (total <= maxSize)
+      return;
+
+    std::sort(entries.begin(), entries.end(),
+	      [](const entry_info &a, const entry_info &b) {
+		return a.mtime < b.mtime;
+	      });
+
+    for (const entry_info &e : entries) {
+      if (total <= maxSize)
+	break;
+      if (unlink(e.path.c_str()) == 0) {
+	total -= e.size;
+	nbEvictions++;
+	DEBUG("cache", std::cerr << "cache evict: " << e.path << "\n";);
+      }
+    }
+  }
+
+  void
+  ProgramCache::printStats() const {
+    pthread_mutex_lock(&cacheLock);
+    std::cerr << "program cache: " << nbHits << " hits, " << nbMisses
+	      << " misses, " << nbBinaryHits << " binary hits, "
+	      << nbBinaryMisses << " binary misses, " << nbStores
+	      << " stores, " << nbEvictions << " evictions\n";
+    pthread_mutex_unlock(&cacheLock);
+  }
+
+};
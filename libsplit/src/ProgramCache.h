@@ -0,0 +1,115 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <KernelAnalysis.h>
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+namespace libsplit {
+
+  // Persistent cache of the programs built from source. An entry holds the
+  // source transformed by ClTransform and the analyses of the kernels, in
+  // program order, so that a program already built in a previous run needs
+  // no subprocess. Binary entries hold the CL_PROGRAM_BINARIES of the
+  // transformed program for a device, so that it is not compiled again by
+  // the vendor compiler.
+  //
+  // Entries are files named after a hash of their key, made of the program
+  // source, the build options and the versions of libsplit, LLVM and the
+  // analysis format. The full key is stored in the entry and checked when it
+  // is loaded, after the header of the entry: its magic number, format
+  // version, size and checksum. An entry that cannot be loaded is a miss and
+  // is removed. When the cache grows beyond its maximum size, the least
+  // recently used entries (oldest modification time, updated on each hit)
+  // are removed.
+  //
+  // Programs may be built from several host threads: lookups, stores and
+  // the statistics are serialized by cacheLock.
+  class ProgramCache {
+  public:
+    // A maxSize of 0 disables the cache.
+    ProgramCache(const char *dir, size_t maxSize);
+    ~ProgramCache();
+
+    bool isEnabled() const;
+
+    static std::string getKey(const std::string &source, const char *options);
+
+    // Return false if there is no valid entry for key. On a hit, the
+    // analyses are appended to analyses and owned by the caller.
+    bool lookup(const std::string &key, std::string *transSource,
+		std::vector<KernelAnalysis *> *analyses);
+
+    void store(const std::string &key, const std::string &transSource,
+	       const std::vector<KernelAnalysis *> &analyses);
+
+    static std::string getBinaryKey(const std::string &deviceName,
+				    const std::string &driverVersion,
+				    const std::string &source,
+				    const char *options);
+
+    bool lookupBinary(const std::string &key, std::string *binary);
+    void storeBinary(const std::string &key, const std::string &binary);
+
+    void printStats() const;
+
+  private:
+    static const unsigned ENTRY_MAGIC = 0x4c535043; // "LSPC"
+    // Bumped when the analysis or the transformed source differ for the same
+    // source, so that older entries are discarded.
+    static const unsigned ENTRY_VERSION = 4;
+    static const unsigned BINARY_MAGIC = 0x4c535042; // "LSPB"
+    static const unsigned BINARY_VERSION = 2;
+
+    // Header of an entry file, followed by size bytes of payload whose
+    // FNV-1a hash is checksum.
+    struct entry_header {
+      unsigned magic;
+      unsigned version;
+      uint64_t size;
+      uint64_t checksum;
+    };
+
+    std::string getEntryPath(const std::string &key,
+			     const char *suffix = ".entry") const;
+    // Write the header and the payload s to path through a temporary file,
+    // unique to the process and the write, so that a concurrent run or thread
+    // never reads a partial entry. Called with cacheLock held.
+    bool writeEntryFile(const std::string &path, unsigned magic,
+			unsigned version, const std::stringstream &s);
+    // Return the payload of the entry data of size bytes, NULL if its header
+    // does not match magic and version or its checksum is wrong.
+    static const char *checkEntry(const char *data, size_t size,
+				  unsigned magic, unsigned version,
+				  size_t *payloadSize);
+    bool readEntry(const char *data, size_t size, const std::string &key,
+		   std::string *transSource,
+		   std::vector<KernelAnalysis *> *analyses);
+
+    // Remove the least recently used entries until the size of the cache is
+    // below maxSize. Called with cacheLock held.
+    void cleanup();
+
+    std::string dir;
+    size_t maxSize;
+    bool enabled;
+
+    unsigned nbHits;
+    unsigned nbMisses;
+    unsigned nbStores;
+    unsigned nbEvictions;
+    unsigned nbBinaryHits;
+    unsigned nbBinaryMisses;
+
+    unsigned nbTmpFiles;
+    mutable pthread_mutex_t cacheLock;
+  };
+
+};
+
+#endif /* PROGRAMCACHE_H */
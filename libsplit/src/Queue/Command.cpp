@@ -2,6 +2,7 @@
 #include <Queue/DeviceQueue.h>
 #include <Utils/Utils.h>
 
+#include <cassert>
 #include <cstring>
 
 namespace libsplit {
@@ -9,15 +10,41 @@ namespace libsplit {
   unsigned
   Command::count = 0;
 
-  Command::Command(Event *event)
-    : event(event) {
+  Command::Command(Event *event, DeviceQueue::QUEUE_TYPE queueType)
+    : event(event), queueType(queueType), queueNo(0),
+      enqueueTime(get_time()), nbDeps(0) {
+    if (event)
+      event->retain();
 
     do {
       id = count;
     } while (!__sync_bool_compare_and_swap(&count, id, id + 1));
   }
 
-  Command::~Command() {}
+  Command::~Command() {
+    if (event)
+      event->release();
+    for (cl_uint i=0; i<nbDeps; i++)
+      deps[i]->release();
+  }
+
+  void
+  Command::addDependency(Event *event, DeviceQueue::QUEUE_TYPE type) {
+    assert(nbDeps < DeviceQueue::NBQUEUETYPES - 1);
+    event->retain();
+    deps[nbDeps] = event;
+    depQueues[nbDeps] = type;
+    nbDeps++;
+  }
+
+  cl_uint
+  Command::getWaitList(DeviceQueue *queue, cl_event *waitList) const {
+    for (cl_uint i=0; i<nbDeps; i++) {
+      queue->flushCLQueue(depQueues[i]);
+      waitList[i] = deps[i]->event;
+    }
+    return nbDeps;
+  }
 
 
   CommandWrite::CommandWrite(cl_mem buffer,
@@ -25,7 +52,7 @@ namespace libsplit {
 			     size_t cb,
 			     const void *ptr,
 			     Event *event) :
-    Command(event),
+    Command(event, DeviceQueue::H2D),
     buffer(buffer), offset(offset), cb(cb), ptr(ptr) {}
 
   CommandWrite::~CommandWrite() {}
@@ -33,15 +60,17 @@ namespace libsplit {
   void
   CommandWrite::execute(DeviceQueue *queue) {
     cl_int err;
+    cl_event waitList[DeviceQueue::NBQUEUETYPES];
+    cl_uint nbWait = getWaitList(queue, waitList);
 
-    err = real_clEnqueueWriteBuffer(queue->cl_queue,
+    err = real_clEnqueueWriteBuffer(queue->getCLQueue(queueType),
 				    buffer,
 				    CL_FALSE /* non blocking */,
 				    offset,
 				    cb,
 				    ptr,
-				    0,
-				    NULL,
+				    nbWait,
+				    nbWait ? waitList : NULL,
 				    &event->event);
 
     clCheck(err, __FILE__, __LINE__);
@@ -54,7 +83,7 @@ namespace libsplit {
 			   size_t cb,
 			   const void *ptr,
 			   Event *event) :
-    Command(event),
+    Command(event, DeviceQueue::D2H),
     buffer(buffer),  offset(offset), cb(cb), ptr(ptr) {}
 
   CommandRead::~CommandRead() {}
@@ -62,15 +91,17 @@ namespace libsplit {
   void
   CommandRead::execute(DeviceQueue *queue) {
     cl_int err;
+    cl_event waitList[DeviceQueue::NBQUEUETYPES];
+    cl_uint nbWait = getWaitList(queue, waitList);
 
-    err = real_clEnqueueReadBuffer(queue->cl_queue,
+    err = real_clEnqueueReadBuffer(queue->getCLQueue(queueType),
 				   buffer,
 				   CL_FALSE /* non blocking */,
 				   offset,
 				   cb,
 				   (void *) ptr,
-				   0,
-				   NULL,
+				   nbWait,
+				   nbWait ? waitList : NULL,
 				   &event->event);
     clCheck(err, __FILE__, __LINE__);
 
@@ -82,53 +113,80 @@ namespace libsplit {
 			   const size_t *global_work_offset,
 			   const size_t *global_work_size,
 			   const size_t *local_work_size,
-			   KernelArgs &args,
+			   DeviceQueue::QUEUE_TYPE queueType,
 			   Event *event) :
-    Command(event),
-    kernel(kernel), work_dim(work_dim), global_work_offset(NULL),
-    global_work_size(NULL), local_work_size(NULL), args(args) {
-    this->global_work_size = new size_t[work_dim];
-    this->local_work_size = new size_t[work_dim];
+    Command(event, queueType),
+    kernel(kernel), work_dim(work_dim),
+    hasOffset(global_work_offset != NULL), nbArgs(0), argDataSize(0),
+    extraArgs(NULL) {
     memcpy(this->global_work_size, global_work_size,
 	   work_dim * sizeof(size_t));
     memcpy(this->local_work_size, local_work_size,
 	   work_dim * sizeof(size_t));
 
     if (global_work_offset) {
-      this->global_work_offset = new size_t[work_dim];
       memcpy(this->global_work_offset, global_work_offset,
 	     work_dim * sizeof(size_t));
     }
   }
 
   CommandExec::~CommandExec() {
-    delete[] global_work_offset;
-    delete[] global_work_size;
-    delete[] local_work_size;
+    delete extraArgs;
+  }
+
+  void
+  CommandExec::addArg(cl_uint index, const KernelArg &arg) {
+    size_t dataSize = arg.local ? 0 : arg.size;
+    if (nbArgs == MAXINLINEARGS || argDataSize + dataSize > INLINEARGDATA) {
+      if (!extraArgs)
+	extraArgs = new KernelArgs();
+      extraArgs->insert(std::make_pair(index, arg));
+      return;
+    }
+
+    arg_desc &a = args[nbArgs++];
+    a.index = index;
+    a.local = arg.local;
+    a.size = arg.size;
+    a.offset = argDataSize;
+    memcpy(argData + argDataSize, arg.value, dataSize);
+    argDataSize += dataSize;
   }
 
   void
   CommandExec::execute(DeviceQueue *queue) {
     cl_int err;
 
-    for (KernelArgs::iterator it=args.begin();
-	 it != args.end(); ++it) {
-      KernelArg value = it->second;
+    for (unsigned i=0; i<nbArgs; i++) {
       err = real_clSetKernelArg(kernel,
-				it->first,
-				value.size,
-				value.local ? NULL : value.value);
+				args[i].index,
+				args[i].size,
+				args[i].local ? NULL : argData + args[i].offset);
       clCheck(err, __FILE__, __LINE__);
     }
 
-    err = real_clEnqueueNDRangeKernel(queue->cl_queue,
+    if (extraArgs) {
+      for (KernelArgs::iterator it=extraArgs->begin();
+	   it != extraArgs->end(); ++it) {
+	KernelArg &value = it->second;
+	err = real_clSetKernelArg(kernel,
+				  it->first,
+				  value.size,
+				  value.local ? NULL : value.value);
+	clCheck(err, __FILE__, __LINE__);
+      }
+    }
+
+    cl_event waitList[DeviceQueue::NBQUEUETYPES];
+    cl_uint nbWait = getWaitList(queue, waitList);
+    err = real_clEnqueueNDRangeKernel(queue->getCLQueue(queueType),
 				      kernel,
 				      work_dim,
-				      global_work_offset,
+				      hasOffset ? global_work_offset : NULL,
 				      global_work_size,
 				      local_work_size,
-				      0,
-				      NULL,
+				      nbWait,
+				      nbWait ? waitList : NULL,
 				      &event->event);
 
     clCheck(err, __FILE__, __LINE__);
@@ -152,17 +210,19 @@ namespace libsplit {
   CommandFill::execute(DeviceQueue *queue) {
     cl_int err;
 
-    err = real_clFinish(queue->cl_queue);
+    err = real_clFinish(queue->getCLQueue(queueType));
     clCheck(err, __FILE__, __LINE__);
 
-    err = real_clEnqueueFillBuffer(queue->cl_queue,
+    cl_event waitList[DeviceQueue::NBQUEUETYPES];
+    cl_uint nbWait = getWaitList(queue, waitList);
+    err = real_clEnqueueFillBuffer(queue->getCLQueue(queueType),
 				   buffer,
 				   pattern,
 				   pattern_size,
 				   offset,
 				   size,
-				   0,
-				   NULL,
+				   nbWait,
+				   nbWait ? waitList : NULL,
 				   &event->event);
     clCheck(err, __FILE__, __LINE__);
 
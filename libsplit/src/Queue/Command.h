@@ -11,12 +11,29 @@ namespace libsplit {
 
   class Command {
   public:
-    Command(Event *event);
+    Command(Event *event,
+	    DeviceQueue::QUEUE_TYPE queueType = DeviceQueue::COMPUTE);
     virtual ~Command();
     virtual void execute(DeviceQueue *queue) = 0;
     unsigned id;
 
     Event *event;
+    DeviceQueue::QUEUE_TYPE queueType;
+    unsigned long queueNo; // Number in its command queue
+    double enqueueTime;
+
+    // Wait for the command of event, from the command queue type.
+    void addDependency(Event *event, DeviceQueue::QUEUE_TYPE type);
+
+  protected:
+    // Fill waitList with the events of the dependencies, enqueued before by
+    // the thread of the queue, and return their number. Their command queues
+    // are flushed so that the events can be waited from another queue.
+    cl_uint getWaitList(DeviceQueue *queue, cl_event *waitList) const;
+
+    cl_uint nbDeps;
+    Event *deps[DeviceQueue::NBQUEUETYPES - 1];
+    DeviceQueue::QUEUE_TYPE depQueues[DeviceQueue::NBQUEUETYPES - 1];
 
   private:
     static unsigned count;
@@ -58,6 +75,8 @@ namespace libsplit {
     const void *ptr;
   };
 
+  // Launch of a kernel. Only the arguments changed since the last launch of
+  // the kernel on the queue are set, they are added with addArg().
   class CommandExec : public Command {
   public:
     CommandExec(cl_kernel kernel,
@@ -65,21 +84,39 @@ namespace libsplit {
 		const size_t *global_work_offset,
 		const size_t *global_work_size,
 		const size_t *local_work_size,
-		KernelArgs &args,
+		DeviceQueue::QUEUE_TYPE queueType,
 		Event *event);
 
     virtual ~CommandExec();
 
     virtual void execute(DeviceQueue *queue);
 
-    void setArg(cl_uint index, KernelArg *value);
+    void addArg(cl_uint index, const KernelArg &arg);
 
     cl_kernel kernel;
     cl_uint work_dim;
-    size_t *global_work_offset;
-    size_t *global_work_size;
-    size_t *local_work_size;
-    KernelArgs args;
+    bool hasOffset;
+    size_t global_work_offset[3];
+    size_t global_work_size[3];
+    size_t local_work_size[3];
+
+  private:
+    // Arguments stored in the command, values packed in argData, so that
+    // commands fit in the slots of the command pool.
+    static const unsigned MAXINLINEARGS = 16;
+    static const size_t INLINEARGDATA = 512;
+    struct arg_desc {
+      cl_uint index;
+      bool local;
+      size_t size;
+      size_t offset;
+    };
+    unsigned nbArgs;
+    size_t argDataSize;
+    arg_desc args[MAXINLINEARGS];
+    char argData[INLINEARGDATA];
+    // Arguments that do not fit, NULL if none.
+    KernelArgs *extraArgs;
   };
 
   class CommandFill : public Command {
@@ -0,0 +1,39 @@
+#include <Queue/CommandPool.h>
+
+namespace libsplit {
+
+  CommandPool::CommandPool(unsigned nbSlots, size_t slotSize)
+    : nbSlots(nbSlots), slotSize(slotSize), nbAllocated(0), nbReleased(0) {
+    // Slots aligned as any command.
+    slotSize = (slotSize + alignof(std::max_align_t) - 1) /
+      alignof(std::max_align_t) * alignof(std::max_align_t);
+    this->slotSize = slotSize;
+    slots = new char[nbSlots * slotSize];
+  }
+
+  CommandPool::~CommandPool() {
+    delete[] slots;
+  }
+
+  void *
+  CommandPool::allocate() {
+    if (nbAllocated - nbReleased.load(std::memory_order_acquire) == nbSlots)
+      return NULL;
+
+    void *slot = slots + (nbAllocated % nbSlots) * slotSize;
+    nbAllocated++;
+    return slot;
+  }
+
+  void
+  CommandPool::release() {
+    nbReleased.fetch_add(1, std::memory_order_release);
+  }
+
+  bool
+  CommandPool::owns(const void *ptr) const {
+    const char *p = (const char *) ptr;
+    return p >= slots && p < slots + nbSlots * slotSize;
+  }
+
+};
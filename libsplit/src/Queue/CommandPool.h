@@ -0,0 +1,36 @@
+#ifndef COMMANDPOOL_H
+#define COMMANDPOOL_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace libsplit {
+
+  // Ring of fixed-size command slots of a device queue. Slots are allocated
+  // by the thread enqueuing the commands and released by the queue thread
+  // once they are executed. Commands are executed in order, so slots are
+  // released in the order they were allocated and the ring only needs the
+  // count of allocated and released slots.
+  class CommandPool {
+  public:
+    CommandPool(unsigned nbSlots, size_t slotSize);
+    ~CommandPool();
+
+    // Return a free slot, NULL if all of them are in use.
+    void *allocate();
+    // Release the oldest slot allocated.
+    void release();
+    bool owns(const void *ptr) const;
+
+  private:
+    unsigned nbSlots;
+    size_t slotSize;
+    char *slots;
+
+    unsigned long nbAllocated; // Only used by the producer
+    std::atomic<unsigned long> nbReleased;
+  };
+
+};
+
+#endif /* COMMANDPOOL_H */
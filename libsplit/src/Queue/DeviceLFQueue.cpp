@@ -1,20 +1,31 @@
 #include <Queue/Command.h>
 #include <Queue/DeviceLFQueue.h>
+#include <Options.h>
 #include <Utils/Utils.h>
 
+#include <cstdint>
 #include <cstdio>
 #include <errno.h>
+#include <sched.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
 namespace libsplit {
 
   DeviceLFQueue::DeviceLFQueue(cl_context context, cl_device_id dev,
-			       unsigned dev_id)
-    : DeviceQueue(context, dev, dev_id), running(true) {
+			       unsigned dev_id, WAIT_POLICY waitPolicy)
+    : DeviceQueue(context, dev, dev_id), waitPolicy(waitPolicy),
+      sleeping(false), running(true) {
     int ret;
 
     threadQueue = new LockFreeQueue(4096);
 
+    wakeupFd = eventfd(0, 0);
+    if (wakeupFd < 0) {
+      perror("eventfd");
+      exit(EXIT_FAILURE);
+    }
+
     ret = pthread_create(&thread, NULL, &DeviceLFQueue::threadFunc, this);
     if (ret != 0) {
       std::cerr << "error: Failed to create DeviceQueue thread ("<<ret<<")\n";
@@ -26,18 +37,58 @@ namespace libsplit {
 
   DeviceLFQueue::~DeviceLFQueue() {
     running = false;
+    wakeup(true);
     finish();
     pthread_join(thread, NULL);
 
+    close(wakeupFd);
     delete threadQueue;
   }
 
 
   void
   DeviceLFQueue::enqueue(Command *command) {
-    lastEvent = command->event;
+    setLastEvent(command);
 
     while (!threadQueue->Enqueue(command));
+
+    wakeup(false);
+  }
+
+  void
+  DeviceLFQueue::wakeup(bool force) {
+    // Pairs with the fence of waitForCommands(): either the thread sees the
+    // command, or sleeping is seen set here.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!sleeping.exchange(false) && !force)
+      return;
+
+    uint64_t one = 1;
+    while (write(wakeupFd, &one, sizeof(one)) < 0 && errno == EINTR);
+  }
+
+  void
+  DeviceLFQueue::waitForCommands() {
+    sleeping = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // A wakeup written while the queue was checked is consumed by the next
+    // wait, which then returns at once.
+    if (threadQueue->Size() == 0 && running) {
+      uint64_t count;
+      while (read(wakeupFd, &count, sizeof(count)) < 0 && errno == EINTR);
+    }
+
+    sleeping = false;
+  }
+
+  unsigned
+  DeviceLFQueue::dequeueBatch(Command **batch, unsigned long *depth) {
+    unsigned nb = 0;
+    while (nb < optBatchSize && threadQueue->Dequeue(&batch[nb]))
+      nb++;
+    *depth = nb + threadQueue->Size();
+    return nb;
   }
 
   void
@@ -45,37 +96,36 @@ namespace libsplit {
     // Bind thread
     bindThread();
 
-    // Create the command queue.
-    cl_int err;
-    cl_queue = real_clCreateCommandQueue(context, device,
-					 CL_QUEUE_PROFILING_ENABLE,
-					 &err);
-    clCheck(err, __FILE__, __LINE__);
+    // Create the command queues.
+    createCLQueues();
 
     // Main loop
+    std::vector<Command *> batch(optBatchSize);
+    unsigned long depth;
+    unsigned emptyPolls = 0;
     while (running) {
-      Command *cmd = NULL;
-
-      // Dequeue one command
-      if (threadQueue->Size() > 0) {
-	while (!threadQueue->Dequeue(&cmd));
-      } else {
-	usleep(1000);
+      // Dequeue the available commands
+      unsigned nb = dequeueBatch(batch.data(), &depth);
+      if (nb == 0) {
+	if (waitPolicy == WAIT_SLEEP) {
+	  usleep(1000);
+	} else if (++emptyPolls >= YIELD_POLLS) {
+	  waitForCommands();
+	  emptyPolls = 0;
+	} else if (emptyPolls >= SPIN_POLLS) {
+	  sched_yield();
+	}
 	continue;
       }
+      emptyPolls = 0;
 
-      // Execute it
-      cmd->execute(this);
-      delete cmd;
+      // Submit them
+      executeBatch(batch.data(), nb, depth);
     }
 
     // Dequeue remaining commands before leaving.
-    while (threadQueue->Size() > 0) {
-      Command *cmd;
-      while (!threadQueue->Dequeue(&cmd));
-      cmd->execute(this);
-      delete cmd;
-    }
+    while (unsigned nb = dequeueBatch(batch.data(), &depth))
+      executeBatch(batch.data(), nb, depth);
   }
 
 };
@@ -8,6 +8,8 @@
 
 #include <CL/cl.h>
 
+#include <atomic>
+
 #include <pthread.h>
 
 class Command;
@@ -16,7 +18,17 @@ namespace libsplit {
 
   class DeviceLFQueue : public DeviceQueue {
   public:
-    DeviceLFQueue(cl_context context, cl_device_id dev, unsigned dev_id);
+    // How the thread waits for commands when the queue is empty.
+    enum WAIT_POLICY {
+      // Spin, then yield, then block on an eventfd until the producer
+      // wakes it up.
+      WAIT_ADAPTIVE,
+      // Sleep 1 ms between polls (former behaviour, kept for comparison).
+      WAIT_SLEEP
+    };
+
+    DeviceLFQueue(cl_context context, cl_device_id dev, unsigned dev_id,
+		  WAIT_POLICY waitPolicy = WAIT_ADAPTIVE);
     virtual ~DeviceLFQueue();
 
     virtual void run();
@@ -24,10 +36,30 @@ namespace libsplit {
   private:
     virtual void enqueue(Command *command);
 
+    // Dequeue the available commands, up to BATCHSIZE, and return their
+    // number.
+    unsigned dequeueBatch(Command **batch, unsigned long *depth);
+
+    // Block until the producer signals a new command, unless the queue is
+    // not empty anymore.
+    void waitForCommands();
+    void wakeup(bool force);
+
+    // Empty polls before yielding, and before blocking.
+    static const unsigned SPIN_POLLS = 2000;
+    static const unsigned YIELD_POLLS = 2100;
+
     LockFreeQueue *threadQueue;
+    WAIT_POLICY waitPolicy;
+
+    // The thread sets sleeping before checking the queue a last time and
+    // blocking on wakeupFd, the producer writes to wakeupFd only if it is
+    // set after publishing a command.
+    std::atomic<bool> sleeping;
+    int wakeupFd;
 
     pthread_t thread;
-    bool running;
+    std::atomic<bool> running;
   };
 
 };
@@ -1,5 +1,6 @@
 #include <Queue/DevicePthreadQueue.h>
 #include <Queue/Command.h>
+#include <Options.h>
 #include <Utils/Utils.h>
 
 /* locking macros */
@@ -43,7 +44,7 @@ namespace libsplit {
 
   void
   DevicePthreadQueue::enqueue(Command *command) {
-    lastEvent = command->event;
+    setLastEvent(command);
 
     PTHREAD_LOCK(&queueLock, NULL);
     threadQueue.push_back(command);
@@ -51,33 +52,38 @@ namespace libsplit {
     PTHREAD_UNLOCK(&queueLock);
   }
 
+  unsigned
+  DevicePthreadQueue::dequeueBatch(Command **batch, unsigned long *depth) {
+    unsigned nb = 0;
+
+    PTHREAD_LOCK(&queueLock, NULL);
+    *depth = threadQueue.size();
+    while (nb < optBatchSize && !threadQueue.empty()) {
+      batch[nb++] = threadQueue.front();
+      threadQueue.pop_front();
+    }
+    PTHREAD_UNLOCK(&queueLock);
+
+    return nb;
+  }
+
   void
   DevicePthreadQueue::run() {
     // Bind thread
     bindThread();
 
-    // Create the command queue.
-    cl_int err;
-    cl_queue = real_clCreateCommandQueue(context, device,
-					 CL_QUEUE_PROFILING_ENABLE,
-					 &err);
-    clCheck(err, __FILE__, __LINE__);
+    // Create the command queues.
+    createCLQueues();
 
     // Main loop
+    std::vector<Command *> batch(optBatchSize);
+    unsigned long depth;
     while (running) {
-      Command *cmd = NULL;
-
-      // Dequeue one command
-      PTHREAD_LOCK(&queueLock, NULL);
-      if (!threadQueue.empty()) {
-	cmd = threadQueue.front();
-	threadQueue.pop_front();
-      }
-      PTHREAD_UNLOCK(&queueLock);
+      // Dequeue the available commands
+      unsigned nb = dequeueBatch(batch.data(), &depth);
 
-      if (cmd) {
-	cmd->execute(this);
-	delete cmd;
+      if (nb) {
+	executeBatch(batch.data(), nb, depth);
       } else {
 	static struct timespec time_to_wait = {0, 0};
 	time_to_wait.tv_sec = time(NULL) + 5;
@@ -90,12 +96,8 @@ namespace libsplit {
     }
 
     // Dequeue remaining commands before leaving.
-    while (!threadQueue.empty()) {
-      Command *cmd = threadQueue.front();
-      cmd->execute(this);
-      delete cmd;
-      threadQueue.pop_front();
-    }
+    while (unsigned nb = dequeueBatch(batch.data(), &depth))
+      executeBatch(batch.data(), nb, depth);
   }
 
 };
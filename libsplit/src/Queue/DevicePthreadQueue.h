@@ -26,6 +26,10 @@ namespace libsplit {
   private:
     virtual void enqueue(Command *command);
 
+    // Dequeue the available commands, up to BATCHSIZE, and return their
+    // number.
+    unsigned dequeueBatch(Command **batch, unsigned long *depth);
+
     std::list<Command *> threadQueue;
 
     pthread_t thread;
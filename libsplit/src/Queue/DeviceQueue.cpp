@@ -1,8 +1,12 @@
 #include <Queue/Command.h>
 #include <Queue/DeviceQueue.h>
 #include <Globals.h>
+#include <Options.h>
+#include <Utils/Debug.h>
 
+#include <algorithm>
 #include <cstring>
+#include <iostream>
 
 #ifdef USE_HWLOC
 
@@ -21,9 +25,30 @@ namespace libsplit {
 #endif /* USE_HWLOC */
 
 
+  // Slots of the command pool of each queue, as many as the commands the
+  // lock free queue can hold.
+  static const unsigned NBCOMMANDSLOTS = 4096;
+
+  static size_t
+  getCommandSlotSize() {
+    return std::max(std::max(sizeof(CommandWrite), sizeof(CommandRead)),
+		    std::max(sizeof(CommandExec), sizeof(CommandFill)));
+  }
+
   DeviceQueue::DeviceQueue(cl_context context, cl_device_id dev, unsigned dev_id)
-    : cl_queue(NULL), dev_id(dev_id), context(context), device(dev),
-      lastEvent(NULL), isCudaDevice(false), isAMDDevice(false) {
+    : dev_id(dev_id), context(context), device(dev),
+      isCudaDevice(false), isAMDDevice(false), numaNode(-1),
+      commandPool(NBCOMMANDSLOTS, getCommandSlotSize()), nbHeapCommands(0),
+      nbArgsSet(0), nbArgsSkipped(0), nbDependencies(0), nbFlushes(0) {
+    for (unsigned q=0; q<NBQUEUETYPES; q++) {
+      cl_queues[q] = NULL;
+      lastEvents[q] = NULL;
+      nbCommands[q] = 0;
+      nbUnflushed[q] = 0;
+    }
+
+    pthread_mutex_init(&enqueueLock, NULL);
+
     size_t vendor_len;
     cl_int err;
     char *vendor;
@@ -39,6 +64,11 @@ namespace libsplit {
       isAMDDevice = true;
     free(vendor);
 
+    if (numaPlacement) {
+      numaNode = numaPlacement->getDeviceNode(dev, isCudaDevice ? dev_id : -1);
+      timeline->pushWorkerPlacement(dev_id, numaNode);
+    }
+
 #ifdef USE_HWLOC
     // HWLOC initialization
     hwloc_topology_init(&topology);
@@ -48,8 +78,33 @@ namespace libsplit {
   }
 
   DeviceQueue::~DeviceQueue() {
-    cl_int err = real_clReleaseCommandQueue(cl_queue);
-    clCheck(err, __FILE__, __LINE__);
+    for (unsigned q=0; q<NBQUEUETYPES; q++) {
+      if (lastEvents[q])
+	lastEvents[q]->release();
+    }
+    while (!bufferAccesses.empty())
+      releaseBuffer(bufferAccesses.begin()->first);
+
+    DEBUG("commands",
+	  std::cerr << "queue " << dev_id << ": " << nbHeapCommands
+	  << " commands allocated on the heap, " << nbArgsSet
+	  << " kernel arguments set, " << nbArgsSkipped << " unchanged, "
+	  << nbDependencies << " dependencies between command queues\n";);
+
+    DEBUG("batches",
+	  std::cerr << "queue " << dev_id << ": " << nbFlushes << " flushes\n";
+	  queueDepths.print(std::cerr, "queue depth", "commands");
+	  batchSizes.print(std::cerr, "batch size", "commands");
+	  submitLatencies.print(std::cerr, "submit latency", "us"););
+
+    for (unsigned q=0; q<NBQUEUETYPES; q++) {
+      if (!cl_queues[q])
+	continue;
+      cl_int err = real_clReleaseCommandQueue(cl_queues[q]);
+      clCheck(err, __FILE__, __LINE__);
+    }
+
+    pthread_mutex_destroy(&enqueueLock);
 
 #ifdef USE_HWLOC
     hwloc_topology_destroy(topology);
@@ -59,11 +114,13 @@ namespace libsplit {
   void
   DeviceQueue::enqueueDummyEvents() {
     Event *dummyEvent = eventFactory->getNewEvent();
-    cl_int err = real_clEnqueueMarker(cl_queue, &dummyEvent->event);
+    cl_int err = real_clEnqueueMarker(getCLQueue(COMPUTE), &dummyEvent->event);
     clCheck(err, __FILE__, __LINE__);
-    err = real_clFinish(cl_queue);
+    err = real_clFinish(getCLQueue(COMPUTE));
     clCheck(err, __FILE__, __LINE__);
+    dummyEvent->setSubmitted();
     timeline->pushH2DEvent(dummyEvent, dev_id);
+    dummyEvent->release();
   }
 
   void
@@ -72,8 +129,11 @@ namespace libsplit {
 			    size_t cb,
 			    const void *ptr,
 			    Event *event) {
-    Command *c = new CommandWrite(buffer, offset, cb, ptr, event);
+    pthread_mutex_lock(&enqueueLock);
+    Command *c = newCommand<CommandWrite>(buffer, offset, cb, ptr, event);
+    orderCommand(c, buffer, true);
     enqueue(c);
+    pthread_mutex_unlock(&enqueueLock);
   }
 
   void
@@ -82,22 +142,56 @@ namespace libsplit {
 			   size_t cb,
 			   const void *ptr,
 			   Event *event) {
-    Command *c = new CommandRead(buffer, offset, cb, ptr, event);
+    pthread_mutex_lock(&enqueueLock);
+    Command *c = newCommand<CommandRead>(buffer, offset, cb, ptr, event);
+    orderCommand(c, buffer, false);
     enqueue(c);
+    pthread_mutex_unlock(&enqueueLock);
   }
 
-  void
+  DeviceQueue::command_ref
   DeviceQueue::enqueueExec(cl_kernel kernel,
 			   cl_uint work_dim,
 			   const size_t *global_work_offset,
 			   const size_t *global_work_size,
 			   const size_t *local_work_size,
-			   KernelArgs args,
+			   const KernelArgs &args,
+			   const std::vector<buffer_access> *accesses,
+			   QUEUE_TYPE type,
+			   const std::vector<command_ref> *waits,
 			   Event *event) {
-    Command *c = new CommandExec(kernel, work_dim, global_work_offset,
-				 global_work_size, local_work_size, args,
-				 event);
+    pthread_mutex_lock(&enqueueLock);
+    CommandExec *c = newCommand<CommandExec>(kernel, work_dim,
+					     global_work_offset,
+					     global_work_size, local_work_size,
+					     type, event);
+
+    KernelArgs &lastArgs = lastKernelArgs[kernel];
+    for (KernelArgs::const_iterator it=args.begin(); it != args.end(); ++it) {
+      const KernelArg &a = it->second;
+      KernelArgs::iterator last = lastArgs.find(it->first);
+      if (last != lastArgs.end() && last->second.size == a.size &&
+	  last->second.local == a.local &&
+	  (a.local || !memcmp(last->second.value, a.value, a.size))) {
+	nbArgsSkipped++;
+	continue;
+      }
+
+      c->addArg(it->first, a);
+      if (last == lastArgs.end())
+	lastArgs.insert(std::make_pair(it->first, a));
+      else
+	last->second = a;
+      nbArgsSet++;
+    }
+
+    orderCommand(c, accesses, waits);
+    // The command may be released by the thread once enqueued.
+    command_ref ref = {event, type, c->queueNo};
     enqueue(c);
+    pthread_mutex_unlock(&enqueueLock);
+
+    return ref;
   }
 
   void
@@ -107,14 +201,23 @@ namespace libsplit {
 			   size_t offset,
 			   size_t size,
 			   Event *event) {
-    Command *c = new CommandFill(buffer, pattern, pattern_size, offset, size,
-				 event);
+    pthread_mutex_lock(&enqueueLock);
+    Command *c = newCommand<CommandFill>(buffer, pattern, pattern_size,
+					 offset, size, event);
+    orderCommand(c, buffer, true);
     enqueue(c);
+    pthread_mutex_unlock(&enqueueLock);
   }
 
 
   void
   DeviceQueue::bindThread() {
+    // With NUMA=1, bind the thread to the cores of the node of the device.
+    if (numaPlacement) {
+      if (numaNode >= 0)
+	numaPlacement->bindThread(numaNode);
+      return;
+    }
 
 #ifdef USE_HWLOC
     // Bind thread with HWLOC if it is a CUDA or AMD device
@@ -171,10 +274,230 @@ namespace libsplit {
 #endif /* USE_HWLOC */
   }
 
+  DeviceQueue::QUEUE_TYPE
+  DeviceQueue::getComputeQueue(unsigned s) {
+    unsigned q = s % optStreams;
+    return q == 0 ? COMPUTE : (QUEUE_TYPE) (COMPUTE1 + q - 1);
+  }
+
+  DeviceQueue::QUEUE_TYPE
+  DeviceQueue::getCLQueueType(QUEUE_TYPE type) {
+    if (!optCopyQueues && (type == H2D || type == D2H))
+      return COMPUTE;
+    return type;
+  }
+
+  void
+  DeviceQueue::createCLQueues() {
+    for (unsigned q=0; q<NBQUEUETYPES; q++) {
+      if (getCLQueueType((QUEUE_TYPE) q) != q ||
+	  (q >= COMPUTE1 && q - COMPUTE1 + 1 >= optStreams))
+	continue;
+
+      cl_int err;
+      cl_queues[q] = real_clCreateCommandQueue(context, device,
+					       CL_QUEUE_PROFILING_ENABLE,
+					       &err);
+      clCheck(err, __FILE__, __LINE__);
+    }
+  }
+
+  cl_command_queue
+  DeviceQueue::getCLQueue(QUEUE_TYPE type) const {
+    return cl_queues[getCLQueueType(type)];
+  }
+
+  void
+  DeviceQueue::flushCLQueue(QUEUE_TYPE type) {
+    type = getCLQueueType(type);
+    if (!nbUnflushed[type])
+      return;
+
+    cl_int err = real_clFlush(cl_queues[type]);
+    clCheck(err, __FILE__, __LINE__);
+    nbUnflushed[type] = 0;
+    nbFlushes++;
+  }
+
+  void
+  DeviceQueue::executeBatch(Command **commands, unsigned nb,
+			    unsigned long depth) {
+    queueDepths.add(depth);
+    batchSizes.add(nb);
+
+    for (unsigned i=0; i<nb; i++) {
+      Command *cmd = commands[i];
+      QUEUE_TYPE type = getCLQueueType(cmd->queueType);
+      double enqueueTime = cmd->enqueueTime;
+
+      cmd->execute(this);
+      releaseCommand(cmd);
+
+      submitLatencies.add((get_time() - enqueueTime) * 1e6);
+      if (++nbUnflushed[type] == optFlushThreshold)
+	flushCLQueue(type);
+    }
+
+    for (unsigned q=0; q<NBQUEUETYPES; q++)
+      flushCLQueue((QUEUE_TYPE) q);
+  }
+
   void
   DeviceQueue::finish() {
+    // Wait outside of the lock, other threads may enqueue meanwhile.
+    Event *events[NBQUEUETYPES];
+    pthread_mutex_lock(&enqueueLock);
+    for (unsigned q=0; q<NBQUEUETYPES; q++) {
+      events[q] = lastEvents[q];
+      if (events[q])
+	events[q]->retain();
+    }
+    pthread_mutex_unlock(&enqueueLock);
+
+    for (unsigned q=0; q<NBQUEUETYPES; q++) {
+      if (events[q]) {
+	events[q]->wait();
+	events[q]->release();
+      }
+    }
+  }
+
+  void
+  DeviceQueue::setLastEvent(Command *command) {
+    Event *&lastEvent = lastEvents[command->queueType];
+    if (command->event)
+      command->event->retain();
     if (lastEvent)
-      lastEvent->wait();
+      lastEvent->release();
+    lastEvent = command->event;
+  }
+
+  void
+  DeviceQueue::getDependencies(const Command *command, cl_mem buffer,
+			       bool write, queue_access *deps) {
+    auto it = bufferAccesses.find(buffer);
+    if (it == bufferAccesses.end())
+      return;
+
+    // Commands of the same queue are executed in order, and waiting for a
+    // command of another queue waits for the previous ones.
+    for (unsigned q=0; q<NBQUEUETYPES; q++) {
+      if (q == command->queueType)
+	continue;
+      const queue_access &w = it->second.writes[q];
+      if (w.event && w.no > deps[q].no)
+	deps[q] = w;
+      const queue_access &r = it->second.reads[q];
+      if (write && r.event && r.no > deps[q].no)
+	deps[q] = r;
+    }
+  }
+
+  void
+  DeviceQueue::addDependencies(Command *command, const queue_access *deps) {
+    for (unsigned q=0; q<NBQUEUETYPES; q++) {
+      if (!deps[q].event)
+	continue;
+      command->addDependency(deps[q].event, (QUEUE_TYPE) q);
+      nbDependencies++;
+    }
+  }
+
+  void
+  DeviceQueue::recordAccess(const Command *command, cl_mem buffer,
+			    bool write) {
+    buffer_accesses &b = bufferAccesses[buffer];
+    queue_access &a = write ? b.writes[command->queueType] :
+      b.reads[command->queueType];
+    command->event->retain();
+    if (a.event)
+      a.event->release();
+    a.event = command->event;
+    a.no = command->queueNo;
+  }
+
+  void
+  DeviceQueue::orderCommand(Command *command,
+			    const std::vector<buffer_access> *accesses,
+			    const std::vector<command_ref> *waits) {
+    command->queueNo = ++nbCommands[command->queueType];
+    if (!optCopyQueues && optStreams == 1)
+      return;
+
+    queue_access deps[NBQUEUETYPES] = {};
+    if (accesses) {
+      for (const buffer_access &a : *accesses)
+	getDependencies(command, a.buffer, a.write, deps);
+    } else {
+      for (unsigned q=0; q<NBQUEUETYPES; q++) {
+	if (q != command->queueType && lastEvents[q]) {
+	  deps[q].event = lastEvents[q];
+	  deps[q].no = nbCommands[q];
+	}
+      }
+    }
+    if (waits) {
+      for (const command_ref &w : *waits) {
+	if (w.type != command->queueType && w.no > deps[w.type].no) {
+	  deps[w.type].event = w.event;
+	  deps[w.type].no = w.no;
+	}
+      }
+    }
+    // Commands with unknown accesses write to any buffer.
+    getDependencies(command, NULL, accesses != NULL, deps);
+    addDependencies(command, deps);
+
+    if (accesses) {
+      for (const buffer_access &a : *accesses)
+	recordAccess(command, a.buffer, a.write);
+    } else {
+      recordAccess(command, NULL, true);
+    }
+  }
+
+  void
+  DeviceQueue::orderCommand(Command *command, cl_mem buffer, bool write) {
+    buffer_access access = {buffer, write};
+    std::vector<buffer_access> accesses(1, access);
+    orderCommand(command, &accesses);
+  }
+
+  void
+  DeviceQueue::releaseBuffer(cl_mem buffer) {
+    pthread_mutex_lock(&enqueueLock);
+    auto it = bufferAccesses.find(buffer);
+    if (it == bufferAccesses.end()) {
+      pthread_mutex_unlock(&enqueueLock);
+      return;
+    }
+
+    for (unsigned q=0; q<NBQUEUETYPES; q++) {
+      if (it->second.reads[q].event)
+	it->second.reads[q].event->release();
+      if (it->second.writes[q].event)
+	it->second.writes[q].event->release();
+    }
+    bufferAccesses.erase(it);
+    pthread_mutex_unlock(&enqueueLock);
+  }
+
+  void
+  DeviceQueue::releaseKernel(cl_kernel kernel) {
+    pthread_mutex_lock(&enqueueLock);
+    lastKernelArgs.erase(kernel);
+    pthread_mutex_unlock(&enqueueLock);
+  }
+
+  void
+  DeviceQueue::releaseCommand(Command *command) {
+    if (!commandPool.owns(command)) {
+      delete command;
+      return;
+    }
+
+    command->~Command();
+    commandPool.release();
   }
 
 
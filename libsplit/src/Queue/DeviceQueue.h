@@ -1,11 +1,20 @@
 #ifndef DEVICEQUEUE_H
 #define DEVICEQUEUE_H
 
+#include <Queue/CommandPool.h>
 #include <Queue/Event.h>
 #include <Handle/KernelHandle.h>
+#include <Utils/Histogram.h>
 
 #include <CL/cl.h>
 
+#include <map>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+
 #ifdef USE_HWLOC
 #include <hwloc.h>
 #endif /* USE_HWLOC */
@@ -14,8 +23,53 @@ namespace libsplit {
 
   class Command;
 
+  // Queue of the commands of a device, executed by a thread of the device.
+  // The thread dequeues the available commands in batches of up to
+  // BATCHSIZE, submits them back to back and flushes the command queues
+  // every FLUSHTHRESHOLD commands and at the end of the batch.
+  // Kernels are enqueued in the compute command queue, and with COPYQUEUES=1
+  // the host to device and device to host transfers in their own command
+  // queues, waiting for the commands of the other queues accessing the same
+  // buffers. With STREAMS > 1, the kernels of the streams of the application
+  // are enqueued in several compute queues, ordered the same way.
+  // Commands may be enqueued by several host threads, the enqueuing side
+  // (ordering of the commands, arguments of the kernels, command pool and
+  // queue of the thread) being serialized by enqueueLock.
   class DeviceQueue {
   public:
+    enum QUEUE_TYPE {
+      COMPUTE,
+      H2D,
+      D2H,
+      // Compute queues of the additional streams.
+      COMPUTE1,
+      COMPUTE2,
+      COMPUTE3,
+      NBQUEUETYPES
+    };
+    static const unsigned MAXSTREAMS = 4;
+
+    // Compute queue of the stream s, the streams sharing the STREAMS
+    // compute queues.
+    static QUEUE_TYPE getComputeQueue(unsigned s);
+    // Queue type whose command queue executes the commands of type, COMPUTE
+    // for the transfers with COPYQUEUES=0.
+    static QUEUE_TYPE getCLQueueType(QUEUE_TYPE type);
+
+    // Command enqueued in the queue, waited for by the commands of the
+    // other command queues of the device.
+    struct command_ref {
+      Event *event;
+      QUEUE_TYPE type;
+      unsigned long no;
+    };
+
+    // Buffer accessed by a kernel.
+    struct buffer_access {
+      cl_mem buffer;
+      bool write;
+    };
+
     virtual ~DeviceQueue();
 
     virtual void enqueueDummyEvents();
@@ -32,13 +86,18 @@ namespace libsplit {
 		     const void *ptr,
 		     Event *event);
 
-    void enqueueExec(cl_kernel kernel,
-		     cl_uint work_dim,
-		     const size_t *global_work_offset,
-		     const size_t *global_work_size,
-		     const size_t *local_work_size,
-		     KernelArgs args,
-		     Event *event);
+    // Launch kernel in the compute queue type, after the commands of
+    // waits, and return the command.
+    command_ref enqueueExec(cl_kernel kernel,
+			    cl_uint work_dim,
+			    const size_t *global_work_offset,
+			    const size_t *global_work_size,
+			    const size_t *local_work_size,
+			    const KernelArgs &args,
+			    const std::vector<buffer_access> *accesses,
+			    QUEUE_TYPE type,
+			    const std::vector<command_ref> *waits,
+			    Event *event);
 
     void enqueueFill(cl_mem buffer,
 		     const void *pattern,
@@ -49,27 +108,121 @@ namespace libsplit {
 
     void finish();
 
+    // Forget the arguments set to kernel before it is released, as another
+    // kernel may get the same handle.
+    void releaseKernel(cl_kernel kernel);
+    // Forget the accesses to buffer before it is released.
+    void releaseBuffer(cl_mem buffer);
+
     virtual void run() = 0;
 
-    cl_command_queue cl_queue;
+    // Command queue of the commands of type, the compute queue for all of
+    // them with COPYQUEUES=0.
+    cl_command_queue getCLQueue(QUEUE_TYPE type) const;
+
+    // Flush the command queue of type if commands were submitted since the
+    // last flush. Only called by the thread of the queue.
+    void flushCLQueue(QUEUE_TYPE type);
+
+    // NUMA node closest to the device with NUMA=1, -1 otherwise.
+    int getNumaNode() const { return numaNode; }
+
     const unsigned dev_id;
 
   protected:
     DeviceQueue(cl_context context, cl_device_id dev, unsigned dev_id);
 
+    // Command of a queue, numbered in the order of the queue.
+    struct queue_access {
+      Event *event;
+      unsigned long no;
+    };
+    struct buffer_accesses {
+      queue_access reads[NBQUEUETYPES];
+      queue_access writes[NBQUEUETYPES];
+    };
+
+    friend void benchSubmissionLatency(cl_context context, cl_device_id dev);
+
+    // Commands are allocated in the slots of the pool, or on the heap when
+    // it is full, and released by the queue thread after execution.
+    template<class T, class... Args>
+    T *newCommand(Args&&... args) {
+      void *slot = commandPool.allocate();
+      if (!slot) {
+	nbHeapCommands++;
+	return new T(std::forward<Args>(args)...);
+      }
+      return new (slot) T(std::forward<Args>(args)...);
+    }
+    void releaseCommand(Command *command);
+
+    // Create the command queues, called by the thread of the queue.
+    void createCLQueues();
+
+    // Submit and release the nb commands of a batch, depth being the number
+    // of commands in the queue when it was dequeued.
+    void executeBatch(Command **commands, unsigned nb, unsigned long depth);
+
     virtual void enqueue(Command *command) = 0;
 
+    // Keep a reference to the event of the last command enqueued in the
+    // command queue of command.
+    void setLastEvent(Command *command);
+
+    // Add to command the dependencies on the commands of the other queues
+    // accessing the same buffers, all the previous commands of the other
+    // queues if accesses is NULL, and on the commands of waits, and record
+    // its accesses.
+    void orderCommand(Command *command,
+		      const std::vector<buffer_access> *accesses,
+		      const std::vector<command_ref> *waits = NULL);
+    void orderCommand(Command *command, cl_mem buffer, bool write);
+    void getDependencies(const Command *command, cl_mem buffer, bool write,
+			 queue_access *deps);
+    void addDependencies(Command *command, const queue_access *deps);
+    void recordAccess(const Command *command, cl_mem buffer, bool write);
+
     void bindThread();
     static void *threadFunc(void *args);
 
     cl_context context;
     cl_device_id device;
 
-
-    Event *lastEvent;
+    cl_command_queue cl_queues[NBQUEUETYPES];
+    Event *lastEvents[NBQUEUETYPES];
 
     bool isCudaDevice;
     bool isAMDDevice;
+    int numaNode;
+
+    // Held by the enqueuing threads, protects lastEvents and the members
+    // below up to nbDependencies.
+    pthread_mutex_t enqueueLock;
+
+    CommandPool commandPool;
+    unsigned long nbHeapCommands;
+
+    // Arguments of the last launch of each kernel on the queue, used to set
+    // only the arguments that changed.
+    std::map<cl_kernel, KernelArgs> lastKernelArgs;
+    unsigned long nbArgsSet;
+    unsigned long nbArgsSkipped;
+
+    // Last commands of each queue reading and writing a buffer. The
+    // accesses of the commands with unknown accesses are recorded as writes
+    // to the NULL buffer.
+    std::map<cl_mem, buffer_accesses> bufferAccesses;
+    unsigned long nbCommands[NBQUEUETYPES];
+    unsigned long nbDependencies;
+
+    // Commands submitted to each command queue since its last flush, and
+    // batch statistics. Only accessed by the thread of the queue.
+    unsigned nbUnflushed[NBQUEUETYPES];
+    unsigned long nbFlushes;
+    Histogram queueDepths;
+    Histogram batchSizes;
+    Histogram submitLatencies; // From the creation of the command, in us
 
 #ifdef USE_HWLOC
     hwloc_topology_t topology;
@@ -0,0 +1,157 @@
+#include <EventFactory.h>
+#include <Options.h>
+#include <Queue/Event.h>
+
+#include <time.h>
+
+namespace libsplit {
+
+  // CPU time of the calling thread, in seconds.
+  static double
+  getThreadTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+  Event::Event()
+    : event(NULL), factory(NULL), refCount(0), completed(false), start(0),
+      end(0), nextCompleted(NULL), submitted(false) {
+    pthread_mutex_init(&mutex_submitted, NULL);
+    pthread_cond_init(&cond_submitted, NULL);
+  }
+
+  Event::~Event() {
+    pthread_mutex_destroy(&mutex_submitted);
+    pthread_cond_destroy(&cond_submitted);
+  }
+
+  void
+  Event::release() {
+    if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      factory->recycle(this);
+  }
+
+  void
+  Event::setSubmitted() {
+    if (optEventCallbacks) {
+      // Reference released once the event leaves the completion queue.
+      retain();
+      cl_int err = real_clSetEventCallback(event, CL_COMPLETE,
+					   completionCallback, this);
+      clCheck(err, __FILE__, __LINE__);
+    }
+
+    pthread_mutex_lock(&mutex_submitted);
+    submitted = true;
+    pthread_cond_broadcast(&cond_submitted);
+    pthread_mutex_unlock(&mutex_submitted);
+  }
+
+  void CL_CALLBACK
+  Event::completionCallback(cl_event event, cl_int status, void *userData) {
+    (void) event;
+    Event *e = static_cast<Event *>(userData);
+
+    // A negative status is the error that terminated the command.
+    if (status < 0)
+      clCheck(status, __FILE__, __LINE__);
+
+    e->readProfilingInfo();
+
+    pthread_mutex_lock(&e->mutex_submitted);
+    e->completed.store(true, std::memory_order_release);
+    pthread_cond_broadcast(&e->cond_submitted);
+    pthread_mutex_unlock(&e->mutex_submitted);
+
+    e->factory->pushCompleted(e);
+  }
+
+  void
+  Event::readProfilingInfo() {
+    // Markers may have no profiling info, their times are left null.
+    if (real_clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START,
+				     sizeof(start), &start, NULL) != CL_SUCCESS ||
+	real_clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,
+				     sizeof(end), &end, NULL) != CL_SUCCESS)
+      start = end = 0;
+  }
+
+  void
+  Event::wait() {
+    if (completed.load(std::memory_order_acquire))
+      return;
+
+    double wallStart = get_time();
+    double cpuStart = getThreadTime();
+
+    pthread_mutex_lock(&mutex_submitted);
+    if (optEventCallbacks) {
+      while (!completed.load(std::memory_order_acquire))
+	pthread_cond_wait(&cond_submitted, &mutex_submitted);
+    } else {
+      while (!submitted)
+	pthread_cond_wait(&cond_submitted, &mutex_submitted);
+
+      cl_int status;
+
+      // Hack
+      do {
+	cl_int err = real_clWaitForEvents(1, &event);
+	clCheck(err, __FILE__, __LINE__);
+
+	err = real_clGetEventInfo(event,
+				  CL_EVENT_COMMAND_EXECUTION_STATUS,
+				  sizeof(status),
+				  &status, NULL);
+	clCheck(err, __FILE__, __LINE__);
+      } while (status != CL_COMPLETE);
+
+      if (!completed.load(std::memory_order_relaxed)) {
+	readProfilingInfo();
+	completed.store(true, std::memory_order_release);
+      }
+    }
+    pthread_mutex_unlock(&mutex_submitted);
+
+    factory->addWait(get_time() - wallStart, getThreadTime() - cpuStart);
+  }
+
+  bool
+  Event::isComplete() {
+    if (completed.load(std::memory_order_acquire))
+      return true;
+    if (optEventCallbacks)
+      return false;
+
+    pthread_mutex_lock(&mutex_submitted);
+    if (submitted && !completed.load(std::memory_order_relaxed)) {
+      cl_int status;
+      cl_int err = real_clGetEventInfo(event,
+				       CL_EVENT_COMMAND_EXECUTION_STATUS,
+				       sizeof(status), &status, NULL);
+      clCheck(err, __FILE__, __LINE__);
+      if (status == CL_COMPLETE) {
+	readProfilingInfo();
+	completed.store(true, std::memory_order_release);
+      }
+    }
+    pthread_mutex_unlock(&mutex_submitted);
+
+    return completed.load(std::memory_order_relaxed);
+  }
+
+  void
+  Event::reset() {
+    if (event) {
+      cl_int err = real_clReleaseEvent(event);
+      clCheck(err, __FILE__, __LINE__);
+      event = NULL;
+    }
+    submitted = false;
+    completed.store(false, std::memory_order_relaxed);
+    start = end = 0;
+    nextCompleted = NULL;
+  }
+
+};
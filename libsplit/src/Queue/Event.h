@@ -1,60 +1,71 @@
 #ifndef EVENT_H
 #define EVENT_H
 
-#include <Utils/Retainable.h>
 #include <Utils/Utils.h>
 
 #include <CL/cl.h>
 
+#include <atomic>
+
 namespace libsplit {
 
-  class Event : public Retainable {
+  class EventFactory;
+
+  // Events are allocated by the EventFactory and reference counted: the
+  // caller of EventFactory::getNewEvent() owns the first reference, each
+  // consumer keeping the event (commands, queues, scheduler timers, timeline)
+  // retains it, and the event is recycled with its cl_event released once the
+  // last reference is released.
+  //
+  // Once the command is submitted, the event is completed by an OpenCL
+  // callback (EVENTCALLBACKS=1), which reads the profiling times, wakes up
+  // the waiters and hands the event to the completion queue of the factory.
+  // Otherwise the event is polled by the threads waiting for it.
+  class Event {
   public:
-    Event() : submitted(false) {
-      pthread_mutex_init(&mutex_submitted, NULL);
-      pthread_cond_init(&cond_submitted, NULL);
-    }
-
-    ~Event() {
-      pthread_mutex_destroy(&mutex_submitted);
-      pthread_cond_destroy(&cond_submitted);
-    }
+    Event();
+    ~Event();
 
     void
-    setSubmitted() {
-      pthread_mutex_lock(&mutex_submitted);
-      submitted = true;
-      pthread_cond_broadcast(&cond_submitted);
-      pthread_mutex_unlock(&mutex_submitted);
+    retain() {
+      refCount.fetch_add(1, std::memory_order_relaxed);
     }
 
-    void
-    wait() {
-      pthread_mutex_lock(&mutex_submitted);
-      if (!submitted)
-	pthread_cond_wait(&cond_submitted, &mutex_submitted);
-
+    void release();
 
-      cl_int status;
+    // Called once the command is enqueued and event is set.
+    void setSubmitted();
 
-      // Hack
-      do {
-	cl_int err = real_clWaitForEvents(1, &event);
-	clCheck(err, __FILE__, __LINE__);
+    // Block until the command is complete.
+    void wait();
 
-	err = real_clGetEventInfo(event,
-				  CL_EVENT_COMMAND_EXECUTION_STATUS,
-				  sizeof(status),
-				  &status, NULL);
-	clCheck(err, __FILE__, __LINE__);
-      } while (status != CL_COMPLETE);
+    // Return true if the command is complete, without blocking.
+    bool isComplete();
 
-      pthread_mutex_unlock(&mutex_submitted);
-    }
+    // Profiling times of the command, once it is complete.
+    cl_ulong getStart() const { return start; }
+    cl_ulong getEnd() const { return end; }
 
     cl_event event;
 
   private:
+    friend class EventFactory;
+
+    static void CL_CALLBACK completionCallback(cl_event event, cl_int status,
+					       void *userData);
+    void readProfilingInfo();
+
+    // Release the cl_event and reset the event before it is reused.
+    void reset();
+
+    EventFactory *factory;
+    std::atomic<int> refCount;
+
+    std::atomic<bool> completed;
+    cl_ulong start;
+    cl_ulong end;
+    Event *nextCompleted; // Link of the completion queue
+
     bool submitted;
     pthread_mutex_t mutex_submitted;
     pthread_cond_t cond_submitted;
@@ -3,11 +3,9 @@
 
 namespace libsplit {
 
-  LockFreeQueue::LockFreeQueue(unsigned long size) {
-    size_ = size;
-    idx_r_ = 0;
-    idx_w_ = 0;
-    elements_ = (volatile Command**)(new Command*[size]);
+  LockFreeQueue::LockFreeQueue(unsigned long size)
+    : size_(size), idx_r_(0), idx_w_(0) {
+    elements_ = new Command*[size];
   }
 
   LockFreeQueue::~LockFreeQueue() {
@@ -15,25 +13,28 @@ namespace libsplit {
   }
 
   bool LockFreeQueue::Enqueue(Command* element) {
-    unsigned long next_idx_w = (idx_w_ + 1) % size_;
-    if (next_idx_w == idx_r_) return false;
-    elements_[idx_w_] = element;
-    __sync_synchronize();
-    idx_w_ = next_idx_w;
+    unsigned long idx_w = idx_w_.load(std::memory_order_relaxed);
+    unsigned long next_idx_w = (idx_w + 1) % size_;
+    if (next_idx_w == idx_r_.load(std::memory_order_acquire)) return false;
+    elements_[idx_w] = element;
+    idx_w_.store(next_idx_w, std::memory_order_release);
     return true;
   }
 
   bool LockFreeQueue::Dequeue(Command** element) {
-    if (idx_r_ == idx_w_) return false;
-    unsigned long next_idx_r = (idx_r_ + 1) % size_;
-    *element = (Command*) elements_[idx_r_];
-    idx_r_ = next_idx_r;
+    unsigned long idx_r = idx_r_.load(std::memory_order_relaxed);
+    if (idx_r == idx_w_.load(std::memory_order_acquire)) return false;
+    unsigned long next_idx_r = (idx_r + 1) % size_;
+    *element = elements_[idx_r];
+    idx_r_.store(next_idx_r, std::memory_order_release);
     return true;
   }
 
   unsigned long LockFreeQueue::Size() const {
-    if (idx_w_ >= idx_r_) return idx_w_ - idx_r_;
-    return size_ - idx_r_ + idx_w_;
+    unsigned long idx_r = idx_r_.load(std::memory_order_acquire);
+    unsigned long idx_w = idx_w_.load(std::memory_order_acquire);
+    if (idx_w >= idx_r) return idx_w - idx_r;
+    return size_ - idx_r + idx_w;
   }
 
 };
@@ -1,11 +1,17 @@
 #ifndef LOCKFREEQUEUE_H
 #define LOCKFREEQUEUE_H
 
+#include <atomic>
+
 class Command;
 
 namespace libsplit {
 
   // Single Producer & Single Consumer
+  //
+  // The producer publishes an element with a release store of idx_w_ and
+  // the consumer frees its slot with a release store of idx_r_, each side
+  // reading the index of the other with acquire.
   class LockFreeQueue {
   public:
     LockFreeQueue(unsigned long size);
@@ -17,9 +23,9 @@ namespace libsplit {
 
   protected:
     unsigned long size_;
-    volatile Command** elements_;
-    volatile unsigned long idx_r_;
-    volatile unsigned long idx_w_;
+    Command** elements_;
+    std::atomic<unsigned long> idx_r_;
+    std::atomic<unsigned long> idx_w_;
   };
 
 };
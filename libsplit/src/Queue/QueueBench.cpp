@@ -0,0 +1,83 @@
+#include <Queue/Command.h>
+#include <Queue/DeviceLFQueue.h>
+#include <Queue/DevicePthreadQueue.h>
+#include <Queue/QueueBench.h>
+#include <Utils/Utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+#include <unistd.h>
+
+namespace libsplit {
+
+  namespace {
+
+    // Command recording the time its execution starts.
+    class CommandTimestamp : public Command {
+    public:
+      CommandTimestamp(double *time, std::atomic<bool> *done)
+	: Command(NULL), time(time), done(done) {}
+
+      virtual void execute(DeviceQueue *) {
+	*time = get_time();
+	done->store(true, std::memory_order_release);
+      }
+
+    private:
+      double *time;
+      std::atomic<bool> *done;
+    };
+
+  }
+
+  static const unsigned NBSUBMISSIONS = 200;
+  // Idle time before each submission in us: back to back, short and long.
+  static const unsigned IDLETIMES[] = {0, 100, 5000};
+
+  void
+  benchSubmissionLatency(cl_context context, cl_device_id dev) {
+    auto benchQueue = [](DeviceQueue *queue, const char *name) {
+      std::cerr << name << ":";
+
+      for (unsigned idle : IDLETIMES) {
+	std::vector<double> latencies;
+	for (unsigned i=0; i<NBSUBMISSIONS; i++) {
+	  if (idle > 0)
+	    usleep(idle);
+
+	  double time;
+	  std::atomic<bool> done(false);
+	  double t0 = get_time();
+	  queue->enqueue(new CommandTimestamp(&time, &done));
+	  while (!done.load(std::memory_order_acquire));
+	  latencies.push_back((time - t0) * 1e6);
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	std::cerr << " idle " << idle << " us: median "
+		  << latencies[latencies.size() / 2] << " us, p99 "
+		  << latencies[latencies.size() * 99 / 100] << " us, max "
+		  << latencies.back() << " us;";
+      }
+      std::cerr << "\n";
+    };
+
+    DeviceQueue *queue;
+
+    queue = new DevicePthreadQueue(context, dev, 0);
+    benchQueue(queue, "pthread queue");
+    delete queue;
+
+    queue = new DeviceLFQueue(context, dev, 0, DeviceLFQueue::WAIT_SLEEP);
+    benchQueue(queue, "lock free queue, sleep");
+    delete queue;
+
+    queue = new DeviceLFQueue(context, dev, 0, DeviceLFQueue::WAIT_ADAPTIVE);
+    benchQueue(queue, "lock free queue, adaptive wakeup");
+    delete queue;
+  }
+
+};
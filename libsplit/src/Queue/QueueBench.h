@@ -0,0 +1,16 @@
+#ifndef QUEUEBENCH_H
+#define QUEUEBENCH_H
+
+#include <CL/cl.h>
+
+namespace libsplit {
+
+  // Print the submission latency of the device queue implementations, the
+  // time from the enqueue of a command to the start of its execution by the
+  // queue thread, for commands enqueued back to back and after the thread
+  // has been idle (BENCHQUEUE=1).
+  void benchSubmissionLatency(cl_context context, cl_device_id dev);
+
+};
+
+#endif /* QUEUEBENCH_H */
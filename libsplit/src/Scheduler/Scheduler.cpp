@@ -5,6 +5,7 @@
 #include <Utils/Debug.h>
 #include <Utils/Timeline.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstring>
@@ -22,20 +23,10 @@ namespace libsplit {
       // H2D timers
       for (auto IT : src2H2DEvents[d]) {
 	for (unsigned i=0; i<IT.second.size(); ++i) {
-	  cl_ulong start, end;
-	  cl_int err;
-
 	  IT.second[i]->wait();
-
-	  err = real_clGetEventProfilingInfo(IT.second[i]->event,
-	  				     CL_PROFILING_COMMAND_START,
-	  				     sizeof(start), &start, NULL);
-	  clCheck(err, __FILE__, __LINE__);
-	  err = real_clGetEventProfilingInfo(IT.second[i]->event,
-	  				     CL_PROFILING_COMMAND_END,
-	  				     sizeof(end), &end, NULL);
-	  clCheck(err, __FILE__, __LINE__);
-	  // IT.second[i]->release();
+	  cl_ulong start = IT.second[i]->getStart();
+	  cl_ulong end = IT.second[i]->getEnd();
+	  IT.second[i]->release();
 
 	  double t = (end - start) * 1e-6;
 	  unsigned cb = src2H2DEventsCB[d][IT.first][i];
@@ -57,20 +48,10 @@ namespace libsplit {
       // D2H timers
       for (auto IT : src2D2HEvents[d]) {
 	for (unsigned i=0; i<IT.second.size(); ++i) {
-	  cl_ulong start, end;
-	  cl_int err;
-
 	  IT.second[i]->wait();
-
-	  err = real_clGetEventProfilingInfo(IT.second[i]->event,
-	  				     CL_PROFILING_COMMAND_START,
-	  				     sizeof(start), &start, NULL);
-	  clCheck(err, __FILE__, __LINE__);
-	  err = real_clGetEventProfilingInfo(IT.second[i]->event,
-	  				     CL_PROFILING_COMMAND_END,
-	  				     sizeof(end), &end, NULL);
-	  clCheck(err, __FILE__, __LINE__);
-	  // IT.second[i]->release();
+	  cl_ulong start = IT.second[i]->getStart();
+	  cl_ulong end = IT.second[i]->getEnd();
+	  IT.second[i]->release();
 
 	  double t = (end - start) * 1e-6;
 	  unsigned cb = src2D2HEventsCB[d][IT.first][i];
@@ -90,19 +71,10 @@ namespace libsplit {
 
     // Subkernels timers
     for (unsigned i=0; i<subkernels.size(); i++) {
-      cl_ulong start, end;
-      cl_int err;
       unsigned dev = subkernels[i]->device;
       subkernels[i]->event->wait();
-      err = real_clGetEventProfilingInfo(subkernels[i]->event->event,
-      					 CL_PROFILING_COMMAND_START,
-      					 sizeof(start), &start, NULL);
-      clCheck(err, __FILE__, __LINE__);
-      err = real_clGetEventProfilingInfo(subkernels[i]->event->event,
-      					 CL_PROFILING_COMMAND_END,
-      					 sizeof(end), &end, NULL);
-      clCheck(err, __FILE__, __LINE__);
-      // subkernels[i]->event->release();
+      cl_ulong start = subkernels[i]->event->getStart();
+      cl_ulong end = subkernels[i]->event->getEnd();
       kernelTimes[dev] += (end - start) * 1e-6;
     }
   }
@@ -110,7 +82,12 @@ namespace libsplit {
   void
   Scheduler::SubKernelSchedInfo::clearEvents() {
     for (unsigned d=0; d<nbDevices; d++) {
-      // TODO: release events
+      for (auto &IT : src2H2DEvents[d])
+	for (Event *event : IT.second)
+	  event->release();
+      for (auto &IT : src2D2HEvents[d])
+	for (Event *event : IT.second)
+	  event->release();
       src2H2DEvents[d].clear();
       src2D2HEvents[d].clear();
       src2H2DEventsCB[d].clear();
@@ -166,10 +143,117 @@ namespace libsplit {
   }
 
   Scheduler::Scheduler(BufferManager *buffManager, unsigned nbDevices) :
-    buffManager(buffManager), nbDevices(nbDevices), count(0) {}
+    buffManager(buffManager), nbDevices(nbDevices), count(0),
+    nbFullInstantiations(0), nbInstantiationsAvoided(0),
+    nbArgsInstantiated(0), nbArgsSubstituted(0), nbArgsSkipped(0),
+    nbIncrementalInstantiations(0), nbArgsMoved(0),
+    nbIndirInstantiationsAvoided(0) {}
 
   Scheduler::~Scheduler() {}
 
+  void
+  Scheduler::computeDevicePeaks() {
+    if (!devicePeakFlops.empty())
+      return;
+
+    for (unsigned d=0; d<nbDevices; d++) {
+      cl_device_id dev = contextHandle->getDevice(d);
+      cl_device_type type;
+      cl_uint computeUnits, clockFrequency, vectorWidth;
+      cl_int err;
+
+      err = real_clGetDeviceInfo(dev, CL_DEVICE_TYPE, sizeof(type), &type,
+				 NULL);
+      clCheck(err, __FILE__, __LINE__);
+      err = real_clGetDeviceInfo(dev, CL_DEVICE_MAX_COMPUTE_UNITS,
+				 sizeof(computeUnits), &computeUnits, NULL);
+      clCheck(err, __FILE__, __LINE__);
+      err = real_clGetDeviceInfo(dev, CL_DEVICE_MAX_CLOCK_FREQUENCY,
+				 sizeof(clockFrequency), &clockFrequency, NULL);
+      clCheck(err, __FILE__, __LINE__);
+      err = real_clGetDeviceInfo(dev, CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT,
+				 sizeof(vectorWidth), &vectorWidth, NULL);
+      clCheck(err, __FILE__, __LINE__);
+
+      // OpenCL does not report the number of lanes of a GPU compute unit nor
+      // the memory bandwidth, typical values are used instead. An FMA counts
+      // as two operations.
+      bool isCPU = type & CL_DEVICE_TYPE_CPU;
+      double lanes = isCPU ? std::max(vectorWidth, 1u) : 64;
+      double flops = 2.0 * computeUnits * clockFrequency * 1e6 * lanes;
+      double bandwidth = isCPU ? 20e9 : 200e9;
+
+      if (d < optDeviceGflops.size())
+	flops = optDeviceGflops[d] * 1e9;
+      if (d < optDeviceBandwidth.size())
+	bandwidth = optDeviceBandwidth[d] * 1e9;
+
+      devicePeakFlops.push_back(flops);
+      deviceBandwidth.push_back(bandwidth);
+
+      DEBUG("roofline",
+	    std::cerr << "device " << d << ": " << flops * 1e-9 << " GFLOP/s, "
+	    << bandwidth * 1e-9 << " GB/s\n";);
+    }
+  }
+
+  bool
+  Scheduler::getRooflinePartition(KernelHandle *k, std::vector<double> *granu) {
+    KernelAnalysis *analysis = k->getAnalysis();
+    if (!analysis)
+      return false;
+
+    const KernelFeatures &features = analysis->getFeatures();
+    if (features.nbArithOps == 0 && features.globalBytes == 0)
+      return false;
+
+    computeDevicePeaks();
+
+    // Time of a work-item on each device, bounded either by the compute peak
+    // or by the memory bandwidth. Each device gets a share of the NDRange
+    // proportional to its throughput.
+    std::vector<double> throughput(nbDevices);
+    double total = 0;
+    for (unsigned d=0; d<nbDevices; d++) {
+      double t = std::max(features.nbArithOps / devicePeakFlops[d],
+			  features.globalBytes / deviceBandwidth[d]);
+      throughput[d] = t > 0 ? 1.0 / t : 0;
+      total += throughput[d];
+    }
+
+    if (total == 0)
+      return false;
+
+    for (unsigned d=0; d<nbDevices; d++)
+      (*granu)[d] = throughput[d] / total;
+
+    DEBUG("roofline",
+	  std::cerr << "roofline partition for " << k->getName() << ": "
+	  << features.nbArithOps << " ops, " << features.globalBytes
+	  << " bytes per work-item, granu";
+	  for (unsigned d=0; d<nbDevices; d++)
+	    std::cerr << " " << (*granu)[d];
+	  std::cerr << "\n";);
+
+    return true;
+  }
+
+  void
+  Scheduler::getStartPartition(SubKernelSchedInfo *SI) {
+    std::vector<double> granu(nbDevices, 1.0 / nbDevices);
+
+    if (optGranustart.size() == nbDevices)
+      granu = optGranustart;
+    else if (optRooflineStart)
+      getRooflinePartition(SI->handle, &granu);
+
+    for (unsigned i=0; i<nbDevices; i++) {
+      SI->req_granu_dscr[i*3] = i;
+      SI->req_granu_dscr[i*3+1] = 1;
+      SI->req_granu_dscr[i*3+2] = granu[i];
+    }
+  }
+
   void
   Scheduler::getShiftedPartition(std::vector<NDRange> *shiftedPartition,
 				 const NDRange &origNDRange,
@@ -257,33 +341,81 @@ namespace libsplit {
 
   bool
   Scheduler::paramHaveChanged(const SubKernelSchedInfo *SI,
-				const KernelHandle *k) {
+			      const KernelHandle *k,
+			      std::vector<unsigned> *changedParams) {
+    changedParams->clear();
+
     for (unsigned i=0; i<k->getArgsValues().size(); i++) {
       if (SI->argsValues[i]) {
 	switch(SI->argsValues[i]->type) {
 	case IndexExpr::LONG:
 	  if (SI->argsValues[i]->getLongValue() !=
 	      k->getArgsValues()[i]->getLongValue())
-	    return true;
+	    changedParams->push_back(i);
 	  break;
 	case IndexExpr::FLOAT:
 	  if (SI->argsValues[i]->getFloatValue() !=
 	      k->getArgsValues()[i]->getFloatValue())
-	    return true;
+	    changedParams->push_back(i);
 	  break;
 	case IndexExpr::DOUBLE:
 	  if (SI->argsValues[i]->getDoubleValue() !=
 	      k->getArgsValues()[i]->getDoubleValue())
-	    return true;
+	    changedParams->push_back(i);
 	  break;
 	};
       } else {
 	if (k->getArgsValues()[i])
-	  return true;
+	  changedParams->push_back(i);
       }
     }
 
-    return false;
+    return !changedParams->empty();
+  }
+
+  void
+  Scheduler::printInstantiationStats() const {
+    std::cerr << "analysis instantiations: " << nbFullInstantiations
+	      << " full, " << nbInstantiationsAvoided << " avoided ("
+	      << nbArgsInstantiated << " arguments re-instantiated, "
+	      << nbArgsSubstituted << " substituted, "
+	      << nbArgsSkipped << " skipped), "
+	      << nbIncrementalInstantiations << " incremental ("
+	      << nbArgsMoved << " arguments moved), "
+	      << nbIndirInstantiationsAvoided
+	      << " avoided with unchanged indirections\n";
+  }
+
+  bool
+  Scheduler::cannotSplit(unsigned kerId) {
+    auto it = kerID2InfoMap.find(kerId);
+    return it != kerID2InfoMap.end() && it->second->cannotSplit;
+  }
+
+  void
+  Scheduler::invalidateAnalysis(KernelHandle *k) {
+    for (auto &it : kerID2InfoMap) {
+      if (it.second->handle == k)
+	it.second->analysisInvalidated = true;
+    }
+  }
+
+  void
+  Scheduler::setPlacement(KernelHandle *k, int device) {
+    placements[k] = device;
+  }
+
+  bool
+  Scheduler::indirectionsUpToDate(const SubKernelSchedInfo *SI) {
+    if (!SI->indirectionsValid)
+      return false;
+
+    for (auto &it : SI->indirectionVersions) {
+      if (it.first->version != it.second)
+	return false;
+    }
+
+    return true;
   }
 
   void
@@ -339,11 +471,34 @@ namespace libsplit {
     if (!SI->hasPartition) {
       SI->hasPartition = true;
 
-      if (!SI->hasInitPartition) {
+      int placement = -1;
+      auto placementIT = placements.find(k);
+      if (placementIT != placements.end()) {
+	placement = placementIT->second;
+	placements.erase(placementIT);
+      }
+      bool placementChanged = placement != SI->placedDevice;
+      SI->placedDevice = placement;
+
+      // The timers of a launch placed whole on a device are not those of a
+      // partition of the scheduler.
+      if (placement >= 0 || placementChanged) {
+	SI->clearEvents();
+	SI->clearTimers();
+      }
+
+      if (placement >= 0) {
+	SI->needOtherExecToComplete = false;
+	SI->needToInstantiateAnalysis = placementChanged;
+      } else if (!SI->hasInitPartition) {
 	getInitialPartition(SI, id, &SI->needOtherExecToComplete);
 	SI->hasInitPartition = true;
 	// Analysis needs to be instantiated
 	SI->needToInstantiateAnalysis = true;
+      } else if (placementChanged) {
+	// Run the last partition requested by the scheduler again, the next
+	// one is computed from its timers.
+	SI->needToInstantiateAnalysis = true;
       } else {
 	// Increment iteration counter.
 	SI->iterno++;
@@ -353,27 +508,51 @@ namespace libsplit {
 			 &SI->needToInstantiateAnalysis);
       }
 
+      if (SI->analysisInvalidated) {
+	SI->analysisInvalidated = false;
+	SI->needToInstantiateAnalysis = true;
+      }
+
+      // The partition instantiated by the last analysis can be kept if the
+      // scheduler does not change it and no shifting is in progress.
+      bool partitionKept = !SI->needToInstantiateAnalysis &&
+	SI->partitionInstantiated &&
+	!SI->partitionUnchanged && !SI->shiftingPartition;
+      SI->onlyParamsChanged = false;
+
       // Check if scalar parameters or buffer parameters have changed.
       // For buffers we consider its address as a long value.
-      if (paramHaveChanged(SI, k)) {
+      bool paramsChanged = paramHaveChanged(SI, k, &SI->changedParams);
+      if (paramsChanged) {
+	SI->onlyParamsChanged = partitionKept;
 	SI->needToInstantiateAnalysis = true;
 	updateParamValues(SI, k);
       }
 
       // Check if original NDRange has changed.
+      bool ndRangeChanged = false;
       if (SI->last_work_dim != work_dim) {
-	SI->needToInstantiateAnalysis = true;
+	ndRangeChanged = true;
       } else {
 	for (cl_uint i=0; i<work_dim; i++) {
 	  if (SI->last_global_work_offset[i] !=
 	      (global_work_offset ? global_work_offset[i] : 0) ||
 	      SI->last_global_work_size[i] != global_work_size[i] ||
 	      SI->last_local_work_size[i] != local_work_size[i]) {
-	    SI->needToInstantiateAnalysis = true;
+	    ndRangeChanged = true;
 	    break;
 	  }
 	}
       }
+      if (ndRangeChanged) {
+	SI->needToInstantiateAnalysis = true;
+	SI->onlyParamsChanged = false;
+      }
+
+      // If neither the parameters nor the NDRange have changed, a new
+      // partition in the same dimension only moves the split boundaries.
+      SI->partitionMovable = SI->partitionInstantiated && !paramsChanged &&
+	!ndRangeChanged && !placementChanged;
       SI->last_work_dim = work_dim;
       for (cl_uint i=0; i<work_dim; i++) {
 	SI->last_global_work_offset[i] =
@@ -390,27 +569,74 @@ namespace libsplit {
       if (!strcmp(k->getName(), "getMaxDerivIntel")) {
 	SI->dimOrder[0] = 1; SI->dimOrder[1] = 0;
       }
-      SI->currentDim = 0;
+      SI->currentDim = SI->onlyParamsChanged ? SI->partitionDim : 0;
+
+      // If the kernel has indirections, analysis needs to be instantiated
+      // again unless the buffers the indirection values have been read from
+      // are unchanged since the last instantiation.
+      if (k->getAnalysis()->hasIndirection() && optEnableIndirections) {
+	SI->onlyParamsChanged = false;
+	if (!SI->needToInstantiateAnalysis && indirectionsUpToDate(SI)) {
+	  nbIndirInstantiationsAvoided++;
+	  DEBUG("instantiation",
+		std::cerr << k->getName()
+		<< ": indirection buffers unchanged, analysis kept\n";);
+	} else {
+	  SI->needToInstantiateAnalysis = true;
+	  SI->indirectionsValid = false;
+	  SI->indirectionVersions.clear();
+	}
+      }
     }
 
-    // Analysis needs to be instantiated every time if the kernel has indirections.
-    if (k->getAnalysis()->hasIndirection() && optEnableIndirections) {
-      SI->needToInstantiateAnalysis = true;
+    // Only the parameters have changed, keep the current partition and
+    // re-instantiate the arguments whose expressions depend on them.
+    if (SI->onlyParamsChanged) {
+      SI->onlyParamsChanged = false;
+      unsigned nbArgs = k->getAnalysis()->getNbGlobalArguments();
+      unsigned nbSubstituted;
+      unsigned nbUpdated =
+	k->getAnalysis()->updateArgValues(k->getArgsValues(),
+					  SI->changedParams,
+					  optCheckIncrementalRegions,
+					  &nbSubstituted);
+      nbInstantiationsAvoided++;
+      nbArgsInstantiated += nbUpdated;
+      nbArgsSubstituted += nbSubstituted;
+      nbArgsSkipped += nbArgs - nbUpdated - nbSubstituted;
+
+      DEBUG("instantiation",
+	    std::cerr << k->getName() << ": " << SI->changedParams.size()
+	    << " parameter(s) changed, " << nbUpdated << "/" << nbArgs
+	    << " argument(s) re-instantiated, " << nbSubstituted
+	    << " substituted\n";);
+      return;
     }
 
     if (SI->needToInstantiateAnalysis && !SI->partitionUnchanged) {
-      // Copy requested granularity to real granularity.
-      std::copy(SI->req_granu_dscr, SI->req_granu_dscr+SI->req_size_gr,
-		SI->real_granu_dscr);
-      SI->real_size_gr = SI->req_size_gr;
+      if (SI->placedDevice >= 0) {
+	SI->real_size_gr = 3;
+	SI->real_granu_dscr[0] = SI->placedDevice;
+	SI->real_granu_dscr[1] = 1.0;
+	SI->real_granu_dscr[2] = 1.0;
+      } else {
+	// Copy requested granularity to real granularity.
+	std::copy(SI->req_granu_dscr, SI->req_granu_dscr+SI->req_size_gr,
+		  SI->real_granu_dscr);
+	SI->real_size_gr = SI->req_size_gr;
+      }
     }
 
     if (!SI->needToInstantiateAnalysis)
       return;
 
+    if (SI->currentDim == 0)
+      SI->cannotSplit = false;
+
     // Fail case
     if (SI->currentDim >= work_dim) {
       std::cerr << "Cannot split kernel " << k->getName() << "\n";
+      SI->cannotSplit = true;
       SI->real_size_gr = 3;
       SI->real_granu_dscr[0] = 0;
       SI->real_granu_dscr[1] = 1.0;
@@ -443,6 +669,7 @@ namespace libsplit {
       // Set partition
       k->getAnalysis()->setPartition(*origNDRange, shiftedPartition,
 				     k->getArgsValues());
+      SI->partitionInstantiated = false;
     }
 
 
@@ -487,8 +714,28 @@ namespace libsplit {
       SI->requiredSubNDRanges = subNDRanges;
 
       // Set partition to analysis
-      k->getAnalysis()->setPartition(*SI->origNDRange, subNDRanges,
-				     k->getArgsValues());
+      if (SI->partitionMovable && SI->partitionDim == currentDim) {
+	unsigned nbArgs = k->getAnalysis()->getNbGlobalArguments();
+	unsigned nbMoved =
+	  k->getAnalysis()->movePartition(subNDRanges,
+					  SI->dimOrder[currentDim],
+					  k->getArgsValues(),
+					  optCheckIncrementalRegions);
+	nbIncrementalInstantiations++;
+	nbArgsMoved += nbMoved;
+
+	DEBUG("instantiation",
+	      std::cerr << k->getName() << ": split boundaries moved, "
+	      << nbMoved << "/" << nbArgs
+	      << " argument(s) updated incrementally\n";);
+      } else {
+	k->getAnalysis()->setPartition(*SI->origNDRange, subNDRanges,
+				       k->getArgsValues());
+	nbFullInstantiations++;
+      }
+      SI->partitionMovable = false;
+      SI->partitionDim = currentDim;
+      SI->partitionInstantiated = true;
     }
 
     // Get indirection regions.
@@ -534,6 +781,7 @@ namespace libsplit {
       if (regions.size() > 0) {
 	std::vector<IndirectionValue> regionValues[nbSplit];
 	for (unsigned i=0; i<regions.size(); i++) {
+	  SI->indirectionVersions[regions[i].m] = regions[i].m->version;
 	  unsigned subkernelId = regions[i].subkernelId;
 	  unsigned indirectionId = regions[i].indirectionId;
 	  IndexExprValue *lbValue = (IndexExprValue *) regions[i].lbValue->clone();
@@ -553,6 +801,7 @@ namespace libsplit {
 	  return false;
 	} else {
 	  SI->partitionUnchanged = false;
+	  SI->indirectionsValid = true;
 	}
       }
 
@@ -896,6 +1145,7 @@ namespace libsplit {
 			 Event *event) {
     assert(kerID2InfoMap.find(dstId) != kerID2InfoMap.end());
     SubKernelSchedInfo *SI = kerID2InfoMap[dstId];
+    event->retain();
     SI->src2H2DEvents[devId][srcId].push_back(event);
     SI->src2H2DEventsCB[devId][srcId].push_back(cb);
   }
@@ -908,6 +1158,7 @@ namespace libsplit {
 			 Event *event) {
     assert(kerID2InfoMap.find(dstId) != kerID2InfoMap.end());
     SubKernelSchedInfo *SI = kerID2InfoMap[dstId];
+    event->retain();
     SI->src2D2HEvents[devId][srcId].push_back(event);
     SI->src2D2HEventsCB[devId][srcId].push_back(cb);
   }
@@ -14,6 +14,12 @@ namespace libsplit {
   class KernelHandle;
 
   struct SubKernelExecInfo {
+    SubKernelExecInfo() : event(NULL) {}
+    ~SubKernelExecInfo() {
+      if (event)
+	event->release();
+    }
+
     unsigned device;
     size_t work_dim;
     size_t global_work_offset[3];
@@ -21,7 +27,7 @@ namespace libsplit {
     size_t local_work_size[3];
     unsigned numgroups;
     unsigned splitdim;
-    Event *event;
+    Event *event; // Released with the sub-kernel
   };
 
   class Scheduler {
@@ -81,6 +87,21 @@ namespace libsplit {
 
     virtual void setBufferRequired(unsigned kerId, MemoryHandle *m);
 
+    void printInstantiationStats() const;
+
+    // Return true if the last partition of kernel id kerId, as returned by
+    // getPartition(), runs on a single device because the analysis cannot
+    // split it in any dimension.
+    bool cannotSplit(unsigned kerId);
+
+    // Instantiate the analysis of k again at its next launches, e.g. once a
+    // footprint has been set to it.
+    void invalidateAnalysis(KernelHandle *k);
+
+    // Run the next launch of k whole on device instead of the partition of
+    // the scheduler, or let the scheduler split it if device is -1 (see
+    // TaskPlacer).
+    void setPlacement(KernelHandle *k, int device);
 
 
   protected:
@@ -88,15 +109,33 @@ namespace libsplit {
     unsigned nbDevices;
     struct SubKernelSchedInfo;
     std::map<unsigned, SubKernelSchedInfo *> kerID2InfoMap;
+    std::map<KernelHandle *, int> placements; // see setPlacement()
     unsigned count;
     const int GRANU2INTFACTOR = 1000000;
 
+    // Analysis instantiation counters
+    unsigned nbFullInstantiations;
+    unsigned nbInstantiationsAvoided;
+    unsigned nbArgsInstantiated;
+    unsigned nbArgsSubstituted; // regions shifted in closed form
+    unsigned nbArgsSkipped;
+    unsigned nbIncrementalInstantiations;
+    unsigned nbArgsMoved;
+    unsigned nbIndirInstantiationsAvoided;
+
     // Transfer throughput sampling per device
     std::map<unsigned, std::vector<std::pair<double, double> > >
     H2DThroughputSamplingPerDevice;
     std::map<unsigned, std::vector<std::pair<double, double> > >
     D2HThroughputSamplingPerDevice;
 
+    // Peak performance (op/s) and memory bandwidth (B/s) of each device,
+    // computed on first use.
+    std::vector<double> devicePeakFlops;
+    std::vector<double> deviceBandwidth;
+    void computeDevicePeaks();
+    bool getRooflinePartition(KernelHandle *k, std::vector<double> *granu);
+
     // This function defines the mapping between a kernel and its
     // SubKernelSchedInfo structure and has to be provided by the scheduler
     // implementation.
@@ -118,6 +157,12 @@ namespace libsplit {
 
     void printPartition(SubKernelSchedInfo *SI);
 
+    // Set the initial partition of adaptive schedulers, one split per
+    // device. The granularities are given by GRANUSTART if set, otherwise
+    // they are computed with a roofline model from the static features of
+    // the kernel and the peaks of the devices, uniform as a last resort.
+    void getStartPartition(SubKernelSchedInfo *SI);
+
     // Compute the array of dimension id from the one with
     // the maximum number of splits.
     void getSortedDim(cl_uint work_dim,
@@ -184,9 +229,12 @@ namespace libsplit {
 
     static
     bool paramHaveChanged(const SubKernelSchedInfo *SI,
-			    const KernelHandle *k);
+			  const KernelHandle *k,
+			  std::vector<unsigned> *changedParams);
     static
     void updateParamValues(SubKernelSchedInfo *SI, const KernelHandle *k);
+    static
+    bool indirectionsUpToDate(const SubKernelSchedInfo *SI);
 
     struct SubKernelSchedInfo {
       SubKernelSchedInfo(Scheduler *sched, KernelHandle *handle,
@@ -196,7 +244,15 @@ namespace libsplit {
 	  partitionUnchanged(false),
 	  needOtherExecToComplete(false),
 	  needToInstantiateAnalysis(true),
+	  onlyParamsChanged(false),
+	  partitionInstantiated(false),
+	  partitionMovable(false),
+	  indirectionsValid(false),
+	  cannotSplit(false),
+	  analysisInvalidated(false),
+	  placedDevice(-1),
 	  currentDim(0),
+	  partitionDim(0),
 	  nbDevices(nbDevices),
 	  shiftingPartition(false),
 	  nbMergeArgs(0),
@@ -222,6 +278,7 @@ namespace libsplit {
 	iterno = 0;
       }
       ~SubKernelSchedInfo() {
+	clearEvents();
 	delete[] req_granu_dscr;
 	delete[] real_granu_dscr;
 	delete[] granu_intervals;
@@ -250,7 +307,27 @@ namespace libsplit {
       bool needOtherExecToComplete;
       bool needToInstantiateAnalysis;
 
+      // True if only the kernel arguments have changed since the last
+      // instantiation of the analysis.
+      bool onlyParamsChanged;
+      bool partitionInstantiated; // analysis instantiated on requiredSubNDRanges
+      bool partitionMovable; // only the split boundaries can move
+      std::vector<unsigned> changedParams;
+
+      // Version of the buffers the indirection values of the last
+      // instantiation have been read from.
+      std::map<MemoryHandle *, unsigned long> indirectionVersions;
+      bool indirectionsValid;
+
+      bool cannotSplit; // analysis failed in every dimension
+      bool analysisInvalidated; // see Scheduler::invalidateAnalysis()
+
+      // Device the current partition runs whole on, -1 if it is the one of
+      // the scheduler (see Scheduler::setPlacement()).
+      int placedDevice;
+
       unsigned currentDim;
+      unsigned partitionDim; // split dim of the instantiated partition
       unsigned dimOrder[3];
 
       unsigned nbDevices;
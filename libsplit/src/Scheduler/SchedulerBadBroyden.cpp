@@ -27,12 +27,9 @@ namespace libsplit {
 
     BroydenMatrix *BM = new BroydenMatrix(nbDevices);
 
-    for (unsigned i=0; i<nbDevices; i++) {
-      SI->req_granu_dscr[i*3] = i;
-      SI->req_granu_dscr[i*3+1] = 1;
-      SI->req_granu_dscr[i*3+2] = 1.0 / nbDevices;
+    getStartPartition(SI);
+    for (unsigned i=0; i<nbDevices; i++)
       BM->x[i] = SI->req_granu_dscr[i*3+2];
-    }
 
     kernel2MatrixMap[SI] = BM;
   }
@@ -1,4 +1,3 @@
-#include <EventFactory.h>
 #include <Queue/DeviceQueue.h>
 #include <Globals.h>
 #include <Scheduler/SchedulerMKGR2.h>
@@ -112,7 +111,6 @@ namespace libsplit {
 
 	  KSI->buffersRequired.clear();
 	}
-        eventFactory->freeEvents();
 	DEBUG("timers",
 	    for (unsigned d=0; d<nbDevices; d++) {
 	      std::cerr << "total iter time on device " << d << ": "
@@ -142,7 +140,6 @@ namespace libsplit {
 	      KSI->printTimers(k);
 	      );
       }
-      eventFactory->freeEvents();
       DEBUG("timers",
 	    for (unsigned d=0; d<nbDevices; d++) {
 	      std::cerr << "total iter time on device " << d << ": "
@@ -1,4 +1,3 @@
-#include <EventFactory.h>
 #include <Globals.h>
 #include <Scheduler/SchedulerMKStatic.h>
 #include <Utils/Debug.h>
@@ -148,8 +147,6 @@ namespace libsplit {
 	KSI->clearEvents();
 	KSI->clearTimers();
       }
-
-      eventFactory->freeEvents();
     }
   }
 
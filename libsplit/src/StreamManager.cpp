@@ -0,0 +1,212 @@
+#include <StreamManager.h>
+
+#include <iostream>
+
+namespace libsplit {
+
+  StreamManager::StreamManager()
+    : nbStreams(0), nbDependencies(0), nbHostWaits(0), nbOtherEvents(0) {
+    pthread_mutex_init(&lock, NULL);
+  }
+
+  StreamManager::~StreamManager() {
+    for (auto &it : streams)
+      releaseCommands(it.second.lastKernels);
+    for (auto &it : launchEvents)
+      releaseCommands(it.second);
+    pthread_mutex_destroy(&lock);
+  }
+
+  void
+  StreamManager::releaseCommands(device_commands &commands) {
+    for (DeviceQueue::command_ref &c : commands) {
+      if (c.event)
+	c.event->release();
+    }
+    commands.clear();
+  }
+
+  StreamManager::stream &
+  StreamManager::getStream(cl_command_queue queue) {
+    auto it = streams.find(queue);
+    if (it != streams.end())
+      return it->second;
+
+    // Queues not created through clCreateCommandQueue() get a stream too.
+    unsigned id = nbStreams++;
+    stream s = {id, DeviceQueue::getComputeQueue(id), device_commands(), 0};
+    return streams.insert(std::make_pair(queue, s)).first->second;
+  }
+
+  void
+  StreamManager::createStream(cl_command_queue queue) {
+    pthread_mutex_lock(&lock);
+    getStream(queue);
+    pthread_mutex_unlock(&lock);
+  }
+
+  void
+  StreamManager::releaseStream(cl_command_queue queue) {
+    pthread_mutex_lock(&lock);
+    auto it = streams.find(queue);
+    if (it != streams.end()) {
+      releaseCommands(it->second.lastKernels);
+      streams.erase(it);
+    }
+    pthread_mutex_unlock(&lock);
+  }
+
+  DeviceQueue::QUEUE_TYPE
+  StreamManager::getComputeQueue(cl_command_queue queue) {
+    pthread_mutex_lock(&lock);
+    DeviceQueue::QUEUE_TYPE type = getStream(queue).computeQueue;
+    pthread_mutex_unlock(&lock);
+    return type;
+  }
+
+  void
+  StreamManager::getWaits(cl_uint num_events, const cl_event *event_list,
+			  unsigned nbDevices, device_waits &waits,
+			  std::vector<cl_event> &otherEvents) {
+    waits.resize(nbDevices);
+    if (!event_list)
+      return;
+
+    pthread_mutex_lock(&lock);
+    for (cl_uint i=0; i<num_events; i++) {
+      auto it = launchEvents.find(event_list[i]);
+      if (it == launchEvents.end()) {
+	otherEvents.push_back(event_list[i]);
+	nbOtherEvents++;
+	continue;
+      }
+
+      const device_commands &commands = it->second;
+      for (unsigned d=0; d<commands.size() && d<nbDevices; d++) {
+	if (!commands[d].event)
+	  continue;
+	commands[d].event->retain();
+	waits[d].push_back(commands[d]);
+	nbDependencies++;
+      }
+    }
+    pthread_mutex_unlock(&lock);
+  }
+
+  void
+  StreamManager::releaseWaits(device_waits &waits) {
+    for (std::vector<DeviceQueue::command_ref> &commands : waits) {
+      for (DeviceQueue::command_ref &c : commands)
+	c.event->release();
+      commands.clear();
+    }
+  }
+
+  void
+  StreamManager::recordLaunch(cl_command_queue queue, cl_event event,
+			      const device_commands &subkernels) {
+    pthread_mutex_lock(&lock);
+    stream &s = getStream(queue);
+    s.nbLaunches++;
+
+    if (s.lastKernels.size() < subkernels.size())
+      s.lastKernels.resize(subkernels.size(), DeviceQueue::command_ref());
+    for (unsigned d=0; d<subkernels.size(); d++) {
+      if (!subkernels[d].event)
+	continue;
+      subkernels[d].event->retain();
+      if (s.lastKernels[d].event)
+	s.lastKernels[d].event->release();
+      s.lastKernels[d] = subkernels[d];
+    }
+
+    if (event) {
+      device_commands &commands = launchEvents[event];
+      releaseCommands(commands);
+      for (const DeviceQueue::command_ref &c : subkernels) {
+	if (c.event)
+	  c.event->retain();
+      }
+      commands = subkernels;
+    }
+    pthread_mutex_unlock(&lock);
+  }
+
+  void
+  StreamManager::retainCommands(const device_commands &commands,
+				std::vector<Event *> &events) {
+    for (const DeviceQueue::command_ref &c : commands) {
+      if (!c.event)
+	continue;
+      c.event->retain();
+      events.push_back(c.event);
+    }
+  }
+
+  void
+  StreamManager::waitEvents(std::vector<Event *> &events) {
+    for (Event *e : events) {
+      e->wait();
+      e->release();
+    }
+  }
+
+  void
+  StreamManager::waitForEvents(cl_uint num_events,
+			       const cl_event *event_list) {
+    if (!event_list)
+      return;
+
+    // Wait outside of the lock, other threads may launch meanwhile.
+    std::vector<Event *> events;
+    pthread_mutex_lock(&lock);
+    for (cl_uint i=0; i<num_events; i++) {
+      auto it = launchEvents.find(event_list[i]);
+      if (it != launchEvents.end())
+	retainCommands(it->second, events);
+    }
+    nbHostWaits++;
+    pthread_mutex_unlock(&lock);
+
+    waitEvents(events);
+  }
+
+  void
+  StreamManager::finish(cl_command_queue queue) {
+    std::vector<Event *> events;
+    pthread_mutex_lock(&lock);
+    retainCommands(getStream(queue).lastKernels, events);
+    nbHostWaits++;
+    pthread_mutex_unlock(&lock);
+
+    waitEvents(events);
+  }
+
+  void
+  StreamManager::releaseEvent(cl_event event) {
+    pthread_mutex_lock(&lock);
+    auto it = launchEvents.find(event);
+    if (it != launchEvents.end()) {
+      releaseCommands(it->second);
+      launchEvents.erase(it);
+    }
+    pthread_mutex_unlock(&lock);
+  }
+
+  void
+  StreamManager::printStats() const {
+    pthread_mutex_lock(&lock);
+    std::cerr << "streams: " << streams.size() << " streams, "
+	      << nbDependencies << " dependencies on events, "
+	      << nbOtherEvents << " other events waited for on the host, "
+	      << nbHostWaits << " host waits, " << launchEvents.size()
+	      << " events not released\n";
+    for (auto &it : streams) {
+      std::cerr << "stream " << it.second.id << ": " << it.second.nbLaunches
+		<< " launches, compute queue " << it.second.computeQueue
+		<< "\n";
+    }
+    pthread_mutex_unlock(&lock);
+  }
+
+};
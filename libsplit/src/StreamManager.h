@@ -0,0 +1,95 @@
+#ifndef STREAMMANAGER_H
+#define STREAMMANAGER_H
+
+#include <Queue/DeviceQueue.h>
+
+#include <CL/cl.h>
+
+#include <map>
+#include <vector>
+
+#include <pthread.h>
+
+namespace libsplit {
+
+  // Command queues of the application. Each command queue is a stream whose
+  // kernels are enqueued in the compute queue of the stream on every device
+  // (see DeviceQueue::getComputeQueue()), so that the kernels of different
+  // streams run concurrently on a device unless they access the same
+  // buffers, the device queues ordering them on their accesses.
+  //
+  // The events returned to the application for kernel launches are
+  // recorded with the sub-kernels of the launch. A launch waiting for an
+  // event waits for its sub-kernels enqueued on the same device, and the
+  // host waits (clWaitForEvents(), clFinish() and the buffer commands) wait
+  // for all of them. Dependencies between devices follow from the transfers
+  // of the data. The other events, e.g. user events and those of buffer
+  // commands, are waited for on the host.
+  class StreamManager {
+  public:
+    // Commands of each device, whose event is NULL if none.
+    typedef std::vector<DeviceQueue::command_ref> device_commands;
+    // Commands waited for on each device.
+    typedef std::vector<std::vector<DeviceQueue::command_ref> > device_waits;
+
+    StreamManager();
+    ~StreamManager();
+
+    void createStream(cl_command_queue queue);
+    // Forget queue, released by the application.
+    void releaseStream(cl_command_queue queue);
+
+    // Compute queue of the kernels of queue.
+    DeviceQueue::QUEUE_TYPE getComputeQueue(cl_command_queue queue);
+
+    // Fill waits with the sub-kernels of the events of the wait list,
+    // retained until releaseWaits(), and otherEvents with the events of the
+    // list that are not kernel launches.
+    void getWaits(cl_uint num_events, const cl_event *event_list,
+		  unsigned nbDevices, device_waits &waits,
+		  std::vector<cl_event> &otherEvents);
+    void releaseWaits(device_waits &waits);
+
+    // Record the sub-kernels of a launch from queue, returned to the
+    // application as event if it is not NULL.
+    void recordLaunch(cl_command_queue queue, cl_event event,
+		      const device_commands &subkernels);
+
+    // Wait for the sub-kernels of the events.
+    void waitForEvents(cl_uint num_events, const cl_event *event_list);
+    // Wait for the last sub-kernels of queue.
+    void finish(cl_command_queue queue);
+
+    // Forget event, released by the application.
+    void releaseEvent(cl_event event);
+
+    void printStats() const;
+
+  private:
+    struct stream {
+      unsigned id;
+      DeviceQueue::QUEUE_TYPE computeQueue;
+      device_commands lastKernels;
+      unsigned long nbLaunches;
+    };
+
+    // Called with the lock held.
+    stream &getStream(cl_command_queue queue);
+    static void retainCommands(const device_commands &commands,
+			       std::vector<Event *> &events);
+    static void waitEvents(std::vector<Event *> &events);
+    static void releaseCommands(device_commands &commands);
+
+    mutable pthread_mutex_t lock;
+    std::map<cl_command_queue, stream> streams;
+    unsigned nbStreams; // Streams created, for their ids
+    std::map<cl_event, device_commands> launchEvents;
+
+    unsigned long nbDependencies;
+    unsigned long nbHostWaits;
+    unsigned long nbOtherEvents;
+  };
+
+};
+
+#endif /* STREAMMANAGER_H */
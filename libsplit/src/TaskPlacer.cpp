@@ -0,0 +1,228 @@
+#include <TaskPlacer.h>
+#include <Options.h>
+#include <Utils/Debug.h>
+
+#include <iostream>
+
+namespace libsplit {
+
+  TaskPlacer::TaskPlacer(unsigned nbDevices)
+    : nbDevices(nbDevices), nbLaunches(0), nbSplit(0), nbIndependent(0),
+      nbDependent(0), nbPlaced(nbDevices, 0) {}
+
+  TaskPlacer::~TaskPlacer() {
+    for (launch &l : window)
+      releaseLaunch(l);
+  }
+
+  void
+  TaskPlacer::releaseLaunch(launch &l) {
+    for (Event *e : l.events)
+      e->release();
+    l.events.clear();
+  }
+
+  void
+  TaskPlacer::dropCompleted() {
+    auto it = window.begin();
+    while (it != window.end()) {
+      bool completed = true;
+      for (Event *e : it->events) {
+	if (!e->isComplete()) {
+	  completed = false;
+	  break;
+	}
+      }
+      if (completed) {
+	releaseLaunch(*it);
+	it = window.erase(it);
+      } else {
+	++it;
+      }
+    }
+  }
+
+  void
+  TaskPlacer::addRegions(const std::vector<DeviceBufferRegion> &regions,
+			 buffer_regions &buffers) {
+    for (const DeviceBufferRegion &r : regions) {
+      ListInterval &region = buffers[r.m];
+      if (r.region.isUndefined())
+	region.add(Interval(0, r.m->mSize-1));
+      else
+	region.myUnion(r.region);
+    }
+  }
+
+  bool
+  TaskPlacer::intersects(const buffer_regions &a, const buffer_regions &b) {
+    for (auto &it : a) {
+      auto jt = b.find(it.first);
+      if (jt == b.end())
+	continue;
+      ListInterval *intersection =
+	ListInterval::intersection(it.second, jt->second);
+      bool ret = intersection->total() > 0;
+      delete intersection;
+      if (ret)
+	return true;
+    }
+    return false;
+  }
+
+  bool
+  TaskPlacer::dependsOn(const footprint &f, const footprint &g) {
+    return intersects(f.read, g.written) || intersects(f.written, g.read) ||
+      intersects(f.written, g.written);
+  }
+
+  void
+  TaskPlacer::predictFootprint(KernelHandle *k, footprint &f) {
+    unsigned nbGlobals = k->getAnalysis()->getNbGlobalArguments();
+    auto it = kernels.find(k);
+    bool known = it != kernels.end() &&
+      it->second.read.size() == nbGlobals;
+
+    for (unsigned a=0; a<nbGlobals; a++) {
+      MemoryHandle *m = k->getGlobalArgHandle(a);
+      if (!m)
+	continue;
+      if (known) {
+	f.read[m].myUnion(it->second.read[a]);
+	f.written[m].myUnion(it->second.written[a]);
+      } else {
+	f.read[m].add(Interval(0, m->mSize-1));
+	f.written[m].add(Interval(0, m->mSize-1));
+      }
+    }
+  }
+
+  int
+  TaskPlacer::getDevice(KernelHandle *k, cl_uint work_dim,
+			const size_t *global_work_size) {
+    nbLaunches++;
+    dropCompleted();
+
+    size_t size = 1;
+    for (cl_uint i=0; i<work_dim; i++)
+      size *= global_work_size[i];
+    if (size >= optDagSplitSize) {
+      nbSplit++;
+      return -1;
+    }
+
+    footprint f;
+    predictFootprint(k, f);
+
+    // Load of each device and devices of the launches k depends on.
+    std::vector<unsigned> load(nbDevices, 0);
+    std::vector<bool> candidates(nbDevices, false);
+    bool dependent = false;
+    for (const launch &l : window) {
+      bool dep = dependsOn(f, l.regions);
+      dependent |= dep;
+      for (unsigned d=0; d<nbDevices; d++) {
+	if (l.device >= 0 && l.device != (int) d)
+	  continue;
+	load[d]++;
+	if (dep)
+	  candidates[d] = true;
+      }
+    }
+    if (!dependent)
+      candidates.assign(nbDevices, true);
+
+    int device = -1;
+    for (unsigned d=0; d<nbDevices; d++) {
+      if (candidates[d] && (device < 0 || load[d] < load[device]))
+	device = d;
+    }
+
+    if (dependent)
+      nbDependent++;
+    else
+      nbIndependent++;
+    nbPlaced[device]++;
+
+    DEBUG("dag",
+	  std::cerr << k->getName() << ": " << size << " work-items, "
+	  << (dependent ? "dependent" : "independent") << " of "
+	  << window.size() << " pending launches, placed on device "
+	  << device << "\n";);
+
+    return device;
+  }
+
+  void
+  TaskPlacer::pushLaunch(KernelHandle *k,
+			 const StreamManager::device_commands &subkernels,
+			 const std::vector<DeviceBufferRegion> &dataRequired,
+			 const std::vector<DeviceBufferRegion> &dataWritten,
+			 const std::vector<DeviceBufferRegion> &dataWrittenMerge,
+			 const std::vector<DeviceBufferRegion> &dataWrittenOr,
+			 const std::vector<DeviceBufferRegion> &dataWrittenAtomicSum,
+			 const std::vector<DeviceBufferRegion> &dataWrittenAtomicMin,
+			 const std::vector<DeviceBufferRegion> &dataWrittenAtomicMax) {
+    launch l;
+    l.device = -1;
+    unsigned nbUsed = 0;
+    for (unsigned d=0; d<subkernels.size(); d++) {
+      if (!subkernels[d].event)
+	continue;
+      subkernels[d].event->retain();
+      l.events.push_back(subkernels[d].event);
+      l.device = d;
+      nbUsed++;
+    }
+    if (nbUsed != 1)
+      l.device = -1;
+
+    addRegions(dataRequired, l.regions.read);
+    addRegions(dataWritten, l.regions.written);
+    addRegions(dataWrittenMerge, l.regions.written);
+    addRegions(dataWrittenOr, l.regions.written);
+    addRegions(dataWrittenAtomicSum, l.regions.written);
+    addRegions(dataWrittenAtomicMin, l.regions.written);
+    addRegions(dataWrittenAtomicMax, l.regions.written);
+
+    // Regions of the launch by global argument for the next ones.
+    unsigned nbGlobals = k->getAnalysis()->getNbGlobalArguments();
+    kernel_info &info = kernels[k];
+    info.read.assign(nbGlobals, ListInterval());
+    info.written.assign(nbGlobals, ListInterval());
+    for (unsigned a=0; a<nbGlobals; a++) {
+      MemoryHandle *m = k->getGlobalArgHandle(a);
+      auto it = l.regions.read.find(m);
+      if (it != l.regions.read.end())
+	info.read[a] = it->second;
+      it = l.regions.written.find(m);
+      if (it != l.regions.written.end())
+	info.written[a] = it->second;
+    }
+
+    if (l.events.empty())
+      return;
+
+    window.push_back(l);
+    if (window.size() > optDagWindow) {
+      releaseLaunch(window.front());
+      window.pop_front();
+    }
+  }
+
+  void
+  TaskPlacer::releaseKernel(KernelHandle *k) {
+    kernels.erase(k);
+  }
+
+  void
+  TaskPlacer::printStats() const {
+    std::cerr << "dag: " << nbLaunches << " launches, " << nbSplit
+	      << " split, " << nbIndependent << " independent, "
+	      << nbDependent << " dependent placed whole on a device\n";
+    for (unsigned d=0; d<nbDevices; d++)
+      std::cerr << "dag: device " << d << ": " << nbPlaced[d]
+		<< " launches placed\n";
+  }
+
+};
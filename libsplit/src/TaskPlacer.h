@@ -0,0 +1,100 @@
+#ifndef TASKPLACER_H
+#define TASKPLACER_H
+
+#include <BufferManager.h>
+#include <Handle/KernelHandle.h>
+#include <Queue/Event.h>
+#include <StreamManager.h>
+
+#include <ListInterval.h>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace libsplit {
+
+  // Task-parallel placement of independent kernels (DAG=1). The last
+  // DAGWINDOW launches whose sub-kernels are still pending are kept with the
+  // regions of the buffers they read and write, as computed by the analysis.
+  // A kernel of less than DAGSPLITSIZE work-items is not split but run whole
+  // on a single device: the least loaded one if it does not access the
+  // regions written by the pending launches nor write the regions they
+  // access, otherwise the least loaded one among the devices of the launches
+  // it depends on, where its data is. Larger kernels are split by the
+  // scheduler.
+  //
+  // The regions of a launch are only known once its partition is computed,
+  // so the dependencies of a kernel are predicted from the regions of its
+  // last launch for the buffers at the same arguments, the buffers of a
+  // kernel not launched yet being entirely read and written. A wrong
+  // prediction only affects the placement: the transfers and the ordering
+  // of the sub-kernels follow from the actual regions.
+  class TaskPlacer {
+  public:
+    TaskPlacer(unsigned nbDevices);
+    ~TaskPlacer();
+
+    // Return the device to run the launch of k on, -1 if it is split.
+    int getDevice(KernelHandle *k, cl_uint work_dim,
+		  const size_t *global_work_size);
+
+    // Record the launch of k with the regions returned by the scheduler and
+    // the sub-kernels enqueued on each device.
+    void pushLaunch(KernelHandle *k,
+		    const StreamManager::device_commands &subkernels,
+		    const std::vector<DeviceBufferRegion> &dataRequired,
+		    const std::vector<DeviceBufferRegion> &dataWritten,
+		    const std::vector<DeviceBufferRegion> &dataWrittenMerge,
+		    const std::vector<DeviceBufferRegion> &dataWrittenOr,
+		    const std::vector<DeviceBufferRegion> &dataWrittenAtomicSum,
+		    const std::vector<DeviceBufferRegion> &dataWrittenAtomicMin,
+		    const std::vector<DeviceBufferRegion> &dataWrittenAtomicMax);
+
+    // Drop the regions recorded for k, which is being deleted.
+    void releaseKernel(KernelHandle *k);
+
+    void printStats() const;
+
+  private:
+    typedef std::map<MemoryHandle *, ListInterval> buffer_regions;
+
+    struct footprint {
+      buffer_regions read;
+      buffer_regions written;
+    };
+
+    struct launch {
+      int device; // -1 if split
+      footprint regions;
+      std::vector<Event *> events;
+    };
+
+    // Regions of the last launch of a kernel by global argument.
+    struct kernel_info {
+      std::vector<ListInterval> read;
+      std::vector<ListInterval> written;
+    };
+
+    void predictFootprint(KernelHandle *k, footprint &f);
+    void dropCompleted();
+    static void addRegions(const std::vector<DeviceBufferRegion> &regions,
+			   buffer_regions &buffers);
+    static bool intersects(const buffer_regions &a, const buffer_regions &b);
+    static bool dependsOn(const footprint &f, const footprint &g);
+    static void releaseLaunch(launch &l);
+
+    unsigned nbDevices;
+    std::deque<launch> window;
+    std::map<KernelHandle *, kernel_info> kernels;
+
+    unsigned long nbLaunches;
+    unsigned long nbSplit;
+    unsigned long nbIndependent;
+    unsigned long nbDependent;
+    std::vector<unsigned long> nbPlaced; // per device
+  };
+
+};
+
+#endif /* TASKPLACER_H */
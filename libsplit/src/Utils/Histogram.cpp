@@ -0,0 +1,42 @@
+#include <Utils/Histogram.h>
+
+namespace libsplit {
+
+  Histogram::Histogram()
+    : count(0), max(0), sum(0) {
+    for (unsigned i=0; i<NBBUCKETS; i++)
+      buckets[i] = 0;
+  }
+
+  void
+  Histogram::add(unsigned long value) {
+    unsigned bucket = value ? 63 - __builtin_clzl(value) : 0;
+    buckets[bucket]++;
+    count++;
+    sum += value;
+    if (value > max)
+      max = value;
+  }
+
+  void
+  Histogram::print(std::ostream &os, const char *name,
+		   const char *unit) const {
+    os << name << ": " << count << " samples";
+    if (count == 0) {
+      os << "\n";
+      return;
+    }
+    os << ", mean " << sum / count << " " << unit << ", max " << max << " "
+       << unit << "\n";
+
+    for (unsigned i=0; i<NBBUCKETS; i++) {
+      if (!buckets[i])
+	continue;
+      unsigned long low = i ? 1UL << i : 0;
+      unsigned long high = (1UL << i << 1) - 1;
+      os << "  [" << low << ", " << high << "] " << unit << ": "
+	 << buckets[i] << " (" << 100.0 * buckets[i] / count << " %)\n";
+    }
+  }
+
+};
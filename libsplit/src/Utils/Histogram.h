@@ -0,0 +1,32 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <iostream>
+
+namespace libsplit {
+
+  // Histogram with power of two buckets: bucket k counts the values in
+  // [2^k, 2^(k+1)), bucket 0 also counts 0. Not thread safe.
+  class Histogram {
+  public:
+    Histogram();
+
+    void add(unsigned long value);
+
+    unsigned long getCount() const { return count; }
+
+    // Print the non empty buckets, values in unit.
+    void print(std::ostream &os, const char *name, const char *unit) const;
+
+  private:
+    static const unsigned NBBUCKETS = 64;
+
+    unsigned long buckets[NBBUCKETS];
+    unsigned long count;
+    unsigned long max;
+    double sum;
+  };
+
+};
+
+#endif /* HISTOGRAM_H */
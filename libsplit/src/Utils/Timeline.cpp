@@ -1,4 +1,5 @@
 #include <Dispatch/OpenCLFunctions.h>
+#include <Options.h>
 #include "Utils/Timeline.h"
 #include "Utils/Utils.h"
 
@@ -34,30 +35,70 @@ namespace libsplit {
 
   Timeline::TimelineEvent::TimelineEvent(Event *event,
 					 std::string method)
-    : event(event), method(method) {}
+    : event(event), method(method), start(0), end(0) {}
 
   Timeline::TimelineEvent::~TimelineEvent() {}
 
+  Timeline::~Timeline() {
+    for (auto &IT : timelineEvents) {
+      for (size_t i=firstPendingEvent[IT.first]; i<IT.second.size(); i++)
+	IT.second[i].event->release();
+    }
+    pthread_mutex_destroy(&lock);
+  }
+
+  void
+  Timeline::collectEvents(int streamId, bool wait) {
+    std::vector<TimelineEvent> &events = timelineEvents[streamId];
+    size_t &first = firstPendingEvent[streamId];
+
+    for (; first < events.size(); first++) {
+      TimelineEvent &e = events[first];
+      if (wait)
+	e.event->wait();
+      else if (!e.event->isComplete())
+	break;
+
+      e.start = e.event->getStart();
+      e.end = e.event->getEnd();
+      e.event->release();
+      e.event = NULL;
+    }
+  }
+
   void
-  Timeline::pushEvent(Event *event, std::string &method, int queueId) {
+  Timeline::pushTimelineEvent(Event *event, const std::string &method,
+			      int queueId, DeviceQueue::QUEUE_TYPE type) {
+    // Each command queue of the device is a stream of the trace.
+    type = DeviceQueue::getCLQueueType(type);
+    int streamId = queueId * DeviceQueue::NBQUEUETYPES + type;
+
+    event->retain();
+    pthread_mutex_lock(&lock);
     devices.insert(queueId);
-    timelineEvents[queueId].push_back(TimelineEvent(event, method));
+    timelineEvents[streamId].push_back(TimelineEvent(event, method));
+    collectEvents(streamId, false);
+    pthread_mutex_unlock(&lock);
+  }
+
+  void
+  Timeline::pushEvent(Event *event, std::string &method, int queueId,
+		       DeviceQueue::QUEUE_TYPE type) {
+    pushTimelineEvent(event, method, queueId, type);
   }
 
   void
   Timeline:: pushH2DEvent(Event *event, int queueId) {
-    devices.insert(queueId);
-    timelineEvents[queueId].push_back(TimelineEvent(event, "memcpyHtoDasync"));
+    pushTimelineEvent(event, "memcpyHtoDasync", queueId, DeviceQueue::H2D);
   }
 
   void
   Timeline::pushD2HEvent(Event *event, int queueId) {
-    devices.insert(queueId);
-    timelineEvents[queueId].push_back(TimelineEvent(event, "memcpyDtoHasync"));
+    pushTimelineEvent(event, "memcpyDtoHasync", queueId, DeviceQueue::D2H);
   }
 
   void
-  Timeline::writeTrace(std::string &filename) const {
+  Timeline::writeTrace(std::string &filename) {
     ofstream outfile;
     outfile.open(filename);
 
@@ -69,43 +110,38 @@ namespace libsplit {
     outfile << "gpustarttimestamp,gpuendtimestamp,method,gputime,streamid\n";
 
 
-    cl_ulong timestart, timeend;
-    for (auto IT : timelineEvents) {
-      int queueId = IT.first;
+    // The streams of a device share the same origin, so that the overlap
+    // of transfers and kernels is visible.
+    std::map<int, cl_ulong> deviceStart;
+    for (auto &IT : timelineEvents) {
+      int streamId = IT.first;
+      int queueId = streamId / DeviceQueue::NBQUEUETYPES;
+      collectEvents(streamId, true);
 
-      cl_int err;
-      err = real_clGetEventProfilingInfo(IT.second[0].event->event,
-					 CL_PROFILING_COMMAND_START,
-					 sizeof(timestart),
-					 &timestart, NULL);
-      clCheck(err, __FILE__, __LINE__);
+      cl_ulong start = IT.second[0].start;
+      auto it = deviceStart.find(queueId);
+      if (it == deviceStart.end() || start < it->second)
+	deviceStart[queueId] = start;
+    }
 
+    for (auto &IT : timelineEvents) {
+      int streamId = IT.first;
+      int queueId = streamId / DeviceQueue::NBQUEUETYPES;
 
-      cl_ulong offset = timestart-1;
-      cl_ulong prevStart = timestart;
+      cl_ulong offset = deviceStart[queueId]-1;
+      cl_ulong prevStart = IT.second[0].start;
 
       for (const TimelineEvent &e : IT.second) {
-	err = real_clGetEventProfilingInfo(e.event->event,
-					   CL_PROFILING_COMMAND_START,
-					   sizeof(timestart),
-					   &timestart, NULL);
-	clCheck(err, __FILE__, __LINE__);
-	err = real_clGetEventProfilingInfo(e.event->event,
-					   CL_PROFILING_COMMAND_END,
-					   sizeof(timeend),
-					   &timeend, NULL);
-	clCheck(err, __FILE__, __LINE__);
-
-      	if (timestart < prevStart) {
+      	if (e.start < prevStart) {
       	  offset -= CL_ULONG_MAX;
       	}
-      	prevStart = timestart;
+      	prevStart = e.start;
 
-	outfile << longToHexString(timestart - offset) << ","
-		<< longToHexString(timeend - offset) << ","
+	outfile << longToHexString(e.start - offset) << ","
+		<< longToHexString(e.end - offset) << ","
 		<< e.method << ","
-		<< (timeend - timestart) * 1.0e-3 << ","
-		<< queueId << "\n";
+		<< (e.end - e.start) * 1.0e-3 << ","
+		<< streamId << "\n";
       }
     }
 
@@ -113,6 +149,23 @@ namespace libsplit {
     outfile.close();
   }
 
+  void
+  Timeline::pushWorkerPlacement(unsigned dev, int node) {
+    TimelinePlacement p = {get_time(), -1, dev, 0, 0, node};
+    pthread_mutex_lock(&lock);
+    placements.push_back(p);
+    pthread_mutex_unlock(&lock);
+  }
+
+  void
+  Timeline::pushBufferPlacement(unsigned buffer, size_t offset, size_t size,
+				int node) {
+    TimelinePlacement p = {get_time(), (int) buffer, 0, offset, size, node};
+    pthread_mutex_lock(&lock);
+    placements.push_back(p);
+    pthread_mutex_unlock(&lock);
+  }
+
   void
   Timeline::pushPartition(double *partition) {
     partitions.insert(partitions.end(), &partition[0], &partition[nbDevices+1]);
@@ -208,6 +261,24 @@ namespace libsplit {
     outfile.close();
   }
 
+  void
+  Timeline::writePlacements(std::string &filename) const {
+    if (placements.empty())
+      return;
+
+    ofstream outfile;
+    outfile.open(filename);
+
+    outfile << "# time buffer(-1 for a device thread) device offset size "
+	    << "node\n";
+    for (const TimelinePlacement &p : placements) {
+      outfile << p.time << " " << p.buffer << " " << p.dev << " "
+	      << p.offset << " " << p.size << " " << p.node << "\n";
+    }
+
+    outfile.close();
+  }
+
   void
   Timeline::writeReqPartitions(std::string &filename) const {
     ofstream outfile;
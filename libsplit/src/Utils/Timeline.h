@@ -1,6 +1,7 @@
 #ifndef TIMELINE_H
 #define TIMELINE_H
 
+#include <Queue/DeviceQueue.h>
 #include <Queue/Event.h>
 
 #include <CL/cl.h>
@@ -12,16 +13,33 @@
 
 #include <cstring>
 
+#include <pthread.h>
+
 namespace libsplit {
 
   class Timeline {
   private:
+    // The event is retained until the command completes, its start and end
+    // times are then read and the event released.
     struct TimelineEvent {
       TimelineEvent(Event *event, std::string method);
       ~TimelineEvent();
 
-      Event *event;
+      Event *event; // NULL once the times are read
       std::string method;
+      cl_ulong start;
+      cl_ulong end;
+    };
+
+    // NUMA node of the thread of a device (buffer -1), or of a chunk of the
+    // host shadow of a buffer.
+    struct TimelinePlacement {
+      double time;
+      int buffer;
+      unsigned dev;
+      size_t offset;
+      size_t size;
+      int node;
     };
 
     struct TimelineTransfer {
@@ -69,15 +87,19 @@ namespace libsplit {
     };
 
   public:
-    Timeline(unsigned nbDevices) : nbDevices(nbDevices) {}
-    ~Timeline() {}
+    Timeline(unsigned nbDevices) : nbDevices(nbDevices) {
+      pthread_mutex_init(&lock, NULL);
+    }
+    ~Timeline();
 
-    void pushEvent(Event *event, std::string &method, int queueId);
+    void pushEvent(Event *event, std::string &method, int queueId,
+		   DeviceQueue::QUEUE_TYPE type = DeviceQueue::COMPUTE);
     void pushH2DEvent(Event *event, int queueId);
     void pushD2HEvent(Event *event, int queueId);
 
-    void writeTrace(std::string &filename) const;
+    void writeTrace(std::string &filename);
     void writePartitions(std::string &filename) const;
+    void writePlacements(std::string &filename) const;
     void writeReqPartitions(std::string &filename) const;
     void writeD2HTransfers() const;
     void writeH2DTransfers() const;
@@ -89,6 +111,9 @@ namespace libsplit {
     void writeH2DPoints() const;
 
     void pushPartition(double *partition);
+    void pushWorkerPlacement(unsigned dev, int node);
+    void pushBufferPlacement(unsigned buffer, size_t offset, size_t size,
+			     int node);
     void pushReqPartition(double *partition);
 
     void pushD2HTransfersWithoutSampling(unsigned iter, unsigned kerFrom, unsigned kerTo,
@@ -124,14 +149,28 @@ namespace libsplit {
     void writeD2HThroughput() const;
 
   private:
+    void pushTimelineEvent(Event *event, const std::string &method,
+			   int queueId, DeviceQueue::QUEUE_TYPE type);
+    // Read the times of the completed events of streamId, or of all of them
+    // if wait is true, in submission order.
+    void collectEvents(int streamId, bool wait);
+
+    // Held when pushing the events and the placements, which may come from
+    // several host threads and from the queue threads.
+    pthread_mutex_t lock;
+
     unsigned nbDevices;
     std::set<int> devices;
 
+    // Events by stream, a stream being a command queue of a device.
     std::map<int, std::vector<Timeline::TimelineEvent> > timelineEvents;
+    std::map<int, size_t> firstPendingEvent;
 
     std::vector<double> partitions;
     std::vector<double> reqPartitions;
 
+    std::vector<Timeline::TimelinePlacement> placements;
+
     std::vector<Timeline::TimelineTransfer *> D2HTransfers;
     std::vector<Timeline::TimelineTransfer *> H2DTransfers;
 